@@ -1,5 +1,7 @@
 #include "order_book.hpp"
 #include "matching_engine.hpp"
+#include "sharded_matching_engine.hpp"
+#include "capture.hpp"
 #include <iostream>
 #include <cassert>
 #include <string>
@@ -10,9 +12,49 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <cstdlib>
+#include <cmath>
+#include <sstream>
+#include <new>
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+
+#ifdef __linux__
+#include "gateway.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <csignal>
+#endif
 
 using namespace trading;
 
+// Count heap allocations so tests can check that hot paths never allocate
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size > 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC flags free() on memory from a replaced operator new once both inline
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
 // Simple test framework
 class AdvancedTestSuite {
 public:
@@ -53,6 +95,11 @@ void assert_with_message(bool condition, const std::string& message) {
     }
 }
 
+// Helper to convert a decimal price to the default book's ticks
+Price px(double price) {
+    return OrderBook::to_price(price);
+}
+
 // Helper to generate timestamps
 uint64_t get_timestamp() {
     static uint64_t timestamp = 1000000; // Start with a non-zero value
@@ -64,9 +111,9 @@ class RandomOrderGenerator {
 public:
     RandomOrderGenerator(uint64_t seed = 42) : generator_(seed) {}
 
-    std::shared_ptr<Order> random_limit_order(OrderSide side, const std::string& symbol) {
-        static int order_id = 0;
-        std::string id = "TEST" + std::to_string(++order_id);
+    Order* random_limit_order(OrderBook& book, OrderSide side) {
+        static OrderId order_id = 0;
+        OrderId id = ++order_id;
         uint64_t size = size_dist_(generator_);
         double price;
 
@@ -76,15 +123,15 @@ public:
             price = 90.0 + (price_dist_(generator_) / 10.0); // 90.0 - 110.0
         }
 
-        return std::make_shared<Order>(id, side, symbol, size, price, get_timestamp());
+        return book.create_limit_order(id, side, size, px(price), get_timestamp());
     }
 
-    std::shared_ptr<Order> random_market_order(OrderSide side, const std::string& symbol) {
-        static int order_id = 0;
-        std::string id = "MKT" + std::to_string(++order_id);
+    Order* random_market_order(OrderBook& book, OrderSide side) {
+        static OrderId order_id = 1000000;
+        OrderId id = ++order_id;
         uint64_t size = size_dist_(generator_);
 
-        return std::make_shared<Order>(id, side, symbol, size, get_timestamp());
+        return book.create_market_order(id, side, size, get_timestamp());
     }
 
 private:
@@ -102,23 +149,23 @@ int main() {
         OrderBook book("TEST");
 
         // Add several small sell orders at different prices
-        auto sell1 = std::make_shared<Order>("SELL1", OrderSide::Sell, "TEST", 100, 10.0, get_timestamp());
-        auto sell2 = std::make_shared<Order>("SELL2", OrderSide::Sell, "TEST", 200, 11.0, get_timestamp());
-        auto sell3 = std::make_shared<Order>("SELL3", OrderSide::Sell, "TEST", 300, 12.0, get_timestamp());
+        auto sell1 = book.create_limit_order(201, OrderSide::Sell, 100, px(10.0), get_timestamp());
+        auto sell2 = book.create_limit_order(202, OrderSide::Sell, 200, px(11.0), get_timestamp());
+        auto sell3 = book.create_limit_order(203, OrderSide::Sell, 300, px(12.0), get_timestamp());
 
         book.add_order(sell1);
         book.add_order(sell2);
         book.add_order(sell3);
 
         // Place a large buy order that will match all these sells
-        auto buy = std::make_shared<Order>("BUY1", OrderSide::Buy, "TEST", 1000, 15.0, get_timestamp());
-        auto trades = book.match_order(buy);
+        auto buy = book.create_limit_order(101, OrderSide::Buy, 1000, px(15.0), get_timestamp());
+        auto trades = book.match_order(*buy);
 
         // Check if the order was filled against all three sells (partial fill)
         assert_with_message(trades.size() == 3, "Expected 3 trades");
-        assert_with_message(trades[0].order_id_sell == "SELL1", "Expected first trade with SELL1");
-        assert_with_message(trades[1].order_id_sell == "SELL2", "Expected second trade with SELL2");
-        assert_with_message(trades[2].order_id_sell == "SELL3", "Expected third trade with SELL3");
+        assert_with_message(trades[0].order_id_sell == 201, "Expected first trade with SELL1");
+        assert_with_message(trades[1].order_id_sell == 202, "Expected second trade with SELL2");
+        assert_with_message(trades[2].order_id_sell == 203, "Expected third trade with SELL3");
 
         // Check if sizes match
         assert_with_message(trades[0].size == 100, "Expected trade size 100");
@@ -139,15 +186,15 @@ int main() {
         OrderBook book("TEST");
 
         // Place a market buy order against an empty book
-        auto buy = std::make_shared<Order>("BUY1", OrderSide::Buy, "TEST", 100, get_timestamp());
-        auto trades = book.match_order(buy);
+        auto buy = book.create_market_order(101, OrderSide::Buy, 100, get_timestamp());
+        auto trades = book.match_order(*buy);
 
         // No trades should occur without any sell orders
         assert_with_message(trades.empty(), "Expected no trades");
 
         // Place a market sell order against an empty book
-        auto sell = std::make_shared<Order>("SELL1", OrderSide::Sell, "TEST", 100, get_timestamp());
-        trades = book.match_order(sell);
+        auto sell = book.create_market_order(201, OrderSide::Sell, 100, get_timestamp());
+        trades = book.match_order(*sell);
 
         // No trades should occur without any buy orders
         assert_with_message(trades.empty(), "Expected no trades");
@@ -157,27 +204,27 @@ int main() {
     tests.add_test("Order ID Uniqueness", [&]() {
         OrderBook book("TEST");
 
-        // Add an order with ID "UNIQUE"
-        auto order1 = std::make_shared<Order>("UNIQUE", OrderSide::Buy, "TEST", 100, 10.0, get_timestamp());
+        // Add an order with ID 7
+        auto order1 = book.create_limit_order(7, OrderSide::Buy, 100, px(10.0), get_timestamp());
         book.add_order(order1);
 
         // Try to add another order with the same ID
-        auto order2 = std::make_shared<Order>("UNIQUE", OrderSide::Buy, "TEST", 200, 11.0, get_timestamp());
+        auto order2 = book.create_limit_order(7, OrderSide::Buy, 200, px(11.0), get_timestamp());
 
         // We should still be able to add it (no check for uniqueness in the current implementation)
         // But in a real system, we might want to reject this. Let's check that it's added correctly.
         book.add_order(order2);
 
         // Cancel the first order
-        bool result = book.cancel_order("UNIQUE");
+        bool result = book.cancel_order(7);
         assert_with_message(result, "Expected successful cancellation");
 
         // Try cancelling again - this should cancel the second order with the same ID
-        result = book.cancel_order("UNIQUE");
+        result = book.cancel_order(7);
         assert_with_message(result, "Expected successful cancellation of second order with same ID");
 
         // Try cancelling a third time - this should fail as no more orders with that ID
-        result = book.cancel_order("UNIQUE");
+        result = book.cancel_order(7);
         assert_with_message(!result, "Expected cancellation to fail for non-existent order");
     });
 
@@ -191,9 +238,9 @@ int main() {
         engine.add_order_book("GOOGL");
 
         // Place orders for different symbols
-        auto trades1 = engine.place_limit_order("AAPL", "A1", OrderSide::Buy, 100, 150.0);
-        auto trades2 = engine.place_limit_order("MSFT", "M1", OrderSide::Buy, 100, 250.0);
-        auto trades3 = engine.place_limit_order("GOOGL", "G1", OrderSide::Buy, 100, 2500.0);
+        auto trades1 = engine.place_limit_order("AAPL", 11, OrderSide::Buy, 100, 150.0);
+        auto trades2 = engine.place_limit_order("MSFT", 21, OrderSide::Buy, 100, 250.0);
+        auto trades3 = engine.place_limit_order("GOOGL", 31, OrderSide::Buy, 100, 2500.0);
 
         // No trades should occur yet
         assert_with_message(trades1.empty(), "Expected no trades for AAPL");
@@ -201,9 +248,9 @@ int main() {
         assert_with_message(trades3.empty(), "Expected no trades for GOOGL");
 
         // Place matching orders for each symbol
-        trades1 = engine.place_limit_order("AAPL", "A2", OrderSide::Sell, 100, 150.0);
-        trades2 = engine.place_limit_order("MSFT", "M2", OrderSide::Sell, 100, 250.0);
-        trades3 = engine.place_limit_order("GOOGL", "G2", OrderSide::Sell, 100, 2500.0);
+        trades1 = engine.place_limit_order("AAPL", 12, OrderSide::Sell, 100, 150.0);
+        trades2 = engine.place_limit_order("MSFT", 22, OrderSide::Sell, 100, 250.0);
+        trades3 = engine.place_limit_order("GOOGL", 32, OrderSide::Sell, 100, 2500.0);
 
         // Should have one trade per symbol
         assert_with_message(trades1.size() == 1, "Expected 1 trade for AAPL");
@@ -211,9 +258,9 @@ int main() {
         assert_with_message(trades3.size() == 1, "Expected 1 trade for GOOGL");
 
         // Check trade details
-        assert_with_message(trades1[0].order_id_buy == "A1", "Expected buyer A1");
-        assert_with_message(trades2[0].order_id_buy == "M1", "Expected buyer M1");
-        assert_with_message(trades3[0].order_id_buy == "G1", "Expected buyer G1");
+        assert_with_message(trades1[0].order_id_buy == 11, "Expected buyer A1");
+        assert_with_message(trades2[0].order_id_buy == 21, "Expected buyer M1");
+        assert_with_message(trades3[0].order_id_buy == 31, "Expected buyer G1");
     });
 
     // Test 5: Stress Test with Many Orders
@@ -224,28 +271,28 @@ int main() {
         // Add many random buy and sell orders
         for (int i = 0; i < NUM_ORDERS; ++i) {
             OrderSide side = i % 2 == 0 ? OrderSide::Buy : OrderSide::Sell;
-            auto order = generator.random_limit_order(side, "TEST");
+            auto order = generator.random_limit_order(book, side);
             book.add_order(order);
         }
 
         // Place some market orders and ensure they match appropriately
         for (int i = 0; i < 10; ++i) {
             OrderSide side = i % 2 == 0 ? OrderSide::Buy : OrderSide::Sell;
-            auto order = generator.random_market_order(side, "TEST");
-            auto trades = book.match_order(order);
+            auto order = generator.random_market_order(book, side);
+            auto trades = book.match_order(*order);
 
             // Not all market orders will create trades, depending on the random order book state
             if (!trades.empty()) {
                 if (side == OrderSide::Buy) {
                     // Buy orders should execute at ask prices or better
                     for (const auto& trade : trades) {
-                        assert_with_message(trade.price <= book.best_ask() || book.best_ask() == std::numeric_limits<double>::max(),
+                        assert_with_message(OrderBook::to_double(trade.price) <= book.best_ask() || book.best_ask() == std::numeric_limits<double>::max(),
                                           "Buy trade price should be <= best ask");
                     }
                 } else {
                     // Sell orders should execute at bid prices or better
                     for (const auto& trade : trades) {
-                        assert_with_message(trade.price >= book.best_bid() || book.best_bid() == 0.0,
+                        assert_with_message(OrderBook::to_double(trade.price) >= book.best_bid() || book.best_bid() == 0.0,
                                           "Sell trade price should be >= best bid");
                     }
                 }
@@ -259,35 +306,35 @@ int main() {
         engine.add_order_book("TEST");
 
         // Place an order
-        engine.place_limit_order("TEST", "ORDER1", OrderSide::Buy, 100, 10.0);
+        engine.place_limit_order("TEST", 1, OrderSide::Buy, 100, 10.0);
 
         // Cancel it
-        bool result = engine.cancel_order("ORDER1");
+        bool result = engine.cancel_order(1);
         assert_with_message(result, "Expected successful cancellation");
 
         // Cancel again - should fail
-        result = engine.cancel_order("ORDER1");
+        result = engine.cancel_order(1);
         assert_with_message(!result, "Expected second cancellation to fail");
 
         // Cancel a non-existent order
-        result = engine.cancel_order("NONEXISTENT");
+        result = engine.cancel_order(999);
         assert_with_message(!result, "Expected cancellation of non-existent order to fail");
 
         // Add another order
-        engine.place_limit_order("TEST", "ORDER2", OrderSide::Buy, 100, 10.0);
+        engine.place_limit_order("TEST", 2, OrderSide::Buy, 100, 10.0);
 
         // Add an order book for a different symbol
         engine.add_order_book("OTHER");
 
         // Place an order with the same ID but different symbol
-        engine.place_limit_order("OTHER", "ORDER2", OrderSide::Buy, 100, 10.0);
+        engine.place_limit_order("OTHER", 2, OrderSide::Buy, 100, 10.0);
 
         // Cancel the order - should cancel the first one
-        result = engine.cancel_order("ORDER2");
+        result = engine.cancel_order(2);
         assert_with_message(result, "Expected successful cancellation");
 
         // Cancel again - should cancel the second one
-        result = engine.cancel_order("ORDER2");
+        result = engine.cancel_order(2);
         assert_with_message(result, "Expected successful cancellation of second order");
     });
 
@@ -296,14 +343,14 @@ int main() {
         OrderBook book("TEST");
 
         // Add some buy orders
-        auto buy1 = std::make_shared<Order>("BUY1", OrderSide::Buy, "TEST", 100, 10.0, get_timestamp());
-        auto buy2 = std::make_shared<Order>("BUY2", OrderSide::Buy, "TEST", 100, 9.0, get_timestamp());
+        auto buy1 = book.create_limit_order(101, OrderSide::Buy, 100, px(10.0), get_timestamp());
+        auto buy2 = book.create_limit_order(102, OrderSide::Buy, 100, px(9.0), get_timestamp());
         book.add_order(buy1);
         book.add_order(buy2);
 
         // Place a market sell order larger than available liquidity
-        auto sell = std::make_shared<Order>("SELL1", OrderSide::Sell, "TEST", 300, get_timestamp());
-        auto trades = book.match_order(sell);
+        auto sell = book.create_market_order(201, OrderSide::Sell, 300, get_timestamp());
+        auto trades = book.match_order(*sell);
 
         // Should create trades for available liquidity only
         assert_with_message(trades.size() == 2, "Expected 2 trades");
@@ -320,10 +367,10 @@ int main() {
         OrderBook book("TEST");
 
         // Add some buy orders with the same price but different times
-        auto buy1 = std::make_shared<Order>("BUY1", OrderSide::Buy, "TEST", 100, 10.0, get_timestamp());
-        auto buy2 = std::make_shared<Order>("BUY2", OrderSide::Buy, "TEST", 100, 10.0, get_timestamp());
-        auto buy3 = std::make_shared<Order>("BUY3", OrderSide::Buy, "TEST", 100, 11.0, get_timestamp());
-        auto buy4 = std::make_shared<Order>("BUY4", OrderSide::Buy, "TEST", 100, 9.0, get_timestamp());
+        auto buy1 = book.create_limit_order(101, OrderSide::Buy, 100, px(10.0), get_timestamp());
+        auto buy2 = book.create_limit_order(102, OrderSide::Buy, 100, px(10.0), get_timestamp());
+        auto buy3 = book.create_limit_order(103, OrderSide::Buy, 100, px(11.0), get_timestamp());
+        auto buy4 = book.create_limit_order(104, OrderSide::Buy, 100, px(9.0), get_timestamp());
 
         book.add_order(buy1);
         book.add_order(buy2);
@@ -331,27 +378,2030 @@ int main() {
         book.add_order(buy4);
 
         // Place a matching sell order
-        auto sell = std::make_shared<Order>("SELL1", OrderSide::Sell, "TEST", 250, 9.0, get_timestamp());
-        auto trades = book.match_order(sell);
+        auto sell = book.create_limit_order(201, OrderSide::Sell, 250, px(9.0), get_timestamp());
+        auto trades = book.match_order(*sell);
 
         // Should match with buy3 first (best price), then buy1 (earlier time), then buy2
         assert_with_message(trades.size() == 3, "Expected 3 trades");
-        assert_with_message(trades[0].order_id_buy == "BUY3", "Expected first trade with BUY3 (best price)");
-        assert_with_message(trades[1].order_id_buy == "BUY1", "Expected second trade with BUY1 (earlier time)");
-        assert_with_message(trades[2].order_id_buy == "BUY2", "Expected third trade with BUY2");
+        assert_with_message(trades[0].order_id_buy == 103, "Expected first trade with BUY3 (best price)");
+        assert_with_message(trades[1].order_id_buy == 101, "Expected second trade with BUY1 (earlier time)");
+        assert_with_message(trades[2].order_id_buy == 102, "Expected third trade with BUY2");
 
         // Verify trade sizes
         assert_with_message(trades[0].size == 100, "Expected trade size 100");
         assert_with_message(trades[1].size == 100, "Expected trade size 100");
         assert_with_message(trades[2].size == 50, "Expected trade size 50");
 
-        // Verify order state
-        assert_with_message(buy1->is_filled(), "BUY1 should be completely filled");
+        // Verify order state (filled orders have already been recycled by the book)
+        assert_with_message(!book.cancel_order(101), "BUY1 should be completely filled");
         assert_with_message(buy2->filled_size == 50, "BUY2 should be partially filled");
-        assert_with_message(buy3->is_filled(), "BUY3 should be completely filled");
+        assert_with_message(!book.cancel_order(103), "BUY3 should be completely filled");
         assert_with_message(buy4->filled_size == 0, "BUY4 should not be filled (price too low)");
     });
 
+    // Test 9: Cancelling from the middle of a price level keeps FIFO order
+    tests.add_test("Cancel Inside Price Level", [&]() {
+        OrderBook book("TEST");
+
+        auto sell1 = book.create_limit_order(201, OrderSide::Sell, 100, px(10.0), get_timestamp());
+        auto sell2 = book.create_limit_order(202, OrderSide::Sell, 100, px(10.0), get_timestamp());
+        auto sell3 = book.create_limit_order(203, OrderSide::Sell, 100, px(10.0), get_timestamp());
+        auto sell4 = book.create_limit_order(204, OrderSide::Sell, 100, px(10.5), get_timestamp());
+
+        book.add_order(sell1);
+        book.add_order(sell2);
+        book.add_order(sell3);
+        book.add_order(sell4);
+
+        // Remove the middle order of the 10.0 level
+        assert_with_message(book.cancel_order(202), "Expected successful cancellation");
+        assert_with_message(book.volume_at_price(OrderSide::Sell, 10.0) == 200, "Expected 200 left at 10.0");
+
+        auto buy = book.create_limit_order(101, OrderSide::Buy, 300, px(10.5), get_timestamp());
+        auto trades = book.match_order(*buy);
+
+        assert_with_message(trades.size() == 3, "Expected 3 trades");
+        assert_with_message(trades[0].order_id_sell == 201, "Expected SELL1 first");
+        assert_with_message(trades[1].order_id_sell == 203, "Expected SELL3 second");
+        assert_with_message(trades[2].order_id_sell == 204, "Expected SELL4 third");
+        assert_with_message(trades[2].price == px(10.5), "Expected last trade at 10.5");
+
+        // Emptied levels are dropped from the ladder
+        assert_with_message(book.best_ask() == std::numeric_limits<double>::max(), "Expected no asks left");
+        auto [buys, sells] = book.get_all_orders();
+        assert_with_message(buys.empty() && sells.empty(), "Expected an empty book");
+    });
+
+    // Test 11: Filled and cancelled orders are recycled through the book's pool
+    tests.add_test("Order Pool Recycling", [&]() {
+        OrderBook book("TEST", 64);
+        assert_with_message(book.order_pool().capacity() == 64, "Expected 64 preallocated orders");
+
+        // Churn far more orders than the pool holds; live orders never exceed two
+        for (int i = 0; i < 1000; ++i) {
+            OrderId sell_id = 2 * i;
+            auto sell = book.create_limit_order(sell_id, OrderSide::Sell, 100, px(10.0), get_timestamp());
+            book.add_order(sell);
+
+            auto buy = book.create_limit_order(sell_id + 1, OrderSide::Buy, 60, px(10.0), get_timestamp());
+            book.match_order(*buy);
+            book.release_order(buy);
+
+            assert_with_message(book.cancel_order(sell_id), "Expected remainder to cancel");
+        }
+
+        assert_with_message(book.order_pool().in_use() == 0, "Expected every order to be recycled");
+        assert_with_message(book.order_pool().slab_count() == 1, "Expected the pool never to grow");
+
+        // Exhausting the preallocation grows the pool by another slab
+        std::vector<Order*> resting;
+        for (int i = 0; i < 65; ++i) {
+            auto order = book.create_limit_order(5000 + i, OrderSide::Buy, 1, px(9.0), get_timestamp());
+            book.add_order(order);
+            resting.push_back(order);
+        }
+        assert_with_message(book.order_pool().slab_count() == 2, "Expected the pool to grow once");
+        assert_with_message(book.volume_at_price(OrderSide::Buy, 9.0) == 65, "Expected all orders to rest");
+    });
+
+    // Test 10: Widely spread prices grow the ladder without losing priority
+    tests.add_test("Wide Price Ladder", [&]() {
+        OrderBook book("TEST");
+
+        auto sell1 = book.create_limit_order(201, OrderSide::Sell, 100, px(100.0), get_timestamp());
+        auto sell2 = book.create_limit_order(202, OrderSide::Sell, 100, px(4000.0), get_timestamp());
+        auto sell3 = book.create_limit_order(203, OrderSide::Sell, 100, px(0.5), get_timestamp());
+        auto buy1 = book.create_limit_order(101, OrderSide::Buy, 100, px(0.25), get_timestamp());
+
+        book.add_order(sell1);
+        book.add_order(sell2);
+        book.add_order(sell3);
+        book.add_order(buy1);
+
+        assert_with_message(book.best_ask() == 0.5, "Expected best ask 0.5");
+        assert_with_message(book.best_bid() == 0.25, "Expected best bid 0.25");
+
+        auto buy = book.create_market_order(102, OrderSide::Buy, 300, get_timestamp());
+        auto trades = book.match_order(*buy);
+
+        assert_with_message(trades.size() == 3, "Expected 3 trades");
+        assert_with_message(trades[0].price == px(0.5), "Expected first trade at 0.5");
+        assert_with_message(trades[1].price == px(100.0), "Expected second trade at 100.0");
+        assert_with_message(trades[2].price == px(4000.0), "Expected third trade at 4000.0");
+
+        // Prices too far from the resting book to index are rejected
+        auto far = book.create_limit_order(300, OrderSide::Buy, 100, px(1e9), get_timestamp());
+        assert_with_message(!book.add_order(far), "Expected out-of-range price to be rejected");
+        assert_with_message(far->status == OrderStatus::Rejected, "Expected Rejected status");
+    });
+
+    // Test 12: The open-addressing index survives heavy churn and growth
+    tests.add_test("Order Index Churn", [&]() {
+        OrderPool pool(4096);
+        OrderIndex index;
+        std::vector<Order*> live;
+
+        // Grow from an empty table, deleting every third order as we go so
+        // backward-shift deletion runs inside long probe clusters
+        for (OrderId id = 1; id <= 3000; ++id) {
+            Order* order = pool.allocate(id, OrderSide::Buy, 0, 1, px(1.0), get_timestamp());
+            assert_with_message(index.insert(order), "Expected insert to succeed");
+            live.push_back(order);
+            if (id % 3 == 0) {
+                Order* victim = live[live.size() / 2];
+                assert_with_message(index.erase(victim), "Expected indexed order to erase");
+                live.erase(live.begin() + static_cast<std::ptrdiff_t>(live.size() / 2));
+            }
+        }
+
+        assert_with_message(index.size() == live.size(), "Expected size to track live orders");
+        assert_with_message(index.load_factor() <= 0.7, "Expected load factor to stay bounded");
+        for (const Order* order : live) {
+            size_t slot = index.find(order->order_id);
+            assert_with_message(slot != OrderIndex::npos && index.at(slot).order == order,
+                                "Expected every live order to be found");
+        }
+        assert_with_message(!index.contains(0) && !index.contains(3001), "Expected unknown IDs to miss");
+
+        // Duplicates resolve oldest first, and only in the requested book
+        Order* first = pool.allocate(OrderId{7777}, OrderSide::Sell, 1, 1, px(1.0), get_timestamp());
+        Order* second = pool.allocate(OrderId{7777}, OrderSide::Sell, 2, 1, px(1.0), get_timestamp());
+        index.insert(first);
+        index.insert(second);
+        assert_with_message(index.at(index.find(7777)).order == first, "Expected oldest duplicate first");
+        assert_with_message(index.at(index.find(7777, 2)).order == second, "Expected per-symbol lookup");
+        index.erase(first);
+        assert_with_message(index.at(index.find(7777)).order == second, "Expected remaining duplicate");
+    });
+
+    // Test 13: The Reject policy refuses IDs that are still live
+    tests.add_test("Reject Duplicate IDs", [&]() {
+        auto index = std::make_shared<OrderIndex>(0, DuplicateIdPolicy::Reject);
+        OrderBook book("TEST", 64, 0, index);
+
+        auto first = book.create_limit_order(1, OrderSide::Buy, 100, px(10.0), get_timestamp());
+        auto again = book.create_limit_order(1, OrderSide::Buy, 100, px(10.0), get_timestamp());
+        assert_with_message(book.add_order(first), "Expected first order to rest");
+        assert_with_message(!book.add_order(again), "Expected duplicate to be rejected");
+        assert_with_message(again->status == OrderStatus::Rejected, "Expected Rejected status");
+        book.release_order(again);
+        assert_with_message(book.volume_at_price(OrderSide::Buy, 10.0) == 100, "Expected only one order resting");
+
+        // The engine refuses the duplicate before it can trade, and the ID is
+        // free again once the original order is gone
+        MatchingEngine engine(64, DuplicateIdPolicy::Reject);
+        SymbolId symbol = engine.add_order_book("TEST");
+        engine.place_limit_order(symbol, 1, OrderSide::Sell, 100, 10.0);
+        auto trades = engine.place_limit_order(symbol, 1, OrderSide::Buy, 100, 10.0);
+        assert_with_message(trades.empty(), "Expected duplicate not to trade");
+        assert_with_message(engine.cancel_order(1), "Expected original to cancel");
+        assert_with_message(!engine.cancel_order(1), "Expected nothing left to cancel");
+
+        engine.place_limit_order(symbol, 1, OrderSide::Sell, 100, 10.0);
+        trades = engine.place_limit_order(symbol, 2, OrderSide::Buy, 100, 10.0);
+        assert_with_message(trades.size() == 1, "Expected reused ID to trade");
+    });
+
+    // Test 14: Symbols split across shards match independently on their own threads
+    tests.add_test("Sharded Engine", [&]() {
+        ShardedMatchingEngine engine(2, 64, 16);
+        SymbolId aapl = engine.add_order_book("AAPL");
+        SymbolId msft = engine.add_order_book("MSFT");
+        SymbolId goog = engine.add_order_book("GOOG");
+        assert_with_message(engine.shard_of(aapl) != engine.shard_of(msft), "Expected symbols on different shards");
+        assert_with_message(engine.find_symbol("GOOG") == goog, "Expected interned symbol");
+
+        std::atomic<int> trade_count{0};
+        std::atomic<uint64_t> traded_volume{0};
+        engine.register_trade_callback([&](const Trade& trade) {
+            trade_count.fetch_add(1);
+            traded_volume.fetch_add(trade.size);
+        });
+
+        // Commands queue up before the shards start; a full queue pushes back
+        for (int i = 0; i < 16; ++i) {
+            assert_with_message(engine.submit_limit_order(aapl, 100 + i, OrderSide::Buy, 10, 10.0),
+                                "Expected command to be queued");
+        }
+        assert_with_message(!engine.submit_limit_order(aapl, 200, OrderSide::Buy, 10, 10.0),
+                            "Expected full queue to reject the command");
+        assert_with_message(!engine.submit_cancel(kInvalidSymbolId, 1), "Expected unknown symbol to be rejected");
+
+        engine.start();
+        engine.drain();
+        engine.submit_limit_order(msft, 301, OrderSide::Sell, 50, 20.0);
+        engine.submit_limit_order(goog, 401, OrderSide::Sell, 50, 30.0);
+        engine.submit_market_order(aapl, 201, OrderSide::Sell, 25);
+        engine.submit_limit_order(msft, 302, OrderSide::Buy, 20, 20.0);
+        engine.submit_cancel(goog, 401);
+        engine.drain();
+
+        assert_with_message(trade_count.load() == 4, "Expected 4 trades");
+        assert_with_message(traded_volume.load() == 45, "Expected 45 traded");
+        assert_with_message(engine.get_order_book(aapl)->volume_at_price(OrderSide::Buy, 10.0) == 135,
+                            "Expected 135 left on AAPL");
+        assert_with_message(engine.get_order_book(msft)->volume_at_price(OrderSide::Sell, 20.0) == 30,
+                            "Expected 30 left on MSFT");
+        assert_with_message(engine.get_order_book(goog)->best_ask() == std::numeric_limits<double>::max(),
+                            "Expected GOOG order cancelled");
+
+        // Stopping processes whatever is still queued
+        engine.submit_market_order(aapl, 202, OrderSide::Sell, 135);
+        engine.stop();
+        assert_with_message(engine.get_order_book(aapl)->best_bid() == 0.0, "Expected AAPL bids consumed");
+        assert_with_message(engine.add_order_book("AMZN") != kInvalidSymbolId, "Expected books to be addable when stopped");
+    });
+
+    // Test 15: Commands queue without blocking and are drained in batches
+    tests.add_test("Inbound Command Queue", [&]() {
+        MatchingEngine engine(64, DuplicateIdPolicy::Allow, 8);
+        SymbolId symbol = engine.add_order_book("TEST");
+
+        for (OrderId id = 1; id <= 8; ++id) {
+            engine.submit(Command::limit(symbol, id, OrderSide::Buy, 10, px(10.0)));
+        }
+        assert_with_message(!engine.submit(Command::cancel(symbol, 1)), "Expected full queue to push back");
+
+        auto stats = engine.queue_stats();
+        assert_with_message(stats.accepted == 8 && stats.rejected == 1 && stats.depth == 8,
+                            "Expected 8 accepted, 1 rejected, 8 waiting");
+
+        assert_with_message(engine.process_commands(3) == 3, "Expected a batch of 3");
+        engine.drain();
+        stats = engine.queue_stats();
+        assert_with_message(stats.processed == 8 && stats.depth == 0, "Expected the queue to be drained");
+        assert_with_message(stats.high_watermark == 8, "Expected high watermark of 8");
+        assert_with_message(engine.get_order_book(symbol)->volume_at_price(OrderSide::Buy, 10.0) == 80,
+                            "Expected 80 resting");
+
+        // Modify shrinks order 1 in place and re-prices order 3
+        engine.submit(Command::modify(symbol, 1, 5, px(10.0)));
+        engine.submit(Command::cancel(symbol, 2));
+        engine.submit(Command::modify(symbol, 3, 10, px(11.0)));
+        engine.drain();
+
+        auto book = engine.get_order_book(symbol);
+        assert_with_message(book->volume_at_price(OrderSide::Buy, 10.0) == 55, "Expected 55 left at 10.0");
+        assert_with_message(book->best_bid() == 11.0, "Expected modified order to set the best bid");
+
+        std::vector<Trade> trades;
+        engine.register_trade_callback([&](const Trade& trade) { trades.push_back(trade); });
+        engine.submit(Command::market(symbol, 50, OrderSide::Sell, 25));
+        engine.drain();
+        assert_with_message(trades.size() == 3, "Expected 3 trades");
+        assert_with_message(trades[0].order_id_buy == 3, "Expected the re-priced order to trade first");
+        assert_with_message(trades[1].order_id_buy == 1, "Expected the size-down to keep its place");
+        assert_with_message(trades[2].order_id_buy == 4, "Expected order 4 behind order 1");
+    });
+
+    // Test 16: Many producers feed one engine thread
+    tests.add_test("Concurrent Producers", [&]() {
+        MatchingEngine engine(1024, DuplicateIdPolicy::Allow, 64);
+        SymbolId symbol = engine.add_order_book("TEST");
+
+        std::atomic<uint64_t> traded{0};
+        engine.register_trade_callback([&](const Trade& trade) { traded.fetch_add(trade.size); });
+        engine.start();
+
+        constexpr int kProducers = 4;
+        constexpr int kOrdersEach = 500;
+        std::vector<std::thread> producers;
+        for (int p = 0; p < kProducers; ++p) {
+            producers.emplace_back([&, p]() {
+                OrderSide side = p % 2 == 0 ? OrderSide::Buy : OrderSide::Sell;
+                for (int i = 0; i < kOrdersEach; ++i) {
+                    Command command = Command::limit(symbol, static_cast<OrderId>(p * kOrdersEach + i), side, 1, px(10.0));
+                    while (!engine.submit(command)) {
+                        std::this_thread::yield(); // Back off while the queue is full
+                    }
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        engine.drain();
+        engine.stop();
+
+        auto stats = engine.queue_stats();
+        assert_with_message(stats.processed == kProducers * kOrdersEach, "Expected every command to run");
+        assert_with_message(traded.load() == kProducers * kOrdersEach / 2, "Expected buys and sells to cross");
+        assert_with_message(engine.get_order_book(symbol)->order_pool().in_use() == 0, "Expected an empty book");
+    });
+
+    // Test 17: Every subscriber sees every trade, and the ring never overwrites unread ones
+    tests.add_test("Trade Broadcast Ring", [&]() {
+        BroadcastRing<Trade> ring(4);
+        size_t fast = ring.subscribe();
+        size_t slow = ring.subscribe();
+
+        for (OrderId id = 1; id <= 4; ++id) {
+            assert_with_message(ring.try_publish({id, 0, 1, px(10.0), 0, 0, 0, 0}), "Expected room in the ring");
+        }
+        assert_with_message(!ring.try_publish({5, 0, 1, px(10.0), 0, 0, 0, 0}), "Expected a full ring");
+
+        std::vector<OrderId> seen;
+        auto record = [&](const Trade& trade) { seen.push_back(trade.order_id_buy); };
+        assert_with_message(ring.poll(fast, record, 10) == 4, "Expected 4 trades for the fast reader");
+        assert_with_message(!ring.try_publish({5, 0, 1, px(10.0), 0, 0, 0, 0}), "Expected the slow reader to hold the ring");
+
+        assert_with_message(ring.poll(slow, record, 3) == 3, "Expected a batch of 3");
+        assert_with_message(ring.try_publish({5, 0, 1, px(10.0), 0, 0, 0, 0}), "Expected room once the slow reader moved");
+        assert_with_message(ring.pending(slow) == 2 && ring.pending(fast) == 1, "Expected per-reader backlog");
+
+        ring.unsubscribe(slow);
+        ring.poll(fast, record, 10);
+        std::vector<OrderId> expected = {1, 2, 3, 4, 1, 2, 3, 5};
+        assert_with_message(seen == expected, "Expected in-order delivery to each reader");
+    });
+
+    // Test 18: Trades reach a polling subscriber thread and the callback adapter
+    tests.add_test("Trade Subscribers", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+
+        std::vector<Trade> callback_trades;
+        engine.register_trade_callback([&](const Trade& trade) { callback_trades.push_back(trade); });
+
+        size_t subscriber = engine.subscribe_trades();
+        assert_with_message(subscriber != MatchingEngine::TradeRing::npos, "Expected a subscriber slot");
+
+        constexpr int kTrades = 3000;
+        std::atomic<bool> done{false};
+        uint64_t polled_volume = 0;
+        int polled = 0;
+        std::thread consumer([&]() {
+            auto add = [&](const Trade& trade) { polled_volume += trade.size; ++polled; };
+            while (polled < kTrades) {
+                if (engine.poll_trades(subscriber, add) == 0) {
+                    std::this_thread::yield();
+                }
+            }
+            done = true;
+        });
+
+        for (int i = 0; i < kTrades; ++i) {
+            engine.place_limit_order(symbol, 2 * i, OrderSide::Sell, 2, 10.0);
+            auto trades = engine.place_limit_order(symbol, 2 * i + 1, OrderSide::Buy, 2, 10.0);
+            assert_with_message(trades.size() == 1, "Expected each buy to trade");
+        }
+        consumer.join();
+        engine.unsubscribe_trades(subscriber);
+
+        assert_with_message(done && polled_volume == 2 * kTrades, "Expected the subscriber to see every trade");
+        assert_with_message(callback_trades.size() == kTrades, "Expected callbacks for every trade");
+        assert_with_message(callback_trades.back().order_id_buy == 2 * kTrades - 1, "Expected callbacks in order");
+
+        // A single sweep larger than the ring must not wait on its own callbacks
+        for (size_t i = 0; i < MatchingEngine::kTradeRingCapacity + 10; ++i) {
+            engine.place_limit_order(symbol, 100000 + i, OrderSide::Sell, 1, 11.0);
+        }
+        callback_trades.clear();
+        auto sweep = engine.place_market_order(symbol, 1, OrderSide::Buy, MatchingEngine::kTradeRingCapacity + 10);
+        assert_with_message(sweep.size() == MatchingEngine::kTradeRingCapacity + 10, "Expected the whole sweep");
+        assert_with_message(callback_trades.size() == sweep.size(), "Expected callbacks for the whole sweep");
+    });
+
+    // Test 19: Sweeping many levels through a sink or a reused buffer never allocates
+    tests.add_test("Allocation-Free Matching", [&]() {
+        OrderBook book("TEST", 1024);
+        std::vector<Trade> buffer;
+        buffer.reserve(256);
+
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < 200; ++i) {
+                auto sell = book.create_limit_order(200 + i, OrderSide::Sell, 10, px(10.0 + i * 0.01), get_timestamp());
+                book.add_order(sell);
+            }
+
+            uint64_t volume = 0;
+            auto buy = book.create_market_order(100 + round, OrderSide::Buy, 1000, get_timestamp());
+            size_t before = g_allocations.load();
+            if (round == 0) {
+                book.match_order(*buy, [&volume](const Trade& trade) { volume += trade.size; });
+            } else {
+                buffer.clear();
+                book.match_order(*buy, buffer);
+                for (const Trade& trade : buffer) {
+                    volume += trade.size;
+                }
+            }
+            size_t allocations = g_allocations.load() - before;
+            book.release_order(buy);
+
+            assert_with_message(allocations == 0, "Expected matching to allocate nothing");
+            assert_with_message(volume == 1000, "Expected 1000 filled across 100 levels");
+            assert_with_message(book.best_ask() == 11.0, "Expected the sweep to stop at 11.0");
+
+            // Clear what is left for the next round
+            auto rest = book.create_market_order(900 + round, OrderSide::Buy, 1000, get_timestamp());
+            book.match_order(*rest);
+            book.release_order(rest);
+        }
+    });
+
+    // Test 20: An L2 replica rebuilt from snapshot plus deltas tracks the book exactly
+    tests.add_test("Market Data Deltas", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        auto publisher = std::make_shared<MarketDataPublisher>();
+        engine.set_market_data(publisher);
+        size_t subscriber = publisher->subscribe();
+
+        // L3 updates for a simple add, partial fill and cancel
+        engine.place_limit_order(symbol, 1, OrderSide::Buy, 100, 10.0);
+        engine.place_limit_order(symbol, 2, OrderSide::Sell, 40, 10.0);
+        engine.cancel_order(1);
+
+        std::vector<BookUpdate> updates;
+        publisher->poll(subscriber, [&](const BookUpdate& update) { updates.push_back(update); });
+        std::vector<BookUpdateType> expected = {
+            BookUpdateType::OrderAdd, BookUpdateType::LevelAdd,
+            BookUpdateType::OrderUpdate, BookUpdateType::LevelChange,
+            BookUpdateType::OrderDelete, BookUpdateType::LevelDelete};
+        assert_with_message(updates.size() == expected.size(), "Expected 6 updates");
+        for (size_t i = 0; i < updates.size(); ++i) {
+            assert_with_message(updates[i].type == expected[i], "Unexpected update type");
+            assert_with_message(updates[i].sequence == i + 1, "Expected contiguous sequence numbers");
+        }
+        assert_with_message(updates[2].quantity == 60 && updates[3].quantity == 60, "Expected 60 left after the fill");
+
+        // Churn the book, joining through a snapshot part way through
+        L2BookReplica replica(symbol);
+        auto apply = [&](const BookUpdate& update) { assert_with_message(replica.apply(update), "Unexpected gap"); };
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> price_dist(95, 105);
+        std::uniform_int_distribution<int> size_dist(1, 50);
+        std::vector<OrderId> placed;
+        for (OrderId id = 100; id < 600; ++id) {
+            if (id == 300) {
+                engine.publish_snapshot(symbol);
+            }
+            if (id % 5 == 0 && !placed.empty()) {
+                engine.cancel_order(placed[rng() % placed.size()]);
+            } else {
+                OrderSide side = id % 2 == 0 ? OrderSide::Buy : OrderSide::Sell;
+                engine.place_limit_order(symbol, id, side, size_dist(rng), price_dist(rng) / 10.0);
+                placed.push_back(id);
+            }
+            publisher->poll(subscriber, apply, 1024);
+            assert_with_message(replica.synced() == (id >= 300), "Expected to sync at the snapshot");
+        }
+
+        BookDepth depth = engine.get_order_book(symbol)->depth(100);
+        assert_with_message(depth.bids.size() == replica.bids().size(), "Expected the same bid levels");
+        assert_with_message(depth.asks.size() == replica.asks().size(), "Expected the same ask levels");
+        auto bid = replica.bids().begin();
+        for (const LevelSummary& level : depth.bids) {
+            assert_with_message(bid->first == level.price && bid->second.quantity == level.quantity &&
+                                bid->second.order_count == level.order_count, "Expected matching bid level");
+            ++bid;
+        }
+        auto ask = replica.asks().begin();
+        for (const LevelSummary& level : depth.asks) {
+            assert_with_message(ask->first == level.price && ask->second.quantity == level.quantity,
+                                "Expected matching ask level");
+            ++ask;
+        }
+
+        // A consumer that falls a whole ring behind sees a gap instead of stalling matching
+        auto small = std::make_shared<MarketDataPublisher>(MarketDataDetail::L2, 4);
+        engine.set_market_data(small);
+        size_t lagging = small->subscribe();
+        for (OrderId id = 1000; id < 1010; ++id) {
+            engine.place_limit_order(symbol, id, OrderSide::Buy, 1, 1.0);
+        }
+        assert_with_message(small->dropped() == 6, "Expected updates beyond the ring to be dropped");
+        L2BookReplica lagging_replica(symbol);
+        bool contiguous = true;
+        small->poll(lagging, [&](const BookUpdate& update) { contiguous = lagging_replica.apply(update) && contiguous; });
+        engine.place_limit_order(symbol, 1010, OrderSide::Buy, 1, 1.0);
+        small->poll(lagging, [&](const BookUpdate& update) { contiguous = lagging_replica.apply(update) && contiguous; });
+        assert_with_message(!contiguous, "Expected the replica to detect the gap");
+    });
+
+    // Test 21: Histogram percentiles stay within bucket resolution
+    tests.add_test("Latency Histogram", [&]() {
+        LatencyHistogram histogram;
+        assert_with_message(histogram.value_at_percentile(99.0) == 0, "Expected an empty histogram to report 0");
+
+        // 1..10000 uniformly, plus one large outlier
+        for (uint64_t value = 1; value <= 10000; ++value) {
+            histogram.record(value);
+        }
+        histogram.record(5000000);
+
+        auto within = [](uint64_t actual, double expected) {
+            return std::abs(static_cast<double>(actual) - expected) <= expected * 0.04;
+        };
+        assert_with_message(histogram.count() == 10001, "Expected 10001 samples");
+        assert_with_message(histogram.min() == 1 && histogram.max() == 5000000, "Expected exact min and max");
+        assert_with_message(within(histogram.value_at_percentile(50.0), 5000.0), "Expected p50 near 5000");
+        assert_with_message(within(histogram.value_at_percentile(99.0), 9900.0), "Expected p99 near 9900");
+        assert_with_message(histogram.value_at_percentile(100.0) == 5000000, "Expected p100 to be the max");
+
+        // Small values are exact
+        LatencyHistogram small;
+        for (uint64_t value = 0; value < 64; ++value) {
+            small.record(value);
+        }
+        assert_with_message(small.value_at_percentile(50.0) == 31, "Expected exact small-value buckets");
+
+        LatencyHistogram merged;
+        merged.merge(histogram);
+        merged.merge(small);
+        assert_with_message(merged.count() == 10065 && merged.min() == 0, "Expected merged counts");
+        LatencySummary summary = merged.summary(2.0);
+        assert_with_message(summary.max_ns == 10000000.0, "Expected the summary scaled to nanoseconds");
+    });
+
+    // Test 22: Engine entry points feed their histograms when stats are built in
+    tests.add_test("Engine Latency Stats", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+
+        engine.place_limit_order(symbol, 1, OrderSide::Sell, 100, 10.0);
+        engine.place_limit_order(symbol, 2, OrderSide::Buy, 50, 10.0);
+        engine.place_market_order(symbol, 3, OrderSide::Buy, 10);
+        engine.cancel_order(1);
+        engine.place_stop_order(symbol, 5, OrderSide::Buy, 10, 20.0);
+        engine.submit(Command::limit(symbol, 4, OrderSide::Buy, 10, px(9.0)));
+        engine.drain();
+
+        EngineLatencyReport report = engine.latency_stats().report();
+        uint64_t expected = kLatencyStatsEnabled ? 1 : 0;
+        assert_with_message(report.place_limit.count == 3 * expected, "Expected 3 limit placements");
+        assert_with_message(report.place_market.count == expected, "Expected 1 market placement");
+        assert_with_message(report.place_stop.count == expected, "Expected 1 stop placement");
+        assert_with_message(report.match.count == 4 * expected, "Expected 4 matches");
+        assert_with_message(report.cancel.count == expected, "Expected 1 cancel");
+        assert_with_message(report.queue_wait.count == expected, "Expected 1 queued command");
+        assert_with_message(report.place_limit.max_ns >= report.place_limit.p50_ns, "Expected ordered percentiles");
+
+        std::ostringstream json;
+        report.write_json(json);
+        assert_with_message(json.str().find("\"queue_wait\":{\"count\":") != std::string::npos,
+                            "Expected a JSON export");
+
+        engine.reset_latency_stats();
+        assert_with_message(engine.latency_stats().place_limit.count() == 0, "Expected reset histograms");
+    });
+
+    // Test 23: One event time per call, taken from the engine's clock
+    tests.add_test("Replay Clock Timestamps", [&]() {
+        auto clock = std::make_shared<ReplayClock>(5000);
+        MatchingEngine engine;
+        engine.set_clock(clock);
+        SymbolId symbol = engine.add_order_book("TEST");
+        auto book = engine.get_order_book(symbol);
+
+        engine.place_limit_order(symbol, 1, OrderSide::Sell, 100, 10.0);
+        engine.place_limit_order(symbol, 2, OrderSide::Sell, 100, 11.0);
+        assert_with_message(book->last_update_time() == 5000, "Expected the replayed add time");
+
+        // A sweep through two levels stamps every fill with the same time
+        clock->set(6000);
+        auto trades = engine.place_market_order(symbol, 3, OrderSide::Buy, 150);
+        assert_with_message(trades.size() == 2, "Expected 2 trades");
+        assert_with_message(trades[0].timestamp == 6000 && trades[1].timestamp == 6000,
+                            "Expected both fills at the event time");
+        assert_with_message(book->last_update_time() == 6000, "Expected the replayed match time");
+
+        clock->advance(500);
+        engine.cancel_order(2);
+        assert_with_message(book->last_update_time() == 6500, "Expected the replayed cancel time");
+    });
+
+    // Test 24: A batch clock reads its source once per batch of commands
+    tests.add_test("Batch Clock", [&]() {
+        auto source = std::make_shared<ReplayClock>(100);
+        MatchingEngine engine;
+        engine.set_clock(std::make_shared<BatchClock>(source));
+        SymbolId symbol = engine.add_order_book("TEST");
+
+        std::vector<Trade> trades;
+        engine.register_trade_callback([&trades](const Trade& trade) { trades.push_back(trade); });
+
+        engine.submit(Command::limit(symbol, 1, OrderSide::Sell, 100, px(10.0)));
+        engine.submit(Command::market(symbol, 2, OrderSide::Buy, 40));
+        source->set(200);
+        engine.process_commands();
+        source->set(300);
+
+        assert_with_message(trades.size() == 1, "Expected 1 trade");
+        assert_with_message(trades[0].timestamp == 200, "Expected the time read when the batch began");
+
+        // The calibrated counter clock tracks the wall clock
+        TscClock tsc;
+        uint64_t wall = SystemClock().now();
+        uint64_t now = tsc.now();
+        uint64_t skew = now > wall ? now - wall : wall - now;
+        assert_with_message(skew < 1000000000ull, "Expected the TSC clock within a second of the wall clock");
+    });
+
+    // Test 25: Replaying a journal rebuilds identical books without side effects
+    tests.add_test("Journal Replay", [&]() {
+        std::string path = (std::filesystem::temp_directory_path() / "finstack_replay_test.journal").string();
+        JournalOptions options;
+        options.path = path;
+        options.truncate = true;
+
+        auto clock = std::make_shared<ReplayClock>(1000);
+        MatchingEngine original;
+        original.set_clock(clock);
+        assert_with_message(original.open_journal(options), "Expected the journal to open");
+        SymbolId aapl = original.add_order_book("AAPL");
+        SymbolId msft = original.add_order_book("MSFT");
+
+        original.place_limit_order(aapl, 1, OrderSide::Sell, 100, 150.0);
+        original.place_limit_order(aapl, 2, OrderSide::Sell, 200, 151.0);
+        original.place_limit_order(msft, 3, OrderSide::Buy, 300, 300.0);
+        clock->set(2000);
+        original.place_market_order(aapl, 4, OrderSide::Buy, 150);
+        original.submit(Command::modify(msft, 3, 250, px(299.5)));
+        original.submit(Command::limit(msft, 5, OrderSide::Buy, 10, px(299.0)));
+        original.drain();
+        clock->set(3000);
+        original.cancel_order(5);
+        original.close_journal();
+
+        MatchingEngine restored;
+        int callbacks = 0;
+        restored.register_trade_callback([&callbacks](const Trade&) { ++callbacks; });
+        uint64_t records = restored.replay_journal(path);
+        assert_with_message(records == 9, "Expected 2 books and 7 commands replayed");
+        assert_with_message(callbacks == 0, "Expected no callbacks during replay");
+
+        for (SymbolId symbol : {aapl, msft}) {
+            auto expected = original.get_order_book(symbol);
+            auto actual = restored.get_order_book(symbol);
+            assert_with_message(actual != nullptr, "Expected the book to be recreated");
+            assert_with_message(actual->get_symbol() == expected->get_symbol(), "Expected the same symbol");
+            BookDepth want = expected->depth(10);
+            BookDepth got = actual->depth(10);
+            assert_with_message(want.bids.size() == got.bids.size() && want.asks.size() == got.asks.size(),
+                                "Expected the same levels");
+            for (size_t i = 0; i < want.bids.size(); ++i) {
+                assert_with_message(want.bids[i].price == got.bids[i].price &&
+                                    want.bids[i].quantity == got.bids[i].quantity, "Expected the same bids");
+            }
+            for (size_t i = 0; i < want.asks.size(); ++i) {
+                assert_with_message(want.asks[i].price == got.asks[i].price &&
+                                    want.asks[i].quantity == got.asks[i].quantity, "Expected the same asks");
+            }
+            assert_with_message(actual->last_update_time() == expected->last_update_time(),
+                                "Expected the recorded event times");
+        }
+        assert_with_message(restored.find_symbol("MSFT") == msft, "Expected the symbols to be re-interned");
+
+        // After the restart, journaling continues where the file left off
+        assert_with_message(restored.open_journal({path}), "Expected the journal to reopen");
+        restored.place_limit_order(aapl, 6, OrderSide::Buy, 10, 140.0);
+        restored.close_journal();
+
+        MatchingEngine again;
+        assert_with_message(again.replay_journal(path) == 10, "Expected the appended record");
+        assert_with_message(again.get_order_book(aapl)->volume_at_price(OrderSide::Buy, 140.0) == 10,
+                            "Expected the appended order");
+
+        // Names longer than one record continue in BookName records; a name
+        // the journal cannot hold is refused rather than lost on replay
+        std::string long_name = "EURUSD.SPOT.LDN.4PM.FIX";
+        MatchingEngine named;
+        assert_with_message(named.open_journal(options), "Expected a new journal");
+        SymbolId fx = named.add_order_book(long_name);
+        assert_with_message(fx != kInvalidSymbolId, "Expected a long name to be journaled");
+        assert_with_message(named.add_order_book(std::string(JournalRecord::kMaxSymbolLength + 1, 'X')) ==
+                            kInvalidSymbolId, "Expected a name past the journal's limit to be refused");
+        named.place_limit_order(fx, 1, OrderSide::Buy, 10, 1.25);
+        named.close_journal();
+
+        MatchingEngine renamed;
+        assert_with_message(renamed.replay_journal(path) == 3, "Expected the book, its name part and the order");
+        assert_with_message(renamed.find_symbol(long_name) == fx &&
+                            renamed.get_order_book(fx)->volume_at_price(OrderSide::Buy, 1.25) == 10,
+                            "Expected the long-named book and its order back");
+        std::filesystem::remove(path);
+    });
+
+    // Test 26: A torn tail is ignored on replay and dropped on reopen
+    tests.add_test("Journal Torn Tail", [&]() {
+        std::string path = (std::filesystem::temp_directory_path() / "finstack_torn_test.journal").string();
+        JournalOptions options;
+        options.path = path;
+        options.truncate = true;
+        options.sync = JournalSync::Always;
+        options.direct_io = true; // Falls back to buffered I/O where unsupported
+
+        {
+            JournalWriter writer;
+            assert_with_message(writer.open(options), "Expected the journal to open");
+            writer.append_book("TEST", 0);
+            for (OrderId id = 1; id <= 100; ++id) {
+                writer.append_command(Command::limit(0, id, OrderSide::Buy, 10, Price(1000)), id);
+            }
+            assert_with_message(writer.commit(), "Expected the commit to succeed");
+            assert_with_message(writer.stats().syncs >= 1, "Expected a sync per commit");
+            assert_with_message(!writer.append_book(std::string(JournalRecord::kMaxSymbolLength + 1, 'X'), 1),
+                                "Expected a rejected name");
+        }
+
+        // Simulate a crash in the middle of a record
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::app);
+            out.write("torn record", 11);
+        }
+
+        JournalReader reader;
+        assert_with_message(reader.open(path), "Expected a readable journal");
+        JournalRecord record;
+        uint64_t last_id = 0;
+        while (reader.next(record)) {
+            last_id = record.order_id;
+        }
+        assert_with_message(reader.records() == 101, "Expected every complete record");
+        assert_with_message(last_id == 100, "Expected the records in order");
+        reader.close();
+
+        {
+            JournalWriter writer;
+            options.truncate = false;
+            assert_with_message(writer.open(options), "Expected the journal to reopen");
+            writer.append_command(Command::cancel(0, 1), 101);
+        }
+
+        MatchingEngine engine;
+        assert_with_message(engine.replay_journal(path) == 102, "Expected the torn bytes to be dropped");
+        assert_with_message(engine.get_order_book("TEST")->orders_at_price(OrderSide::Buy, Price(1000)) == 99,
+                            "Expected the replayed orders and cancel");
+
+        // Group commit syncs on time as well as on bytes, and an engine
+        // thread syncs the last group once its queue goes quiet
+        options.truncate = true;
+        options.direct_io = false;
+        options.sync = JournalSync::Group;
+        options.group_interval_ns = 1'000'000;
+        {
+            JournalWriter writer;
+            assert_with_message(writer.open(options), "Expected the journal to open");
+            uint64_t opened = writer.stats().syncs;
+            writer.append_command(Command::limit(0, 1, OrderSide::Buy, 10, Price(1000)), 1);
+            writer.commit();
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            writer.append_command(Command::limit(0, 2, OrderSide::Buy, 10, Price(1000)), 2);
+            assert_with_message(writer.commit() && writer.stats().syncs > opened && !writer.sync_pending(),
+                                "Expected a group sync once the interval had passed");
+        }
+
+        options.group_interval_ns = 0;
+        MatchingEngine worker;
+        assert_with_message(worker.open_journal(options), "Expected the engine journal to open");
+        SymbolId symbol = worker.add_order_book("TEST");
+        uint64_t before = worker.journal_stats().syncs;
+        worker.start();
+        worker.submit(Command::limit(symbol, 1, OrderSide::Buy, 10, Price(1000)));
+        worker.drain();
+        for (int i = 0; i < 1000 && worker.journal_stats().syncs == before; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert_with_message(worker.journal_stats().syncs > before, "Expected the idle engine thread to sync");
+        worker.stop();
+        worker.close_journal();
+
+#ifdef __linux__
+        // A buffer that cannot be written out refuses records instead of
+        // overrunning; a file size limit makes the writes fail with EFBIG
+        options.buffer_bytes = JournalWriter::kBlockSize;
+        {
+            JournalWriter writer;
+            assert_with_message(writer.open(options), "Expected the journal to open");
+            rlimit saved;
+            getrlimit(RLIMIT_FSIZE, &saved);
+            auto previous = std::signal(SIGXFSZ, SIG_IGN);
+            rlimit limited = saved;
+            limited.rlim_cur = std::filesystem::file_size(path) + 3 * JournalWriter::kBlockSize;
+            setrlimit(RLIMIT_FSIZE, &limited);
+
+            size_t accepted = 0;
+            for (OrderId id = 1; id <= 1000; ++id) {
+                accepted += writer.append_command(Command::limit(0, id, OrderSide::Buy, 10, Price(1000)), id);
+            }
+            setrlimit(RLIMIT_FSIZE, &saved);
+            std::signal(SIGXFSZ, previous);
+
+            JournalStats stats = writer.stats();
+            assert_with_message(accepted < 1000 && stats.dropped == 1000 - accepted && stats.errors >= stats.dropped,
+                                "Expected records past the failed write to be dropped");
+            assert_with_message(writer.commit(), "Expected the buffer to go out once writes succeed");
+            JournalReader full;
+            full.open(path);
+            while (full.next(record)) {
+            }
+            assert_with_message(full.records() == accepted, "Expected every accepted record in the journal");
+        }
+#endif
+        std::filesystem::remove(path);
+    });
+
+    // Test 27: Batch entry points fill one reusable response buffer
+    tests.add_test("Bulk Order Entry", [&]() {
+        auto clock = std::make_shared<ReplayClock>(777);
+        MatchingEngine engine;
+        engine.set_clock(clock);
+        SymbolId aapl = engine.add_order_book("AAPL");
+        SymbolId msft = engine.add_order_book("MSFT");
+
+        std::vector<NewOrder> quotes = {
+            NewOrder::limit(aapl, 1, OrderSide::Sell, 100, px(10.0)),
+            NewOrder::limit(aapl, 2, OrderSide::Sell, 100, px(10.1)),
+            NewOrder::limit(msft, 3, OrderSide::Buy, 50, px(20.0)),
+            NewOrder::limit(aapl, 4, OrderSide::Buy, 150, px(10.1)),
+            NewOrder::market(msft, 5, OrderSide::Sell, 80),
+            NewOrder::limit(kInvalidSymbolId, 6, OrderSide::Buy, 10, px(1.0)),
+        };
+        BatchResponse response;
+        response.reserve(16, 16);
+        engine.place_orders(quotes, response);
+
+        assert_with_message(response.results.size() == 6, "Expected one result per order");
+        assert_with_message(response.results[0].status == OrderStatus::New, "Expected the first quote to rest");
+        const OrderResult& sweep = response.results[3];
+        assert_with_message(sweep.status == OrderStatus::Filled && sweep.filled_size == 150, "Expected a full fill");
+        assert_with_message(sweep.trade_count == 2 && response.trades[sweep.first_trade].order_id_sell == 1,
+                            "Expected the sweep's trades in order");
+        const OrderResult& market = response.results[4];
+        assert_with_message(market.status == OrderStatus::Cancelled && market.filled_size == 50,
+                            "Expected the market remainder to be cancelled");
+        assert_with_message(response.results[5].status == OrderStatus::Rejected, "Expected the unknown symbol rejected");
+        for (const Trade& trade : response.trades) {
+            assert_with_message(trade.timestamp == 777, "Expected one event time for the batch");
+        }
+
+        // Once the book has seen the prices, a requote cycle through the same
+        // buffer allocates nothing
+        std::vector<NewOrder> requote;
+        for (OrderId id = 10; id < 20; ++id) {
+            requote.push_back(NewOrder::limit(aapl, id, OrderSide::Buy, 10, px(9.0 + (id - 10) * 0.01)));
+        }
+        std::vector<OrderId> cancels = {10, 11, 12, 99};
+        size_t allocations = 0;
+        for (int cycle = 0; cycle < 2; ++cycle) {
+            size_t before = g_allocations.load();
+            engine.place_orders(requote, response);
+            engine.cancel_orders(cancels, response);
+            allocations = g_allocations.load() - before;
+        }
+        assert_with_message(allocations == 0, "Expected the reused buffer to avoid allocation");
+        assert_with_message(response.results.size() == 4, "Expected the buffer refilled by the cancels");
+        assert_with_message(response.results[2].status == OrderStatus::Cancelled, "Expected a cancel");
+        assert_with_message(response.results[3].status == OrderStatus::Rejected, "Expected an unknown ID");
+
+        // Mass cancel one side, then the whole book
+        assert_with_message(engine.mass_cancel(aapl, OrderSide::Buy) == 14, "Expected 14 bids cancelled");
+        auto book = engine.get_order_book(aapl);
+        assert_with_message(book->level_count(OrderSide::Buy) == 0, "Expected no bids left");
+        assert_with_message(book->best_ask() == 10.1, "Expected the asks untouched");
+        assert_with_message(engine.mass_cancel(aapl) == 1, "Expected the last ask cancelled");
+        assert_with_message(book->order_pool().in_use() == 0, "Expected every slot recycled");
+        assert_with_message(!engine.cancel_order(2), "Expected the index cleared");
+    });
+
+    // Test 28: Native modify keeps or forfeits priority and re-matches on a cross
+    tests.add_test("Modify Order", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        auto book = engine.get_order_book(symbol);
+        std::vector<Trade> trades;
+        engine.register_trade_callback([&trades](const Trade& trade) { trades.push_back(trade); });
+
+        engine.place_limit_order(symbol, 1, OrderSide::Buy, 100, 10.0);
+        engine.place_limit_order(symbol, 2, OrderSide::Buy, 100, 10.0);
+        engine.place_limit_order(symbol, 3, OrderSide::Sell, 100, 10.5);
+        size_t slabs = book->order_pool().slab_count();
+
+        // Size-down keeps the queue position and updates the aggregate
+        assert_with_message(engine.modify_order(1, 60, 10.0) == ModifyResult::Amended, "Expected an in-place amend");
+        assert_with_message(book->volume_at_price(OrderSide::Buy, 10.0) == 160, "Expected the level to shrink");
+        assert_with_message(book->get_all_orders().first.front()->order_id == 1, "Expected order 1 still first");
+
+        // Size-up at the same price goes to the back
+        assert_with_message(engine.modify_order(1, 120, 10.0) == ModifyResult::Requeued, "Expected a requeue");
+        assert_with_message(book->get_all_orders().first.front()->order_id == 2, "Expected order 2 first now");
+        assert_with_message(book->volume_at_price(OrderSide::Buy, 10.0) == 220, "Expected the level to grow");
+
+        // Re-pricing through the ask trades, then rests the remainder
+        assert_with_message(engine.modify_order(2, 150, 10.5) == ModifyResult::Requeued, "Expected a requeue");
+        assert_with_message(trades.size() == 1 && trades[0].order_id_buy == 2 && trades[0].size == 100,
+                            "Expected the crossing modify to trade");
+        assert_with_message(book->best_bid() == 10.5 && book->volume_at_price(OrderSide::Buy, 10.5) == 50,
+                            "Expected the remainder at the new price");
+        assert_with_message(book->best_ask() == std::numeric_limits<double>::max(), "Expected the ask consumed");
+
+        // Shrinking below the filled size leaves nothing to fill
+        assert_with_message(engine.modify_order(2, 100, 10.5) == ModifyResult::Cancelled, "Expected a cancel");
+        assert_with_message(book->level_count(OrderSide::Buy) == 1, "Expected only the 10.0 level left");
+        assert_with_message(engine.modify_order(99, 10, 10.0) == ModifyResult::NotFound, "Expected an unknown ID");
+        assert_with_message(book->order_pool().slab_count() == slabs, "Expected no new pool slabs");
+
+        // A batch modify reports its own fills, not those of the stops it releases
+        engine.place_limit_order(symbol, 10, OrderSide::Sell, 10, 11.0);
+        engine.place_limit_order(symbol, 11, OrderSide::Sell, 40, 11.5);
+        BatchResponse response;
+        std::vector<Command> commands = {Command::stop(symbol, 12, OrderSide::Buy, 40, px(11.0)),
+                                         Command::modify(symbol, 1, 120, px(11.0))};
+        engine.execute_commands(commands, response);
+        assert_with_message(response.trades.size() == 2 && response.trades[1].order_id_buy == 12,
+                            "Expected the modify's trade to release the stop");
+        assert_with_message(response.results[1].filled_size == 10 &&
+                            response.results[1].status == OrderStatus::PartiallyFilled,
+                            "Expected only the modified order's fill");
+    });
+
+    // Test 29: IOC, FOK and post-only are applied inside the matching loop
+    tests.add_test("Time In Force", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        auto book = engine.get_order_book(symbol);
+
+        engine.place_limit_order(symbol, 1, OrderSide::Sell, 100, 10.0);
+        engine.place_limit_order(symbol, 2, OrderSide::Sell, 100, 10.1);
+
+        // IOC takes what its limit allows and never rests
+        auto trades = engine.place_limit_order(symbol, 3, OrderSide::Buy, 150, 10.0, TimeInForce::ImmediateOrCancel);
+        assert_with_message(trades.size() == 1 && trades[0].size == 100, "Expected the IOC to take one level");
+        assert_with_message(book->level_count(OrderSide::Buy) == 0, "Expected no IOC remainder in the book");
+        assert_with_message(!engine.cancel_order(3), "Expected the IOC remainder never indexed");
+
+        // FOK beyond the available quantity leaves the book untouched
+        trades = engine.place_limit_order(symbol, 4, OrderSide::Buy, 150, 10.1, TimeInForce::FillOrKill);
+        assert_with_message(trades.empty(), "Expected the FOK killed without trading");
+        assert_with_message(book->volume_at_price(OrderSide::Sell, 10.1) == 100, "Expected the ask intact");
+
+        // FOK that the aggregates can cover fills across levels
+        engine.place_limit_order(symbol, 5, OrderSide::Sell, 100, 10.2);
+        trades = engine.place_limit_order(symbol, 6, OrderSide::Buy, 150, 10.2, TimeInForce::FillOrKill);
+        assert_with_message(trades.size() == 2 && trades[1].size == 50, "Expected the FOK filled over two levels");
+        trades = engine.place_market_order(symbol, 7, OrderSide::Buy, 60, TimeInForce::FillOrKill);
+        assert_with_message(trades.empty(), "Expected the market FOK killed");
+        trades = engine.place_market_order(symbol, 8, OrderSide::Buy, 50, TimeInForce::FillOrKill);
+        assert_with_message(trades.size() == 1 && book->level_count(OrderSide::Sell) == 0,
+                            "Expected the market FOK filled");
+
+        // Post-only rejects or slides instead of taking liquidity
+        engine.place_limit_order(symbol, 9, OrderSide::Sell, 100, 10.5);
+        assert_with_message(engine.place_post_only_order(symbol, 10, OrderSide::Buy, 100, 10.5) == OrderStatus::Rejected,
+                            "Expected a crossing post-only order rejected");
+        assert_with_message(engine.place_post_only_order(symbol, 11, OrderSide::Buy, 100, 10.6, true) == OrderStatus::New,
+                            "Expected a crossing post-only order repriced");
+        assert_with_message(book->best_bid() == 10.49 && book->volume_at_price(OrderSide::Sell, 10.5) == 100,
+                            "Expected the repriced order one tick behind the ask");
+        assert_with_message(engine.place_post_only_order(symbol, 12, OrderSide::Buy, 100, 10.4) == OrderStatus::New,
+                            "Expected a passive post-only order to rest");
+
+        // Moving a post-only order through the spread removes it
+        assert_with_message(engine.modify_order(12, 100, 10.5) == ModifyResult::Rejected,
+                            "Expected the crossing modify rejected");
+        assert_with_message(book->level_count(OrderSide::Buy) == 1, "Expected only the repriced bid left");
+
+        // Time in force and order type survive the journal encoding
+        Command command = JournalRecord::from_command(Command::post_only(symbol, 13, OrderSide::Sell, 10,
+                                                                         Price(1000), true), 0).to_command();
+        assert_with_message(command.order_type == OrderType::PostOnlySlide, "Expected the order type journaled");
+        command = JournalRecord::from_command(Command::market(symbol, 14, OrderSide::Sell, 10,
+                                                             TimeInForce::FillOrKill), 0).to_command();
+        assert_with_message(command.tif == TimeInForce::FillOrKill, "Expected the time in force journaled");
+    });
+
+    // Test 30: Sweep estimates from the contiguous level quantities match a walk of the depth
+    tests.add_test("Sweep Estimate", [&]() {
+        OrderBook book("TEST");
+        std::mt19937_64 rng(7);
+        std::uniform_int_distribution<int64_t> offset(0, 700);
+        std::uniform_int_distribution<uint64_t> size(1, 100);
+        OrderId next_id = 1;
+
+        // Bids and asks spread over many bitmap words, with fills and cancels
+        for (int i = 0; i < 3000; ++i) {
+            OrderSide side = (i % 2 == 0) ? OrderSide::Buy : OrderSide::Sell;
+            Price price(side == OrderSide::Buy ? 10000 - offset(rng) : 10001 + offset(rng));
+            Order* order = book.create_limit_order(next_id++, side, size(rng), price, get_timestamp());
+            book.add_order(order);
+            if (i % 7 == 0) {
+                book.cancel_order(next_id / 2);
+            }
+        }
+        Order* taker = book.create_market_order(next_id++, OrderSide::Buy, 2500, get_timestamp());
+        book.match_order(*taker);
+        book.release_order(taker);
+
+        BookDepth depth = book.depth(std::numeric_limits<size_t>::max());
+        auto walk = [](const std::vector<LevelSummary>& levels, uint64_t wanted, auto within) {
+            SweepEstimate expected{0, 0, Price{}};
+            for (const LevelSummary& level : levels) {
+                if (expected.quantity >= wanted || !within(level.price)) {
+                    break;
+                }
+                expected.quantity += level.quantity;
+                ++expected.levels;
+                expected.worst_price = level.price;
+            }
+            expected.quantity = std::min(expected.quantity, wanted);
+            return expected;
+        };
+
+        std::uniform_int_distribution<uint64_t> wanted(1, 200000);
+        for (int i = 0; i < 200; ++i) {
+            OrderSide side = (i % 2 == 0) ? OrderSide::Buy : OrderSide::Sell;
+            uint64_t amount = wanted(rng);
+            Price limit(side == OrderSide::Buy ? 10001 + offset(rng) : 10000 - offset(rng));
+            SweepEstimate estimate = book.estimate_sweep(side, amount, limit);
+            SweepEstimate expected = side == OrderSide::Buy
+                ? walk(depth.asks, amount, [limit](Price price) { return price <= limit; })
+                : walk(depth.bids, amount, [limit](Price price) { return price >= limit; });
+            assert_with_message(estimate.quantity == expected.quantity && estimate.levels == expected.levels &&
+                                (expected.levels == 0 || estimate.worst_price == expected.worst_price),
+                                "Expected the estimate to match the depth walk");
+        }
+
+        // A market sweep of everything reaches every level
+        SweepEstimate all = book.estimate_sweep(OrderSide::Sell, std::numeric_limits<uint64_t>::max());
+        assert_with_message(all.levels == depth.bids.size() && all.worst_price == depth.bids.back().price,
+                            "Expected a market sweep to reach the worst bid");
+    });
+
+    // Test 31: Book snapshots track the book and can be read while matching runs
+    tests.add_test("Book Snapshots", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        SymbolId other = engine.add_order_book("OTHER");
+        engine.place_limit_order(symbol, 1, OrderSide::Buy, 100, 10.0);
+
+        // The buffer starts from the current state of the book
+        auto snapshots = engine.book_snapshots(symbol, 3);
+        BookSnapshot snapshot;
+        assert_with_message(snapshots && snapshots->read(snapshot), "Expected an initial snapshot");
+        assert_with_message(snapshot.bid_levels == 1 && snapshot.ask_levels == 0 &&
+                            snapshot.top().bid.quantity == 100, "Expected the resting bid");
+        assert_with_message(engine.book_snapshots(99) == nullptr, "Expected no buffer for an unknown symbol");
+
+        // Every event on the book republishes; other books cost nothing
+        engine.place_limit_order(symbol, 2, OrderSide::Sell, 50, 10.5);
+        engine.place_limit_order(other, 3, OrderSide::Sell, 50, 10.5);
+        engine.place_limit_order(symbol, 4, OrderSide::Buy, 20, 10.5);
+        engine.cancel_order(1);
+        assert_with_message(snapshots->read(snapshot) && snapshot.sequence == 4, "Expected one snapshot per event");
+        assert_with_message(snapshot.bid_levels == 0 && snapshot.top().ask.quantity == 30 &&
+                            snapshot.top().ask.price == OrderBook::to_price(10.5), "Expected the book after the trade");
+
+        // Depth is capped at the buffer's level count
+        for (OrderId id = 10; id < 20; ++id) {
+            engine.place_limit_order(symbol, id, OrderSide::Buy, 10, 9.0 + static_cast<double>(id) / 100);
+        }
+        snapshots->read(snapshot);
+        assert_with_message(snapshot.bid_levels == 3 && snapshot.bids[0].price == OrderBook::to_price(9.19),
+                            "Expected the best three bids");
+
+        // A reader polling while the engine thread matches sees whole snapshots
+        std::atomic<bool> done{false};
+        std::atomic<bool> consistent{true};
+        std::thread reader([&]() {
+            uint64_t last = 0;
+            BookSnapshot seen;
+            while (!done.load(std::memory_order_acquire)) {
+                if (!snapshots->read(seen)) {
+                    continue;
+                }
+                bool crossed = seen.bid_levels > 0 && seen.ask_levels > 0 && seen.bids[0].price >= seen.asks[0].price;
+                bool ordered = true;
+                for (uint32_t i = 1; i < seen.bid_levels; ++i) {
+                    ordered = ordered && seen.bids[i].price < seen.bids[i - 1].price;
+                }
+                if (crossed || !ordered || seen.sequence < last) {
+                    consistent.store(false);
+                }
+                last = seen.sequence;
+            }
+        });
+
+        engine.start();
+        for (OrderId id = 100; id < 20100; ++id) {
+            OrderSide side = (id % 2 == 0) ? OrderSide::Buy : OrderSide::Sell;
+            double price = side == OrderSide::Buy ? 9.0 + static_cast<double>(id % 10) / 100
+                                                  : 9.05 + static_cast<double>(id % 10) / 100;
+            while (!engine.submit(Command::limit(symbol, id, side, 10, OrderBook::to_price(price)))) {
+                std::this_thread::yield();
+            }
+        }
+        engine.drain();
+        done.store(true, std::memory_order_release);
+        reader.join();
+        engine.stop();
+
+        assert_with_message(consistent.load(), "Expected every snapshot read to be consistent");
+        snapshots->read(snapshot);
+        auto book = engine.get_order_book(symbol);
+        assert_with_message(snapshot.top().bid.price == book->top_of_book().bid.price &&
+                            snapshot.top().ask.quantity == book->top_of_book().ask.quantity,
+                            "Expected the last snapshot to match the book");
+    });
+
+    // Test 32: The pre-trade risk stage stops orders before they reach the book
+    tests.add_test("Pre-Trade Risk", [&]() {
+        MatchingEngine engine;
+        auto clock = std::make_shared<ReplayClock>(1000);
+        engine.set_clock(clock);
+        SymbolId symbol = engine.add_order_book("TEST");
+
+        RiskConfig config;
+        config.accounts = 7;
+        config.symbols = 4;
+        config.price_band_bps = 100;
+        config.rate_window_ns = 1000;
+        auto risk = std::make_shared<PreTradeRisk<>>(config);
+        RiskLimits trader;
+        trader.max_order_size = 100;
+        trader.max_position = 150;
+        risk->set_limits(1, trader);
+        RiskLimits throttled;
+        throttled.max_order_size = 100;
+        throttled.max_orders_per_window = 2;
+        risk->set_limits(3, throttled);
+        engine.set_risk_check(risk);
+
+        BatchResponse response;
+        auto place = [&](const NewOrder& order) {
+            engine.place_orders({&order, 1}, response);
+            return response.results[0].status;
+        };
+        Price ten = OrderBook::to_price(10.0);
+
+        assert_with_message(place(NewOrder::limit(symbol, 1, OrderSide::Sell, 500, ten, TimeInForce::GoodTillCancel, 2)) ==
+                            OrderStatus::New, "Expected the unlimited account's order to rest");
+        assert_with_message(place(NewOrder::limit(symbol, 2, OrderSide::Buy, 200, ten, TimeInForce::GoodTillCancel, 1)) ==
+                            OrderStatus::Rejected, "Expected the order size limit to apply");
+        assert_with_message(place(NewOrder::limit(symbol, 3, OrderSide::Buy, 50, OrderBook::to_price(10.5),
+                                                  TimeInForce::GoodTillCancel, 1)) == OrderStatus::Rejected,
+                            "Expected a price more than 1% through the ask to be rejected");
+        assert_with_message(place(NewOrder::limit(symbol, 4, OrderSide::Buy, 50, ten, TimeInForce::GoodTillCancel, 9)) ==
+                            OrderStatus::Rejected, "Expected an unknown account to be rejected");
+        assert_with_message(engine.get_order_book(symbol)->top_of_book().ask.quantity == 500,
+                            "Expected rejected orders not to trade");
+
+        // Fills move positions and notionals; the position limit counts the new order
+        assert_with_message(place(NewOrder::limit(symbol, 5, OrderSide::Buy, 100, ten, TimeInForce::GoodTillCancel, 1)) ==
+                            OrderStatus::Filled, "Expected an order within limits to trade");
+        assert_with_message(risk->position(1, symbol) == 100 && risk->position(2, symbol) == -100 &&
+                            risk->notional(1) == ten.ticks * 100, "Expected fills to update both accounts");
+        assert_with_message(place(NewOrder::limit(symbol, 6, OrderSide::Buy, 100, ten, TimeInForce::GoodTillCancel, 1)) ==
+                            OrderStatus::Rejected, "Expected the position limit to apply");
+        assert_with_message(place(NewOrder::market(symbol, 7, OrderSide::Buy, 50, TimeInForce::ImmediateOrCancel, 1)) ==
+                            OrderStatus::Filled && risk->position(1, symbol) == 150,
+                            "Expected an order up to the position limit to trade");
+
+        // Orders, accepted or not, count towards the message rate
+        Price above = OrderBook::to_price(10.05);
+        place(NewOrder::limit(symbol, 8, OrderSide::Sell, 10, above, TimeInForce::GoodTillCancel, 3));
+        place(NewOrder::limit(symbol, 9, OrderSide::Sell, 10, above, TimeInForce::GoodTillCancel, 3));
+        assert_with_message(place(NewOrder::limit(symbol, 10, OrderSide::Sell, 10, above, TimeInForce::GoodTillCancel, 3)) ==
+                            OrderStatus::Rejected, "Expected the third order in the window to be throttled");
+        clock->advance(1000);
+        assert_with_message(place(NewOrder::limit(symbol, 10, OrderSide::Sell, 10, above, TimeInForce::GoodTillCancel, 3)) ==
+                            OrderStatus::New, "Expected a new window to accept orders again");
+
+        // Modifies that add exposure are checked; a refusal leaves the order alone
+        BookDepth depth;
+        assert_with_message(engine.modify_order(8, 200, 10.05) == ModifyResult::Refused, "Expected an oversized modify to be refused");
+        engine.get_order_book(symbol)->depth(2, depth);
+        assert_with_message(depth.asks.size() == 2 && depth.asks[1].quantity == 30, "Expected the order to be unchanged");
+        assert_with_message(engine.modify_order(8, 5, 10.05) == ModifyResult::Amended,
+                            "Expected a size reduction to pass");
+        assert_with_message(risk->rejects(RiskReject::OrderSize) == 2 && risk->rejects(RiskReject::PriceBand) == 1 &&
+                            risk->rejects(RiskReject::Position) == 1 && risk->rejects(RiskReject::MessageRate) == 1 &&
+                            risk->rejects(RiskReject::UnknownAccount) == 1, "Expected rejects counted by reason");
+
+        // Open orders count towards the limits as if they filled, and release
+        // their share as they fill, shrink or go
+        RiskLimits stacked;
+        stacked.max_position = 100;
+        risk->set_limits(4, stacked);
+        Price bid = OrderBook::to_price(9.5);
+        auto buy = [&](OrderId id, uint64_t size, AccountId account, Price price) {
+            return place(NewOrder::limit(symbol, id, OrderSide::Buy, size, price, TimeInForce::GoodTillCancel, account));
+        };
+        assert_with_message(buy(20, 60, 4, bid) == OrderStatus::New && risk->open_quantity(4, symbol, OrderSide::Buy) == 60,
+                            "Expected the resting order to count as open");
+        assert_with_message(buy(21, 60, 4, bid) == OrderStatus::Rejected, "Expected stacked orders to hit the limit");
+        place(NewOrder::limit(symbol, 22, OrderSide::Sell, 20, bid, TimeInForce::GoodTillCancel, 2));
+        assert_with_message(risk->position(4, symbol) == 20 && risk->open_quantity(4, symbol, OrderSide::Buy) == 40,
+                            "Expected a partial fill to move quantity from open to filled");
+        assert_with_message(buy(23, 40, 4, bid) == OrderStatus::New && buy(24, 1, 4, bid) == OrderStatus::Rejected,
+                            "Expected the limit to count the position and every open order");
+        engine.cancel_order(23);
+        assert_with_message(engine.modify_order(20, 80, 9.5) == ModifyResult::Requeued &&
+                            risk->open_quantity(4, symbol, OrderSide::Buy) == 60 &&
+                            risk->open_notional(4, OrderSide::Buy) == bid.ticks * 60,
+                            "Expected a modify to replace its own open quantity");
+        assert_with_message(engine.modify_order(20, 101, 9.5) == ModifyResult::Refused, "Expected a modify past the limit");
+
+        RiskLimits notional;
+        notional.max_notional = static_cast<uint64_t>(ten.ticks) * 150;
+        risk->set_limits(5, notional);
+        Price low = OrderBook::to_price(9.0);
+        assert_with_message(buy(25, 100, 5, low) == OrderStatus::New && buy(26, 100, 5, low) == OrderStatus::Rejected,
+                            "Expected open notional to count towards the notional limit");
+
+        // Stop-market orders are valued at their trigger and skip the price band
+        Command stops[] = {Command::stop(symbol, 27, OrderSide::Sell, 100, OrderBook::to_price(5.0), 5),
+                           Command::stop(symbol, 28, OrderSide::Buy, 100, ten, 5)};
+        engine.execute_commands(stops, response);
+        assert_with_message(response.results[0].status == OrderStatus::Pending,
+                            "Expected a far stop-market trigger to pass the band");
+        assert_with_message(response.results[1].status == OrderStatus::Rejected,
+                            "Expected a stop-market order to count its notional at the trigger");
+        engine.cancel_order(27);
+        assert_with_message(risk->rejects(RiskReject::Position) == 4 && risk->rejects(RiskReject::Notional) == 2 &&
+                            risk->rejects(RiskReject::PriceBand) == 1, "Expected the open-order rejects counted");
+
+        // Pending stops count as open until they are cancelled or trigger
+        risk->set_limits(6, stacked);
+        Price trigger = OrderBook::to_price(12.0);
+        Command pending[] = {Command::stop(symbol, 30, OrderSide::Buy, 60, trigger, 6),
+                             Command::stop_limit(symbol, 31, OrderSide::Buy, 60, trigger, trigger,
+                                                 TimeInForce::GoodTillCancel, 6),
+                             Command::stop(symbol, 32, OrderSide::Buy, 40, trigger, 6)};
+        engine.execute_commands(pending, response);
+        assert_with_message(response.results[0].status == OrderStatus::Pending &&
+                            response.results[1].status == OrderStatus::Rejected &&
+                            response.results[2].status == OrderStatus::Pending,
+                            "Expected stacked stops to hit the position limit");
+        assert_with_message(risk->open_quantity(6, symbol, OrderSide::Buy) == 100 &&
+                            risk->open_notional(6, OrderSide::Buy) == trigger.ticks * 100,
+                            "Expected pending stops valued at their triggers");
+        engine.cancel_order(30);
+        assert_with_message(risk->open_quantity(6, symbol, OrderSide::Buy) == 40 &&
+                            risk->open_notional(6, OrderSide::Buy) == trigger.ticks * 40,
+                            "Expected a cancelled stop to release its share");
+        engine.cancel_order(32);
+
+        // Without the stage only the order size limit of an Order remains
+        engine.set_risk_check(nullptr);
+        assert_with_message(place(NewOrder::limit(symbol, 11, OrderSide::Buy, 200, ten, TimeInForce::GoodTillCancel, 1)) ==
+                            OrderStatus::Filled, "Expected no checks once the stage is removed");
+        assert_with_message(place(NewOrder::limit(symbol, 12, OrderSide::Buy, kMaxOrderSize + 1, ten)) ==
+                            OrderStatus::Rejected, "Expected sizes beyond kMaxOrderSize to be rejected");
+    });
+
+    // Test 33: Self-trade prevention resolves same-account crosses inside the matching loop
+    tests.add_test("Self-Trade Prevention", [&]() {
+        struct Outcome {
+            std::vector<Trade> trades;
+            Order* aggressor;
+            bool rests;
+            uint64_t ask_quantity;
+            bool first_resting_live;
+        };
+        auto cross = [&](OrderBook& book, SelfTradePrevention mode, AccountId aggressor_account, uint64_t size) {
+            book.set_self_trade_prevention(mode);
+            // Two sells at one price: the aggressor's own account first, then someone else's
+            Order* own = book.create_limit_order(1, OrderSide::Sell, 100, px(10.0), get_timestamp());
+            own->account = 7;
+            Order* other = book.create_limit_order(2, OrderSide::Sell, 100, px(10.0), get_timestamp());
+            other->account = 8;
+            book.add_order(own);
+            book.add_order(other);
+
+            Outcome outcome;
+            outcome.aggressor = book.create_limit_order(3, OrderSide::Buy, size, px(10.0), get_timestamp());
+            outcome.aggressor->account = aggressor_account;
+            outcome.trades = book.match_order(*outcome.aggressor);
+            outcome.rests = book.add_order(outcome.aggressor);
+            outcome.ask_quantity = book.top_of_book().ask.quantity;
+            outcome.first_resting_live = book.order_index().contains(1);
+            return outcome;
+        };
+
+        {
+            OrderBook book("TEST");
+            Outcome outcome = cross(book, SelfTradePrevention::None, 7, 150);
+            assert_with_message(outcome.trades.size() == 2 && outcome.trades[0].order_id_sell == 1,
+                                "Expected no prevention to let the accounts trade");
+        }
+        {
+            OrderBook book("TEST");
+            Outcome outcome = cross(book, SelfTradePrevention::CancelResting, 7, 150);
+            assert_with_message(!outcome.first_resting_live && outcome.trades.size() == 1 &&
+                                outcome.trades[0].order_id_sell == 2 && outcome.trades[0].size == 100,
+                                "Expected the own resting order to be cancelled and matching to continue");
+            assert_with_message(outcome.rests && outcome.aggressor->remaining_size() == 50 && outcome.ask_quantity == 0,
+                                "Expected the remainder to rest");
+        }
+        {
+            OrderBook book("TEST");
+            Outcome outcome = cross(book, SelfTradePrevention::CancelAggressing, 7, 150);
+            assert_with_message(outcome.trades.empty() && outcome.aggressor->status == OrderStatus::Cancelled &&
+                                !outcome.rests && outcome.ask_quantity == 200,
+                                "Expected the aggressor to be cancelled and the book untouched");
+            book.release_order(outcome.aggressor);
+        }
+        {
+            OrderBook book("TEST");
+            Outcome outcome = cross(book, SelfTradePrevention::DecrementBoth, 7, 150);
+            assert_with_message(!outcome.first_resting_live && outcome.trades.size() == 1 &&
+                                outcome.trades[0].size == 50 && outcome.aggressor->status == OrderStatus::Filled &&
+                                outcome.ask_quantity == 50,
+                                "Expected both to lose 100 and the rest to trade with the other account");
+            book.release_order(outcome.aggressor);
+        }
+        {
+            OrderBook book("TEST");
+            Outcome outcome = cross(book, SelfTradePrevention::DecrementBoth, 7, 30);
+            assert_with_message(outcome.trades.empty() && outcome.aggressor->status == OrderStatus::Cancelled &&
+                                outcome.first_resting_live && outcome.ask_quantity == 170,
+                                "Expected a smaller aggressor to be used up against its own order");
+            book.release_order(outcome.aggressor);
+        }
+        {
+            OrderBook book("TEST");
+            Outcome outcome = cross(book, SelfTradePrevention::CancelAggressing, kNoAccount, 150);
+            assert_with_message(outcome.trades.size() == 2, "Expected orders without an account to trade freely");
+            book.release_order(outcome.aggressor);
+        }
+
+        // Fill-or-kill stays all or nothing when its own orders are in the way
+        auto fill_or_kill = [&](SelfTradePrevention mode, MatchingAlgorithm algorithm, uint64_t size) {
+            OrderBook book("TEST");
+            book.set_self_trade_prevention(mode);
+            book.set_matching({algorithm});
+            AccountId accounts[] = {8, 7, 8};
+            Price prices[] = {px(10.0), px(10.0), px(10.1)};
+            for (OrderId id = 1; id <= 3; ++id) {
+                Order* resting = book.create_limit_order(id, OrderSide::Sell, 100, prices[id - 1], get_timestamp());
+                resting->account = accounts[id - 1];
+                book.add_order(resting);
+            }
+            Order* aggressor = book.create_limit_order(4, OrderSide::Buy, size, px(10.1), get_timestamp(),
+                                                       TimeInForce::FillOrKill);
+            aggressor->account = 7;
+            std::vector<Trade> trades = book.match_order(*aggressor);
+            uint64_t traded = 0;
+            for (const Trade& trade : trades) {
+                traded += trade.size;
+            }
+            bool all_or_nothing = aggressor->status == OrderStatus::Filled ? traded == size
+                                                                            : trades.empty() && book.order_index().contains(2);
+            OrderStatus status = aggressor->status;
+            book.release_order(aggressor);
+            assert_with_message(all_or_nothing, "Expected a fill-or-kill order to fill completely or not at all");
+            return status;
+        };
+        assert_with_message(fill_or_kill(SelfTradePrevention::CancelAggressing, MatchingAlgorithm::Fifo, 150) ==
+                            OrderStatus::Cancelled, "Expected its own order to kill it");
+        assert_with_message(fill_or_kill(SelfTradePrevention::DecrementBoth, MatchingAlgorithm::Fifo, 150) ==
+                            OrderStatus::Cancelled, "Expected its own order to kill it");
+        assert_with_message(fill_or_kill(SelfTradePrevention::CancelAggressing, MatchingAlgorithm::Fifo, 100) ==
+                            OrderStatus::Filled, "Expected a fill ahead of its own order");
+        assert_with_message(fill_or_kill(SelfTradePrevention::CancelAggressing, MatchingAlgorithm::ProRata, 100) ==
+                            OrderStatus::Cancelled, "Expected its own order anywhere in a pro-rata level to kill it");
+        assert_with_message(fill_or_kill(SelfTradePrevention::CancelResting, MatchingAlgorithm::Fifo, 150) ==
+                            OrderStatus::Filled, "Expected other accounts' quantity to fill it");
+        assert_with_message(fill_or_kill(SelfTradePrevention::CancelResting, MatchingAlgorithm::Fifo, 250) ==
+                            OrderStatus::Cancelled, "Expected its own quantity not to count");
+
+        // The engine applies its mode to every book, and modifies match under it too
+        MatchingEngine engine;
+        engine.set_self_trade_prevention(SelfTradePrevention::CancelAggressing);
+        SymbolId symbol = engine.add_order_book("TEST");
+        BatchResponse response;
+        std::vector<NewOrder> orders = {
+            NewOrder::limit(symbol, 1, OrderSide::Sell, 100, px(10.0), TimeInForce::GoodTillCancel, 7),
+            NewOrder::limit(symbol, 2, OrderSide::Buy, 100, px(9.0), TimeInForce::GoodTillCancel, 7),
+            NewOrder::limit(symbol, 3, OrderSide::Buy, 100, px(10.0), TimeInForce::GoodTillCancel, 7)};
+        engine.place_orders(orders, response);
+        assert_with_message(response.trades.empty() && response.results[2].status == OrderStatus::Cancelled,
+                            "Expected the engine to cancel the self-crossing order");
+        assert_with_message(engine.modify_order(2, 100, 10.0) == ModifyResult::Cancelled &&
+                            engine.get_order_book(symbol)->top_of_book().bid.quantity == 0,
+                            "Expected a self-crossing modify to cancel the order");
+    });
+
+    // Test 34: Pro-rata and lead market maker allocation share a level as configured
+    tests.add_test("Matching Algorithms", [&]() {
+        // Sells of 100, 300 and 600 at 10.00, oldest first; the middle one is account 5's
+        auto fills_of = [&](const MatchingConfig& matching, uint64_t size, Price limit) {
+            OrderBook book("TEST");
+            book.set_matching(matching);
+            OrderId id = 1;
+            for (uint64_t resting : {100, 300, 600}) {
+                Order* order = book.create_limit_order(id, OrderSide::Sell, resting, px(10.0), get_timestamp());
+                order->account = id == 2 ? 5 : 1;
+                book.add_order(order);
+                ++id;
+            }
+            for (uint64_t resting : {200, 200}) {
+                book.add_order(book.create_limit_order(id++, OrderSide::Sell, resting, px(10.1), get_timestamp()));
+            }
+
+            Order* buy = book.create_limit_order(100, OrderSide::Buy, size, limit, get_timestamp());
+            std::vector<uint64_t> filled(6, 0);
+            for (const Trade& trade : book.match_order(*buy)) {
+                filled[trade.order_id_sell] += trade.size;
+            }
+            if (!book.add_order(buy)) {
+                book.release_order(buy);
+            }
+            return filled;
+        };
+        using Fills = std::vector<uint64_t>;
+
+        assert_with_message(fills_of({}, 150, px(10.0)) == Fills({0, 100, 50, 0, 0, 0}),
+                            "Expected price-time priority by default");
+        assert_with_message(fills_of({MatchingAlgorithm::ProRata}, 100, px(10.0)) == Fills({0, 10, 30, 60, 0, 0}),
+                            "Expected shares in proportion to resting size");
+        assert_with_message(fills_of({MatchingAlgorithm::ProRata}, 101, px(10.0)) == Fills({0, 11, 30, 60, 0, 0}),
+                            "Expected the rounding remainder to go to the oldest order");
+        assert_with_message(fills_of({MatchingAlgorithm::ProRata}, 1100, px(10.1)) == Fills({0, 100, 300, 600, 50, 50}),
+                            "Expected a sweep to take the first level whole and share the next");
+        assert_with_message(fills_of({MatchingAlgorithm::TopOrderProRata}, 400, px(10.0)) == Fills({0, 100, 100, 200, 0, 0}),
+                            "Expected the top order to fill first and the rest to be shared");
+        assert_with_message(fills_of({MatchingAlgorithm::FifoLmm, 5, 40}, 500, px(10.0)) == Fills({0, 100, 300, 100, 0, 0}),
+                            "Expected the lead market maker's share before price-time priority");
+
+        // Engines pick the algorithm per book, and journals remember it
+        MatchingEngine engine;
+        SymbolId fifo = engine.add_order_book("FIFO");
+        SymbolId pro_rata = engine.add_order_book("PRO", {MatchingAlgorithm::ProRata});
+        assert_with_message(engine.get_order_book(fifo)->matching().algorithm == MatchingAlgorithm::Fifo &&
+                            engine.get_order_book(pro_rata)->matching().algorithm == MatchingAlgorithm::ProRata,
+                            "Expected each book to keep its own algorithm");
+        MatchingConfig lmm = JournalRecord::add_book("LMM", 2, {MatchingAlgorithm::FifoLmm, 5, 40}).matching();
+        assert_with_message(lmm.algorithm == MatchingAlgorithm::FifoLmm && lmm.lmm_account == 5 && lmm.lmm_percent == 40,
+                            "Expected book records to carry the matching setup");
+    });
+
+    // Test 35: Stop orders wait in their book and trigger in order off trade prices
+    tests.add_test("Stop Orders", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        auto book = engine.get_order_book(symbol);
+        engine.place_limit_order(symbol, 1, OrderSide::Sell, 100, 10.0);
+        engine.place_limit_order(symbol, 2, OrderSide::Sell, 100, 10.5);
+        engine.place_limit_order(symbol, 3, OrderSide::Sell, 100, 11.0);
+        engine.place_limit_order(symbol, 4, OrderSide::Buy, 100, 9.5);
+
+        assert_with_message(engine.place_stop_order(symbol, 10, OrderSide::Buy, 100, 10.5) == OrderStatus::Pending &&
+                            engine.place_stop_limit_order(symbol, 11, OrderSide::Sell, 50, 9.5, 9.4) == OrderStatus::Pending,
+                            "Expected stops to wait for their trigger");
+        assert_with_message(book->stop_count(OrderSide::Buy) == 1 && book->top_of_book().bid.quantity == 100,
+                            "Expected pending stops to stay out of the book");
+
+        // A trade below the trigger leaves the buy stop alone; one at it releases the stop in the same event
+        engine.place_limit_order(symbol, 5, OrderSide::Buy, 100, 10.0);
+        assert_with_message(book->stop_count(OrderSide::Buy) == 1, "Expected no trigger below the stop price");
+        auto trades = engine.place_market_order(symbol, 6, OrderSide::Buy, 50);
+        assert_with_message(trades.size() == 3 && trades[1].order_id_buy == 10 && trades[2].price == px(11.0),
+                            "Expected the triggered stop to sweep on from the trigger");
+        assert_with_message(book->stop_count(OrderSide::Buy) == 0 && book->top_of_book().ask.quantity == 50,
+                            "Expected the stop to be gone once released");
+
+        // Pending stops can be cancelled, not modified
+        assert_with_message(engine.modify_order(11, 10, 9.4) == ModifyResult::NotFound,
+                            "Expected a pending stop not to be amended");
+        assert_with_message(engine.cancel_order(11) && !engine.cancel_order(11) && book->stop_count(OrderSide::Sell) == 0,
+                            "Expected a pending stop to cancel once");
+
+        // Stops triggered by released stops follow in the same event
+        engine.place_limit_order(symbol, 7, OrderSide::Buy, 100, 9.0);
+        engine.place_stop_limit_order(symbol, 12, OrderSide::Sell, 50, 9.5, 9.0);
+        engine.place_stop_order(symbol, 13, OrderSide::Sell, 10, 9.0);
+        trades = engine.place_market_order(symbol, 14, OrderSide::Sell, 100);
+        assert_with_message(trades.size() == 3 && trades[1].order_id_sell == 12 && trades[2].order_id_sell == 13 &&
+                            book->top_of_book().bid.quantity == 40, "Expected the stops to cascade in trigger order");
+
+        // A stop the last trade has already reached triggers on entry
+        assert_with_message(engine.place_stop_order(symbol, 15, OrderSide::Buy, 10, 8.0) == OrderStatus::Filled,
+                            "Expected an immediate trigger");
+
+        // A triggered stop-limit that does not cross rests at its limit
+        engine.place_stop_limit_order(symbol, 16, OrderSide::Buy, 20, 11.0, 10.8);
+        engine.place_market_order(symbol, 17, OrderSide::Buy, 10);
+        assert_with_message(book->top_of_book().bid.price == px(10.8) && book->top_of_book().bid.quantity == 20,
+                            "Expected the stop-limit to rest once triggered");
+
+        // Mass cancels take pending stops too, and journals keep triggers
+        engine.place_stop_order(symbol, 18, OrderSide::Sell, 10, 5.0);
+        assert_with_message(engine.mass_cancel(symbol, OrderSide::Sell) == 2 && book->stop_count(OrderSide::Sell) == 0,
+                            "Expected mass cancel to include pending stops");
+        Command stop = Command::stop_limit(symbol, 19, OrderSide::Buy, 10, px(12.5), px(12.6));
+        Command replayed = JournalRecord::from_command(stop, 1).to_command();
+        assert_with_message(replayed.type == CommandType::NewStop && replayed.trigger == px(12.5) &&
+                            replayed.price == px(12.6), "Expected stop commands to journal their trigger");
+
+        // The risk stage holds a pending stop as open until it triggers and trades
+        MatchingEngine risked;
+        SymbolId risked_symbol = risked.add_order_book("TEST");
+        auto risk = std::make_shared<PreTradeRisk<>>();
+        risked.set_risk_check(risk);
+        BatchResponse response;
+        Command flow[] = {Command::limit(risked_symbol, 1, OrderSide::Sell, 100, px(10.0)),
+                          Command::stop(risked_symbol, 2, OrderSide::Buy, 30, px(10.0), 1)};
+        risked.execute_commands(flow, response);
+        assert_with_message(risk->open_quantity(1, risked_symbol, OrderSide::Buy) == 30 &&
+                            risk->open_notional(1, OrderSide::Buy) == px(10.0).ticks * 30,
+                            "Expected the pending stop to count as open");
+        Command trigger = Command::market(risked_symbol, 3, OrderSide::Buy, 10, TimeInForce::ImmediateOrCancel, 1);
+        risked.execute_commands({&trigger, 1}, response);
+        assert_with_message(risk->open_quantity(1, risked_symbol, OrderSide::Buy) == 0 &&
+                            risk->open_notional(1, OrderSide::Buy) == 0 && risk->position(1, risked_symbol) == 40,
+                            "Expected the triggered stop to move from open to filled");
+    });
+
+    // Test 36: An auction collects a crossed book and uncrosses it at one price
+    tests.add_test("Auction Uncross", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        auto book = engine.get_order_book(symbol);
+        assert_with_message(engine.begin_auction(symbol) && book->in_auction(), "Expected the auction to open");
+
+        std::vector<Trade> trades;
+        for (auto [id, side, size, price] : std::vector<std::tuple<OrderId, OrderSide, uint64_t, double>>{
+                 {1, OrderSide::Buy, 100, 10.2}, {2, OrderSide::Buy, 200, 10.0}, {3, OrderSide::Buy, 100, 9.9},
+                 {4, OrderSide::Sell, 150, 9.9}, {5, OrderSide::Sell, 100, 10.0}, {6, OrderSide::Sell, 100, 10.3}}) {
+            auto placed = engine.place_limit_order(symbol, id, side, size, price);
+            trades.insert(trades.end(), placed.begin(), placed.end());
+        }
+        assert_with_message(trades.empty() && book->best_bid_price() > book->best_ask_price(),
+                            "Expected orders to accumulate in a crossed book");
+        assert_with_message(engine.place_market_order(symbol, 7, OrderSide::Buy, 10).empty() &&
+                            book->order_pool().in_use() == 6, "Expected market orders to be refused during the auction");
+
+        // Most volume trades at 10.00: 300 bid at or above it, 250 offered at or below it
+        AuctionResult indicative = book->indicative_uncross();
+        assert_with_message(indicative.price == px(10.0) && indicative.volume == 250 && indicative.imbalance == 50,
+                            "Expected the equilibrium from the volume curves");
+
+        AuctionResult result = engine.uncross(symbol);
+        assert_with_message(result.price == indicative.price && result.volume == 250 && result.trades == 3,
+                            "Expected the uncross to trade the equilibrium volume");
+        TopOfBook top = book->top_of_book();
+        assert_with_message(!book->in_auction() && top.bid.price == px(10.0) && top.bid.quantity == 50 &&
+                            top.ask.price == px(10.3), "Expected an uncrossed book with the surplus left on the bid");
+        assert_with_message(book->last_trade_price() == px(10.0) && book->indicative_uncross().volume == 0,
+                            "Expected the book to be uncrossed");
+
+        // Continuous matching resumes
+        assert_with_message(engine.place_limit_order(symbol, 8, OrderSide::Sell, 50, 10.0).size() == 1,
+                            "Expected orders to match again after the uncross");
+        assert_with_message(engine.uncross(symbol).volume == 0, "Expected no uncross outside an auction");
+    });
+
+    // Test 37: Engine threads idle as configured, wake on submit and account for their time
+    tests.add_test("Worker Runtime", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        assert_with_message(engine.set_worker_config({-1, IdleStrategy::Park, 16}), "Expected the config to apply");
+        engine.start();
+        assert_with_message(!engine.set_worker_config({}), "Expected the config to be fixed while running");
+
+        for (int i = 0; i < 1000 && engine.worker_stats().parks == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert_with_message(engine.worker_stats().parks > 0, "Expected the idle engine thread to park");
+
+        // A submit wakes the parked thread, and stop() wakes it to exit
+        engine.submit(Command::limit(symbol, 1, OrderSide::Buy, 10, px(10.0)));
+        engine.submit(Command::limit(symbol, 2, OrderSide::Sell, 10, px(10.0)));
+        engine.drain();
+        assert_with_message(engine.get_order_book(symbol)->order_pool().in_use() == 0, "Expected the orders to match");
+        engine.stop();
+        WorkerStats stats = engine.worker_stats();
+        assert_with_message(stats.batches >= 1 && stats.idle_ns > 0 && stats.utilization() < 1.0,
+                            "Expected busy and idle time to be accounted");
+
+        // Shards take their own placement; unlisted shards get the defaults
+        ShardRuntimeConfig runtime;
+        runtime.workers = {{0, IdleStrategy::BusySpin}, {-1, IdleStrategy::Park, 0}};
+        runtime.numa_local = true;
+        ShardedMatchingEngine sharded(3, runtime, 64, 64);
+        assert_with_message(sharded.worker_config(0).cpu == 0 && sharded.worker_config(1).idle == IdleStrategy::Park &&
+                            sharded.worker_config(2).idle == IdleStrategy::SpinYield,
+                            "Expected per-shard worker configs");
+
+        std::atomic<int> trade_count{0};
+        sharded.register_trade_callback([&](const Trade&) { trade_count.fetch_add(1); });
+        std::vector<SymbolId> symbols = {sharded.add_order_book("A"), sharded.add_order_book("B"),
+                                         sharded.add_order_book("C")};
+        sharded.start();
+        OrderId id = 1;
+        for (SymbolId s : symbols) {
+            sharded.submit_limit_order(s, id++, OrderSide::Buy, 10, 10.0);
+            sharded.submit_limit_order(s, id++, OrderSide::Sell, 10, 10.0);
+        }
+        sharded.drain();
+        sharded.stop();
+        assert_with_message(trade_count.load() == 3, "Expected a trade on every shard");
+        for (size_t i = 0; i < sharded.shard_count(); ++i) {
+            assert_with_message(sharded.worker_stats(i).batches >= 1, "Expected every shard thread to do work");
+        }
+    });
+
+#ifdef __linux__
+    // Test 38: Binary orders over TCP come back as acks and fills, trades go out as UDP market data
+    tests.add_test("Binary Gateway", [&]() {
+        // Messages decode in place; a partial one waits for the next read
+        std::vector<std::byte> bytes;
+        wire::Encoder encoder(bytes);
+        encoder.new_order(3, 42, OrderSide::Sell, wire::WireOrderType::Limit, 500, px(10.25),
+                          TimeInForce::ImmediateOrCancel, 7);
+        encoder.cancel(3, 42);
+        Command command{};
+        size_t decoded_count = 0;
+        wire::DecodeResult decoded = wire::decode(std::span<const std::byte>(bytes.data(), bytes.size() - 1),
+                                                  [&](const wire::MessageView& message) {
+                                                      ++decoded_count;
+                                                      wire::NewOrderView(message.data()).to_command(99, command);
+                                                  });
+        assert_with_message(decoded.consumed == wire::kNewOrderSize && !decoded.malformed && decoded_count == 1,
+                            "Expected only the complete message to decode");
+        assert_with_message(command.order_id == 99 && command.symbol == 3 && command.side == OrderSide::Sell &&
+                            command.size == 500 && command.price == px(10.25) &&
+                            command.tif == TimeInForce::ImmediateOrCancel && command.account == 7,
+                            "Expected the command to carry the wire fields");
+
+        auto set_timeout = [](int fd) {
+            timeval timeout{5, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        };
+        auto loopback = [](uint16_t port) {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            return address;
+        };
+
+        // Market data goes to a local UDP socket
+        int market_data = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in md_address = loopback(0);
+        socklen_t md_length = sizeof(md_address);
+        bind(market_data, reinterpret_cast<sockaddr*>(&md_address), sizeof(md_address));
+        getsockname(market_data, reinterpret_cast<sockaddr*>(&md_address), &md_length);
+        set_timeout(market_data);
+
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        GatewayConfig config;
+        config.bind_address = "127.0.0.1";
+        config.market_data_address = "127.0.0.1";
+        config.market_data_port = ntohs(md_address.sin_port);
+        Gateway gateway(engine, config);
+        assert_with_message(gateway.open() && gateway.port() != 0, "Expected the gateway to listen");
+        gateway.start();
+
+        auto connect_client = [&]() {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address = loopback(gateway.port());
+            connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+            set_timeout(fd);
+            return fd;
+        };
+        auto send_range = [](int fd, const std::vector<std::byte>& data, size_t from, size_t to) {
+            send(fd, data.data() + from, to - from, MSG_NOSIGNAL);
+        };
+        // Read exactly `size` bytes of replies and split them into acks and fills
+        struct Replies {
+            std::vector<std::byte> data;
+            std::vector<wire::AckView> acks;
+            std::vector<wire::FillView> fills;
+        };
+        auto read_replies = [](int fd, size_t size, Replies& replies) {
+            replies.data.assign(size, std::byte{0});
+            size_t got = 0;
+            while (got < size) {
+                ssize_t n = recv(fd, replies.data.data() + got, size - got, 0);
+                if (n <= 0) {
+                    break;
+                }
+                got += static_cast<size_t>(n);
+            }
+            replies.data.resize(got);
+            wire::decode(replies.data, [&](const wire::MessageView& message) {
+                if (message.type() == wire::MessageType::Ack) {
+                    replies.acks.emplace_back(message.data());
+                } else if (message.type() == wire::MessageType::Fill) {
+                    replies.fills.emplace_back(message.data());
+                }
+            });
+        };
+
+        int buyer = connect_client();
+        int seller = connect_client();
+        bytes.clear();
+        encoder.new_order(symbol, 1, OrderSide::Buy, wire::WireOrderType::Limit, 100, px(10.0));
+        send_range(buyer, bytes, 0, bytes.size());
+        Replies buyer_replies;
+        read_replies(buyer, wire::kAckSize, buyer_replies);
+        assert_with_message(buyer_replies.acks.size() == 1 && buyer_replies.acks[0].status() == OrderStatus::New &&
+                            buyer_replies.acks[0].request() == wire::MessageType::NewOrder &&
+                            buyer_replies.acks[0].client_order_id() == 1, "Expected the buy order to be acked");
+
+        // The same client order ID from another session is a different order;
+        // the read is split mid-message
+        bytes.clear();
+        encoder.new_order(symbol, 1, OrderSide::Sell, wire::WireOrderType::Limit, 60, px(10.0));
+        encoder.cancel(symbol, 77);
+        send_range(seller, bytes, 0, 20);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        send_range(seller, bytes, 20, bytes.size());
+        Replies seller_replies;
+        read_replies(seller, 2 * wire::kAckSize + wire::kFillSize, seller_replies);
+        assert_with_message(seller_replies.acks.size() == 2 && seller_replies.fills.size() == 1,
+                            "Expected two acks and a fill for the seller");
+        assert_with_message(seller_replies.acks[0].status() == OrderStatus::Filled &&
+                            seller_replies.acks[0].filled_size() == 60 &&
+                            seller_replies.acks[1].status() == OrderStatus::Rejected,
+                            "Expected the sell filled and the unknown cancel rejected");
+        assert_with_message(seller_replies.fills[0].client_order_id() == 1 && seller_replies.fills[0].size() == 60 &&
+                            seller_replies.fills[0].price() == px(10.0), "Expected the seller's fill");
+
+        Replies buyer_fill;
+        read_replies(buyer, wire::kFillSize, buyer_fill);
+        assert_with_message(buyer_fill.fills.size() == 1 && buyer_fill.fills[0].size() == 60,
+                            "Expected the resting buyer to hear of its fill");
+
+        // The print and the new top of book share a datagram
+        std::vector<std::byte> packet(2048);
+        ssize_t packet_size = recv(market_data, packet.data(), packet.size(), 0);
+        assert_with_message(packet_size > static_cast<ssize_t>(wire::kPacketHeaderSize) &&
+                            wire::load<uint64_t>(packet.data()) == 1 && wire::load<uint16_t>(packet.data() + 8) == 2,
+                            "Expected one packet with two messages");
+        wire::TradePrintView print(packet.data() + wire::kPacketHeaderSize);
+        wire::QuoteView quote(packet.data() + wire::kPacketHeaderSize + wire::kTradePrintSize);
+        assert_with_message(print.type() == wire::MessageType::TradePrint && print.size() == 60 &&
+                            quote.type() == wire::MessageType::Quote && quote.bid_price() == px(10.0) &&
+                            quote.bid_size() == 40 && quote.ask_size() == 0, "Expected the print and the quote");
+
+        // IDs beyond kClientIdBits are refused at the gateway
+        bytes.clear();
+        encoder.cancel(symbol, 1);
+        encoder.new_order(symbol, uint64_t{1} << 41, OrderSide::Buy, wire::WireOrderType::Limit, 10, px(9.0));
+        send_range(buyer, bytes, 0, bytes.size());
+        Replies last;
+        read_replies(buyer, 2 * wire::kAckSize, last);
+        assert_with_message(last.acks.size() == 2 && last.acks[0].status() == OrderStatus::Cancelled &&
+                            last.acks[1].status() == OrderStatus::Rejected, "Expected the cancel and the refusal");
+
+        // A closed session's resting orders and pending stops are cancelled
+        bytes.clear();
+        encoder.new_order(symbol, 2, OrderSide::Sell, wire::WireOrderType::Limit, 30, px(11.0));
+        encoder.new_order(symbol, 3, OrderSide::Buy, wire::WireOrderType::Stop, 5, Price{},
+                          TimeInForce::ImmediateOrCancel, 0, px(12.0));
+        send_range(seller, bytes, 0, bytes.size());
+        Replies open_replies;
+        read_replies(seller, 2 * wire::kAckSize, open_replies);
+        assert_with_message(open_replies.acks.size() == 2 && open_replies.acks[0].status() == OrderStatus::New &&
+                            open_replies.acks[1].status() == OrderStatus::Pending, "Expected an order and a stop open");
+        close(seller);
+        for (int i = 0; i < 500 && engine.memory_stats().orders > 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        assert_with_message(engine.memory_stats().orders == 0, "Expected the seller's orders cancelled on disconnect");
+
+        gateway.stop();
+        close(buyer);
+        close(market_data);
+        GatewayStats stats = gateway.stats();
+        assert_with_message(stats.sessions == 2 && stats.messages == 7 && stats.rejected == 1 &&
+                            stats.responses == 9 && stats.market_data_packets >= 1 && stats.wire_to_wire.count >= 4 &&
+                            stats.disconnect_cancels == 2, "Expected the gateway counters");
+        assert_with_message(engine.get_order_book(symbol)->order_pool().in_use() == 0, "Expected an empty book");
+    });
+#endif
+
+    // Test 39: A mapped capture replays into the engine with its executions verified
+    tests.add_test("Capture Replay", [&]() {
+        std::string path = (std::filesystem::temp_directory_path() / "finstack_capture_test.cap").string();
+        MatchingEngine recorder;
+        SymbolId symbol = recorder.add_order_book("AAPL");
+        std::vector<Command> flow = {
+            Command::limit(symbol, 1, OrderSide::Sell, 100, px(10.0)),
+            Command::limit(symbol, 2, OrderSide::Sell, 50, px(10.1)),
+            Command::limit(symbol, 3, OrderSide::Buy, 80, px(9.9)),
+            Command::modify(symbol, 3, 60, px(9.8)),
+            Command::market(symbol, 4, OrderSide::Buy, 120),
+            Command::cancel(symbol, 2),
+            Command::limit(symbol, 5, OrderSide::Sell, 70, px(9.8), TimeInForce::ImmediateOrCancel),
+        };
+
+        // Record the flow with the trades each message produced, and a
+        // second copy whose last execution is wrong
+        std::string bad_path = path + ".bad";
+        capture::CaptureWriter writer;
+        capture::CaptureWriter bad;
+        assert_with_message(writer.open(path) && bad.open(bad_path), "Expected the captures to open");
+        assert_with_message(writer.directory(symbol, "AAPL") && bad.directory(symbol, "AAPL"),
+                            "Expected the directory entries");
+        assert_with_message(!writer.directory(1, "A_SYMBOL_NAME_TOO_LONG"), "Expected a long name to be refused");
+        BatchResponse response;
+        uint64_t timestamp = 1000;
+        size_t expected_trades = 0;
+        for (const Command& command : flow) {
+            assert_with_message(writer.command(command, timestamp) && bad.command(command, timestamp),
+                                "Expected a capture message for every command");
+            recorder.execute_commands(std::span<const Command>(&command, 1), response);
+            for (Trade trade : response.trades) {
+                writer.execution(trade, timestamp);
+                if (++expected_trades == 3) {
+                    trade.size += 1;
+                }
+                bad.execution(trade, timestamp);
+            }
+            timestamp += 100;
+        }
+        assert_with_message(!writer.command(Command::mass_cancel(symbol, OrderSide::Buy), timestamp),
+                            "Expected no capture message for a mass cancel");
+        assert_with_message(expected_trades == 3, "Expected two sweep fills and one IOC fill");
+        assert_with_message(writer.close() && bad.close(), "Expected the captures to be written");
+
+        auto replay = [&](const std::string& file_path, capture::VerifyStats& stats, size_t& messages) {
+            capture::CaptureFile file;
+            assert_with_message(file.open(file_path, true), "Expected the capture to open");
+            MatchingEngine engine;
+            capture::TradeVerifier verifier;
+            BatchResponse batch;
+            messages = 0;
+            const std::byte* base = file.messages().data();
+            capture::DecodeResult decoded = capture::decode(file.messages(), [&](const capture::MessageView& message) {
+                Command command;
+                switch (message.type()) {
+                case capture::MessageType::Directory:
+                    engine.add_order_book(capture::DirectoryView(message.data()).name());
+                    return;
+                case capture::MessageType::AddOrder:
+                    assert_with_message(capture::AddOrderView(message.data()).to_command(command),
+                                        "Expected a known order type");
+                    break;
+                case capture::MessageType::Delete:
+                    command = Command::cancel(message.symbol(), capture::DeleteView(message.data()).order_id());
+                    break;
+                case capture::MessageType::Replace: {
+                    capture::ReplaceView replace(message.data());
+                    command = Command::modify(message.symbol(), replace.order_id(), replace.size(), replace.price());
+                    break;
+                }
+                case capture::MessageType::Execution:
+                    verifier.expect(capture::ExecutionView(message.data()));
+                    return;
+                }
+                ++messages;
+                verifier.begin(static_cast<uint64_t>(message.data() - base));
+                engine.execute_commands(std::span<const Command>(&command, 1), batch);
+                for (const Trade& trade : batch.trades) {
+                    verifier.observe(trade);
+                }
+            });
+            assert_with_message(!decoded.malformed && decoded.consumed == file.messages().size(),
+                                "Expected the whole capture to decode");
+            stats = verifier.finish();
+        };
+
+        capture::VerifyStats stats;
+        size_t messages = 0;
+        replay(path, stats, messages);
+        assert_with_message(messages == flow.size(), "Expected every order message applied");
+        assert_with_message(stats.expected == 3 && stats.observed == 3 && stats.mismatches == 0,
+                            "Expected the replayed trades to match the capture");
+
+        replay(bad_path, stats, messages);
+        assert_with_message(stats.mismatches == 1, "Expected the altered execution to be caught");
+
+        // A capture's header is checked, and a truncated tail is reported
+        std::vector<char> bytes;
+        {
+            std::ifstream in(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        {
+            std::ofstream out(bad_path, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 5));
+        }
+        capture::CaptureFile truncated;
+        assert_with_message(truncated.open(bad_path), "Expected the truncated capture to open");
+        assert_with_message(capture::decode(truncated.messages(), [](const capture::MessageView&) {}).malformed,
+                            "Expected the cut-off message to be reported");
+        bytes[0] = 'X';
+        {
+            std::ofstream out(bad_path, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        }
+        capture::CaptureFile foreign;
+        assert_with_message(!foreign.open(bad_path), "Expected a file without the magic to be refused");
+        std::filesystem::remove(path);
+        std::filesystem::remove(bad_path);
+    });
+
+    // Test 40: Memory stats track a book's footprint, and compaction gives back what a drained ladder and index held
+    tests.add_test("Memory Compaction", [&]() {
+        MatchingEngine engine;
+        SymbolId symbol = engine.add_order_book("TEST");
+        for (OrderId id = 1; id <= 51; ++id) {
+            engine.place_limit_order(symbol, id, OrderSide::Buy, 10, 9.0 + static_cast<double>(id));
+        }
+        BookMemoryStats grown = engine.memory_stats(symbol);
+        assert_with_message(grown.orders == 51 && grown.levels == 51 && grown.allocated_levels > 5000,
+                            "Expected the bid ladder to grow over the spread of prices");
+        assert_with_message(grown.shared_index && grown.index_entries == 51 && grown.pool_capacity >= 51 &&
+                            grown.pool_utilization > 0.0 && grown.pool_utilization <= 1.0,
+                            "Expected the pool and shared index figures");
+        assert_with_message(grown.total_bytes == grown.pool_bytes + grown.ladder_bytes + grown.other_bytes,
+                            "Expected a shared index to be left out of the book's total");
+        assert_with_message(engine.memory_stats(kInvalidSymbolId).total_bytes == 0, "Expected nothing for an unknown book");
+
+        for (OrderId id = 2; id <= 51; ++id) {
+            engine.cancel_order(id);
+        }
+        assert_with_message(engine.get_order_book(symbol)->needs_compaction(), "Expected the drained ladder to be oversized");
+        assert_with_message(engine.compact(64) == 0, "Expected a re-centre bigger than the budget to wait");
+        while (engine.compact() > 0) {
+        }
+        BookMemoryStats compacted = engine.memory_stats(symbol);
+        assert_with_message(compacted.orders == 1 && compacted.levels == 1 &&
+                            compacted.allocated_levels < grown.allocated_levels / 8 &&
+                            compacted.ladder_bytes < grown.ladder_bytes, "Expected the bid ladder to shrink");
+        assert_with_message(engine.get_order_book(symbol)->top_of_book().bid.price == px(10.0) &&
+                            engine.place_limit_order(symbol, 100, OrderSide::Sell, 10, 10.0).size() == 1,
+                            "Expected the surviving bid to rest and match as before");
+        EngineMemoryStats totals = engine.memory_stats();
+        assert_with_message(totals.books == 1 && totals.total_bytes == totals.book_bytes + totals.index_bytes,
+                            "Expected engine totals over the books and the shared index");
+
+        // The index migrates to a smaller table a slice at a time, staying
+        // usable in between, and duplicate IDs keep their age order
+        std::vector<Order> orders;
+        orders.reserve(4001);
+        for (uint64_t i = 0; i < 4000; ++i) {
+            orders.emplace_back(i % 1000, OrderSide::Buy, 0, 10, px(10.0), i);
+        }
+        OrderIndex index;
+        for (Order& order : orders) {
+            index.insert(&order);
+        }
+        size_t grown_capacity = index.capacity();
+        for (size_t i = 0; i < orders.size(); ++i) {
+            bool keep = (i < 1000 && i % 10 == 0) || (i >= 1000 && i < 2000 && i % 50 == 0);
+            if (!keep) {
+                index.erase(&orders[i]);
+            }
+        }
+        assert_with_message(index.size() == 120 && index.needs_compaction(), "Expected a mostly empty index");
+        assert_with_message(index.compact(64) > 0 && index.migrating(), "Expected a migration under way");
+
+        orders.emplace_back(50, OrderSide::Buy, 0, 10, px(10.0), 4000);
+        index.insert(&orders.back());
+        index.erase(&orders[100]);
+        for (uint64_t id = 0; id < 1000; id += 10) {
+            size_t slot = index.find(id);
+            Order* expected = id == 100 ? &orders[1100] : &orders[id];
+            assert_with_message(slot != OrderIndex::npos && index.at(slot).order == expected,
+                                "Expected the oldest order of every ID mid-migration");
+        }
+        while (index.compact(64) > 0) {
+        }
+        assert_with_message(!index.migrating() && index.size() == 120 && index.capacity() * 4 <= grown_capacity,
+                            "Expected the migration to finish in a smaller table");
+        for (Order* expected : {&orders[50], &orders[1050], &orders.back()}) {
+            size_t slot = index.find(50);
+            assert_with_message(slot != OrderIndex::npos && index.at(slot).order == expected,
+                                "Expected duplicates in insertion order after the migration");
+            index.erase_at(slot);
+        }
+
+        // An idle engine thread compacts without being asked
+        MatchingEngine worker;
+        SymbolId idle_symbol = worker.add_order_book("IDLE");
+        WorkerConfig config{-1, IdleStrategy::Park, 16};
+        config.compaction_slice = 4096;
+        assert_with_message(worker.set_worker_config(config), "Expected the config to apply");
+        worker.start();
+        for (OrderId id = 1; id <= 51; ++id) {
+            worker.submit(Command::limit(idle_symbol, id, OrderSide::Sell, 10, px(9.0 + static_cast<double>(id))));
+        }
+        for (OrderId id = 2; id <= 51; ++id) {
+            worker.submit(Command::cancel(idle_symbol, id));
+        }
+        worker.drain();
+        size_t drained_levels = 0;
+        for (int i = 0; i < 1000; ++i) {
+            drained_levels = worker.memory_stats(idle_symbol).allocated_levels;
+            if (drained_levels < grown.allocated_levels / 8) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        worker.stop();
+        assert_with_message(drained_levels < grown.allocated_levels / 8 && worker.memory_stats(idle_symbol).orders == 1,
+                            "Expected the idle engine thread to shrink the drained ladder");
+    });
+
     // Run all tests
     tests.run_all();
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "price.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace trading {
+
+// Outcome of an auction uncross, or of the indicative one that would run now
+struct AuctionResult {
+    Price price;        // Equilibrium price (meaningless when volume is 0)
+    uint64_t volume;    // Quantity trading at price
+    int64_t imbalance;  // Buy interest at price minus sell interest at price
+    uint64_t trades;    // Trades printed (always 0 for an indicative result)
+};
+
+// Equilibrium price over the per-tick quantities of the crossed range: bids[i]
+// and asks[i] rest at low + i. Picks the price that trades the most volume,
+// then the one leaving the smallest imbalance, then the one nearest
+// reference. The spans are turned into the cumulative demand and supply
+// curves in place: three linear passes over contiguous arrays, however many
+// orders the levels hold.
+inline AuctionResult find_equilibrium(Price low, std::span<uint64_t> bids, std::span<uint64_t> asks, Price reference) {
+    AuctionResult best{low, 0, 0, 0};
+    size_t count = std::min(bids.size(), asks.size());
+    if (count == 0) {
+        return best;
+    }
+
+    // Buy interest at or above each price, sell interest at or below it
+    for (size_t i = count - 1; i-- > 0;) {
+        bids[i] += bids[i + 1];
+    }
+    for (size_t i = 1; i < count; ++i) {
+        asks[i] += asks[i - 1];
+    }
+
+    uint64_t best_gap = 0;
+    uint64_t best_distance = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t volume = std::min(bids[i], asks[i]);
+        uint64_t gap = std::max(bids[i], asks[i]) - volume;
+        int64_t ticks = low.ticks + static_cast<int64_t>(i);
+        uint64_t distance = ticks > reference.ticks ? static_cast<uint64_t>(ticks - reference.ticks)
+                                                    : static_cast<uint64_t>(reference.ticks - ticks);
+        bool better = volume > best.volume ||
+                      (volume == best.volume && (gap < best_gap || (gap == best_gap && distance < best_distance)));
+        if (i == 0 || better) {
+            best.price = Price(ticks);
+            best.volume = volume;
+            best.imbalance = static_cast<int64_t>(bids[i]) - static_cast<int64_t>(asks[i]);
+            best_gap = gap;
+            best_distance = distance;
+        }
+    }
+    if (best.volume == 0) {
+        best.imbalance = 0;
+    }
+    return best;
+}
+
+} // namespace trading
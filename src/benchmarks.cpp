@@ -1,219 +1,423 @@
 #include "order_book.hpp"
 #include "matching_engine.hpp"
+#include "latency_histogram.hpp"
+#include "tool_support.hpp"
+#include "tsc.hpp"
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <chrono>
 #include <random>
 #include <iomanip>
 #include <algorithm>
-#include <functional>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 
 using namespace trading;
 
-// Simple benchmarking framework
-class BenchmarkSuite {
+// Count heap allocations so each run can report allocations per operation
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size > 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC flags free() on memory from a replaced operator new once both inline
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+using tools::FlowMix;
+using tools::kMixes;
+
+enum class OpType : uint8_t { Add, Cancel, Aggress };
+
+// One pre-generated operation. Random numbers are drawn before the timed
+// loop so the measurement covers the book, not the generator.
+struct FlowOp {
+    OpType type;
+    OrderSide side;
+    uint32_t pick;      // Selects the live order to cancel
+    uint64_t size;
+    int64_t offset;     // Ticks away from the mid for passive orders
+};
+
+// Deterministic order flow around a fixed mid price. Passive orders rest
+// uniformly over a band of levels on their side and never cross, so every
+// trade comes from an aggress operation.
+class OrderFlow {
 public:
-    using BenchmarkFunc = std::function<void()>;
+    static constexpr int64_t kMidTicks = 10000; // 100.00 in cents
 
-    void add_benchmark(const std::string& name, BenchmarkFunc bench, int iterations = 1000) {
-        benchmarks_.push_back({name, bench, iterations});
+    OrderFlow(const FlowMix& mix, size_t depth, uint64_t seed)
+        : mix_(mix), generator_(seed),
+          levels_(static_cast<int64_t>(std::clamp<size_t>(depth / 20, 8, 4096))) {
     }
 
-    void run_all() {
-        std::cout << "=== Running Benchmarks ===" << std::endl;
-        std::cout << std::left << std::setw(40) << "Benchmark"
-                  << std::setw(15) << "Iterations"
-                  << std::setw(15) << "Time (μs)"
-                  << std::setw(15) << "Avg (μs)" << std::endl;
-        std::cout << std::string(85, '-') << std::endl;
+    // Passive price for a side
+    Price price(OrderSide side, int64_t offset) const {
+        return Price(side == OrderSide::Buy ? kMidTicks - offset : kMidTicks + offset);
+    }
 
-        for (const auto& [name, bench, iterations] : benchmarks_) {
-            // Warmup
-            bench();
+    // Draw a passive order for pre-populating the book
+    FlowOp passive() {
+        return {OpType::Add, random_side(), 0, size_dist_(generator_), offset_dist()};
+    }
 
-            // Timed run
-            auto start = std::chrono::high_resolution_clock::now();
-            for (int i = 0; i < iterations; ++i) {
-                bench();
+    // Draw `count` operations following the mix
+    std::vector<FlowOp> generate(size_t count) {
+        std::vector<FlowOp> ops;
+        ops.reserve(count);
+        std::uniform_int_distribution<unsigned> percent(0, 99);
+        std::uniform_int_distribution<uint32_t> pick;
+        std::uniform_int_distribution<uint64_t> aggress_size(1, 400);
+
+        for (size_t i = 0; i < count; ++i) {
+            unsigned roll = percent(generator_);
+            if (roll < mix_.add) {
+                ops.push_back(passive());
+            } else if (roll < mix_.add + mix_.cancel) {
+                ops.push_back({OpType::Cancel, OrderSide::Buy, pick(generator_), 0, 0});
+            } else {
+                ops.push_back({OpType::Aggress, random_side(), 0, aggress_size(generator_), 0});
             }
-            auto end = std::chrono::high_resolution_clock::now();
+        }
+        return ops;
+    }
+
+private:
+    FlowMix mix_;
+    std::mt19937_64 generator_;
+    int64_t levels_;
+    std::uniform_int_distribution<uint64_t> size_dist_{1, 200};
+
+    OrderSide random_side() { return (generator_() & 1) ? OrderSide::Buy : OrderSide::Sell; }
+    int64_t offset_dist() { return std::uniform_int_distribution<int64_t>(1, levels_)(generator_); }
+};
+
+// Benchmark targets share one interface: add a passive order, cancel by ID,
+// send an aggressive market order, and report how many orders rest.
+// Order IDs double as timestamps so runs are reproducible.
+
+// The order book alone, driven the way the engine drives it
+class BookTarget {
+public:
+    static constexpr const char* kName = "book";
 
-            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-            double avg = static_cast<double>(duration) / iterations;
+    explicit BookTarget(size_t capacity) : book_("BENCH", capacity) {}
 
-            std::cout << std::left << std::setw(40) << name
-                      << std::setw(15) << iterations
-                      << std::setw(15) << duration
-                      << std::setw(15) << std::fixed << std::setprecision(2) << avg << std::endl;
+    void add(OrderId id, OrderSide side, uint64_t size, Price price) {
+        Order* order = book_.create_limit_order(id, side, size, price, id);
+        book_.match_order(*order, [](const Trade&) {});
+        if (order->is_filled() || !book_.add_order(order)) {
+            book_.release_order(order);
         }
     }
 
+    void cancel(OrderId id) { book_.cancel_order(id, id); }
+
+    void aggress(OrderId id, OrderSide side, uint64_t size) {
+        Order* order = book_.create_market_order(id, side, size, id);
+        book_.match_order(*order, [](const Trade&) {});
+        book_.release_order(order);
+    }
+
+    size_t resting() const { return book_.order_pool().in_use(); }
+
 private:
-    std::vector<std::tuple<std::string, BenchmarkFunc, int>> benchmarks_;
+    OrderBook book_;
 };
 
-// Random order generation
-class OrderGenerator {
+// The full engine command path: submit into the inbound queue, then execute
+// it under the engine lock with the trade ring, clock and latency stats
+class EngineTarget {
 public:
-    OrderGenerator(uint64_t seed = 0) : generator_(seed) {}
+    static constexpr const char* kName = "engine";
 
-    std::shared_ptr<Order> generate_limit_order(OrderSide side, const std::string& symbol, uint64_t timestamp) {
-        static uint64_t order_count = 0;
-        std::string order_id = "ORD" + std::to_string(++order_count);
+    explicit EngineTarget(size_t capacity)
+        : engine_(capacity),
+          symbol_(engine_.add_order_book("BENCH")),
+          book_(engine_.get_order_book(symbol_)) {
+    }
 
-        uint64_t size = size_dist_(generator_);
-        double price = 0.0;
+    void add(OrderId id, OrderSide side, uint64_t size, Price price) {
+        engine_.submit(Command::limit(symbol_, id, side, size, price));
+        engine_.process_commands();
+    }
 
-        if (side == OrderSide::Buy) {
-            price = 100.0 + (buy_price_dist_(generator_) / 10.0);
-        } else {
-            price = 100.0 + (sell_price_dist_(generator_) / 10.0);
-        }
+    void cancel(OrderId id) {
+        engine_.submit(Command::cancel(symbol_, id));
+        engine_.process_commands();
+    }
 
-        return std::make_shared<Order>(order_id, side, symbol, size, price, timestamp);
+    void aggress(OrderId id, OrderSide side, uint64_t size) {
+        engine_.submit(Command::market(symbol_, id, side, size));
+        engine_.process_commands();
     }
 
-    std::shared_ptr<Order> generate_market_order(OrderSide side, const std::string& symbol, uint64_t timestamp) {
-        static uint64_t order_count = 0;
-        std::string order_id = "MKT" + std::to_string(++order_count);
-        uint64_t size = size_dist_(generator_);
+    size_t resting() const { return book_->order_pool().in_use(); }
+
+protected:
+    MatchingEngine engine_;
+    SymbolId symbol_;
+    std::shared_ptr<OrderBook> book_;
+};
+
+// The same path with every pre-trade risk check enabled and no limit ever
+// hit, to measure what the checks cost
+class RiskEngineTarget : public EngineTarget {
+public:
+    static constexpr const char* kName = "engine-risk";
 
-        return std::make_shared<Order>(order_id, side, symbol, size, timestamp);
+    explicit RiskEngineTarget(size_t capacity) : EngineTarget(capacity) {
+        RiskConfig config;
+        config.price_band_bps = 10000;
+        engine_.set_risk_check(std::make_shared<PreTradeRisk<>>(config));
     }
+};
 
-private:
-    std::mt19937_64 generator_;
-    std::uniform_int_distribution<uint64_t> size_dist_{10, 1000};
-    std::uniform_int_distribution<int> buy_price_dist_{950, 1050};  // 95.0 - 105.0
-    std::uniform_int_distribution<int> sell_price_dist_{950, 1050}; // 95.0 - 105.0
+struct BenchmarkResult {
+    std::string target;
+    std::string mix;
+    size_t depth;
+    size_t ops;
+    double seconds;
+    double ops_per_sec;
+    double allocs_per_op;
+    LatencySummary all;
+    LatencySummary add;
+    LatencySummary cancel;
+    LatencySummary aggress;
 };
 
-// Get current timestamp in nanoseconds
-uint64_t get_timestamp() {
-    return std::chrono::duration_cast<std::chrono::nanoseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch()
-    ).count();
-}
+// Pre-populate a book with `depth` resting orders, run a warm-up, then time
+// `ops` operations in steady state. The flow keeps the resting count within
+// 10% of depth by turning an add into a cancel (or the reverse) at the edges.
+template <typename Target>
+BenchmarkResult run_flow(const FlowMix& mix, size_t depth, size_t ops, uint64_t seed) {
+    size_t warmup = std::max<size_t>(ops / 4, 1000);
+    size_t capacity = depth + depth / 4 + 1024;
+
+    Target target(capacity);
+    OrderFlow flow(mix, depth, seed);
+    std::vector<FlowOp> passive;
+    passive.reserve(depth);
+    for (size_t i = 0; i < depth; ++i) {
+        passive.push_back(flow.passive());
+    }
+    std::vector<FlowOp> stream = flow.generate(warmup + ops);
 
-int main() {
-    BenchmarkSuite benchmarks;
-    OrderGenerator generator(42); // Fixed seed for reproducibility
-
-    // Benchmark 1: Order book creation
-    benchmarks.add_benchmark("Order Book Creation", []() {
-        OrderBook book("TEST");
-    }, 10000);
-
-    // Benchmark 2: Adding limit orders
-    benchmarks.add_benchmark("Adding Limit Orders", [&]() {
-        OrderBook book("TEST");
-        uint64_t timestamp = get_timestamp();
-
-        for (int i = 0; i < 100; ++i) {
-            auto order = generator.generate_limit_order(
-                i % 2 == 0 ? OrderSide::Buy : OrderSide::Sell,
-                "TEST", timestamp + i
-            );
-            book.add_order(order);
-        }
-    }, 100);
+    // IDs of orders added and not yet cancelled; some may have been filled
+    // already, in which case their cancel simply misses
+    std::vector<OrderId> live;
+    live.reserve(depth + warmup + ops);
+    OrderId next_id = 1;
 
-    // Benchmark 3: Order matching
-    benchmarks.add_benchmark("Order Matching", [&]() {
-        OrderBook book("TEST");
-        uint64_t timestamp = get_timestamp();
+    for (const FlowOp& op : passive) {
+        target.add(next_id, op.side, op.size, flow.price(op.side, op.offset));
+        live.push_back(next_id++);
+    }
 
-        // Add 100 buy orders
-        for (int i = 0; i < 100; ++i) {
-            auto order = generator.generate_limit_order(OrderSide::Buy, "TEST", timestamp + i);
-            book.add_order(order);
+    LatencyHistogram histograms[3];
+    LatencyHistogram all;
+    size_t low = depth - depth / 10;
+    size_t high = depth + depth / 10;
+
+    auto execute = [&](const FlowOp& op) {
+        OpType type = op.type;
+        size_t resting = target.resting();
+        if (resting < low && type == OpType::Cancel) {
+            type = OpType::Add;
+        } else if (resting > high && type == OpType::Add) {
+            type = OpType::Cancel;
         }
 
-        // Add 100 sell orders and measure matching
-        std::vector<Trade> all_trades;
-        for (int i = 0; i < 100; ++i) {
-            auto order = generator.generate_limit_order(OrderSide::Sell, "TEST", timestamp + 100 + i);
-            auto trades = book.match_order(order);
-            all_trades.insert(all_trades.end(), trades.begin(), trades.end());
-            if (!trades.empty()) {
-                book.add_order(order);
+        uint64_t start = read_tsc();
+        switch (type) {
+        case OpType::Add: {
+            int64_t offset = op.offset > 0 ? op.offset : 1;
+            target.add(next_id, op.side, op.size > 0 ? op.size : 100, flow.price(op.side, offset));
+            break;
+        }
+        case OpType::Cancel:
+            if (!live.empty()) {
+                size_t slot = op.pick % live.size();
+                target.cancel(live[slot]);
+                live[slot] = live.back();
+                live.pop_back();
             }
+            break;
+        case OpType::Aggress:
+            target.aggress(next_id, op.side, op.size);
+            break;
         }
-    }, 10);
+        uint64_t elapsed = read_tsc() - start;
 
-    // Benchmark 4: Matching engine with multiple order books
-    benchmarks.add_benchmark("Matching Engine Multiple Books", [&]() {
-        MatchingEngine engine;
-        const std::vector<std::string> symbols = {"AAPL", "MSFT", "GOOGL", "AMZN", "FB"};
-
-        // Create order books
-        for (const auto& symbol : symbols) {
-            engine.add_order_book(symbol);
+        if (type == OpType::Add) {
+            live.push_back(next_id);
         }
+        ++next_id;
+        return std::pair<OpType, uint64_t>(type, elapsed);
+    };
 
-        for (int i = 0; i < 100; ++i) {
-            const std::string& symbol = symbols[i % symbols.size()];
-            OrderSide side = i % 2 == 0 ? OrderSide::Buy : OrderSide::Sell;
-
-            engine.place_limit_order(
-                symbol,
-                "ORD" + std::to_string(i),
-                side,
-                100 + (i % 900),
-                100.0 + (i % 10)
-            );
-        }
-    }, 10);
-
-    // Benchmark 5: Cancel orders
-    benchmarks.add_benchmark("Order Cancellation", [&]() {
-        OrderBook book("TEST");
-        std::vector<std::string> order_ids;
-        uint64_t timestamp = get_timestamp();
-
-        // Add orders
-        for (int i = 0; i < 100; ++i) {
-            auto order = generator.generate_limit_order(
-                i % 2 == 0 ? OrderSide::Buy : OrderSide::Sell,
-                "TEST", timestamp + i
-            );
-            order_ids.push_back(order->order_id);
-            book.add_order(order);
-        }
+    for (size_t i = 0; i < warmup; ++i) {
+        execute(stream[i]);
+    }
 
-        // Cancel orders
-        for (const auto& id : order_ids) {
-            book.cancel_order(id);
-        }
-    }, 100);
-
-    // Benchmark 6: Market orders
-    benchmarks.add_benchmark("Market Order Execution", [&]() {
-        OrderBook book("TEST");
-        uint64_t timestamp = get_timestamp();
-
-        // Add limit orders to provide liquidity
-        for (int i = 0; i < 100; ++i) {
-            auto order = generator.generate_limit_order(
-                i % 2 == 0 ? OrderSide::Buy : OrderSide::Sell,
-                "TEST", timestamp + i
-            );
-            book.add_order(order);
+    size_t allocations = g_allocations.load(std::memory_order_relaxed);
+    auto wall_start = std::chrono::steady_clock::now();
+    for (size_t i = warmup; i < stream.size(); ++i) {
+        auto [type, elapsed] = execute(stream[i]);
+        histograms[static_cast<size_t>(type)].record(elapsed);
+        all.record(elapsed);
+    }
+    auto wall_end = std::chrono::steady_clock::now();
+    allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+
+    double seconds = std::chrono::duration<double>(wall_end - wall_start).count();
+    double ns_per_tick = tsc_ns_per_tick();
+    return {Target::kName,
+            mix.name,
+            depth,
+            ops,
+            seconds,
+            seconds > 0 ? static_cast<double>(ops) / seconds : 0.0,
+            static_cast<double>(allocations) / static_cast<double>(ops),
+            all.summary(ns_per_tick),
+            histograms[static_cast<size_t>(OpType::Add)].summary(ns_per_tick),
+            histograms[static_cast<size_t>(OpType::Cancel)].summary(ns_per_tick),
+            histograms[static_cast<size_t>(OpType::Aggress)].summary(ns_per_tick)};
+}
+
+void print_header() {
+    std::cout << "=== Running Benchmarks (level scans: " << level_scan::kInstructionSet << ") ===" << std::endl;
+    std::cout << std::left << std::setw(34) << "Benchmark"
+              << std::right << std::setw(12) << "ops/s"
+              << std::setw(10) << "p50 ns"
+              << std::setw(10) << "p99 ns"
+              << std::setw(10) << "p99.9 ns"
+              << std::setw(12) << "max ns"
+              << std::setw(12) << "allocs/op" << std::endl;
+    std::cout << std::string(100, '-') << std::endl;
+}
+
+void print_result(const BenchmarkResult& result) {
+    std::string name = result.target + "/" + result.mix + "/" + std::to_string(result.depth);
+    std::cout << std::left << std::setw(34) << name << std::right << std::fixed
+              << std::setw(12) << std::setprecision(0) << result.ops_per_sec
+              << std::setw(10) << result.all.p50_ns
+              << std::setw(10) << result.all.p99_ns
+              << std::setw(10) << result.all.p999_ns
+              << std::setw(12) << result.all.max_ns
+              << std::setw(12) << std::setprecision(3) << result.allocs_per_op << std::endl;
+}
+
+void write_json(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+    out << "{\"level_scans\":\"" << level_scan::kInstructionSet << "\",\"benchmarks\":[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        out << (i == 0 ? "" : ",") << "{"
+            << "\"name\":\"" << result.target << "/" << result.mix << "/" << result.depth << "\""
+            << ",\"target\":\"" << result.target << "\""
+            << ",\"mix\":\"" << result.mix << "\""
+            << ",\"depth\":" << result.depth
+            << ",\"ops\":" << result.ops
+            << ",\"seconds\":" << result.seconds
+            << ",\"ops_per_sec\":" << result.ops_per_sec
+            << ",\"allocs_per_op\":" << result.allocs_per_op
+            << ",\"latency\":{";
+        tools::write_summary(out, "all", result.all, false);
+        tools::write_summary(out, "add", result.add, false);
+        tools::write_summary(out, "cancel", result.cancel, false);
+        tools::write_summary(out, "aggress", result.aggress, true);
+        out << "}}";
+    }
+    out << "]}" << std::endl;
+}
+
+void print_usage() {
+    std::cout << "Usage: trading_benchmarks [--depths N,N,...] [--ops N] [--mix NAME]\n"
+              << "                          [--target book|engine|engine-risk|all] [--json FILE]\n"
+              << "Mixes:";
+    for (const FlowMix& mix : kMixes) {
+        std::cout << " " << mix.name;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> depths = {100, 1000, 10000, 100000, 1000000};
+    size_t ops = 200000;
+    std::string mix_filter;
+    std::string target = "all";
+    std::string json_path;
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--depths") == 0 && has_value) {
+            depths = tools::parse_sizes(argv[++i]);
+        } else if (std::strcmp(argv[i], "--ops") == 0 && has_value) {
+            ops = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--mix") == 0 && has_value) {
+            mix_filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--target") == 0 && has_value) {
+            target = argv[++i];
+        } else if (std::strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else {
+            print_usage();
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
         }
+    }
 
-        // Execute market orders
-        for (int i = 0; i < 20; ++i) {
-            auto order = generator.generate_market_order(
-                i % 2 == 0 ? OrderSide::Buy : OrderSide::Sell,
-                "TEST", timestamp + 100 + i
-            );
-            book.match_order(order);
+    // Calibrate the timestamp counter before anything is timed
+    tsc_ns_per_tick();
+
+    std::vector<BenchmarkResult> results;
+    print_header();
+    for (size_t depth : depths) {
+        for (const FlowMix& mix : kMixes) {
+            if (!mix_filter.empty() && mix_filter != mix.name) {
+                continue;
+            }
+            uint64_t seed = 42 + depth;
+            if (target == "all" || target == BookTarget::kName) {
+                results.push_back(run_flow<BookTarget>(mix, depth, ops, seed));
+                print_result(results.back());
+            }
+            if (target == "all" || target == EngineTarget::kName) {
+                results.push_back(run_flow<EngineTarget>(mix, depth, ops, seed));
+                print_result(results.back());
+            }
+            if (target == "all" || target == RiskEngineTarget::kName) {
+                results.push_back(run_flow<RiskEngineTarget>(mix, depth, ops, seed));
+                print_result(results.back());
+            }
         }
-    }, 50);
+    }
 
-    // Run all benchmarks
-    benchmarks.run_all();
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        if (!out) {
+            std::cerr << "Cannot write " << json_path << std::endl;
+            return 1;
+        }
+        write_json(out, results);
+        std::cout << "Results written to " << json_path << std::endl;
+    }
 
     return 0;
 }
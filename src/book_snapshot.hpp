@@ -0,0 +1,155 @@
+#pragma once
+
+#include "order_book.hpp"
+#include "price.hpp"
+#include "price_level.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace trading {
+
+// Copy of a book's best levels as of the end of one engine event
+struct BookSnapshot {
+    static constexpr size_t kMaxLevels = 16;
+
+    uint64_t sequence;      // Snapshots published before and including this one
+    uint64_t timestamp;     // The book's last update time
+    SymbolId symbol;
+    uint32_t bid_levels;    // Entries of bids in use, best first
+    uint32_t ask_levels;
+    LevelSummary bids[kMaxLevels];
+    LevelSummary asks[kMaxLevels];
+
+    // Best bid and ask, with the same empty-side convention as OrderBook
+    TopOfBook top() const {
+        TopOfBook top{{Price::min(), 0, 0}, {Price::max(), 0, 0}};
+        if (bid_levels > 0) {
+            top.bid = bids[0];
+        }
+        if (ask_levels > 0) {
+            top.ask = asks[0];
+        }
+        return top;
+    }
+};
+
+// Single-writer, many-reader publication of BookSnapshots for risk and
+// market data threads that must not touch a live book. The matching thread
+// publishes after every event that changed the book; readers copy the
+// latest snapshot without locks and without ever making the writer wait.
+//
+// Snapshots rotate through a few seqlock-protected slots. A slot is written
+// again only after kSlots - 1 newer snapshots, so a reader retries only if
+// the writer laps it that many times during one copy of a few hundred bytes.
+// All shared data is accessed through relaxed atomics, which compile to
+// plain loads and stores.
+class BookSnapshotBuffer {
+public:
+    static constexpr size_t kDefaultLevels = 5;
+
+    // levels is the depth published per side, at most BookSnapshot::kMaxLevels
+    explicit BookSnapshotBuffer(size_t levels = kDefaultLevels)
+        : levels_(std::clamp<size_t>(levels, 1, BookSnapshot::kMaxLevels)) {
+        // Publishing never allocates
+        depth_.bids.reserve(levels_);
+        depth_.asks.reserve(levels_);
+    }
+
+    BookSnapshotBuffer(const BookSnapshotBuffer&) = delete;
+    BookSnapshotBuffer& operator=(const BookSnapshotBuffer&) = delete;
+
+    size_t levels() const { return levels_; }
+
+    // Number of snapshots published; a cheap check for a change
+    uint64_t sequence() const { return latest_.load(std::memory_order_acquire); }
+
+    // From the writer's thread only: capture the book's best levels
+    template <typename Book>
+    void publish(const Book& book) {
+        book.depth(levels_, depth_);
+
+        uint64_t sequence = ++published_;
+        Slot& slot = slots_[sequence % kSlots];
+        uint64_t version = slot.version.load(std::memory_order_relaxed);
+        slot.version.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.words[0].store(sequence, std::memory_order_relaxed);
+        slot.words[1].store(book.last_update_time(), std::memory_order_relaxed);
+        slot.words[2].store(book.get_symbol_id(), std::memory_order_relaxed);
+        slot.words[3].store(depth_.bids.size() | (depth_.asks.size() << 32), std::memory_order_relaxed);
+        size_t word = kHeaderWords;
+        for (const auto* side : {&depth_.bids, &depth_.asks}) {
+            for (const LevelSummary& level : *side) {
+                slot.words[word++].store(static_cast<uint64_t>(level.price.ticks), std::memory_order_relaxed);
+                slot.words[word++].store(level.quantity, std::memory_order_relaxed);
+                slot.words[word++].store(level.order_count, std::memory_order_relaxed);
+            }
+        }
+
+        slot.version.store(version + 2, std::memory_order_release);
+        latest_.store(sequence, std::memory_order_release);
+    }
+
+    // From any thread: copy the latest snapshot. Returns false if nothing
+    // has been published yet
+    bool read(BookSnapshot& out) const {
+        while (true) {
+            uint64_t sequence = latest_.load(std::memory_order_acquire);
+            if (sequence == 0) {
+                return false;
+            }
+
+            const Slot& slot = slots_[sequence % kSlots];
+            uint64_t version = slot.version.load(std::memory_order_acquire);
+            if (version % 2 != 0) {
+                continue; // Lapped by the writer mid-update
+            }
+
+            out.sequence = slot.words[0].load(std::memory_order_relaxed);
+            out.timestamp = slot.words[1].load(std::memory_order_relaxed);
+            out.symbol = static_cast<SymbolId>(slot.words[2].load(std::memory_order_relaxed));
+            uint64_t counts = slot.words[3].load(std::memory_order_relaxed);
+            out.bid_levels = static_cast<uint32_t>(std::min<uint64_t>(counts & 0xffffffff, BookSnapshot::kMaxLevels));
+            out.ask_levels = static_cast<uint32_t>(std::min<uint64_t>(counts >> 32, BookSnapshot::kMaxLevels));
+            size_t word = kHeaderWords;
+            for (LevelSummary* side : {out.bids, out.asks}) {
+                uint32_t count = side == out.bids ? out.bid_levels : out.ask_levels;
+                for (uint32_t i = 0; i < count; ++i) {
+                    side[i].price = Price(static_cast<int64_t>(slot.words[word++].load(std::memory_order_relaxed)));
+                    side[i].quantity = slot.words[word++].load(std::memory_order_relaxed);
+                    side[i].order_count = slot.words[word++].load(std::memory_order_relaxed);
+                }
+            }
+
+            // The copy is good only if the slot was not rewritten meanwhile
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.version.load(std::memory_order_relaxed) == version && out.sequence == sequence) {
+                return true;
+            }
+        }
+    }
+
+private:
+    static constexpr size_t kSlots = 4;
+    static constexpr size_t kHeaderWords = 4;
+    static constexpr size_t kWords = kHeaderWords + 2 * 3 * BookSnapshot::kMaxLevels;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> version{0};   // Odd while the writer is in the slot
+        std::array<std::atomic<uint64_t>, kWords> words{};
+    };
+
+    size_t levels_;
+    std::array<Slot, kSlots> slots_;
+    alignas(64) std::atomic<uint64_t> latest_{0};   // Sequence of the newest complete snapshot
+
+    // Writer state
+    uint64_t published_ = 0;
+    BookDepth depth_;
+};
+
+} // namespace trading
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+namespace trading {
+
+// Bounded single-producer ring that broadcasts every element to each
+// subscribed consumer. Each consumer owns a cursor and polls in batches on
+// its own thread; the producer only reads the cursors when the ring looks
+// full, so consumers and producer share nothing on the fast path.
+// The producer never overwrites an element a consumer has not read yet: a
+// full ring fails try_publish() and makes publish() wait for the slowest
+// consumer. Subscribing and unsubscribing must be serialised with the
+// producer (e.g. done under the same lock).
+template <typename T, size_t MaxConsumers = 8>
+class BroadcastRing {
+    static_assert(std::is_trivially_copyable_v<T>, "Ring elements are copied between threads");
+
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Capacity is rounded up to a power of two
+    explicit BroadcastRing(size_t capacity)
+        : capacity_(std::bit_ceil(capacity < 2 ? size_t{2} : capacity)),
+          mask_(capacity_ - 1),
+          slots_(std::make_unique_for_overwrite<T[]>(capacity_)) {}
+
+    BroadcastRing(const BroadcastRing&) = delete;
+    BroadcastRing& operator=(const BroadcastRing&) = delete;
+
+    // Producer: append an element, or return false if the slowest consumer
+    // is a whole ring behind
+    bool try_publish(const T& value) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - min_cursor_ >= capacity_) {
+            min_cursor_ = slowest_cursor(head);
+            if (head - min_cursor_ >= capacity_) {
+                return false;
+            }
+        }
+        slots_[head & mask_] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer: append an element, waiting for consumers if the ring is full
+    void publish(const T& value) {
+        while (!try_publish(value)) {
+            stalls_.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::yield();
+        }
+    }
+
+    // Add a consumer that sees everything published from now on; returns
+    // its ID, or npos if all consumer slots are taken
+    size_t subscribe() {
+        for (size_t id = 0; id < MaxConsumers; ++id) {
+            if (!consumers_[id].active.load(std::memory_order_relaxed)) {
+                consumers_[id].cursor.store(head_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                consumers_[id].active.store(true, std::memory_order_release);
+                return id;
+            }
+        }
+        return npos;
+    }
+
+    void unsubscribe(size_t id) {
+        consumers_[id].active.store(false, std::memory_order_release);
+    }
+
+    // Consumer: hand up to max_batch unread elements to f in order and
+    // return how many were consumed
+    template <typename F>
+    size_t poll(size_t id, F&& f, size_t max_batch) {
+        Consumer& consumer = consumers_[id];
+        uint64_t cursor = consumer.cursor.load(std::memory_order_relaxed);
+        uint64_t available = head_.load(std::memory_order_acquire) - cursor;
+        size_t count = static_cast<size_t>(std::min<uint64_t>(available, max_batch));
+
+        for (size_t i = 0; i < count; ++i) {
+            f(slots_[(cursor + i) & mask_]);
+        }
+        consumer.cursor.store(cursor + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: number of elements waiting for this consumer
+    size_t pending(size_t id) const {
+        return static_cast<size_t>(head_.load(std::memory_order_acquire) -
+                                   consumers_[id].cursor.load(std::memory_order_relaxed));
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // Total number of elements published
+    uint64_t published() const { return head_.load(std::memory_order_acquire); }
+
+    // Number of times publish() had to wait for a slow consumer
+    uint64_t stalls() const { return stalls_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    struct alignas(kCacheLine) Consumer {
+        std::atomic<uint64_t> cursor{0};
+        std::atomic<bool> active{false};
+    };
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<T[]> slots_;
+
+    // Producer state
+    alignas(kCacheLine) std::atomic<uint64_t> head_{0};
+    uint64_t min_cursor_ = 0;   // Cached lower bound of every consumer's cursor
+    std::atomic<uint64_t> stalls_{0};
+
+    std::array<Consumer, MaxConsumers> consumers_;
+
+    uint64_t slowest_cursor(uint64_t head) const {
+        uint64_t slowest = head;
+        for (const Consumer& consumer : consumers_) {
+            if (consumer.active.load(std::memory_order_acquire)) {
+                slowest = std::min(slowest, consumer.cursor.load(std::memory_order_acquire));
+            }
+        }
+        return slowest;
+    }
+};
+
+} // namespace trading
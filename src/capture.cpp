@@ -0,0 +1,217 @@
+#include "capture.hpp"
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TRADING_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define TRADING_HAS_MMAP 0
+#endif
+
+namespace trading::capture {
+
+namespace {
+
+bool valid_header(const std::byte* data, size_t size) {
+    return size >= kFileHeaderSize && std::memcmp(data, kMagic, sizeof(kMagic)) == 0 &&
+           wire::load<uint32_t>(data + 8) == kVersion;
+}
+
+} // namespace
+
+// --- CaptureWriter ---
+
+CaptureWriter::~CaptureWriter() {
+    close();
+}
+
+bool CaptureWriter::open(const std::string& path) {
+    close();
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        return false;
+    }
+    failed_ = false;
+    messages_ = 0;
+    buffer_.assign(kFileHeaderSize, std::byte{0});
+    std::memcpy(buffer_.data(), kMagic, sizeof(kMagic));
+    wire::store<uint32_t>(buffer_.data() + 8, kVersion);
+    return true;
+}
+
+std::byte* CaptureWriter::begin(MessageType type, size_t size, SymbolId symbol, uint64_t timestamp) {
+    size_t offset = buffer_.size();
+    buffer_.resize(offset + size);
+    std::byte* at = buffer_.data() + offset;
+    std::memset(at, 0, size);
+    wire::store<uint16_t>(at, static_cast<uint16_t>(size));
+    wire::store<uint8_t>(at + 2, static_cast<uint8_t>(type));
+    wire::store<uint32_t>(at + 4, symbol);
+    wire::store<uint64_t>(at + 8, timestamp);
+    ++messages_;
+    return at;
+}
+
+bool CaptureWriter::directory(SymbolId symbol, const std::string& name, uint64_t timestamp) {
+    if (name.size() > kMaxNameLength) {
+        return false;
+    }
+    std::byte* at = begin(MessageType::Directory, kDirectorySize, symbol, timestamp);
+    std::memcpy(at + 16, name.data(), name.size());
+    flush();
+    return true;
+}
+
+void CaptureWriter::add_order(const Command& command, uint64_t timestamp) {
+    std::byte* at = begin(MessageType::AddOrder, kAddOrderSize, command.symbol, timestamp);
+    wire::store<uint64_t>(at + 16, command.order_id);
+    wire::store<int64_t>(at + 24, command.price.ticks);
+    wire::store<uint64_t>(at + 32, command.size);
+    wire::store<uint32_t>(at + 40, command.account);
+    wire::store<uint8_t>(at + 44, command.side == OrderSide::Buy ? 'B' : 'S');
+    wire::store<uint8_t>(at + 45, static_cast<uint8_t>(command.order_type));
+    wire::store<uint8_t>(at + 46, static_cast<uint8_t>(command.tif));
+    flush();
+}
+
+void CaptureWriter::delete_order(SymbolId symbol, OrderId order_id, uint64_t timestamp) {
+    std::byte* at = begin(MessageType::Delete, kDeleteSize, symbol, timestamp);
+    wire::store<uint64_t>(at + 16, order_id);
+    flush();
+}
+
+void CaptureWriter::replace(SymbolId symbol, OrderId order_id, uint64_t size, Price price, uint64_t timestamp) {
+    std::byte* at = begin(MessageType::Replace, kReplaceSize, symbol, timestamp);
+    wire::store<uint64_t>(at + 16, order_id);
+    wire::store<int64_t>(at + 24, price.ticks);
+    wire::store<uint64_t>(at + 32, size);
+    flush();
+}
+
+void CaptureWriter::execution(const Trade& trade, uint64_t timestamp) {
+    std::byte* at = begin(MessageType::Execution, kExecutionSize, trade.symbol, timestamp);
+    wire::store<uint64_t>(at + 16, trade.order_id_buy);
+    wire::store<uint64_t>(at + 24, trade.order_id_sell);
+    wire::store<int64_t>(at + 32, trade.price.ticks);
+    wire::store<uint64_t>(at + 40, trade.size);
+    flush();
+}
+
+bool CaptureWriter::command(const Command& command, uint64_t timestamp) {
+    switch (command.type) {
+    case CommandType::NewLimit:
+    case CommandType::NewMarket:
+        add_order(command, timestamp);
+        return true;
+    case CommandType::Cancel:
+        delete_order(command.symbol, command.order_id, timestamp);
+        return true;
+    case CommandType::Modify:
+        replace(command.symbol, command.order_id, command.size, command.price, timestamp);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void CaptureWriter::flush() {
+    if (buffer_.size() < kFlushBytes) {
+        return;
+    }
+    if (std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+        failed_ = true;
+    }
+    buffer_.clear();
+}
+
+bool CaptureWriter::close() {
+    if (!file_) {
+        return false;
+    }
+    if (!buffer_.empty() && std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+        failed_ = true;
+    }
+    buffer_.clear();
+    if (std::fclose(file_) != 0) {
+        failed_ = true;
+    }
+    file_ = nullptr;
+    return !failed_;
+}
+
+// --- CaptureFile ---
+
+CaptureFile::~CaptureFile() {
+    close();
+}
+
+bool CaptureFile::open(const std::string& path, bool prefault) {
+    close();
+#if TRADING_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < kFileHeaderSize) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (prefault) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* mapping = ::mmap(nullptr, size, PROT_READ, flags, fd, 0);
+    ::close(fd); // The mapping keeps the file open
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+    if (!valid_header(static_cast<const std::byte*>(mapping), size)) {
+        ::munmap(mapping, size);
+        return false;
+    }
+    data_ = static_cast<const std::byte*>(mapping);
+    size_ = size;
+    mapped_ = true;
+    return true;
+#else
+    (void)prefault;
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::byte chunk[64 * 1024];
+    for (size_t got; (got = std::fread(chunk, 1, sizeof(chunk), file)) > 0;) {
+        copy_.insert(copy_.end(), chunk, chunk + got);
+    }
+    std::fclose(file);
+    if (!valid_header(copy_.data(), copy_.size())) {
+        copy_.clear();
+        return false;
+    }
+    data_ = copy_.data();
+    size_ = copy_.size();
+    return true;
+#endif
+}
+
+void CaptureFile::close() {
+#if TRADING_HAS_MMAP
+    if (mapped_) {
+        ::munmap(const_cast<std::byte*>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+    copy_.clear();
+}
+
+} // namespace trading::capture
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "command.hpp"
+#include "order.hpp"
+#include "price.hpp"
+#include "wire_protocol.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace trading::capture {
+
+// Order flow capture, in the style of an ITCH feed: a 16-byte file header
+// followed by variable-length messages with a common 16-byte prefix. All
+// integers are little-endian and prices are in ticks; the wire_protocol
+// load/store helpers read and write them.
+//
+//   File header     magic "FSCAP001" @0, version u32 @8, reserved u32 @12
+//   Prefix          length u16 @0 (whole message), type u8 @2, reserved u8 @3,
+//                   symbol u32 @4, timestamp u64 @8 (capture time, ns)
+//
+//   Directory  'R' 32   name char[16] @16 (zero padded); names the symbol
+//   AddOrder   'A' 48   order_id u64 @16, price i64 @24, size u64 @32, account u32 @40,
+//                       side u8 @44 ('B' or 'S'), order_type u8 @45 (OrderType), tif u8 @46 (TimeInForce)
+//   Delete     'D' 24   order_id u64 @16
+//   Replace    'U' 40   order_id u64 @16, price i64 @24, size u64 @32 (the new total size)
+//   Execution  'E' 48   buy_order_id u64 @16, sell_order_id u64 @24, price i64 @32, size u64 @40
+//
+// Execution messages are the trades the preceding order message produced,
+// in the order they printed; a replay checks its own trades against them.
+// Messages of an unknown type are skipped by their length.
+
+inline constexpr char kMagic[8] = {'F', 'S', 'C', 'A', 'P', '0', '0', '1'};
+inline constexpr uint32_t kVersion = 1;
+
+enum class MessageType : uint8_t {
+    Directory = 'R',
+    AddOrder = 'A',
+    Delete = 'D',
+    Replace = 'U',
+    Execution = 'E'
+};
+
+inline constexpr size_t kFileHeaderSize = 16;
+inline constexpr size_t kPrefixSize = 16;
+inline constexpr size_t kDirectorySize = 32;
+inline constexpr size_t kAddOrderSize = 48;
+inline constexpr size_t kDeleteSize = 24;
+inline constexpr size_t kReplaceSize = 40;
+inline constexpr size_t kExecutionSize = 48;
+inline constexpr size_t kMaxNameLength = 16;
+
+// Fixed size of a known message type (0 for an unknown one)
+inline size_t message_size(MessageType type) {
+    switch (type) {
+    case MessageType::Directory: return kDirectorySize;
+    case MessageType::AddOrder: return kAddOrderSize;
+    case MessageType::Delete: return kDeleteSize;
+    case MessageType::Replace: return kReplaceSize;
+    case MessageType::Execution: return kExecutionSize;
+    }
+    return 0;
+}
+
+// Views over a complete message in a buffer; they hold a pointer only
+class MessageView {
+public:
+    explicit MessageView(const std::byte* data) : data_(data) {}
+    uint16_t length() const { return wire::load<uint16_t>(data_); }
+    MessageType type() const { return static_cast<MessageType>(wire::load<uint8_t>(data_ + 2)); }
+    SymbolId symbol() const { return wire::load<uint32_t>(data_ + 4); }
+    uint64_t timestamp() const { return wire::load<uint64_t>(data_ + 8); }
+    const std::byte* data() const { return data_; }
+
+protected:
+    const std::byte* data_;
+};
+
+class DirectoryView : public MessageView {
+public:
+    using MessageView::MessageView;
+    std::string name() const {
+        const char* chars = reinterpret_cast<const char*>(data_ + 16);
+        size_t length = 0;
+        while (length < kMaxNameLength && chars[length] != '\0') {
+            ++length;
+        }
+        return std::string(chars, length);
+    }
+};
+
+class AddOrderView : public MessageView {
+public:
+    using MessageView::MessageView;
+    OrderId order_id() const { return wire::load<uint64_t>(data_ + 16); }
+    Price price() const { return Price(wire::load<int64_t>(data_ + 24)); }
+    uint64_t size() const { return wire::load<uint64_t>(data_ + 32); }
+    AccountId account() const { return wire::load<uint32_t>(data_ + 40); }
+    OrderSide side() const { return wire::load<uint8_t>(data_ + 44) == 'S' ? OrderSide::Sell : OrderSide::Buy; }
+    OrderType order_type() const { return static_cast<OrderType>(wire::load<uint8_t>(data_ + 45)); }
+    TimeInForce tif() const { return static_cast<TimeInForce>(wire::load<uint8_t>(data_ + 46)); }
+
+    // The engine command for this order; false if the order type or time
+    // in force is not one the engine knows
+    bool to_command(Command& out) const {
+        if (wire::load<uint8_t>(data_ + 45) > static_cast<uint8_t>(OrderType::PostOnlySlide) ||
+            wire::load<uint8_t>(data_ + 46) > static_cast<uint8_t>(TimeInForce::FillOrKill)) {
+            return false;
+        }
+        CommandType command = order_type() == OrderType::Market ? CommandType::NewMarket : CommandType::NewLimit;
+        out = {order_id(), price(), size(), 0, symbol(), command, side(), order_type(), tif(), account()};
+        return true;
+    }
+};
+
+class DeleteView : public MessageView {
+public:
+    using MessageView::MessageView;
+    OrderId order_id() const { return wire::load<uint64_t>(data_ + 16); }
+};
+
+class ReplaceView : public MessageView {
+public:
+    using MessageView::MessageView;
+    OrderId order_id() const { return wire::load<uint64_t>(data_ + 16); }
+    Price price() const { return Price(wire::load<int64_t>(data_ + 24)); }
+    uint64_t size() const { return wire::load<uint64_t>(data_ + 32); }
+};
+
+class ExecutionView : public MessageView {
+public:
+    using MessageView::MessageView;
+    OrderId buy_order_id() const { return wire::load<uint64_t>(data_ + 16); }
+    OrderId sell_order_id() const { return wire::load<uint64_t>(data_ + 24); }
+    Price price() const { return Price(wire::load<int64_t>(data_ + 32)); }
+    uint64_t size() const { return wire::load<uint64_t>(data_ + 40); }
+};
+
+struct DecodeResult {
+    size_t consumed;    // Bytes of messages handed out (or skipped)
+    bool malformed;     // Stopped at a length that cannot be right, or a truncated message
+};
+
+// Hand every message in buffer to visit(MessageView) in order. Unlike a
+// socket stream a capture is complete, so a message cut off at the end
+// counts as malformed
+template <typename Visit>
+DecodeResult decode(std::span<const std::byte> buffer, Visit&& visit) {
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        if (buffer.size() - offset < kPrefixSize) {
+            return {offset, true};
+        }
+        MessageView message(buffer.data() + offset);
+        size_t length = message.length();
+        size_t expected = message_size(message.type());
+        if (length < kPrefixSize || (expected != 0 && length != expected) || buffer.size() - offset < length) {
+            return {offset, true};
+        }
+        if (expected != 0) {
+            visit(message);
+        }
+        offset += length;
+    }
+    return {offset, false};
+}
+
+// Buffered writer of a capture file
+class CaptureWriter {
+public:
+    CaptureWriter() = default;
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    // Create (or replace) the file and write its header
+    bool open(const std::string& path);
+    bool is_open() const { return file_ != nullptr; }
+
+    // Names longer than kMaxNameLength are refused
+    bool directory(SymbolId symbol, const std::string& name, uint64_t timestamp = 0);
+    void add_order(const Command& command, uint64_t timestamp);
+    void delete_order(SymbolId symbol, OrderId order_id, uint64_t timestamp);
+    void replace(SymbolId symbol, OrderId order_id, uint64_t size, Price price, uint64_t timestamp);
+    void execution(const Trade& trade, uint64_t timestamp);
+
+    // Append a NewLimit, NewMarket, Cancel or Modify command as the matching
+    // message; false (nothing written) for any other command
+    bool command(const Command& command, uint64_t timestamp);
+
+    // Flush and close; false if any write failed
+    bool close();
+
+    uint64_t messages() const { return messages_; }
+
+private:
+    static constexpr size_t kFlushBytes = 64 * 1024;
+
+    std::FILE* file_ = nullptr;
+    std::vector<std::byte> buffer_;
+    uint64_t messages_ = 0;
+    bool failed_ = false;
+
+    std::byte* begin(MessageType type, size_t size, SymbolId symbol, uint64_t timestamp);
+    void flush();
+};
+
+// Read-only view of a capture file. On POSIX platforms the file is mapped
+// rather than read, so a replay walks the page cache directly and opening a
+// multi-gigabyte capture costs nothing up front; prefault asks the kernel to
+// populate the mapping at open() so that page faults stay out of a timed
+// replay. Elsewhere the file is read into memory.
+class CaptureFile {
+public:
+    CaptureFile() = default;
+    ~CaptureFile();
+
+    CaptureFile(const CaptureFile&) = delete;
+    CaptureFile& operator=(const CaptureFile&) = delete;
+
+    // Returns false if the file is missing or is not a capture
+    bool open(const std::string& path, bool prefault = false);
+    void close();
+
+    bool is_open() const { return data_ != nullptr; }
+    bool mapped() const { return mapped_; }
+
+    // Everything after the file header
+    std::span<const std::byte> messages() const {
+        return data_ ? std::span<const std::byte>(data_ + kFileHeaderSize, size_ - kFileHeaderSize)
+                     : std::span<const std::byte>();
+    }
+    size_t file_size() const { return size_; }
+
+private:
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<std::byte> copy_;   // Contents when the file could not be mapped
+};
+
+struct VerifyStats {
+    uint64_t expected;              // Execution messages checked
+    uint64_t observed;              // Trades the replay produced
+    uint64_t mismatches;            // Order messages whose trades differ from the capture
+    uint64_t first_mismatch;        // Capture offset of the first of those (valid when mismatches > 0)
+};
+
+// Compares the trades a replay produces with the capture's Execution
+// messages. Call begin() before applying an order message, hand each trade
+// it produces to observe(), then expect() each Execution message that
+// follows it; the next begin() (or finish()) closes the message. Buy and
+// sell order IDs, price and size must match, in print order
+class TradeVerifier {
+public:
+    void begin(uint64_t offset) {
+        close_message();
+        offset_ = offset;
+        observed_.clear();
+        next_ = 0;
+        failed_ = false;
+    }
+
+    void observe(const Trade& trade) {
+        observed_.push_back(trade);
+        ++stats_.observed;
+    }
+
+    void expect(const ExecutionView& execution) {
+        ++stats_.expected;
+        if (next_ >= observed_.size()) {
+            failed_ = true;
+            return;
+        }
+        const Trade& trade = observed_[next_++];
+        if (trade.order_id_buy != execution.buy_order_id() || trade.order_id_sell != execution.sell_order_id() ||
+            trade.price != execution.price() || trade.size != execution.size()) {
+            failed_ = true;
+        }
+    }
+
+    // Close the last message and return the totals
+    VerifyStats finish() {
+        close_message();
+        observed_.clear();
+        next_ = 0;
+        return stats_;
+    }
+
+private:
+    std::vector<Trade> observed_;
+    size_t next_ = 0;
+    uint64_t offset_ = 0;
+    bool failed_ = false;
+    VerifyStats stats_{0, 0, 0, 0};
+
+    void close_message() {
+        if (failed_ || next_ < observed_.size()) {
+            if (stats_.mismatches++ == 0) {
+                stats_.first_mismatch = offset_;
+            }
+        }
+        failed_ = false;
+        next_ = observed_.size();
+    }
+};
+
+} // namespace trading::capture
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "tsc.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace trading {
+
+// Source of event timestamps in nanoseconds. The engine reads its clock once
+// per event (an order placed, a cancel, a queued command) and that single
+// value is stamped on the order, the book's update time and every trade the
+// event produces, so a sweep through many levels costs one clock read.
+class Clock {
+public:
+    virtual ~Clock() = default;
+
+    // Time of the event about to be executed
+    virtual uint64_t now() = 0;
+
+    // Called by the engine before each batch of inbound commands
+    virtual void begin_batch() {}
+};
+
+// Wall-clock nanoseconds since the epoch, read on every call
+class SystemClock final : public Clock {
+public:
+    uint64_t now() override {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+};
+
+// Wall-clock nanoseconds extrapolated from the timestamp counter: the wall
+// clock is read once at construction, after which each call is a read_tsc()
+// and a multiply. Drift against the system clock stays within the accuracy
+// of the one-off calibration in tsc_ns_per_tick().
+class TscClock final : public Clock {
+public:
+    TscClock()
+        : ns_per_tick_(tsc_ns_per_tick()),
+          base_tsc_(read_tsc()),
+          base_ns_(SystemClock().now()) {
+    }
+
+    uint64_t now() override {
+        return base_ns_ + static_cast<uint64_t>(static_cast<double>(read_tsc() - base_tsc_) * ns_per_tick_);
+    }
+
+private:
+    double ns_per_tick_;
+    uint64_t base_tsc_;
+    uint64_t base_ns_;
+};
+
+// Event time cached once per batch of inbound commands: every command in a
+// batch, and every synchronous call, shares the time read from the source
+// clock when it began. Only the engine thread may use it, so it must not be
+// shared between engines.
+class BatchClock final : public Clock {
+public:
+    explicit BatchClock(std::shared_ptr<Clock> source = std::make_shared<TscClock>())
+        : source_(std::move(source)), cached_(source_->now()) {
+    }
+
+    uint64_t now() override { return cached_; }
+    void begin_batch() override { cached_ = source_->now(); }
+
+private:
+    std::shared_ptr<Clock> source_;
+    uint64_t cached_;
+};
+
+// Deterministic time for replaying a recorded session or for tests: returns
+// whatever was last set, so a replay stamps the same times as the original
+// run. Setting it from another thread than the engine's is safe.
+class ReplayClock final : public Clock {
+public:
+    explicit ReplayClock(uint64_t start = 0) : time_(start) {}
+
+    void set(uint64_t ns) { time_.store(ns, std::memory_order_relaxed); }
+    void advance(uint64_t ns) { time_.fetch_add(ns, std::memory_order_relaxed); }
+
+    uint64_t now() override { return time_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> time_;
+};
+
+} // namespace trading
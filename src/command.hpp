@@ -0,0 +1,161 @@
+#pragma once
+
+#include "order.hpp"
+#include "price.hpp"
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace trading {
+
+// Kind of request carried by a Command
+enum class CommandType : uint8_t {
+    NewLimit,
+    NewMarket,
+    Cancel,
+    Modify,     // New total size and price for a resting order (see OrderBook::modify_order)
+    MassCancel, // Every resting order on one side of a book
+    NewStop,    // A stop (order_type Market) or stop-limit (order_type Limit) order
+    BeginAuction, // Switch a book to auction mode
+    Uncross     // End a book's auction, trading what crosses at one price
+};
+
+// Fixed-size inbound request, copied by value through the engine's queues.
+// Prices are already converted to ticks by the submitting thread, so the
+// matching thread never touches a double.
+struct Command {
+    OrderId order_id;
+    Price price;        // Limit price; unused for market orders and cancels
+    uint64_t size;      // Unused for cancels; the new total size for modifies
+    uint64_t submit_tsc; // Timestamp counter at submit(), for queue-wait statistics
+    SymbolId symbol;
+    CommandType type;
+    OrderSide side;
+    OrderType order_type;   // New orders: Limit or a post-only type for NewLimit, Market for NewMarket
+    TimeInForce tif;        // New orders only
+    AccountId account;      // New orders only: the owner, for risk checks
+    Price trigger{};        // Stop orders only: the trade price that releases the order
+
+    static Command limit(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, Price price,
+                         TimeInForce tif = TimeInForce::GoodTillCancel, AccountId account = 0) {
+        return {order_id, price, size, 0, symbol, CommandType::NewLimit, side, OrderType::Limit, tif, account};
+    }
+
+    // reprice selects OrderType::PostOnlySlide over OrderType::PostOnly
+    static Command post_only(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, Price price,
+                             bool reprice = false, AccountId account = 0) {
+        return {order_id, price, size, 0, symbol, CommandType::NewLimit, side,
+                reprice ? OrderType::PostOnlySlide : OrderType::PostOnly, TimeInForce::GoodTillCancel, account};
+    }
+
+    static Command market(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size,
+                          TimeInForce tif = TimeInForce::ImmediateOrCancel, AccountId account = 0) {
+        return {order_id, Price{}, size, 0, symbol, CommandType::NewMarket, side, OrderType::Market, tif, account};
+    }
+
+    // A stop order becomes a market order once a trade prints at or through
+    // trigger; a stop-limit order becomes a limit order at price
+    static Command stop(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, Price trigger,
+                        AccountId account = 0) {
+        return {order_id, Price{}, size, 0, symbol, CommandType::NewStop, side, OrderType::Market,
+                TimeInForce::ImmediateOrCancel, account, trigger};
+    }
+
+    static Command stop_limit(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, Price trigger,
+                              Price price, TimeInForce tif = TimeInForce::GoodTillCancel, AccountId account = 0) {
+        return {order_id, price, size, 0, symbol, CommandType::NewStop, side, OrderType::Limit, tif, account, trigger};
+    }
+
+    static Command cancel(SymbolId symbol, OrderId order_id) {
+        return {order_id, Price{}, 0, 0, symbol, CommandType::Cancel, OrderSide::Buy, OrderType::Limit,
+                TimeInForce::GoodTillCancel, 0};
+    }
+
+    // The side is taken from the resting order
+    static Command modify(SymbolId symbol, OrderId order_id, uint64_t size, Price price) {
+        return {order_id, price, size, 0, symbol, CommandType::Modify, OrderSide::Buy, OrderType::Limit,
+                TimeInForce::GoodTillCancel, 0};
+    }
+
+    static Command mass_cancel(SymbolId symbol, OrderSide side) {
+        return {0, Price{}, 0, 0, symbol, CommandType::MassCancel, side, OrderType::Limit,
+                TimeInForce::GoodTillCancel, 0};
+    }
+
+    static Command begin_auction(SymbolId symbol) {
+        return {0, Price{}, 0, 0, symbol, CommandType::BeginAuction, OrderSide::Buy, OrderType::Limit,
+                TimeInForce::GoodTillCancel, 0};
+    }
+
+    static Command uncross(SymbolId symbol) {
+        return {0, Price{}, 0, 0, symbol, CommandType::Uncross, OrderSide::Buy, OrderType::Limit,
+                TimeInForce::GoodTillCancel, 0};
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<Command>, "Commands are copied through ring buffers");
+static_assert(sizeof(Command) == 56, "Command should stay within a cache line");
+
+// One order of a batch passed to MatchingEngine::place_orders
+struct NewOrder {
+    SymbolId symbol;
+    OrderId order_id;
+    OrderSide side;
+    OrderType type;
+    uint64_t size;
+    Price price;        // Ticks; unused for market orders
+    TimeInForce tif;
+    AccountId account;
+
+    static NewOrder limit(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, Price price,
+                          TimeInForce tif = TimeInForce::GoodTillCancel, AccountId account = 0) {
+        return {symbol, order_id, side, OrderType::Limit, size, price, tif, account};
+    }
+
+    static NewOrder post_only(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, Price price,
+                              bool reprice = false, AccountId account = 0) {
+        return {symbol, order_id, side, reprice ? OrderType::PostOnlySlide : OrderType::PostOnly, size, price,
+                TimeInForce::GoodTillCancel, account};
+    }
+
+    static NewOrder market(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size,
+                           TimeInForce tif = TimeInForce::ImmediateOrCancel, AccountId account = 0) {
+        return {symbol, order_id, side, OrderType::Market, size, Price{}, tif, account};
+    }
+
+    // The command this order is placed (and journaled) as
+    Command to_command() const {
+        CommandType command = type == OrderType::Market ? CommandType::NewMarket : CommandType::NewLimit;
+        return {order_id, price, size, 0, symbol, command, side, type, tif, account};
+    }
+};
+
+// Outcome of one entry of a batch call
+struct OrderResult {
+    OrderId order_id;
+    OrderStatus status;     // New or PartiallyFilled if it rests, Filled, Cancelled (a cancelled order,
+                            // or the unfilled rest of a market, IOC or FOK order) or Rejected
+    uint64_t filled_size;
+    uint32_t first_trade;   // Index of the entry's first trade in BatchResponse::trades
+    uint32_t trade_count;
+};
+
+// Caller-owned response buffer for the batch calls. Each call clears and
+// refills it, so reusing one buffer makes a steady requote cycle
+// allocation-free once it has grown to the batch size.
+struct BatchResponse {
+    std::vector<OrderResult> results;   // One per input entry, in input order
+    std::vector<Trade> trades;          // Every trade of the batch, in execution order
+
+    void reserve(size_t orders, size_t expected_trades) {
+        results.reserve(orders);
+        trades.reserve(expected_trades);
+    }
+
+    void clear() {
+        results.clear();
+        trades.clear();
+    }
+};
+
+} // namespace trading
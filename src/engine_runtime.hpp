@@ -0,0 +1,92 @@
+#pragma once
+
+#include "tsc.hpp"
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace trading {
+
+// What an engine thread does when its inbound queue is empty. Each trades
+// wake-up latency for the CPU the thread gives back
+enum class IdleStrategy : uint8_t {
+    BusySpin,   // Poll continuously: lowest latency, the core is never released
+    SpinYield,  // Poll with a pause for spin_limit polls, then yield between polls
+    Park        // Poll with a pause for spin_limit polls, then sleep on a futex until submit() wakes it
+};
+
+// Where and how an engine thread runs
+struct WorkerConfig {
+    int cpu = -1;                               // Core to pin the thread to; -1 leaves it to the scheduler
+    IdleStrategy idle = IdleStrategy::SpinYield;
+    uint32_t spin_limit = 256;                  // Empty polls before yielding or parking
+
+    // Once spin_limit empty polls have gone by, run MatchingEngine::compact
+    // slices of this budget until nothing is left or a command arrives. 0
+    // leaves compaction to the caller: a compacting engine thread resizes
+    // books, so other threads may then no longer read them directly while
+    // it runs, even between bursts
+    size_t compaction_slice = 0;
+};
+
+// Where an engine thread's time went since start(), by the TSC
+struct WorkerStats {
+    uint64_t busy_ns;   // Executing command batches
+    uint64_t idle_ns;   // Polling an empty queue, spinning, yielding or parked
+    uint64_t batches;   // Polls that found work
+    uint64_t parks;     // Times the thread went to sleep (Park only)
+
+    double utilization() const {
+        uint64_t total = busy_ns + idle_ns;
+        return total > 0 ? static_cast<double>(busy_ns) / static_cast<double>(total) : 0.0;
+    }
+};
+
+// Hint to the core that this is a spin-wait loop
+inline void cpu_relax() {
+#if TRADING_HAS_RDTSC
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Pin the calling thread to one core; returns false if cpu is negative, out
+// of the process's allowed set, or the platform has no affinity control
+inline bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Run f on a short-lived thread pinned to cpu and wait for it, so that the
+// memory f allocates and first touches is placed on that core's NUMA node
+// under the kernel's default first-touch policy. With cpu -1, f runs here
+template <typename F>
+void run_on_cpu(int cpu, F&& f) {
+    if (cpu < 0) {
+        f();
+        return;
+    }
+    std::thread worker([&]() {
+        pin_current_thread(cpu);
+        f();
+    });
+    worker.join();
+}
+
+} // namespace trading
@@ -0,0 +1,570 @@
+#include "gateway.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace trading {
+
+namespace {
+
+// epoll tags besides session numbers
+constexpr uint64_t kListenerTag = ~uint64_t{0};
+constexpr uint64_t kWakeTag = ~uint64_t{0} - 1;
+
+constexpr size_t kMaxEvents = 64;
+constexpr size_t kMaxDatagramsPerSend = 64;
+constexpr uint64_t kClientIdMask = (uint64_t{1} << Gateway::kClientIdBits) - 1;
+constexpr uint32_t kMaxSessions = uint32_t{1} << (64 - Gateway::kClientIdBits);
+
+uint64_t wall_clock_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+bool parse_address(const std::string& address, uint16_t port, sockaddr_in& out) {
+    std::memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_port = htons(port);
+    return inet_pton(AF_INET, address.c_str(), &out.sin_addr) == 1;
+}
+
+} // namespace
+
+Gateway::Gateway(MatchingEngine& engine, const GatewayConfig& config)
+    : engine_(engine), config_(config) {
+    config_.receive_buffer = std::max(config_.receive_buffer, wire::kNewOrderSize);
+    config_.datagram_size = std::max(config_.datagram_size, wire::kPacketHeaderSize + wire::kQuoteSize);
+}
+
+Gateway::~Gateway() {
+    stop();
+    while (!sessions_.empty()) {
+        close_session(sessions_.begin()->first, false);
+    }
+    close_sockets();
+}
+
+bool Gateway::open() {
+    auto fail = [this]() {
+        int saved = errno;
+        close_sockets();
+        errno = saved;
+        return false;
+    };
+
+    sockaddr_in address;
+    if (!parse_address(config_.bind_address, config_.port, address)) {
+        errno = EINVAL;
+        return fail();
+    }
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if (listen_fd_ < 0 || ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listen_fd_, SOMAXCONN) != 0) {
+        return fail();
+    }
+    socklen_t length = sizeof(address);
+    if (::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        return fail();
+    }
+    port_ = ntohs(address.sin_port);
+
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        return fail();
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = kListenerTag;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event) != 0) {
+        return fail();
+    }
+    event.data.u64 = kWakeTag;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) != 0) {
+        return fail();
+    }
+
+    // Connected, so sendmmsg() needs no per-datagram address
+    if (!config_.market_data_address.empty()) {
+        sockaddr_in group;
+        if (!parse_address(config_.market_data_address, config_.market_data_port, group)) {
+            errno = EINVAL;
+            return fail();
+        }
+        market_data_fd_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (market_data_fd_ < 0) {
+            return fail();
+        }
+        if (IN_MULTICAST(ntohl(group.sin_addr.s_addr)) &&
+            ::setsockopt(market_data_fd_, IPPROTO_IP, IP_MULTICAST_TTL, &config_.multicast_ttl,
+                         sizeof(config_.multicast_ttl)) != 0) {
+            return fail();
+        }
+        if (::connect(market_data_fd_, reinterpret_cast<sockaddr*>(&group), sizeof(group)) != 0) {
+            return fail();
+        }
+    }
+    return true;
+}
+
+void Gateway::close_sockets() {
+    for (int* fd : {&listen_fd_, &epoll_fd_, &wake_fd_, &market_data_fd_}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+size_t Gateway::poll(int timeout_ms) {
+    if (epoll_fd_ < 0) {
+        return 0;
+    }
+
+    epoll_event events[kMaxEvents];
+    int ready = ::epoll_wait(epoll_fd_, events, static_cast<int>(kMaxEvents), timeout_ms);
+    uint64_t messages = stats_.messages;
+
+    for (int i = 0; i < ready; ++i) {
+        uint64_t tag = events[i].data.u64;
+        if (tag == kListenerTag) {
+            accept_sessions();
+            continue;
+        }
+        if (tag == kWakeTag) {
+            uint64_t count;
+            [[maybe_unused]] ssize_t drained = ::read(wake_fd_, &count, sizeof(count));
+            continue;
+        }
+
+        // The session may have been closed earlier in this pass
+        auto it = sessions_.find(static_cast<uint32_t>(tag));
+        if (it == sessions_.end()) {
+            continue;
+        }
+        Session& session = *it->second;
+        if ((events[i].events & EPOLLOUT) && !flush_session(session)) {
+            continue;
+        }
+        // A hang-up or error surfaces as a failed or empty read
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            read_session(session);
+        }
+    }
+
+    // Fills for sessions other than the one that traded
+    for (uint32_t number : pending_) {
+        auto it = sessions_.find(number);
+        if (it != sessions_.end()) {
+            it->second->queued = false;
+            flush_session(*it->second);
+        }
+    }
+    pending_.clear();
+
+    publish_quotes();
+    flush_market_data();
+    return stats_.messages - messages;
+}
+
+void Gateway::start() {
+    if (epoll_fd_ < 0 || running_.exchange(true, std::memory_order_acq_rel)) {
+        return; // Not open, or already running
+    }
+    worker_ = std::thread([this]() {
+        while (running_.load(std::memory_order_acquire)) {
+            poll(100);
+        }
+    });
+}
+
+void Gateway::stop() {
+    if (!running_.exchange(false, std::memory_order_acq_rel)) {
+        return; // Not running
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = ::write(wake_fd_, &one, sizeof(one));
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+GatewayStats Gateway::stats() const {
+    GatewayStats stats = stats_;
+    stats.wire_to_wire = wire_to_wire_.summary(tsc_ns_per_tick());
+    return stats;
+}
+
+void Gateway::accept_sessions() {
+    for (;;) {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return; // EAGAIN once the backlog is empty
+        }
+        if (sessions_.size() >= config_.max_sessions || next_session_ >= kMaxSessions) {
+            ::close(fd);
+            continue;
+        }
+
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto session = std::make_unique<Session>();
+        session->fd = fd;
+        session->number = next_session_++;
+        session->in.resize(config_.receive_buffer);
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = session->number;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            ::close(fd);
+            continue;
+        }
+        ++stats_.sessions;
+        sessions_.emplace(session->number, std::move(session));
+    }
+}
+
+void Gateway::read_session(Session& session) {
+    uint32_t number = session.number;
+
+    // A full buffer without a complete message cannot be framed
+    if (session.in_used == session.in.size()) {
+        close_session(number, true);
+        return;
+    }
+    ssize_t received = ::recv(session.fd, session.in.data() + session.in_used, session.in.size() - session.in_used, 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (received <= 0) {
+        close_session(number, false);
+        return;
+    }
+    uint64_t received_tsc = read_tsc();
+    uint64_t received_ns = wall_clock_ns();
+    session.in_used += static_cast<size_t>(received);
+
+    // Every complete message of the read becomes one engine batch
+    commands_.clear();
+    requests_.clear();
+    wire::DecodeResult decoded = wire::decode(std::span<const std::byte>(session.in.data(), session.in_used),
+                                              [&](const wire::MessageView& message) {
+                                                  decode_request(session, message);
+                                              });
+    if (!commands_.empty()) {
+        engine_.execute_commands(commands_, response_);
+    } else {
+        response_.clear();
+    }
+
+    wire::Encoder encoder(session.out);
+    size_t next_result = 0;
+    for (const Request& request : requests_) {
+        if (!request.valid) {
+            encoder.ack(request.type, OrderStatus::Rejected, request.client_order_id, 0, received_ns);
+            continue;
+        }
+        const OrderResult& result = response_.results[next_result];
+        track_order(session, request, commands_[next_result++], result);
+        encoder.ack(request.type, result.status, request.client_order_id, result.filled_size, received_ns);
+    }
+    stats_.responses += requests_.size();
+    for (const Trade& trade : response_.trades) {
+        route_fills(trade);
+    }
+
+    // Keep a partial message at the front for the next read
+    std::memmove(session.in.data(), session.in.data() + decoded.consumed, session.in_used - decoded.consumed);
+    session.in_used -= decoded.consumed;
+
+    if (!flush_session(session)) {
+        return;
+    }
+    wire_to_wire_.record(read_tsc() - received_tsc);
+    if (decoded.malformed) {
+        close_session(number, true);
+    }
+}
+
+void Gateway::decode_request(Session& session, const wire::MessageView& message) {
+    Request request{message.type(), 0, false};
+    Command command;
+    switch (message.type()) {
+    case wire::MessageType::NewOrder: {
+        wire::NewOrderView order(message.data());
+        request.client_order_id = order.client_order_id();
+        request.valid = request.client_order_id <= kClientIdMask &&
+                        order.to_command(engine_order_id(session.number, request.client_order_id), command);
+        break;
+    }
+    case wire::MessageType::Cancel: {
+        wire::CancelView cancel(message.data());
+        request.client_order_id = cancel.client_order_id();
+        request.valid = request.client_order_id <= kClientIdMask;
+        command = Command::cancel(cancel.symbol(), engine_order_id(session.number, request.client_order_id));
+        break;
+    }
+    case wire::MessageType::Modify: {
+        wire::ModifyView modify(message.data());
+        request.client_order_id = modify.client_order_id();
+        request.valid = request.client_order_id <= kClientIdMask;
+        command = Command::modify(modify.symbol(), engine_order_id(session.number, request.client_order_id),
+                                  modify.size(), modify.price());
+        break;
+    }
+    default:
+        return; // Gateway-to-client types mean nothing here
+    }
+
+    ++stats_.messages;
+    if (request.valid) {
+        commands_.push_back(command);
+    } else {
+        ++stats_.rejected;
+    }
+    requests_.push_back(request);
+}
+
+void Gateway::track_order(Session& session, const Request& request, const Command& command,
+                          const OrderResult& result) {
+    // Fills of the batch are routed after its acks, so this sees the order
+    // as it was before it traded
+    switch (request.type) {
+    case wire::MessageType::NewOrder: {
+        bool waiting = result.status == OrderStatus::Pending;
+        bool resting = (result.status == OrderStatus::New || result.status == OrderStatus::PartiallyFilled) &&
+                       command.type != CommandType::NewMarket && command.tif == TimeInForce::GoodTillCancel;
+        if (waiting || resting) {
+            session.open[request.client_order_id] = OpenOrder{command.symbol, command.size, 0};
+        }
+        break;
+    }
+    case wire::MessageType::Cancel:
+        session.open.erase(request.client_order_id);
+        break;
+    case wire::MessageType::Modify: {
+        auto it = session.open.find(request.client_order_id);
+        if (it == session.open.end()) {
+            break;
+        }
+        if (result.status == OrderStatus::Filled || result.status == OrderStatus::Cancelled) {
+            session.open.erase(it);
+        } else if (result.status != OrderStatus::Rejected) {
+            it->second.size = command.size;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void Gateway::route_fills(const Trade& trade) {
+    for (OrderId order_id : {trade.order_id_buy, trade.order_id_sell}) {
+        auto it = sessions_.find(static_cast<uint32_t>(order_id >> kClientIdBits));
+        if (order_id >> kClientIdBits == 0 || it == sessions_.end()) {
+            continue; // Not a gateway order, or its session has gone
+        }
+        Session& session = *it->second;
+        uint64_t client_order_id = order_id & kClientIdMask;
+        wire::Encoder(session.out).fill(trade.symbol, client_order_id, trade.price, trade.size, trade.timestamp);
+        ++stats_.responses;
+        queue_output(session);
+
+        auto open = session.open.find(client_order_id);
+        if (open != session.open.end() && (open->second.filled += trade.size) >= open->second.size) {
+            session.open.erase(open);
+        }
+    }
+
+    if (market_data_fd_ >= 0) {
+        wire::Encoder(market_data_).trade_print(trade.symbol, trade.price, trade.size, trade.timestamp);
+        ++market_data_count_;
+        touched_.push_back(trade.symbol);
+    }
+}
+
+void Gateway::queue_output(Session& session) {
+    if (!session.queued) {
+        session.queued = true;
+        pending_.push_back(session.number);
+    }
+}
+
+bool Gateway::flush_session(Session& session) {
+    while (session.out_sent < session.out.size()) {
+        ssize_t sent = ::send(session.fd, session.out.data() + session.out_sent, session.out.size() - session.out_sent,
+                              MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0) {
+            session.out_sent += static_cast<size_t>(sent);
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            close_session(session.number, false);
+            return false;
+        }
+    }
+
+    size_t backlog = session.out.size() - session.out_sent;
+    if (backlog > config_.send_buffer_limit) {
+        close_session(session.number, true);
+        return false;
+    }
+    if (backlog == 0) {
+        session.out.clear();
+        session.out_sent = 0;
+    } else if (session.out_sent > backlog) {
+        // Shift the backlog down once more has been sent than is left
+        session.out.erase(session.out.begin(), session.out.begin() + static_cast<std::ptrdiff_t>(session.out_sent));
+        session.out_sent = 0;
+    }
+
+    // Wait for the socket to drain only while something is left to send
+    if ((backlog > 0) != session.want_write) {
+        session.want_write = backlog > 0;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | (session.want_write ? EPOLLOUT : 0u);
+        event.data.u64 = session.number;
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, session.fd, &event);
+    }
+    return true;
+}
+
+void Gateway::close_session(uint32_t number, bool dropped) {
+    auto it = sessions_.find(number);
+    if (it == sessions_.end()) {
+        return;
+    }
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second->fd, nullptr);
+    ::close(it->second->fd);
+    if (config_.cancel_on_disconnect) {
+        cancel_open_orders(*it->second);
+    }
+    sessions_.erase(it);
+    if (dropped) {
+        ++stats_.dropped_sessions;
+    }
+}
+
+void Gateway::cancel_open_orders(Session& session) {
+    if (session.open.empty()) {
+        return;
+    }
+
+    // One batch, like any read; the batch scratch is free again by the time
+    // a session can close
+    commands_.clear();
+    for (const auto& [client_order_id, order] : session.open) {
+        commands_.push_back(Command::cancel(order.symbol, engine_order_id(session.number, client_order_id)));
+    }
+    session.open.clear();
+    engine_.execute_commands(commands_, response_);
+    for (const OrderResult& result : response_.results) {
+        stats_.disconnect_cancels += result.status == OrderStatus::Cancelled;
+    }
+}
+
+void Gateway::publish_quotes() {
+    if (touched_.empty()) {
+        return;
+    }
+    std::sort(touched_.begin(), touched_.end());
+    touched_.erase(std::unique(touched_.begin(), touched_.end()), touched_.end());
+
+    // Quotes come from the books' snapshot buffers, never from a live book
+    // another thread may be matching on
+    wire::Encoder encoder(market_data_);
+    BookSnapshot snapshot;
+    for (SymbolId symbol : touched_) {
+        if (symbol >= quotes_.size()) {
+            quotes_.resize(static_cast<size_t>(symbol) + 1);
+        }
+        if (!quotes_[symbol]) {
+            quotes_[symbol] = engine_.book_snapshots(symbol, 1);
+        }
+        if (quotes_[symbol] && quotes_[symbol]->read(snapshot)) {
+            TopOfBook top = snapshot.top();
+            encoder.quote(symbol, top.bid.price, top.bid.quantity, top.ask.price, top.ask.quantity);
+            ++market_data_count_;
+        }
+    }
+    touched_.clear();
+}
+
+void Gateway::flush_market_data() {
+    if (market_data_count_ == 0) {
+        return;
+    }
+
+    // Pack the messages into datagrams, each behind a header carrying the
+    // sequence number of its first message and how many it holds
+    packets_.clear();
+    packet_ends_.clear();
+    size_t packet_start = 0;
+    uint16_t packet_count = 0;
+    auto finish_packet = [&]() {
+        wire::store<uint64_t>(packets_.data() + packet_start, market_data_sequence_);
+        wire::store<uint16_t>(packets_.data() + packet_start + 8, packet_count);
+        market_data_sequence_ += packet_count;
+        packet_ends_.push_back(packets_.size());
+    };
+
+    for (size_t offset = 0; offset < market_data_.size();) {
+        size_t length = wire::MessageView(market_data_.data() + offset).length();
+        if (packet_count == 0 || packets_.size() - packet_start + length > config_.datagram_size) {
+            if (packet_count > 0) {
+                finish_packet();
+            }
+            packet_start = packets_.size();
+            packet_count = 0;
+            packets_.resize(packets_.size() + wire::kPacketHeaderSize);
+        }
+        packets_.insert(packets_.end(), market_data_.begin() + static_cast<std::ptrdiff_t>(offset),
+                        market_data_.begin() + static_cast<std::ptrdiff_t>(offset + length));
+        ++packet_count;
+        offset += length;
+    }
+    finish_packet();
+    market_data_.clear();
+    market_data_count_ = 0;
+
+    // Datagrams a full socket buffer refuses are lost, like any other UDP
+    // loss; receivers see the gap in the sequence numbers
+    for (size_t first = 0; first < packet_ends_.size();) {
+        mmsghdr messages[kMaxDatagramsPerSend];
+        iovec vectors[kMaxDatagramsPerSend];
+        size_t batch = std::min(kMaxDatagramsPerSend, packet_ends_.size() - first);
+        for (size_t i = 0; i < batch; ++i) {
+            size_t begin = first + i == 0 ? 0 : packet_ends_[first + i - 1];
+            vectors[i] = {packets_.data() + begin, packet_ends_[first + i] - begin};
+            messages[i] = {};
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = ::sendmmsg(market_data_fd_, messages, static_cast<unsigned>(batch), 0);
+        if (sent <= 0) {
+            break;
+        }
+        stats_.market_data_packets += static_cast<uint64_t>(sent);
+        first += static_cast<size_t>(sent);
+    }
+}
+
+} // namespace trading
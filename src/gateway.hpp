@@ -0,0 +1,176 @@
+#pragma once
+
+#include "book_snapshot.hpp"
+#include "latency_histogram.hpp"
+#include "matching_engine.hpp"
+#include "wire_protocol.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace trading {
+
+struct GatewayConfig {
+    std::string bind_address = "0.0.0.0";
+    uint16_t port = 0;                      // Order entry TCP port; 0 picks a free one (see Gateway::port())
+    std::string market_data_address;        // UDP (multicast or unicast) destination; empty disables market data
+    uint16_t market_data_port = 0;
+    int multicast_ttl = 1;
+    size_t max_sessions = 256;
+    size_t receive_buffer = 64 * 1024;      // Per session; bounds the messages one read can batch
+    size_t send_buffer_limit = 4 << 20;     // Unsent output at which a session is dropped as too slow
+    size_t datagram_size = 1400;            // Largest market data datagram, headers included
+    bool cancel_on_disconnect = true;       // Cancel a session's open orders when it closes
+};
+
+struct GatewayStats {
+    uint64_t sessions;              // Connections accepted
+    uint64_t messages;              // Client messages decoded
+    uint64_t rejected;              // Of those, refused before the engine (bad order ID or type)
+    uint64_t responses;             // Acks and fills written to sessions
+    uint64_t market_data_packets;   // Datagrams sent
+    uint64_t dropped_sessions;      // Closed for a malformed stream or a backlog past send_buffer_limit
+    uint64_t disconnect_cancels;    // Orders cancelled because their session closed
+    LatencySummary wire_to_wire;    // Per read: from recv() returning until its acks are handed to send()
+};
+
+// Order entry gateway speaking the binary protocol of wire_protocol.hpp
+// over TCP and publishing trade prints and quotes over UDP.
+//
+// Each read from a session is decoded in place and executed as one
+// MatchingEngine::execute_commands batch, under a single engine lock, and
+// its acks go out in one send(). Fills reach the sessions owning either
+// side of a trade; market data is packed into datagrams that leave in one
+// sendmmsg() per loop iteration. Quotes are read from the engine's book
+// snapshots, so the gateway never reads a book while it matches.
+//
+// Sessions are numbered in order of arrival and never reuse a number. The
+// engine order ID of a client order is its session number above the low
+// kClientIdBits bits of its client order ID, so sessions cannot collide
+// or touch each other's orders. The gateway should be the engine's only
+// source of orders; trades of orders placed around it are not reported.
+//
+// Each session tracks the orders it has open, from their acks and fills,
+// and by default they are cancelled when the session closes, whether the
+// client hung up or was dropped. Orders that left the book another way
+// (self-trade prevention, a mass cancel, a triggered stop's unfilled
+// remainder) stay tracked until then and cost only a refused cancel. With
+// cancel_on_disconnect off, orders outlive their session and can be
+// removed with MatchingEngine::mass_cancel.
+//
+// Linux only (epoll). The loop runs on the gateway's own thread after
+// start(), or on the caller's through poll().
+class Gateway {
+public:
+    static constexpr unsigned kClientIdBits = 40;
+
+    explicit Gateway(MatchingEngine& engine, const GatewayConfig& config = {});
+    ~Gateway();
+
+    Gateway(const Gateway&) = delete;
+    Gateway& operator=(const Gateway&) = delete;
+
+    // Bind, listen and open the market data socket; false (with errno set)
+    // if any step fails
+    bool open();
+
+    // The bound order entry port, once open
+    uint16_t port() const { return port_; }
+
+    // One pass of the event loop: wait up to timeout_ms for activity,
+    // handle it and flush the output. Returns the messages processed
+    size_t poll(int timeout_ms);
+
+    // Run poll() on a dedicated thread until stop()
+    void start();
+    void stop();
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+    size_t session_count() const { return sessions_.size(); }
+
+    // Read while the loop is idle (after stop(), or between poll() calls)
+    GatewayStats stats() const;
+
+private:
+    // An order of a session that may still rest or wait for its trigger
+    struct OpenOrder {
+        SymbolId symbol;
+        uint64_t size;      // Total size, fills included
+        uint64_t filled;
+    };
+
+    struct Session {
+        int fd;
+        uint32_t number;
+        std::unordered_map<uint64_t, OpenOrder> open;   // By client order ID
+        std::vector<std::byte> in;
+        size_t in_used = 0;
+        std::vector<std::byte> out;
+        size_t out_sent = 0;
+        bool want_write = false;    // Registered for EPOLLOUT while a backlog waits
+        bool queued = false;        // In pending_
+    };
+
+    // One decoded client message of the batch being executed
+    struct Request {
+        wire::MessageType type;
+        uint64_t client_order_id;
+        bool valid;         // Whether it went to the engine (the next result belongs to it)
+    };
+
+    MatchingEngine& engine_;
+    GatewayConfig config_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    int market_data_fd_ = -1;
+    uint16_t port_ = 0;
+
+    std::unordered_map<uint32_t, std::unique_ptr<Session>> sessions_;
+    uint32_t next_session_ = 1;     // 0 marks orders that did not come through a gateway session
+
+    // Batch scratch, reused across reads
+    std::vector<Command> commands_;
+    std::vector<Request> requests_;
+    BatchResponse response_;
+    std::vector<SymbolId> touched_;     // Symbols with trades since the last quote publish
+    std::vector<std::shared_ptr<const BookSnapshotBuffer>> quotes_;    // By symbol, from its first trade
+    std::vector<uint32_t> pending_;     // Sessions with output waiting to be flushed
+
+    // Market data not yet sent, as concatenated messages
+    std::vector<std::byte> market_data_;
+    size_t market_data_count_ = 0;
+    uint64_t market_data_sequence_ = 1;
+    std::vector<std::byte> packets_;    // Datagrams being sent, back to back
+    std::vector<size_t> packet_ends_;
+
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+
+    GatewayStats stats_{};
+    LatencyHistogram wire_to_wire_;
+
+    static OrderId engine_order_id(uint32_t session, uint64_t client_order_id) {
+        return (static_cast<OrderId>(session) << kClientIdBits) | client_order_id;
+    }
+
+    void accept_sessions();
+    void read_session(Session& session);
+    void decode_request(Session& session, const wire::MessageView& message);
+    void track_order(Session& session, const Request& request, const Command& command, const OrderResult& result);
+    void route_fills(const Trade& trade);
+    void queue_output(Session& session);
+    bool flush_session(Session& session);
+    void close_session(uint32_t number, bool dropped);
+    void cancel_open_orders(Session& session);
+    void publish_quotes();
+    void flush_market_data();
+    void close_sockets();
+};
+
+} // namespace trading
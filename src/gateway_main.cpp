@@ -0,0 +1,110 @@
+#include "gateway.hpp"
+#include "matching_engine.hpp"
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+using namespace trading;
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_signal(int) {
+    stop_requested = 1;
+}
+
+std::vector<std::string> split(const std::string& list, char separator) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(separator, start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        if (end > start) {
+            parts.push_back(list.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return parts;
+}
+
+void print_usage() {
+    std::cout << "Usage: trading_gateway [--bind ADDR] [--port N] [--symbols SYM,SYM,...]\n"
+              << "                       [--market-data ADDR:PORT] [--ttl N] [--keep-orders]\n"
+              << "Symbols are numbered from 0 in the order given; orders refer to them by number.\n"
+              << "--keep-orders leaves a session's open orders in the book when it disconnects."
+              << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    GatewayConfig config;
+    config.port = 9000;
+    std::vector<std::string> symbols = {"AAPL", "MSFT", "GOOGL"};
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--bind") == 0 && has_value) {
+            config.bind_address = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+            config.port = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--symbols") == 0 && has_value) {
+            symbols = split(argv[++i], ',');
+        } else if (std::strcmp(argv[i], "--market-data") == 0 && has_value) {
+            std::string target = argv[++i];
+            size_t colon = target.rfind(':');
+            if (colon == std::string::npos) {
+                print_usage();
+                return 1;
+            }
+            config.market_data_address = target.substr(0, colon);
+            config.market_data_port = static_cast<uint16_t>(std::strtoul(target.c_str() + colon + 1, nullptr, 10));
+        } else if (std::strcmp(argv[i], "--ttl") == 0 && has_value) {
+            config.multicast_ttl = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--keep-orders") == 0) {
+            config.cancel_on_disconnect = false;
+        } else {
+            print_usage();
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    MatchingEngine engine;
+    for (const std::string& symbol : symbols) {
+        std::cout << "Symbol " << engine.add_order_book(symbol) << ": " << symbol << std::endl;
+    }
+
+    Gateway gateway(engine, config);
+    if (!gateway.open()) {
+        std::cerr << "Cannot open the gateway: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    std::cout << "Order entry on " << config.bind_address << ":" << gateway.port();
+    if (!config.market_data_address.empty()) {
+        std::cout << ", market data to " << config.market_data_address << ":" << config.market_data_port;
+    }
+    std::cout << std::endl;
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    while (!stop_requested) {
+        gateway.poll(100);
+    }
+
+    GatewayStats stats = gateway.stats();
+    std::cout << "\nSessions: " << stats.sessions << ", messages: " << stats.messages
+              << " (" << stats.rejected << " rejected), responses: " << stats.responses
+              << ", market data packets: " << stats.market_data_packets
+              << ", cancelled on disconnect: " << stats.disconnect_cancels << std::endl;
+    std::cout << std::fixed << std::setprecision(0) << "Wire to wire (ns per read): p50 "
+              << stats.wire_to_wire.p50_ns << ", p99 " << stats.wire_to_wire.p99_ns << ", p99.9 "
+              << stats.wire_to_wire.p999_ns << ", max " << stats.wire_to_wire.max_ns << std::endl;
+    return 0;
+}
@@ -0,0 +1,477 @@
+#include "journal.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TRADING_HAS_POSIX_IO 1
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define TRADING_HAS_POSIX_IO 0
+#endif
+
+namespace trading {
+
+namespace {
+
+// First record-sized block of every journal
+struct JournalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    unsigned char reserved[48];
+};
+
+static_assert(sizeof(JournalHeader) == sizeof(JournalRecord), "The header keeps records block aligned");
+
+constexpr char kJournalMagic[8] = {'F', 'S', 'J', 'R', 'N', 'L', '0', '1'};
+constexpr uint32_t kJournalVersion = 4;
+
+JournalHeader make_header() {
+    JournalHeader header{};
+    std::memcpy(header.magic, kJournalMagic, sizeof(kJournalMagic));
+    header.version = kJournalVersion;
+    header.record_size = sizeof(JournalRecord);
+    return header;
+}
+
+size_t round_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+JournalRecord JournalRecord::from_command(const Command& command, uint64_t timestamp) {
+    JournalRecord record{};
+    record.timestamp = timestamp;
+    record.order_id = command.order_id;
+    record.price = command.price.ticks;
+    record.size = command.size;
+    record.symbol = command.symbol;
+    record.type = JournalRecordType::Command;
+    record.command = command.type;
+    record.side = command.side;
+    record.order_type = command.order_type;
+    record.tif = command.tif;
+    record.account = command.account;
+    if (command.type == CommandType::NewStop) {
+        std::memcpy(record.name, &command.trigger.ticks, sizeof(command.trigger.ticks));
+    }
+    record.checksum = record.compute_checksum();
+    return record;
+}
+
+JournalRecord JournalRecord::add_book(const std::string& symbol, SymbolId id, const MatchingConfig& matching) {
+    JournalRecord record{};
+    record.symbol = id;
+    record.size = static_cast<uint64_t>(matching.algorithm);
+    record.price = matching.lmm_percent;
+    record.account = matching.lmm_account;
+    record.type = JournalRecordType::AddBook;
+    record.name_length = static_cast<uint8_t>(std::min(symbol.size(), kMaxSymbolLength));
+    std::memcpy(record.name, symbol.data(), std::min(symbol.size(), kMaxNameLength));
+    record.checksum = record.compute_checksum();
+    return record;
+}
+
+JournalRecord JournalRecord::book_name(const std::string& symbol, SymbolId id, size_t offset) {
+    JournalRecord record{};
+    record.symbol = id;
+    record.type = JournalRecordType::BookName;
+    record.name_length = static_cast<uint8_t>(std::min(symbol.size() - offset, kMaxNameLength));
+    std::memcpy(record.name, symbol.data() + offset, record.name_length);
+    record.checksum = record.compute_checksum();
+    return record;
+}
+
+Command JournalRecord::to_command() const {
+    Command result{order_id, Price(price), size, 0, symbol, command, side, order_type, tif, account};
+    if (command == CommandType::NewStop) {
+        std::memcpy(&result.trigger.ticks, name, sizeof(result.trigger.ticks));
+    }
+    return result;
+}
+
+MatchingConfig JournalRecord::matching() const {
+    return {static_cast<MatchingAlgorithm>(size), account, static_cast<uint32_t>(price)};
+}
+
+uint32_t JournalRecord::compute_checksum() const {
+    // FNV-1a; an all-zero record (unwritten padding) never checks out
+    const auto* bytes = reinterpret_cast<const unsigned char*>(this);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(JournalRecord, checksum); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// --- JournalWriter ---
+
+void JournalWriter::FreeBuffer::operator()(unsigned char* buffer) const {
+    std::free(buffer);
+}
+
+JournalWriter::~JournalWriter() {
+    close();
+}
+
+bool JournalWriter::open(const JournalOptions& options) {
+#if TRADING_HAS_POSIX_IO
+    close();
+    options_ = options;
+
+    // Find where the valid records of an existing journal end
+    uint64_t valid_end = 0;
+    if (!options.truncate) {
+        struct stat info;
+        if (::stat(options.path.c_str(), &info) == 0 && info.st_size > 0) {
+            JournalReader reader;
+            if (!reader.open(options.path)) {
+                return false; // Not a journal; refuse to append to it
+            }
+            for (JournalRecord record; reader.next(record);) {
+            }
+            valid_end = reader.valid_bytes();
+        }
+    }
+
+    capacity_ = round_up(std::max(options.buffer_bytes, kBlockSize), kBlockSize);
+    buffer_.reset(static_cast<unsigned char*>(std::aligned_alloc(kBlockSize, capacity_)));
+    if (!buffer_) {
+        return false;
+    }
+
+    int flags = O_WRONLY | O_CREAT | (valid_end == 0 ? O_TRUNC : 0);
+    int fd = ::open(options.path.c_str(), flags, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Drop a torn tail, then pick up the partial last block so that direct
+    // writes can rewrite it whole
+    if (valid_end > 0 && ::ftruncate(fd, static_cast<off_t>(valid_end)) != 0) {
+        ::close(fd);
+        return false;
+    }
+    file_offset_ = options.direct_io ? valid_end / kBlockSize * kBlockSize : valid_end;
+    used_ = static_cast<size_t>(valid_end - file_offset_);
+    written_ = used_;
+    if (used_ > 0) {
+        int reader = ::open(options.path.c_str(), O_RDONLY);
+        bool read_ok = reader >= 0 &&
+            ::pread(reader, buffer_.get(), used_, static_cast<off_t>(file_offset_)) == static_cast<ssize_t>(used_);
+        if (reader >= 0) {
+            ::close(reader);
+        }
+        if (!read_ok) {
+            ::close(fd);
+            return false;
+        }
+    }
+
+#ifdef O_DIRECT
+    // Not every file system supports direct I/O (tmpfs does not); fall back
+    // to buffered writes there
+    if (options.direct_io) {
+        int direct_fd = ::open(options.path.c_str(), O_WRONLY | O_DIRECT);
+        if (direct_fd >= 0) {
+            ::close(fd);
+            fd = direct_fd;
+            direct_ = true;
+        }
+    }
+#endif
+    if (!direct_) {
+        // Buffered writes start exactly at the end of the valid records
+        file_offset_ += written_;
+        used_ = 0;
+        written_ = 0;
+    }
+    fd_ = fd;
+
+    if (valid_end == 0) {
+        JournalHeader header = make_header();
+        std::memcpy(buffer_.get() + used_, &header, sizeof(header));
+        used_ += sizeof(header);
+        return commit();
+    }
+    return true;
+#else
+    (void)options;
+    return false;
+#endif
+}
+
+bool JournalWriter::reserve(size_t bytes) {
+    if (used_ + bytes > capacity_) {
+        write_buffer();
+    }
+    // A failed write leaves the buffer as full as it was
+    if (used_ + bytes > capacity_) {
+        ++stats_.errors;
+        ++stats_.dropped;
+        return false;
+    }
+    return true;
+}
+
+void JournalWriter::append(const JournalRecord& record) {
+    std::memcpy(buffer_.get() + used_, &record, sizeof(record));
+    used_ += sizeof(record);
+    ++stats_.records;
+}
+
+bool JournalWriter::append_command(const Command& command, uint64_t timestamp) {
+    if (!reserve(sizeof(JournalRecord))) {
+        return false;
+    }
+    append(JournalRecord::from_command(command, timestamp));
+    return true;
+}
+
+bool JournalWriter::append_book(const std::string& symbol, SymbolId id, const MatchingConfig& matching) {
+    if (symbol.size() > JournalRecord::kMaxSymbolLength) {
+        ++stats_.errors;
+        return false;
+    }
+    // The name group goes in whole or not at all
+    JournalRecord record = JournalRecord::add_book(symbol, id, matching);
+    if (!reserve((1 + record.name_records()) * sizeof(JournalRecord))) {
+        return false;
+    }
+    append(record);
+    for (size_t offset = JournalRecord::kMaxNameLength; offset < symbol.size(); offset += JournalRecord::kMaxNameLength) {
+        append(JournalRecord::book_name(symbol, id, offset));
+    }
+    return true;
+}
+
+bool JournalWriter::write_buffer() {
+#if TRADING_HAS_POSIX_IO
+    if (used_ == written_) {
+        return true; // Nothing new
+    }
+
+    // Direct I/O writes whole blocks; the zero padding past the last record
+    // is overwritten by the next commit and trimmed on close
+    size_t length = used_;
+    if (direct_) {
+        length = round_up(used_, kBlockSize);
+        std::memset(buffer_.get() + used_, 0, length - used_);
+    }
+
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::pwrite(fd_, buffer_.get() + done, length - done, static_cast<off_t>(file_offset_ + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ++stats_.errors; // An error, or a write that made no progress
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+
+    if (unsynced_ == 0) {
+        unsynced_since_ = std::chrono::steady_clock::now();
+    }
+    stats_.bytes += used_ - written_;
+    unsynced_ += used_ - written_;
+
+    // Keep the partial last block in the buffer when writing direct
+    size_t complete = direct_ ? used_ / kBlockSize * kBlockSize : used_;
+    std::memmove(buffer_.get(), buffer_.get() + complete, used_ - complete);
+    file_offset_ += complete;
+    used_ -= complete;
+    written_ = used_;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool JournalWriter::sync_file() {
+#if TRADING_HAS_POSIX_IO
+    if (unsynced_ == 0) {
+        return true;
+    }
+#if defined(__linux__)
+    int result = ::fdatasync(fd_);
+#else
+    int result = ::fsync(fd_);
+#endif
+    if (result != 0) {
+        ++stats_.errors;
+        return false;
+    }
+    ++stats_.syncs;
+    unsynced_ = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool JournalWriter::commit() {
+    if (!is_open()) {
+        return false;
+    }
+
+    bool ok = write_buffer();
+    switch (options_.sync) {
+    case JournalSync::None:
+        break;
+    case JournalSync::Group:
+        if (unsynced_ >= options_.group_bytes ||
+            (unsynced_ > 0 && options_.group_interval_ns > 0 &&
+             std::chrono::steady_clock::now() - unsynced_since_ >= std::chrono::nanoseconds(options_.group_interval_ns))) {
+            ok = sync_file() && ok;
+        }
+        break;
+    case JournalSync::Always:
+        ok = sync_file() && ok;
+        break;
+    }
+    return ok;
+}
+
+bool JournalWriter::sync() {
+    if (!is_open()) {
+        return false;
+    }
+    bool written = write_buffer();
+    return sync_file() && written;
+}
+
+void JournalWriter::close() {
+#if TRADING_HAS_POSIX_IO
+    if (!is_open()) {
+        return;
+    }
+    sync();
+    if (direct_) {
+        // Trim the block padding after the last record
+        if (::ftruncate(fd_, static_cast<off_t>(file_offset_ + used_)) != 0) {
+            ++stats_.errors;
+        }
+    }
+    ::close(fd_);
+    fd_ = -1;
+    direct_ = false;
+    buffer_.reset();
+    used_ = 0;
+    written_ = 0;
+    file_offset_ = 0;
+    unsynced_ = 0;
+#endif
+}
+
+// --- JournalReader ---
+
+JournalReader::~JournalReader() {
+    close();
+}
+
+bool JournalReader::open(const std::string& path) {
+    close();
+    file_ = std::fopen(path.c_str(), "rb");
+    if (!file_) {
+        return false;
+    }
+
+    JournalHeader header;
+    JournalHeader expected = make_header();
+    if (std::fread(&header, sizeof(header), 1, file_) != 1 ||
+        std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.version != expected.version || header.record_size != expected.record_size) {
+        close();
+        return false;
+    }
+
+    batch_ = std::make_unique<JournalRecord[]>(kBatchRecords);
+    return true;
+}
+
+bool JournalReader::next(JournalRecord& record) {
+    if (!read(record)) {
+        return false;
+    }
+    if (record.type == JournalRecordType::BookName) {
+        done_ = true; // Only ever follows an AddBook record
+        return false;
+    }
+
+    if (record.type == JournalRecordType::AddBook) {
+        // A name cut short by a crash makes the whole book torn, so that a
+        // reopened writer drops it along with its AddBook record
+        book_name_.assign(record.name, std::min<size_t>(record.name_length, JournalRecord::kMaxNameLength));
+        for (size_t i = 0, parts = record.name_records(); i < parts; ++i) {
+            JournalRecord part;
+            if (!read(part) || part.type != JournalRecordType::BookName || part.symbol != record.symbol) {
+                done_ = true;
+                return false;
+            }
+            book_name_.append(part.name, part.name_length);
+        }
+        if (book_name_.size() != record.name_length) {
+            done_ = true;
+            return false;
+        }
+        records_ += record.name_records();
+    }
+    ++records_;
+    return true;
+}
+
+bool JournalReader::read(JournalRecord& record) {
+    if (done_ || !file_) {
+        return false;
+    }
+
+    if (batch_pos_ == batch_size_) {
+        // A partial record at the end of the file is not counted by fread
+        batch_size_ = std::fread(batch_.get(), sizeof(JournalRecord), kBatchRecords, file_);
+        batch_pos_ = 0;
+        if (batch_size_ == 0) {
+            done_ = true;
+            return false;
+        }
+    }
+
+    const JournalRecord& candidate = batch_[batch_pos_];
+    bool known = candidate.type == JournalRecordType::Command || candidate.type == JournalRecordType::AddBook ||
+                 candidate.type == JournalRecordType::BookName;
+    if (!known || !candidate.valid()) {
+        done_ = true;
+        return false;
+    }
+
+    record = candidate;
+    ++batch_pos_;
+    return true;
+}
+
+uint64_t JournalReader::valid_bytes() const {
+    return sizeof(JournalHeader) + records_ * sizeof(JournalRecord);
+}
+
+void JournalReader::close() {
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+    batch_.reset();
+    batch_size_ = 0;
+    batch_pos_ = 0;
+    records_ = 0;
+    done_ = false;
+    book_name_.clear();
+}
+
+} // namespace trading
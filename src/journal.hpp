@@ -0,0 +1,215 @@
+#pragma once
+
+#include "command.hpp"
+#include "matching_policy.hpp"
+#include "order.hpp"
+#include <cstddef>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+namespace trading {
+
+// Kind of entry in a journal
+enum class JournalRecordType : uint8_t {
+    Command = 1,    // An inbound command and the event time it executed at
+    AddBook = 2,    // A book created under a given SymbolId
+    BookName = 3    // The next part of a name too long for its AddBook record
+};
+
+// Fixed-size journal entry, one cache line. Every field is written
+// explicitly (no padding), and the trailing checksum lets a reader stop
+// cleanly at a record torn by a crash.
+struct JournalRecord {
+    uint64_t timestamp;         // Event time the command executed at
+    OrderId order_id;
+    int64_t price;              // Ticks; AddBook records: lead market maker share in percent
+    uint64_t size;              // AddBook records: the MatchingAlgorithm
+    SymbolId symbol;
+    JournalRecordType type;
+    CommandType command;        // Command records only
+    OrderSide side;
+    OrderType order_type;       // Command records only
+    TimeInForce tif;            // Command records only
+    uint8_t name_length;        // AddBook records: length of the whole name; BookName records: bytes of name in use
+    char name[14];              // AddBook records: the symbol, or its start; BookName records: the next part;
+                                // NewStop commands: the trigger, in its first 8 bytes
+    AccountId account;          // AddBook records: the lead market maker
+    uint32_t checksum;          // FNV-1a over every byte before it
+
+    static constexpr size_t kMaxNameLength = sizeof(name);    // Name bytes one record holds
+    static constexpr size_t kMaxSymbolLength = 255;            // Longest name a book can be journaled under
+
+    static JournalRecord from_command(const Command& command, uint64_t timestamp);
+
+    // A book's AddBook record, carrying the first kMaxNameLength bytes of
+    // its name; longer names continue in book_name() records after it
+    static JournalRecord add_book(const std::string& symbol, SymbolId id, const MatchingConfig& matching = {});
+    static JournalRecord book_name(const std::string& symbol, SymbolId id, size_t offset);
+
+    // Number of BookName records that follow an AddBook record
+    size_t name_records() const {
+        return name_length > kMaxNameLength ? (name_length - 1) / kMaxNameLength : 0;
+    }
+
+    Command to_command() const;
+    MatchingConfig matching() const;
+
+    uint32_t compute_checksum() const;
+    bool valid() const { return checksum == compute_checksum(); }
+};
+
+static_assert(std::is_trivially_copyable_v<JournalRecord>, "Records are written as raw bytes");
+static_assert(sizeof(JournalRecord) == 64, "Records are one cache line and divide a disk block evenly");
+
+// How often committed records are forced to stable storage
+enum class JournalSync : uint8_t {
+    None,       // Hand them to the OS and let it write back
+    Group,      // Sync once group_bytes have accumulated, or group_interval_ns has passed, since the last sync
+    Always      // Sync on every commit
+};
+
+struct JournalOptions {
+    std::string path;
+    JournalSync sync = JournalSync::Group;
+    size_t group_bytes = 64 * 1024;         // Group commit threshold
+
+    // Longest a written record waits for a group sync; 0 leaves it to
+    // group_bytes alone. Checked on commit, so a record committed just
+    // before the input stops waits for the next commit or sync(); an
+    // engine thread syncs its journal itself once its queue goes quiet
+    uint64_t group_interval_ns = 2'000'000;
+    size_t buffer_bytes = 1024 * 1024;      // Records buffered between commits
+    bool direct_io = false;                 // Bypass the page cache with O_DIRECT where supported
+    bool truncate = false;                  // Start a new journal instead of appending
+};
+
+// Counters of a journal writer
+struct JournalStats {
+    uint64_t records;   // Records appended
+    uint64_t bytes;     // Bytes handed to the file
+    uint64_t syncs;     // fsync calls
+    uint64_t errors;    // Failed writes or syncs, and records that could not be encoded
+    uint64_t dropped;   // Records refused because a failed write left the buffer full
+};
+
+// Append-only, write-ahead journal of engine input. Records collect in an
+// in-memory buffer; commit() writes them with one system call and, under
+// JournalSync::Group, syncs only once enough bytes have built up, so a burst
+// of commands shares a single fsync.
+//
+// Reopening an existing journal drops any torn record at its tail and
+// appends after the last valid one. With direct I/O the buffer is block
+// aligned and the partial last block is rewritten in place on each commit.
+// Journals are available on POSIX platforms; elsewhere open() fails.
+// Not thread-safe: the engine appends under its own lock.
+class JournalWriter {
+public:
+    static constexpr size_t kBlockSize = 4096;
+
+    JournalWriter() = default;
+    ~JournalWriter();
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    bool open(const JournalOptions& options);
+    bool is_open() const { return fd_ >= 0; }
+
+    // True if the file was opened with O_DIRECT (direct_io was requested
+    // and the file system accepted it)
+    bool direct_io() const { return direct_; }
+
+    // Buffer a command with the event time it executed at; a full buffer
+    // is written out without syncing. Returns false (and counts the record
+    // as dropped) if the buffer is full and cannot be written
+    bool append_command(const Command& command, uint64_t timestamp);
+
+    // Buffer a book creation; returns false (and counts an error) if the
+    // symbol is longer than JournalRecord::kMaxSymbolLength or its records
+    // do not fit, as for append_command
+    bool append_book(const std::string& symbol, SymbolId id, const MatchingConfig& matching = {});
+
+    // Write everything buffered and sync according to the policy
+    bool commit();
+
+    // Write everything buffered and sync now
+    bool sync();
+
+    // Whether, under JournalSync::Group, written records are waiting for
+    // their group's sync
+    bool sync_pending() const { return options_.sync == JournalSync::Group && unsynced_ > 0; }
+
+    // Sync and close; reopening appends
+    void close();
+
+    JournalStats stats() const { return stats_; }
+
+private:
+    struct FreeBuffer {
+        void operator()(unsigned char* buffer) const;
+    };
+
+    JournalOptions options_;
+    int fd_ = -1;
+    bool direct_ = false;
+    std::unique_ptr<unsigned char, FreeBuffer> buffer_;
+    size_t capacity_ = 0;
+    size_t used_ = 0;           // Bytes in the buffer
+    size_t written_ = 0;        // Leading bytes of the buffer already in the file
+    uint64_t file_offset_ = 0;  // File offset of the buffer's first byte
+    uint64_t unsynced_ = 0;     // Bytes written since the last sync
+    std::chrono::steady_clock::time_point unsynced_since_;  // When the first of them was written
+    JournalStats stats_{0, 0, 0, 0, 0};
+
+    // Make room for `bytes` more, writing the buffer out if it is full
+    bool reserve(size_t bytes);
+    void append(const JournalRecord& record);
+    bool write_buffer();
+    bool sync_file();
+};
+
+// Sequential reader over a journal written by JournalWriter
+class JournalReader {
+public:
+    JournalReader() = default;
+    ~JournalReader();
+
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+
+    // Returns false if the file is missing or is not a journal
+    bool open(const std::string& path);
+
+    // Read the next record; false at the end of the journal or at the first
+    // torn or corrupt record. An AddBook record is returned once the
+    // BookName records after it have been read too, and book_name() then
+    // holds its whole name
+    bool next(JournalRecord& record);
+    const std::string& book_name() const { return book_name_; }
+
+    // Records read so far (the BookName records of a returned AddBook
+    // included), and the file size they cover
+    uint64_t records() const { return records_; }
+    uint64_t valid_bytes() const;
+
+    void close();
+
+private:
+    static constexpr size_t kBatchRecords = 4096;
+
+    std::FILE* file_ = nullptr;
+    std::unique_ptr<JournalRecord[]> batch_;
+    size_t batch_size_ = 0;
+    size_t batch_pos_ = 0;
+    uint64_t records_ = 0;
+    bool done_ = false;
+    std::string book_name_;
+
+    bool read(JournalRecord& record);
+};
+
+} // namespace trading
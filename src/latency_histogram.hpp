@@ -0,0 +1,151 @@
+#pragma once
+
+#include "tsc.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace trading {
+
+#ifndef TRADING_LATENCY_STATS
+#define TRADING_LATENCY_STATS 0
+#endif
+
+// Set by the TRADING_LATENCY_STATS build option; when false, latency
+// instrumentation compiles to nothing
+inline constexpr bool kLatencyStatsEnabled = TRADING_LATENCY_STATS != 0;
+
+// Percentiles of one histogram, converted to nanoseconds
+struct LatencySummary {
+    uint64_t count;
+    double min_ns;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+};
+
+// Fixed-size log-linear histogram in the style of HdrHistogram: values below
+// 64 are counted exactly, larger values fall into 32 linear sub-buckets per
+// power of two, so every recorded value is resolved to within about 3% up to
+// 2^40. Recording is a few integer operations and never allocates.
+// Not thread-safe: each histogram has a single writer.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 5;
+    static constexpr uint64_t kSubBuckets = uint64_t(1) << kSubBucketBits;
+    static constexpr unsigned kMaxValueBits = 40;
+    static constexpr size_t kBucketCount = (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t value) {
+        ++counts_[bucket_of(value)];
+        ++count_;
+        sum_ += value;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    // Add every sample of another histogram to this one
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / static_cast<double>(count_) : 0.0; }
+
+    // Smallest recorded value v such that at least `percentile` percent of
+    // samples are <= v, up to bucket resolution (never above max())
+    uint64_t value_at_percentile(double percentile) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        double clamped = std::clamp(percentile, 0.0, 100.0);
+        auto target = static_cast<uint64_t>(clamped / 100.0 * static_cast<double>(count_) + 0.5);
+        target = std::clamp<uint64_t>(target, 1, count_);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts_[i];
+            if (seen >= target) {
+                return std::min(highest_value_in(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    // Percentiles in nanoseconds, given the length of one recorded unit
+    LatencySummary summary(double ns_per_unit = 1.0) const {
+        auto ns = [ns_per_unit](uint64_t value) { return static_cast<double>(value) * ns_per_unit; };
+        return {count_, ns(min()), mean() * ns_per_unit,
+                ns(value_at_percentile(50.0)), ns(value_at_percentile(99.0)),
+                ns(value_at_percentile(99.9)), ns(max_)};
+    }
+
+private:
+    std::array<uint64_t, kBucketCount> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+
+    static size_t bucket_of(uint64_t value) {
+        if (value < 2 * kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        unsigned shift = static_cast<unsigned>(std::bit_width(value)) - kSubBucketBits - 1;
+        if (shift > kMaxValueBits - kSubBucketBits - 1) {
+            return kBucketCount - 1; // Beyond the tracked range
+        }
+        uint64_t sub = value >> shift; // In [kSubBuckets, 2 * kSubBuckets)
+        return static_cast<size_t>((shift + 1) * kSubBuckets + (sub - kSubBuckets));
+    }
+
+    static uint64_t highest_value_in(size_t bucket) {
+        if (bucket < 2 * kSubBuckets) {
+            return bucket;
+        }
+        uint64_t shift = bucket / kSubBuckets - 1;
+        uint64_t sub = bucket % kSubBuckets + kSubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+};
+
+// Records the timestamp counter ticks between construction and destruction
+// into a histogram (none if it is null); does nothing at all when latency
+// stats are compiled out
+class LatencyTimer {
+public:
+    explicit LatencyTimer(LatencyHistogram* histogram)
+        : histogram_(histogram), start_(kLatencyStatsEnabled && histogram ? read_tsc() : 0) {}
+
+    ~LatencyTimer() {
+        if constexpr (kLatencyStatsEnabled) {
+            if (histogram_) {
+                histogram_->record(read_tsc() - start_);
+            }
+        }
+    }
+
+    LatencyTimer(const LatencyTimer&) = delete;
+    LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+private:
+    LatencyHistogram* histogram_;
+    uint64_t start_;
+};
+
+} // namespace trading
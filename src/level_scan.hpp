@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace trading {
+
+// Kernels over the contiguous per-level quantities kept by PriceLadder. The
+// instruction set is fixed at build time by TRADING_SIMD in CMakeLists.txt:
+// AVX-512 or AVX2 when the compiler targets it, plain loops otherwise.
+namespace level_scan {
+
+#if defined(__AVX512F__)
+inline constexpr const char* kInstructionSet = "avx512";
+#elif defined(__AVX2__)
+inline constexpr const char* kInstructionSet = "avx2";
+#else
+inline constexpr const char* kInstructionSet = "scalar";
+#endif
+
+// Sum of count quantities
+inline uint64_t sum(const uint64_t* values, size_t count) {
+    uint64_t total = 0;
+    size_t i = 0;
+#if defined(__AVX512F__)
+    __m512i acc = _mm512_setzero_si512();
+    for (; i + 8 <= count; i += 8) {
+        acc = _mm512_add_epi64(acc, _mm512_loadu_si512(values + i));
+    }
+    alignas(64) uint64_t lanes[8];
+    _mm512_store_si512(lanes, acc);
+    for (uint64_t lane : lanes) {
+        total += lane;
+    }
+#elif defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 4 <= count; i += 4) {
+        acc = _mm256_add_epi64(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)));
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    total = static_cast<uint64_t>(_mm_cvtsi128_si64(half)) + static_cast<uint64_t>(_mm_extract_epi64(half, 1));
+#endif
+    for (; i < count; ++i) {
+        total += values[i];
+    }
+    return total;
+}
+
+} // namespace level_scan
+
+} // namespace trading
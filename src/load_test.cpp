@@ -0,0 +1,468 @@
+#include "matching_engine.hpp"
+#include "sharded_matching_engine.hpp"
+#include "latency_histogram.hpp"
+#include "engine_runtime.hpp"
+#include "tool_support.hpp"
+#include "tsc.hpp"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <cstdlib>
+#include <cstring>
+
+using namespace trading;
+
+// Multi-threaded load test: producer threads drive order flow across many
+// symbols into the engine in one of three modes, and each run reports
+// sustained throughput, producer-side latency, the engine's own stage
+// histograms and how long producers waited on the engine lock. Running the
+// same flow at several thread counts gives the scaling curve of each mode.
+
+using tools::FlowMix;
+using tools::kMixes;
+
+enum class Mode : uint8_t {
+    Mutex,      // Producers call the synchronous entry points and contend on the engine lock
+    Queued,     // Producers submit() to one engine thread through its inbound queue
+    Sharded     // Producers submit() to ShardedMatchingEngine, one thread per shard
+};
+
+const char* mode_name(Mode mode) {
+    switch (mode) {
+    case Mode::Mutex: return "mutex";
+    case Mode::Queued: return "queued";
+    case Mode::Sharded: return "sharded";
+    }
+    return "?";
+}
+
+struct LoadConfig {
+    FlowMix mix = kMixes[1];
+    size_t symbols = 16;
+    size_t ops_per_thread = 200000;
+    size_t depth = 200;             // Resting orders per symbol before the timed phase
+    size_t shards = 4;
+    IdleStrategy idle = IdleStrategy::SpinYield;
+};
+
+constexpr int64_t kMidTicks = 10000;
+constexpr int64_t kLevels = 50;
+constexpr size_t kQueueCapacity = 1 << 16;
+
+// A producer's operations, drawn before the timed phase
+struct LoadOp {
+    enum Type : uint8_t { Add, Cancel, Aggress } type;
+    OrderSide side;
+    SymbolId symbol;
+    uint32_t pick;      // Selects the live order to cancel
+    uint64_t size;
+    int64_t offset;     // Ticks away from the mid for passive orders
+};
+
+std::vector<LoadOp> generate_ops(const LoadConfig& config, size_t count, uint64_t seed) {
+    std::mt19937_64 generator(seed);
+    std::uniform_int_distribution<unsigned> percent(0, 99);
+    std::uniform_int_distribution<uint32_t> pick;
+    std::uniform_int_distribution<SymbolId> symbol(0, static_cast<SymbolId>(config.symbols - 1));
+    std::uniform_int_distribution<uint64_t> passive_size(1, 200);
+    std::uniform_int_distribution<uint64_t> aggress_size(1, 400);
+    std::uniform_int_distribution<int64_t> offset(1, kLevels);
+
+    std::vector<LoadOp> ops;
+    ops.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        unsigned roll = percent(generator);
+        OrderSide side = (generator() & 1) ? OrderSide::Buy : OrderSide::Sell;
+        if (roll < config.mix.add) {
+            ops.push_back({LoadOp::Add, side, symbol(generator), 0, passive_size(generator), offset(generator)});
+        } else if (roll < config.mix.add + config.mix.cancel) {
+            ops.push_back({LoadOp::Cancel, side, 0, pick(generator), 0, 0});
+        } else {
+            ops.push_back({LoadOp::Aggress, side, symbol(generator), 0, aggress_size(generator), 0});
+        }
+    }
+    return ops;
+}
+
+Price passive_price(OrderSide side, int64_t offset) {
+    return Price(side == OrderSide::Buy ? kMidTicks - offset : kMidTicks + offset);
+}
+
+// Appended rather than built with operator+, which trips GCC's -Wrestrict
+std::string symbol_name(size_t index) {
+    std::string name = "S";
+    name += std::to_string(index);
+    return name;
+}
+
+// Mode adapters. send() is called from any producer thread and returns
+// false only when a queue is full; finish() waits until everything sent
+// has executed
+class MutexTarget {
+public:
+    explicit MutexTarget(const LoadConfig& config) : engine_(config.depth * 4 + 1024) {
+        for (size_t i = 0; i < config.symbols; ++i) {
+            engine_.add_order_book(symbol_name(i));
+        }
+    }
+
+    bool send(const Command& command) {
+        switch (command.type) {
+        case CommandType::NewLimit:
+            engine_.place_limit_order(command.symbol, command.order_id, command.side, command.size,
+                                      OrderBook::to_double(command.price));
+            break;
+        case CommandType::NewMarket:
+            engine_.place_market_order(command.symbol, command.order_id, command.side, command.size);
+            break;
+        default:
+            engine_.cancel_order(command.order_id);
+            break;
+        }
+        return true;
+    }
+
+    void start() {}
+    void finish() {}
+    EngineLatencyStats latency_stats() const { return engine_.latency_stats(); }
+    void reset_latency_stats() { engine_.reset_latency_stats(); }
+    std::vector<WorkerStats> worker_stats() const { return {}; }
+
+private:
+    MatchingEngine engine_;
+};
+
+class QueuedTarget {
+public:
+    explicit QueuedTarget(const LoadConfig& config)
+        : engine_(config.depth * 4 + 1024, DuplicateIdPolicy::Allow, kQueueCapacity) {
+        for (size_t i = 0; i < config.symbols; ++i) {
+            engine_.add_order_book(symbol_name(i));
+        }
+        engine_.set_worker_config({-1, config.idle});
+    }
+
+    bool send(const Command& command) { return engine_.submit(command); }
+    void start() { engine_.start(); }
+    void finish() { engine_.drain(); }
+    EngineLatencyStats latency_stats() const { return engine_.latency_stats(); }
+    void reset_latency_stats() { engine_.reset_latency_stats(); }
+    std::vector<WorkerStats> worker_stats() const { return {engine_.worker_stats()}; }
+
+private:
+    MatchingEngine engine_;
+};
+
+class ShardedTarget {
+public:
+    explicit ShardedTarget(const LoadConfig& config)
+        : engine_(config.shards, runtime(config), config.depth * 4 + 1024, kQueueCapacity) {
+        for (size_t i = 0; i < config.symbols; ++i) {
+            engine_.add_order_book(symbol_name(i));
+        }
+    }
+
+    bool send(const Command& command) { return engine_.submit(command); }
+    void start() { engine_.start(); }
+    void finish() { engine_.drain(); }
+    EngineLatencyStats latency_stats() const { return engine_.latency_stats(); }
+    void reset_latency_stats() { engine_.reset_latency_stats(); }
+
+    std::vector<WorkerStats> worker_stats() const {
+        std::vector<WorkerStats> stats;
+        for (size_t i = 0; i < engine_.shard_count(); ++i) {
+            stats.push_back(engine_.worker_stats(i));
+        }
+        return stats;
+    }
+
+private:
+    ShardedMatchingEngine engine_;
+
+    static ShardRuntimeConfig runtime(const LoadConfig& config) {
+        ShardRuntimeConfig runtime;
+        runtime.workers.assign(std::max<size_t>(config.shards, 1), WorkerConfig{-1, config.idle});
+        return runtime;
+    }
+};
+
+struct LoadResult {
+    Mode mode;
+    size_t threads;
+    uint64_t messages;
+    double seconds;
+    double msgs_per_sec;
+    uint64_t full_retries;          // submit() calls refused by a full queue and retried
+    LatencySummary producer;        // Per call (mutex) or per accepted submit() (queued, sharded)
+    EngineLatencyReport engine;
+    double lock_wait_ms;            // Total time spent waiting for a contended engine lock
+    double lock_wait_share;         // Of the producers' total time, in percent
+    double utilization;             // Mean busy share of the engine threads (0 in mutex mode)
+};
+
+// Pre-populate every book, then release `threads` producers together and
+// time them until every message they sent has executed
+template <typename Target>
+LoadResult run_load(Mode mode, const LoadConfig& config, size_t threads) {
+    Target target(config);
+    target.start();
+
+    // Seed the books with resting orders on both sides
+    OrderId seed_id = 1;
+    for (SymbolId symbol = 0; symbol < config.symbols; ++symbol) {
+        for (size_t i = 0; i < config.depth; ++i) {
+            OrderSide side = (i & 1) ? OrderSide::Sell : OrderSide::Buy;
+            Command command = Command::limit(symbol, seed_id++, side, 100,
+                                             passive_price(side, static_cast<int64_t>(i % kLevels) + 1));
+            while (!target.send(command)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    target.finish();
+    target.reset_latency_stats();
+    std::vector<WorkerStats> workers_before = target.worker_stats();
+
+    std::vector<std::vector<LoadOp>> ops(threads);
+    for (size_t t = 0; t < threads; ++t) {
+        ops[t] = generate_ops(config, config.ops_per_thread, 1000 + t);
+    }
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms(threads);
+    std::vector<uint64_t> retries(threads, 0);
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threads; ++t) {
+        histograms[t] = std::make_unique<LatencyHistogram>();
+        producers.emplace_back([&, t]() {
+            // Each producer owns an ID range, and cancels only its own orders
+            OrderId next_id = static_cast<OrderId>(t + 1) << 40;
+            std::vector<std::pair<SymbolId, OrderId>> live;
+            live.reserve(ops[t].size());
+            LatencyHistogram& histogram = *histograms[t];
+
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                cpu_relax();
+            }
+
+            for (const LoadOp& op : ops[t]) {
+                Command command;
+                if (op.type == LoadOp::Cancel && !live.empty()) {
+                    size_t slot = op.pick % live.size();
+                    command = Command::cancel(live[slot].first, live[slot].second);
+                    live[slot] = live.back();
+                    live.pop_back();
+                } else if (op.type == LoadOp::Aggress) {
+                    command = Command::market(op.symbol, next_id++, op.side, op.size);
+                } else {
+                    command = Command::limit(op.symbol, next_id, op.side, op.size > 0 ? op.size : 100,
+                                             passive_price(op.side, op.offset > 0 ? op.offset : 1));
+                    live.emplace_back(op.symbol, next_id++);
+                }
+
+                uint64_t start = read_tsc();
+                while (!target.send(command)) {
+                    ++retries[t];
+                    cpu_relax();
+                }
+                histogram.record(read_tsc() - start);
+            }
+        });
+    }
+
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    auto wall_start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    target.finish();
+    auto wall_end = std::chrono::steady_clock::now();
+
+    LatencyHistogram producer;
+    uint64_t full_retries = 0;
+    for (size_t t = 0; t < threads; ++t) {
+        producer.merge(*histograms[t]);
+        full_retries += retries[t];
+    }
+
+    // Busy share of each engine thread over the timed phase only
+    std::vector<WorkerStats> workers_after = target.worker_stats();
+    double utilization = 0.0;
+    for (size_t i = 0; i < workers_after.size(); ++i) {
+        WorkerStats delta{workers_after[i].busy_ns - workers_before[i].busy_ns,
+                          workers_after[i].idle_ns - workers_before[i].idle_ns, 0, 0};
+        utilization += delta.utilization() / static_cast<double>(workers_after.size());
+    }
+
+    double seconds = std::chrono::duration<double>(wall_end - wall_start).count();
+    uint64_t messages = static_cast<uint64_t>(threads) * config.ops_per_thread;
+    EngineLatencyReport engine = target.latency_stats().report();
+    double lock_wait_ms = static_cast<double>(engine.lock_wait.count) * engine.lock_wait.mean_ns / 1e6;
+    double producer_ms = seconds * 1e3 * static_cast<double>(threads);
+    return {mode,
+            threads,
+            messages,
+            seconds,
+            seconds > 0 ? static_cast<double>(messages) / seconds : 0.0,
+            full_retries,
+            producer.summary(tsc_ns_per_tick()),
+            engine,
+            lock_wait_ms,
+            producer_ms > 0 ? 100.0 * lock_wait_ms / producer_ms : 0.0,
+            utilization};
+}
+
+void print_header(const LoadConfig& config) {
+    std::cout << "=== Load Test: mix " << config.mix.name << ", " << config.symbols << " symbols, "
+              << config.ops_per_thread << " msgs per producer, " << config.shards << " shards ===" << std::endl;
+    std::cout << std::left << std::setw(9) << "Mode"
+              << std::right << std::setw(8) << "threads"
+              << std::setw(12) << "msgs/s"
+              << std::setw(8) << "scale"
+              << std::setw(11) << "call p50"
+              << std::setw(11) << "call p99"
+              << std::setw(11) << "exec p99"
+              << std::setw(11) << "queue p99"
+              << std::setw(12) << "lock wait"
+              << std::setw(9) << "lock %"
+              << std::setw(9) << "busy %"
+              << std::setw(10) << "retries" << std::endl;
+    std::cout << std::string(121, '-') << std::endl;
+}
+
+// Scale is throughput relative to the mode's first (smallest) thread count
+void print_result(const LoadResult& result, double baseline) {
+    std::cout << std::left << std::setw(9) << mode_name(result.mode) << std::right << std::fixed
+              << std::setw(8) << result.threads
+              << std::setw(12) << std::setprecision(0) << result.msgs_per_sec
+              << std::setw(8) << std::setprecision(2) << (baseline > 0 ? result.msgs_per_sec / baseline : 0.0)
+              << std::setw(11) << std::setprecision(0) << result.producer.p50_ns
+              << std::setw(11) << result.producer.p99_ns
+              << std::setw(11) << result.engine.place_limit.p99_ns
+              << std::setw(11) << result.engine.queue_wait.p99_ns
+              << std::setw(10) << std::setprecision(1) << result.lock_wait_ms << "ms"
+              << std::setw(9) << result.lock_wait_share
+              << std::setw(9) << 100.0 * result.utilization
+              << std::setw(10) << result.full_retries << std::endl;
+}
+
+void write_json(std::ostream& out, const LoadConfig& config, const std::vector<LoadResult>& results) {
+    out << "{\"mix\":\"" << config.mix.name << "\",\"symbols\":" << config.symbols
+        << ",\"ops_per_thread\":" << config.ops_per_thread << ",\"shards\":" << config.shards << ",\"runs\":[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const LoadResult& result = results[i];
+        out << (i == 0 ? "" : ",") << "{"
+            << "\"mode\":\"" << mode_name(result.mode) << "\""
+            << ",\"threads\":" << result.threads
+            << ",\"messages\":" << result.messages
+            << ",\"seconds\":" << result.seconds
+            << ",\"msgs_per_sec\":" << result.msgs_per_sec
+            << ",\"full_retries\":" << result.full_retries
+            << ",\"lock_wait_ms\":" << result.lock_wait_ms
+            << ",\"lock_wait_share\":" << result.lock_wait_share
+            << ",\"utilization\":" << result.utilization
+            << ",";
+        tools::write_summary(out, "producer", result.producer, false);
+        out << "\"engine\":";
+        result.engine.write_json(out);
+        out << "}";
+    }
+    out << "]}" << std::endl;
+}
+
+void print_usage() {
+    std::cout << "Usage: trading_load_test [--mode mutex|queued|sharded|all] [--threads N,N,...]\n"
+              << "                         [--symbols N] [--ops N] [--depth N] [--shards N]\n"
+              << "                         [--mix NAME] [--idle spin|yield|park] [--json FILE]\n"
+              << "Mixes:";
+    for (const FlowMix& mix : kMixes) {
+        std::cout << " " << mix.name;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    LoadConfig config;
+    std::vector<size_t> thread_counts = {1, 2, 4, 8};
+    std::string mode = "all";
+    std::string json_path;
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--mode") == 0 && has_value) {
+            mode = argv[++i];
+        } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+            thread_counts = tools::parse_sizes(argv[++i]);
+        } else if (std::strcmp(argv[i], "--symbols") == 0 && has_value) {
+            config.symbols = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--ops") == 0 && has_value) {
+            config.ops_per_thread = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--depth") == 0 && has_value) {
+            config.depth = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--shards") == 0 && has_value) {
+            config.shards = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--mix") == 0 && has_value) {
+            const FlowMix* mix = tools::find_mix(argv[++i]);
+            if (!mix) {
+                print_usage();
+                return 1;
+            }
+            config.mix = *mix;
+        } else if (std::strcmp(argv[i], "--idle") == 0 && has_value) {
+            std::string idle = argv[++i];
+            config.idle = idle == "spin" ? IdleStrategy::BusySpin
+                        : idle == "park" ? IdleStrategy::Park
+                                         : IdleStrategy::SpinYield;
+        } else if (std::strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else {
+            print_usage();
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    // Calibrate the timestamp counter before anything is timed
+    tsc_ns_per_tick();
+
+    std::vector<LoadResult> results;
+    print_header(config);
+    for (Mode m : {Mode::Mutex, Mode::Queued, Mode::Sharded}) {
+        if (mode != "all" && mode != mode_name(m)) {
+            continue;
+        }
+        double baseline = 0.0;
+        for (size_t threads : thread_counts) {
+            threads = std::max<size_t>(threads, 1);
+            switch (m) {
+            case Mode::Mutex: results.push_back(run_load<MutexTarget>(m, config, threads)); break;
+            case Mode::Queued: results.push_back(run_load<QueuedTarget>(m, config, threads)); break;
+            case Mode::Sharded: results.push_back(run_load<ShardedTarget>(m, config, threads)); break;
+            }
+            if (baseline == 0.0) {
+                baseline = results.back().msgs_per_sec;
+            }
+            print_result(results.back(), baseline);
+        }
+    }
+
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        write_json(out, config, results);
+        std::cout << "\nResults written to " << json_path << std::endl;
+    }
+    return 0;
+}
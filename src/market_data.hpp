@@ -0,0 +1,247 @@
+#pragma once
+
+#include "broadcast_ring.hpp"
+#include "order.hpp"
+#include "price.hpp"
+#include "price_level.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <type_traits>
+
+namespace trading {
+
+// Kind of market data update
+enum class BookUpdateType : uint8_t {
+    // L3: individual orders
+    OrderAdd,       // quantity = order size
+    OrderUpdate,    // quantity = remaining size after a partial fill
+    OrderDelete,    // Filled or cancelled
+
+    // L2: aggregated price levels; quantity and order_count are the new totals
+    LevelAdd,
+    LevelChange,
+    LevelDelete,
+
+    // Full snapshot of one book, framed by start and end. Between them
+    // SnapshotLevel (L2) and SnapshotOrder (L3) updates list its contents
+    SnapshotStart,
+    SnapshotLevel,
+    SnapshotOrder,
+    SnapshotEnd
+};
+
+// Fixed-size market data update. Sequence numbers are contiguous per
+// publisher, so a consumer that sees a gap knows it missed updates and must
+// resynchronise from the next snapshot.
+struct BookUpdate {
+    uint64_t sequence;
+    OrderId order_id;       // L3 updates only
+    Price price;
+    uint64_t quantity;
+    uint64_t order_count;   // L2 updates only
+    SymbolId symbol;
+    BookUpdateType type;
+    OrderSide side;
+};
+
+static_assert(std::is_trivially_copyable_v<BookUpdate>, "Updates are copied through a ring buffer");
+
+// Which levels of detail a publisher emits
+enum class MarketDataDetail : uint8_t {
+    L2 = 1,
+    L3 = 2,
+    L2AndL3 = 3
+};
+
+// Turns book events into a stream of incremental updates. Order books call
+// the event hooks as they add, fill and cancel orders; consumers subscribe
+// and poll the stream on their own threads. A full ring never holds up
+// matching: the update is dropped instead and consumers see the gap in the
+// sequence numbers. Like the book, the producing side is single-threaded.
+class MarketDataPublisher {
+public:
+    static constexpr size_t kDefaultCapacity = 1 << 14;
+    static constexpr size_t npos = BroadcastRing<BookUpdate>::npos;
+
+    explicit MarketDataPublisher(MarketDataDetail detail = MarketDataDetail::L2AndL3,
+                                 size_t capacity = kDefaultCapacity)
+        : l2_((static_cast<uint8_t>(detail) & static_cast<uint8_t>(MarketDataDetail::L2)) != 0),
+          l3_((static_cast<uint8_t>(detail) & static_cast<uint8_t>(MarketDataDetail::L3)) != 0),
+          ring_(capacity) {}
+
+    // Event hooks, called by the book after the level has been updated
+
+    void order_added(const Order& order, const PriceLevel& level) {
+        if (l3_) {
+            emit(BookUpdateType::OrderAdd, order.symbol, order.side, order.price,
+                 order.order_id, order.remaining_size(), 0);
+        }
+        if (l2_) {
+            emit(level.order_count == 1 ? BookUpdateType::LevelAdd : BookUpdateType::LevelChange,
+                 order.symbol, order.side, order.price, 0, level.total_quantity, level.order_count);
+        }
+    }
+
+    void order_reduced(const Order& order, const PriceLevel& level) {
+        if (l3_) {
+            emit(BookUpdateType::OrderUpdate, order.symbol, order.side, order.price,
+                 order.order_id, order.remaining_size(), 0);
+        }
+        if (l2_) {
+            emit_level(order, level);
+        }
+    }
+
+    void order_removed(const Order& order, const PriceLevel& level) {
+        if (l3_) {
+            emit(BookUpdateType::OrderDelete, order.symbol, order.side, order.price, order.order_id, 0, 0);
+        }
+        if (l2_) {
+            emit_level(order, level);
+        }
+    }
+
+    // Snapshot framing, driven by BasicOrderBook::publish_snapshot()
+
+    void snapshot_start(SymbolId symbol) {
+        emit(BookUpdateType::SnapshotStart, symbol, OrderSide::Buy, Price{}, 0, 0, 0);
+    }
+
+    void snapshot_level(SymbolId symbol, OrderSide side, Price price, const PriceLevel& level) {
+        if (l2_) {
+            emit(BookUpdateType::SnapshotLevel, symbol, side, price, 0, level.total_quantity, level.order_count);
+        }
+        if (l3_) {
+            for (const Order* order = level.head; order; order = order->next_in_level) {
+                emit(BookUpdateType::SnapshotOrder, symbol, side, price,
+                     order->order_id, order->remaining_size(), 0);
+            }
+        }
+    }
+
+    void snapshot_end(SymbolId symbol) {
+        emit(BookUpdateType::SnapshotEnd, symbol, OrderSide::Buy, Price{}, 0, 0, 0);
+    }
+
+    // Consumers
+
+    size_t subscribe() { return ring_.subscribe(); }
+    void unsubscribe(size_t subscriber) { ring_.unsubscribe(subscriber); }
+
+    template <typename F>
+    size_t poll(size_t subscriber, F&& f, size_t max_batch = 64) {
+        return ring_.poll(subscriber, std::forward<F>(f), max_batch);
+    }
+
+    // Sequence number of the last update emitted
+    uint64_t sequence() const { return sequence_; }
+
+    // Updates lost because a subscriber was a whole ring behind
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    bool l2_;
+    bool l3_;
+    uint64_t sequence_ = 0;
+    std::atomic<uint64_t> dropped_{0};
+    BroadcastRing<BookUpdate> ring_;
+
+    void emit_level(const Order& order, const PriceLevel& level) {
+        emit(level.empty() ? BookUpdateType::LevelDelete : BookUpdateType::LevelChange,
+             order.symbol, order.side, order.price, 0, level.total_quantity, level.order_count);
+    }
+
+    void emit(BookUpdateType type, SymbolId symbol, OrderSide side, Price price,
+              OrderId order_id, uint64_t quantity, uint64_t order_count) {
+        BookUpdate update{++sequence_, order_id, price, quantity, order_count, symbol, type, side};
+        if (!ring_.try_publish(update)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Consumer-side L2 view of one book rebuilt from a publisher's stream. It
+// starts unsynchronised, becomes synchronised at the end of a snapshot of
+// its symbol and drops back out whenever a sequence gap shows that updates
+// were lost.
+class L2BookReplica {
+public:
+    explicit L2BookReplica(SymbolId symbol) : symbol_(symbol) {}
+
+    // Apply the next update from the stream (updates for other symbols only
+    // advance the sequence); returns false if a gap was detected
+    bool apply(const BookUpdate& update) {
+        bool contiguous = last_sequence_ == 0 || update.sequence == last_sequence_ + 1;
+        last_sequence_ = update.sequence;
+        if (!contiguous) {
+            synced_ = false;
+            in_snapshot_ = false;
+        }
+        if (update.symbol != symbol_) {
+            return contiguous;
+        }
+
+        switch (update.type) {
+        case BookUpdateType::SnapshotStart:
+            bids_.clear();
+            asks_.clear();
+            in_snapshot_ = true;
+            break;
+        case BookUpdateType::SnapshotLevel:
+            if (in_snapshot_) {
+                set_level(update);
+            }
+            break;
+        case BookUpdateType::SnapshotEnd:
+            synced_ = in_snapshot_;
+            in_snapshot_ = false;
+            break;
+        case BookUpdateType::LevelAdd:
+        case BookUpdateType::LevelChange:
+        case BookUpdateType::LevelDelete:
+            if (synced_) {
+                set_level(update);
+            }
+            break;
+        default:
+            break; // L3 updates do not change the L2 view
+        }
+        return contiguous;
+    }
+
+    bool synced() const { return synced_; }
+
+    // Levels best price first: quantity and order count per price
+    const std::map<Price, LevelSummary, std::greater<>>& bids() const { return bids_; }
+    const std::map<Price, LevelSummary>& asks() const { return asks_; }
+
+private:
+    SymbolId symbol_;
+    uint64_t last_sequence_ = 0;
+    bool synced_ = false;
+    bool in_snapshot_ = false;
+    std::map<Price, LevelSummary, std::greater<>> bids_;
+    std::map<Price, LevelSummary> asks_;
+
+    void set_level(const BookUpdate& update) {
+        if (update.side == OrderSide::Buy) {
+            set_level(bids_, update);
+        } else {
+            set_level(asks_, update);
+        }
+    }
+
+    template <typename Levels>
+    static void set_level(Levels& levels, const BookUpdate& update) {
+        if (update.type == BookUpdateType::LevelDelete) {
+            levels.erase(update.price);
+        } else {
+            levels[update.price] = {update.price, update.quantity, update.order_count};
+        }
+    }
+};
+
+} // namespace trading
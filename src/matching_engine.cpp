@@ -1,171 +1,1235 @@
 #include "matching_engine.hpp"
-#include <chrono>
+#include <utility>
 
 namespace trading {
 
-MatchingEngine::MatchingEngine() {
-    // Nothing to initialize
+namespace {
+
+// Queued commands and modifies report trades only through the outbound ring
+constexpr auto discard_trades = [](const Trade&) {};
+
+} // namespace
+
+MatchingEngine::MatchingEngine(size_t orders_per_book, DuplicateIdPolicy duplicate_ids, size_t queue_capacity)
+    : order_index_(std::make_shared<OrderIndex>(orders_per_book, duplicate_ids)),
+      orders_per_book_(orders_per_book),
+      trades_out_(kTradeRingCapacity),
+      clock_(std::make_shared<TscClock>()),
+      inbound_(queue_capacity) {
+    if constexpr (kLatencyStatsEnabled) {
+        latency_ = std::make_unique<EngineLatencyStats>();
+    }
+}
+
+MatchingEngine::~MatchingEngine() {
+    stop();
 }
 
-void MatchingEngine::add_order_book(const std::string& symbol) {
+SymbolId MatchingEngine::add_order_book(const std::string& symbol, const MatchingConfig& matching) {
     std::lock_guard<std::mutex> lock(mutex_);
 
     // Check if order book already exists
-    if (order_books_.find(symbol) != order_books_.end()) {
-        return; // Already exists, do nothing
+    auto it = symbol_ids_.find(symbol);
+    if (it != symbol_ids_.end()) {
+        return it->second; // Already exists, do nothing
+    }
+
+    // Intern the symbol and create a new order book in the next slot
+    SymbolId id = static_cast<SymbolId>(order_books_.size());
+    return add_order_book_locked(symbol, id, matching) ? id : kInvalidSymbolId;
+}
+
+bool MatchingEngine::add_order_book_locked(const std::string& symbol, SymbolId id, const MatchingConfig& matching) {
+    // A book the journal cannot record would vanish on replay, taking its
+    // orders with it
+    bool journaled = journal_ && !replaying_;
+    if (journaled && !journal_->append_book(symbol, id, matching)) {
+        return false;
     }
 
-    // Create a new order book
-    order_books_[symbol] = std::make_shared<OrderBook>(symbol);
+    // A sharded engine hands out IDs globally, so this engine may hold only
+    // some of them and the table can have gaps
+    if (id >= order_books_.size()) {
+        order_books_.resize(static_cast<size_t>(id) + 1);
+    }
+    symbol_ids_.emplace(symbol, id);
+    order_books_[id] = std::make_shared<OrderBook>(symbol, orders_per_book_, id, order_index_);
+    order_books_[id]->set_market_data(replaying_ ? nullptr : market_data_.get());
+    order_books_[id]->set_self_trade_prevention(self_trade_prevention_);
+    order_books_[id]->set_resting_observer(risk_.get());
+    order_books_[id]->set_matching(matching);
+
+    if (journaled) {
+        journal_->commit();
+    }
+    return true;
+}
+
+SymbolId MatchingEngine::find_symbol(const std::string& symbol) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return find_symbol_locked(symbol);
+}
+
+SymbolId MatchingEngine::find_symbol_locked(const std::string& symbol) const {
+    auto it = symbol_ids_.find(symbol);
+    return it == symbol_ids_.end() ? kInvalidSymbolId : it->second;
+}
+
+OrderBook* MatchingEngine::find_book_locked(SymbolId symbol) const {
+    return symbol < order_books_.size() ? order_books_[symbol].get() : nullptr;
+}
+
+std::vector<Trade> MatchingEngine::place_limit_order(
+    SymbolId symbol,
+    OrderId order_id,
+    OrderSide side,
+    uint64_t size,
+    double price,
+    TimeInForce tif) {
+
+    std::vector<Trade> trades;
+    auto collect = [&trades](const Trade& trade) { trades.push_back(trade); };
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+        Command command = Command::limit(symbol, order_id, side, size, OrderBook::to_price(price), tif);
+        place_limit_order_locked(command, begin_event_locked(command), collect);
+        commit_journal_locked();
+    }
+
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
+    return trades;
 }
 
 std::vector<Trade> MatchingEngine::place_limit_order(
     const std::string& symbol,
-    const std::string& order_id,
+    OrderId order_id,
     OrderSide side,
     uint64_t size,
-    double price) {
+    double price,
+    TimeInForce tif) {
 
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Trade> trades;
+    auto collect = [&trades](const Trade& trade) { trades.push_back(trade); };
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+        SymbolId id = find_symbol_locked(symbol);
+        Command command = Command::limit(id, order_id, side, size, OrderBook::to_price(price), tif);
+        place_limit_order_locked(command, begin_event_locked(command), collect);
+        commit_journal_locked();
+    }
+
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
+    return trades;
+}
+
+OrderStatus MatchingEngine::place_post_only_order(
+    SymbolId symbol,
+    OrderId order_id,
+    OrderSide side,
+    uint64_t size,
+    double price,
+    bool reprice) {
+
+    // Post-only orders never trade on entry, so there are no callbacks to run
+    std::unique_lock<std::mutex> lock = lock_engine();
+    Command command = Command::post_only(symbol, order_id, side, size, OrderBook::to_price(price), reprice);
+    OrderResult result = place_limit_order_locked(command, begin_event_locked(command), discard_trades);
+    commit_journal_locked();
+    return result.status;
+}
+
+template <typename Sink>
+OrderResult MatchingEngine::place_limit_order_locked(const Command& command, uint64_t timestamp, Sink&& on_trade) {
+    LatencyTimer timer(latency_histogram(&EngineLatencyStats::place_limit));
+    OrderResult result{command.order_id, OrderStatus::Rejected, 0, 0, 0};
 
     // Find the order book
-    auto it = order_books_.find(symbol);
-    if (it == order_books_.end()) {
-        return {}; // No such symbol
+    OrderBook* book = find_book_locked(command.symbol);
+    if (!book) {
+        return result; // No such symbol
     }
 
-    // Create the order
-    auto order = std::make_shared<Order>(
-        order_id, side, symbol, size, price, generate_timestamp());
+    // Orders reusing a live ID are refused before they can trade
+    if (order_index_->duplicate_policy() == DuplicateIdPolicy::Reject && order_index_->contains(command.order_id)) {
+        return result;
+    }
 
-    // Store the order ID to symbol mapping
-    order_id_to_symbol_.insert({order_id, symbol});
+    if (!admit_order_locked(command, *book, timestamp)) {
+        return result;
+    }
 
-    // Match the order
-    auto trades = it->second->match_order(order);
+    // Create the order from the book's pool
+    Order* order = book->create_limit_order(command.order_id, command.side, command.size, command.price,
+                                            timestamp, command.tif, command.order_type);
+    order->account = command.account;
 
-    // If not fully filled, add to book
-    if (!order->is_filled()) {
-        it->second->add_order(order);
+    // Match the order, publishing each trade to the outbound ring as it happens
+    auto sink = [&](const Trade& trade) {
+        record_trade_locked(trade);
+        on_trade(trade);
+    };
+    {
+        LatencyTimer match_timer(latency_histogram(&EngineLatencyStats::match));
+        book->match_order(*order, sink);
     }
 
-    // Notify about trades
-    for (const auto& trade : trades) {
-        notify_trade(trade);
+    // If it may rest, add it to the book; otherwise (filled, an IOC or FOK
+    // remainder, a refused post-only order) its slot goes straight back
+    bool rests = book->add_order(order);
+    result.status = order->status;
+    result.filled_size = order->filled_size;
+    if (!rests) {
+        book->release_order(order);
     }
 
+    // Stops its trades reached follow within the same event
+    book->release_triggered_stops(sink);
+    refresh_snapshot_locked(command.symbol);
+    return result;
+}
+
+std::vector<Trade> MatchingEngine::place_market_order(
+    SymbolId symbol,
+    OrderId order_id,
+    OrderSide side,
+    uint64_t size,
+    TimeInForce tif) {
+
+    std::vector<Trade> trades;
+    auto collect = [&trades](const Trade& trade) { trades.push_back(trade); };
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+        Command command = Command::market(symbol, order_id, side, size, tif);
+        place_market_order_locked(command, begin_event_locked(command), collect);
+        commit_journal_locked();
+    }
+
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
     return trades;
 }
 
 std::vector<Trade> MatchingEngine::place_market_order(
     const std::string& symbol,
-    const std::string& order_id,
+    OrderId order_id,
     OrderSide side,
-    uint64_t size) {
+    uint64_t size,
+    TimeInForce tif) {
 
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Trade> trades;
+    auto collect = [&trades](const Trade& trade) { trades.push_back(trade); };
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+        SymbolId id = find_symbol_locked(symbol);
+        Command command = Command::market(id, order_id, side, size, tif);
+        place_market_order_locked(command, begin_event_locked(command), collect);
+        commit_journal_locked();
+    }
+
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
+    return trades;
+}
+
+template <typename Sink>
+OrderResult MatchingEngine::place_market_order_locked(const Command& command, uint64_t timestamp, Sink&& on_trade) {
+    LatencyTimer timer(latency_histogram(&EngineLatencyStats::place_market));
+    OrderResult result{command.order_id, OrderStatus::Rejected, 0, 0, 0};
 
     // Find the order book
-    auto it = order_books_.find(symbol);
-    if (it == order_books_.end()) {
-        return {}; // No such symbol
+    OrderBook* book = find_book_locked(command.symbol);
+    if (!book) {
+        return result; // No such symbol
     }
 
-    // Create the order
-    auto order = std::make_shared<Order>(
-        order_id, side, symbol, size, generate_timestamp());
+    if (!admit_order_locked(command, *book, timestamp)) {
+        return result;
+    }
 
-    // No need to store in symbol map as market orders don't rest in the book
+    // Create the order from the book's pool
+    Order* order = book->create_market_order(command.order_id, command.side, command.size, timestamp, command.tif);
+    order->account = command.account;
 
-    // Match the order
-    auto trades = it->second->match_order(order);
+    // No need to index market orders as they don't rest in the book
 
-    // Notify about trades
-    for (const auto& trade : trades) {
-        notify_trade(trade);
+    // Match the order, then recycle it since any remainder is not kept
+    auto sink = [&](const Trade& trade) {
+        record_trade_locked(trade);
+        on_trade(trade);
+    };
+    {
+        LatencyTimer match_timer(latency_histogram(&EngineLatencyStats::match));
+        book->match_order(*order, sink);
     }
 
-    return trades;
+    // Matching cancels whatever is left of a market order
+    result.status = order->status;
+    result.filled_size = order->filled_size;
+    book->release_order(order);
+    book->release_triggered_stops(sink);
+    refresh_snapshot_locked(command.symbol);
+    return result;
 }
 
-bool MatchingEngine::cancel_order(const std::string& order_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
+OrderStatus MatchingEngine::place_stop_order(
+    SymbolId symbol,
+    OrderId order_id,
+    OrderSide side,
+    uint64_t size,
+    double trigger_price) {
 
-    // Find the symbol for this order
-    auto range = order_id_to_symbol_.equal_range(order_id);
-    if (range.first == range.second) {
-        return false; // Order ID not found
+    OrderResult result;
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+        Command command = Command::stop(symbol, order_id, side, size, OrderBook::to_price(trigger_price));
+        result = place_stop_order_locked(command, begin_event_locked(command), discard_trades);
+        commit_journal_locked();
     }
 
-    // Get the first matching order
-    auto symbol_it = range.first;
-    const std::string& symbol = symbol_it->second;
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
+    return result.status;
+}
+
+OrderStatus MatchingEngine::place_stop_limit_order(
+    SymbolId symbol,
+    OrderId order_id,
+    OrderSide side,
+    uint64_t size,
+    double trigger_price,
+    double price,
+    TimeInForce tif) {
+
+    OrderResult result;
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+        Command command = Command::stop_limit(symbol, order_id, side, size, OrderBook::to_price(trigger_price),
+                                              OrderBook::to_price(price), tif);
+        result = place_stop_order_locked(command, begin_event_locked(command), discard_trades);
+        commit_journal_locked();
+    }
+
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
+    return result.status;
+}
+
+template <typename Sink>
+OrderResult MatchingEngine::place_stop_order_locked(const Command& command, uint64_t timestamp, Sink&& on_trade) {
+    LatencyTimer timer(latency_histogram(&EngineLatencyStats::place_stop));
+    OrderResult result{command.order_id, OrderStatus::Rejected, 0, 0, 0};
 
     // Find the order book
-    auto book_it = order_books_.find(symbol);
-    if (book_it == order_books_.end()) {
-        return false; // Order book not found
+    OrderBook* book = find_book_locked(command.symbol);
+    if (!book) {
+        return result; // No such symbol
+    }
+
+    // Orders reusing a live ID are refused before they can trade
+    if (order_index_->duplicate_policy() == DuplicateIdPolicy::Reject && order_index_->contains(command.order_id)) {
+        return result;
+    }
+
+    if (!admit_order_locked(command, *book, timestamp)) {
+        return result;
+    }
+
+    // The book keeps the order from here on, pending or triggered
+    Order* order = command.order_type == OrderType::Market
+                   ? book->create_market_order(command.order_id, command.side, command.size, timestamp, command.tif)
+                   : book->create_limit_order(command.order_id, command.side, command.size, command.price,
+                                              timestamp, command.tif, command.order_type);
+    order->account = command.account;
+
+    auto sink = [&](const Trade& trade) {
+        record_trade_locked(trade);
+        on_trade(trade);
+    };
+    result.status = book->add_stop_order(order, command.trigger, sink);
+    book->release_triggered_stops(sink);
+    refresh_snapshot_locked(command.symbol);
+    return result;
+}
+
+bool MatchingEngine::cancel_order(OrderId order_id) {
+    std::unique_lock<std::mutex> lock = lock_engine();
+
+    // Cancels find their book by ID, so the journaled command carries no symbol
+    bool cancelled = cancel_order_locked(order_id, begin_event_locked(Command::cancel(kInvalidSymbolId, order_id)));
+    commit_journal_locked();
+    return cancelled;
+}
+
+bool MatchingEngine::cancel_order_locked(OrderId order_id, uint64_t timestamp) {
+    LatencyTimer timer(latency_histogram(&EngineLatencyStats::cancel));
+
+    // A single probe finds the oldest live order with this ID in any book
+    size_t slot = order_index_->find(order_id);
+    if (slot == OrderIndex::npos) {
+        return false; // Order ID not found
+    }
+
+    // The order record knows its book; unlink it without another lookup
+    SymbolId symbol = order_index_->at(slot).order->symbol;
+    order_books_[symbol]->cancel_order_at(slot, timestamp);
+    refresh_snapshot_locked(symbol);
+
+    return true;
+}
+
+void MatchingEngine::place_orders(std::span<const NewOrder> orders, BatchResponse& response) {
+    response.clear();
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+
+        // The whole batch is one event as far as the clock is concerned
+        clock_->begin_batch();
+        uint64_t timestamp = clock_->now();
+        auto collect = [&response](const Trade& trade) { response.trades.push_back(trade); };
+
+        for (const NewOrder& order : orders) {
+            auto first_trade = static_cast<uint32_t>(response.trades.size());
+            Command command = order.to_command();
+            journal_locked(command, timestamp);
+            OrderResult result = order.type == OrderType::Market
+                                 ? place_market_order_locked(command, timestamp, collect)
+                                 : place_limit_order_locked(command, timestamp, collect);
+            result.first_trade = first_trade;
+            result.trade_count = static_cast<uint32_t>(response.trades.size()) - first_trade;
+            response.results.push_back(result);
+        }
+        commit_journal_locked();
+    }
+
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
+}
+
+void MatchingEngine::cancel_orders(std::span<const OrderId> order_ids, BatchResponse& response) {
+    response.clear();
+
+    std::unique_lock<std::mutex> lock = lock_engine();
+    clock_->begin_batch();
+    uint64_t timestamp = clock_->now();
+
+    for (OrderId order_id : order_ids) {
+        journal_locked(Command::cancel(kInvalidSymbolId, order_id), timestamp);
+        bool cancelled = cancel_order_locked(order_id, timestamp);
+        response.results.push_back({order_id, cancelled ? OrderStatus::Cancelled : OrderStatus::Rejected, 0,
+                                    static_cast<uint32_t>(response.trades.size()), 0});
+    }
+    commit_journal_locked();
+}
+
+void MatchingEngine::execute_commands(std::span<const Command> commands, BatchResponse& response) {
+    response.clear();
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+
+        clock_->begin_batch();
+        uint64_t timestamp = clock_->now();
+        auto collect = [&response](const Trade& trade) { response.trades.push_back(trade); };
+
+        for (const Command& command : commands) {
+            auto first_trade = static_cast<uint32_t>(response.trades.size());
+            journal_locked(command, timestamp);
+
+            OrderResult result{command.order_id, OrderStatus::Rejected, 0, 0, 0};
+            switch (command.type) {
+            case CommandType::NewLimit:
+                result = place_limit_order_locked(command, timestamp, collect);
+                break;
+            case CommandType::NewMarket:
+                result = place_market_order_locked(command, timestamp, collect);
+                break;
+            case CommandType::NewStop:
+                result = place_stop_order_locked(command, timestamp, collect);
+                break;
+            case CommandType::Cancel:
+                if (cancel_order_locked(command.order_id, timestamp)) {
+                    result.status = OrderStatus::Cancelled;
+                }
+                break;
+            case CommandType::Modify: {
+                ModifyResult modified =
+                    modify_order_locked(command.order_id, command.size, command.price, timestamp, collect);
+                // Stops the modify released print into the same range
+                for (size_t i = first_trade; i < response.trades.size(); ++i) {
+                    const Trade& trade = response.trades[i];
+                    if (trade.order_id_buy == command.order_id || trade.order_id_sell == command.order_id) {
+                        result.filled_size += trade.size;
+                    }
+                }
+                switch (modified) {
+                case ModifyResult::Amended:
+                case ModifyResult::Requeued:
+                    result.status = result.filled_size > 0 ? OrderStatus::PartiallyFilled : OrderStatus::New;
+                    break;
+                case ModifyResult::Filled:
+                    result.status = OrderStatus::Filled;
+                    break;
+                case ModifyResult::Cancelled:
+                    result.status = OrderStatus::Cancelled;
+                    break;
+                case ModifyResult::NotFound:
+                case ModifyResult::Rejected:
+                case ModifyResult::Refused:
+                    break;
+                }
+                break;
+            }
+            case CommandType::MassCancel:
+                result.status = OrderStatus::Cancelled;
+                result.filled_size = mass_cancel_locked(command.symbol, command.side, timestamp);
+                break;
+            case CommandType::BeginAuction:
+                if (begin_auction_locked(command.symbol)) {
+                    result.status = OrderStatus::New;
+                }
+                break;
+            case CommandType::Uncross:
+                result.status = OrderStatus::Filled;
+                result.filled_size = uncross_locked(command.symbol, timestamp, collect).volume;
+                break;
+            }
+
+            result.first_trade = first_trade;
+            result.trade_count = static_cast<uint32_t>(response.trades.size()) - first_trade;
+            response.results.push_back(result);
+        }
+        commit_journal_locked();
+    }
+
+    dispatch_trade_callbacks();
+}
+
+size_t MatchingEngine::mass_cancel(SymbolId symbol) {
+    std::unique_lock<std::mutex> lock = lock_engine();
+
+    uint64_t timestamp = begin_event_locked(Command::mass_cancel(symbol, OrderSide::Buy));
+    journal_locked(Command::mass_cancel(symbol, OrderSide::Sell), timestamp);
+    size_t cancelled = mass_cancel_locked(symbol, OrderSide::Buy, timestamp) +
+                       mass_cancel_locked(symbol, OrderSide::Sell, timestamp);
+    commit_journal_locked();
+    return cancelled;
+}
+
+size_t MatchingEngine::mass_cancel(SymbolId symbol, OrderSide side) {
+    std::unique_lock<std::mutex> lock = lock_engine();
+
+    size_t cancelled = mass_cancel_locked(symbol, side, begin_event_locked(Command::mass_cancel(symbol, side)));
+    commit_journal_locked();
+    return cancelled;
+}
+
+size_t MatchingEngine::mass_cancel_locked(SymbolId symbol, OrderSide side, uint64_t timestamp) {
+    OrderBook* book = find_book_locked(symbol);
+    if (!book) {
+        return 0;
+    }
+    size_t cancelled = book->cancel_all(side, timestamp);
+    refresh_snapshot_locked(symbol);
+    return cancelled;
+}
+
+ModifyResult MatchingEngine::modify_order(OrderId order_id, uint64_t new_size, double new_price) {
+    ModifyResult result;
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+
+        // Like cancels, modifies find their book by ID
+        Price price = OrderBook::to_price(new_price);
+        uint64_t timestamp = begin_event_locked(Command::modify(kInvalidSymbolId, order_id, new_size, price));
+        result = modify_order_locked(order_id, new_size, price, timestamp, discard_trades);
+        commit_journal_locked();
+    }
+
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
+    return result;
+}
+
+template <typename Sink>
+ModifyResult MatchingEngine::modify_order_locked(
+    OrderId order_id, uint64_t size, Price price, uint64_t timestamp, Sink&& on_trade) {
+    LatencyTimer timer(latency_histogram(&EngineLatencyStats::modify));
+
+    // One probe finds the order; the book amends it without looking again
+    size_t slot = order_index_->find(order_id);
+    if (slot == OrderIndex::npos) {
+        return ModifyResult::NotFound;
+    }
+
+    // A modify that can add exposure goes through the risk stage as if it
+    // were the order it turns into; a refusal leaves the order untouched
+    const Order& resting = *order_index_->at(slot).order;
+    SymbolId symbol = resting.symbol;
+    if (risk_ && (size > resting.size || price != resting.price)) {
+        Command amended = Command::limit(symbol, order_id, resting.side, size, price, resting.tif, resting.account);
+        amended.order_type = resting.type;
+        if (risk_->check(amended, order_books_[symbol]->top_of_book(), timestamp, &resting) != RiskReject::None) {
+            return ModifyResult::Refused;
+        }
+    }
+
+    auto sink = [&](const Trade& trade) {
+        record_trade_locked(trade);
+        on_trade(trade);
+    };
+    OrderBook& book = *order_books_[symbol];
+    ModifyResult result = book.modify_order_at(slot, size, price, timestamp, sink);
+    book.release_triggered_stops(sink);
+    refresh_snapshot_locked(symbol);
+    return result;
+}
+
+bool MatchingEngine::begin_auction(SymbolId symbol) {
+    std::unique_lock<std::mutex> lock = lock_engine();
+    begin_event_locked(Command::begin_auction(symbol));
+    bool opened = begin_auction_locked(symbol);
+    commit_journal_locked();
+    return opened;
+}
+
+bool MatchingEngine::begin_auction_locked(SymbolId symbol) {
+    OrderBook* book = find_book_locked(symbol);
+    if (!book) {
+        return false;
+    }
+    book->begin_auction();
+    return true;
+}
+
+AuctionResult MatchingEngine::uncross(SymbolId symbol) {
+    AuctionResult result;
+    {
+        std::unique_lock<std::mutex> lock = lock_engine();
+        Command command = Command::uncross(symbol);
+        result = uncross_locked(symbol, begin_event_locked(command), discard_trades);
+        commit_journal_locked();
+    }
+
+    // Callbacks run after the lock is released
+    dispatch_trade_callbacks();
+    return result;
+}
+
+template <typename Sink>
+AuctionResult MatchingEngine::uncross_locked(SymbolId symbol, uint64_t timestamp, Sink&& on_trade) {
+    OrderBook* book = find_book_locked(symbol);
+    if (!book || !book->in_auction()) {
+        return {Price{}, 0, 0, 0};
+    }
+
+    auto sink = [&](const Trade& trade) {
+        record_trade_locked(trade);
+        on_trade(trade);
+    };
+    AuctionResult result = book->uncross(timestamp, sink);
+    book->release_triggered_stops(sink);
+    refresh_snapshot_locked(symbol);
+    return result;
+}
+
+void MatchingEngine::execute_locked(const Command& command) {
+    if constexpr (kLatencyStatsEnabled) {
+        if (command.submit_tsc != 0) {
+            latency_->queue_wait.record(read_tsc() - command.submit_tsc);
+        }
+    }
+
+    // One clock read per command, however many fills it produces
+    uint64_t timestamp = clock_->now();
+    journal_locked(command, timestamp);
+
+    switch (command.type) {
+    case CommandType::NewLimit:
+        place_limit_order_locked(command, timestamp, discard_trades);
+        break;
+    case CommandType::NewMarket:
+        place_market_order_locked(command, timestamp, discard_trades);
+        break;
+    case CommandType::Cancel:
+        cancel_order_locked(command.order_id, timestamp);
+        break;
+    case CommandType::Modify:
+        modify_order_locked(command.order_id, command.size, command.price, timestamp, discard_trades);
+        break;
+    case CommandType::MassCancel:
+        mass_cancel_locked(command.symbol, command.side, timestamp);
+        break;
+    case CommandType::NewStop:
+        place_stop_order_locked(command, timestamp, discard_trades);
+        break;
+    case CommandType::BeginAuction:
+        begin_auction_locked(command.symbol);
+        break;
+    case CommandType::Uncross:
+        uncross_locked(command.symbol, timestamp, discard_trades);
+        break;
+    }
+}
+
+bool MatchingEngine::submit(const Command& command) {
+    Command stamped = command;
+    if constexpr (kLatencyStatsEnabled) {
+        stamped.submit_tsc = read_tsc();
+    }
+
+    if (!inbound_.try_push(stamped)) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Pairs with the fence in park_worker(): either the engine thread sees
+    // this command before sleeping, or this sees it parked and wakes it
+    if (worker_config_.idle == IdleStrategy::Park) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked_.load(std::memory_order_relaxed)) {
+            wake_worker();
+        }
+    }
+    return true;
+}
+
+size_t MatchingEngine::process_commands(size_t max_batch) {
+    // Skip the lock entirely when there is nothing to do
+    if (inbound_.empty()) {
+        return 0;
     }
 
-    // Cancel the order
-    bool success = book_it->second->cancel_order(order_id);
+    size_t count = 0;
+    {
+        // The mutex also makes this thread the queue's only consumer
+        std::unique_lock<std::mutex> lock = lock_engine();
 
-    // If successful, remove only this specific entry from the multimap
-    if (success) {
-        order_id_to_symbol_.erase(symbol_it);
+        size_t depth = inbound_.size();
+        if (depth > high_watermark_.load(std::memory_order_relaxed)) {
+            high_watermark_.store(depth, std::memory_order_relaxed);
+        }
+
+        clock_->begin_batch();
+        count = inbound_.drain([this](const Command& command) { execute_locked(command); }, max_batch);
+
+        // Group commit: the whole batch shares one write
+        commit_journal_locked();
+    }
+
+    // Hand the batch's trades to the callbacks before reporting it processed,
+    // so drain() also covers their delivery
+    dispatch_trade_callbacks();
+
+    if (count > 0) {
+        processed_.fetch_add(count, std::memory_order_release);
     }
+    return count;
+}
 
-    return success;
+void MatchingEngine::start() {
+    if (running_.exchange(true, std::memory_order_acq_rel)) {
+        return; // Already running
+    }
+    worker_ = std::thread([this]() { run_command_loop(); });
+}
+
+void MatchingEngine::stop() {
+    if (!running_.exchange(false, std::memory_order_acq_rel)) {
+        return; // Not running
+    }
+    wake_worker();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void MatchingEngine::drain() {
+    // accepted also covers pushes that are claimed but not yet published,
+    // so this waits for those too
+    uint64_t target = inbound_.push_count();
+    while (processed_.load(std::memory_order_acquire) < target) {
+        // Without an engine thread, do the work here
+        if (running() || process_commands() == 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+MatchingEngine::QueueStats MatchingEngine::queue_stats() const {
+    return {inbound_.push_count(),
+            rejected_.load(std::memory_order_relaxed),
+            processed_.load(std::memory_order_acquire),
+            inbound_.size(),
+            high_watermark_.load(std::memory_order_relaxed)};
+}
+
+std::unique_lock<std::mutex> MatchingEngine::lock_engine() {
+    // The uncontended path is a single try_lock, with no clock read
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        uint64_t start = kLatencyStatsEnabled ? read_tsc() : 0;
+        lock.lock();
+        if (LatencyHistogram* histogram = latency_histogram(&EngineLatencyStats::lock_wait)) {
+            histogram->record(read_tsc() - start);
+        }
+    }
+    return lock;
+}
+
+bool MatchingEngine::set_worker_config(const WorkerConfig& config) {
+    if (running()) {
+        return false;
+    }
+    worker_config_ = config;
+    return true;
+}
+
+WorkerStats MatchingEngine::worker_stats() const {
+    double ns_per_tick = tsc_ns_per_tick();
+    return {static_cast<uint64_t>(static_cast<double>(busy_ticks_.load(std::memory_order_relaxed)) * ns_per_tick),
+            static_cast<uint64_t>(static_cast<double>(idle_ticks_.load(std::memory_order_relaxed)) * ns_per_tick),
+            batches_.load(std::memory_order_relaxed),
+            parks_.load(std::memory_order_relaxed)};
+}
+
+void MatchingEngine::run_command_loop() {
+    pin_current_thread(worker_config_.cpu);
+
+    // The counters have a single writer, so plain load/store pairs suffice
+    auto add = [](std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    };
+
+    bool tidied = false;        // Since the last batch
+    for (uint32_t empty_polls = 0;;) {
+        // Read the flag before draining so commands queued ahead of stop()
+        // are always processed on the final pass
+        bool keep_running = running_.load(std::memory_order_acquire);
+
+        uint64_t start = read_tsc();
+        if (process_commands() > 0) {
+            add(busy_ticks_, read_tsc() - start);
+            add(batches_, 1);
+            empty_polls = 0;
+            tidied = false;
+            continue;
+        }
+        if (!keep_running) {
+            break;
+        }
+
+        // Tidy up once per quiet spell, before yielding or parking: make the
+        // last group of journal records durable, then compact. This counts
+        // as busy time
+        if (!tidied && empty_polls >= worker_config_.spin_limit) {
+            tidied = true;
+            uint64_t idle = read_tsc();
+            sync_journal_while_idle();
+            if (worker_config_.compaction_slice > 0) {
+                compact_while_idle();
+            }
+            uint64_t done = read_tsc();
+            add(idle_ticks_, idle - start);
+            add(busy_ticks_, done - idle);
+            start = done;
+        }
+        idle_wait(empty_polls);
+        empty_polls = empty_polls < worker_config_.spin_limit ? empty_polls + 1 : empty_polls;
+        add(idle_ticks_, read_tsc() - start);
+    }
+}
+
+void MatchingEngine::idle_wait(uint32_t empty_polls) {
+    switch (worker_config_.idle) {
+        case IdleStrategy::BusySpin:
+            break;
+        case IdleStrategy::SpinYield:
+            if (empty_polls < worker_config_.spin_limit) {
+                cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+            break;
+        case IdleStrategy::Park:
+            if (empty_polls < worker_config_.spin_limit) {
+                cpu_relax();
+            } else {
+                park_worker();
+            }
+            break;
+    }
+}
+
+void MatchingEngine::park_worker() {
+    // Take the epoch before announcing the park, so a wake-up that lands
+    // between the check below and the wait still makes the wait return
+    uint32_t epoch = wake_epoch_.load(std::memory_order_acquire);
+    parked_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (inbound_.empty() && running_.load(std::memory_order_acquire)) {
+        parks_.store(parks_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        wake_epoch_.wait(epoch, std::memory_order_acquire);
+    }
+    parked_.store(false, std::memory_order_relaxed);
+}
+
+void MatchingEngine::wake_worker() {
+    wake_epoch_.fetch_add(1, std::memory_order_release);
+    wake_epoch_.notify_one();
+}
+
+BookMemoryStats MatchingEngine::memory_stats(SymbolId symbol) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    OrderBook* book = find_book_locked(symbol);
+    return book ? book->memory_stats() : BookMemoryStats{};
+}
+
+EngineMemoryStats MatchingEngine::memory_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EngineMemoryStats stats{};
+    for (const auto& book : order_books_) {
+        if (!book) {
+            continue;
+        }
+        BookMemoryStats memory = book->memory_stats();
+        ++stats.books;
+        stats.orders += memory.orders;
+        stats.levels += memory.levels;
+        stats.allocated_levels += memory.allocated_levels;
+        stats.book_bytes += memory.total_bytes;
+    }
+    stats.index_entries = order_index_->size();
+    stats.index_capacity = order_index_->capacity();
+    stats.index_load_factor = order_index_->load_factor();
+    stats.index_bytes = order_index_->memory_bytes();
+    stats.total_bytes = stats.book_bytes + stats.index_bytes;
+    return stats;
+}
+
+size_t MatchingEngine::compact(size_t budget) {
+    std::unique_lock<std::mutex> lock = lock_engine();
+
+    // The shared index first, then the books from where the last slice
+    // stopped, so that every book gets its turn however small the budget
+    size_t work = order_index_->compact(budget);
+    for (size_t visited = 0; visited < order_books_.size() && work < budget; ++visited) {
+        if (compaction_cursor_ >= order_books_.size()) {
+            compaction_cursor_ = 0;
+        }
+        OrderBook* book = order_books_[compaction_cursor_].get();
+        if (book && book->needs_compaction()) {
+            work += book->compact(budget - work);
+        }
+        ++compaction_cursor_;
+    }
+    return work;
+}
+
+void MatchingEngine::sync_journal_while_idle() {
+    std::unique_lock<std::mutex> lock = lock_engine();
+    if (journal_ && journal_->sync_pending()) {
+        journal_->sync();
+    }
+}
+
+void MatchingEngine::compact_while_idle() {
+    // Slices are bounded, and the queue is checked between them, so a
+    // command that arrives waits for one slice at most
+    while (inbound_.empty() && running_.load(std::memory_order_acquire) &&
+           compact(worker_config_.compaction_slice) > 0) {
+    }
 }
 
 std::vector<std::shared_ptr<OrderBook>> MatchingEngine::get_all_order_books() const {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    std::vector<std::shared_ptr<OrderBook>> result;
-    result.reserve(order_books_.size());
+    std::vector<std::shared_ptr<OrderBook>> books;
+    for (const auto& book : order_books_) {
+        if (book) {
+            books.push_back(book);
+        }
+    }
+    return books;
+}
 
-    for (const auto& [symbol, book] : order_books_) {
-        result.push_back(book);
+std::shared_ptr<OrderBook> MatchingEngine::get_order_book(SymbolId symbol) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (symbol >= order_books_.size()) {
+        return nullptr;
     }
 
-    return result;
+    return order_books_[symbol];
 }
 
 std::shared_ptr<OrderBook> MatchingEngine::get_order_book(const std::string& symbol) const {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto it = order_books_.find(symbol);
-    if (it == order_books_.end()) {
+    SymbolId id = find_symbol_locked(symbol);
+    if (id == kInvalidSymbolId) {
         return nullptr;
     }
 
-    return it->second;
+    return order_books_[id];
+}
+
+std::shared_ptr<const BookSnapshotBuffer> MatchingEngine::book_snapshots(SymbolId symbol, size_t levels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!find_book_locked(symbol)) {
+        return nullptr;
+    }
+    if (symbol >= snapshots_.size()) {
+        snapshots_.resize(static_cast<size_t>(symbol) + 1);
+    }
+    if (!snapshots_[symbol]) {
+        snapshots_[symbol] = std::make_shared<BookSnapshotBuffer>(levels);
+        refresh_snapshot_locked(symbol);
+    }
+    return snapshots_[symbol];
 }
 
 void MatchingEngine::register_trade_callback(TradeCallback callback) {
+    // Always mutex_ before callback_mutex_ (see publish_trade)
     std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> callback_lock(callback_mutex_);
+
+    // All callbacks share one ring subscription
+    if (callback_subscriber_ == TradeRing::npos) {
+        callback_subscriber_ = trades_out_.subscribe();
+        if (callback_subscriber_ == TradeRing::npos) {
+            return; // No consumer slot left
+        }
+    }
     trade_callbacks_.push_back(std::move(callback));
+    has_callbacks_.store(true, std::memory_order_release);
+}
+
+EngineLatencyStats MatchingEngine::latency_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return latency_ ? *latency_ : EngineLatencyStats{};
+}
+
+void MatchingEngine::reset_latency_stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (latency_) {
+        *latency_ = EngineLatencyStats{};
+    }
+}
+
+void EngineLatencyStats::merge(const EngineLatencyStats& other) {
+    place_limit.merge(other.place_limit);
+    place_market.merge(other.place_market);
+    place_stop.merge(other.place_stop);
+    cancel.merge(other.cancel);
+    modify.merge(other.modify);
+    match.merge(other.match);
+    queue_wait.merge(other.queue_wait);
+    lock_wait.merge(other.lock_wait);
+}
+
+EngineLatencyReport EngineLatencyStats::report() const {
+    double ns_per_tick = tsc_ns_per_tick();
+    return {place_limit.summary(ns_per_tick), place_market.summary(ns_per_tick), place_stop.summary(ns_per_tick),
+            cancel.summary(ns_per_tick), modify.summary(ns_per_tick), match.summary(ns_per_tick),
+            queue_wait.summary(ns_per_tick), lock_wait.summary(ns_per_tick)};
+}
+
+void EngineLatencyReport::write_json(std::ostream& out) const {
+    auto write = [&out](const char* name, const LatencySummary& summary, bool last) {
+        out << "\"" << name << "\":{"
+            << "\"count\":" << summary.count
+            << ",\"min_ns\":" << summary.min_ns
+            << ",\"mean_ns\":" << summary.mean_ns
+            << ",\"p50_ns\":" << summary.p50_ns
+            << ",\"p99_ns\":" << summary.p99_ns
+            << ",\"p999_ns\":" << summary.p999_ns
+            << ",\"max_ns\":" << summary.max_ns
+            << "}" << (last ? "" : ",");
+    };
+
+    out << "{";
+    write("place_limit", place_limit, false);
+    write("place_market", place_market, false);
+    write("place_stop", place_stop, false);
+    write("cancel", cancel, false);
+    write("modify", modify, false);
+    write("match", match, false);
+    write("queue_wait", queue_wait, false);
+    write("lock_wait", lock_wait, true);
+    out << "}";
+}
+
+void MatchingEngine::set_market_data(std::shared_ptr<MarketDataPublisher> publisher) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    market_data_ = std::move(publisher);
+    for (const auto& book : order_books_) {
+        if (book) {
+            book->set_market_data(market_data_.get());
+        }
+    }
+}
+
+bool MatchingEngine::publish_snapshot(SymbolId symbol) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    OrderBook* book = find_book_locked(symbol);
+    if (!book || !market_data_) {
+        return false;
+    }
+    book->publish_snapshot();
+    return true;
+}
+
+bool MatchingEngine::open_journal(const JournalOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto journal = std::make_unique<JournalWriter>();
+    if (!journal->open(options)) {
+        return false;
+    }
+    journal_ = std::move(journal);
+    return true;
+}
+
+void MatchingEngine::close_journal() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    journal_.reset();
+}
+
+JournalStats MatchingEngine::journal_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return journal_ ? journal_->stats() : JournalStats{0, 0, 0, 0, 0};
+}
+
+uint64_t MatchingEngine::replay_journal(const std::string& path) {
+    JournalReader reader;
+    if (!reader.open(path)) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Re-execute at the recorded times with every side channel switched off
+    auto replay_clock = std::make_shared<ReplayClock>();
+    std::shared_ptr<Clock> live_clock = std::exchange(clock_, replay_clock);
+    replaying_ = true;
+    for (const auto& book : order_books_) {
+        if (book) {
+            book->set_market_data(nullptr);
+        }
+    }
+
+    JournalRecord record;
+    while (reader.next(record)) {
+        if (record.type == JournalRecordType::AddBook) {
+            if (!find_book_locked(record.symbol)) {
+                add_order_book_locked(reader.book_name(), record.symbol, record.matching());
+            }
+            continue;
+        }
+        replay_clock->set(record.timestamp);
+        execute_locked(record.to_command());
+    }
+
+    replaying_ = false;
+    clock_ = std::move(live_clock);
+    for (const auto& book : order_books_) {
+        if (book) {
+            book->set_market_data(market_data_.get());
+        }
+    }
+    return reader.records();
+}
+
+void MatchingEngine::set_clock(std::shared_ptr<Clock> clock) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    clock_ = clock ? std::move(clock) : std::make_shared<TscClock>();
+}
+
+void MatchingEngine::set_self_trade_prevention(SelfTradePrevention mode) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    self_trade_prevention_ = mode;
+    for (const auto& book : order_books_) {
+        if (book) {
+            book->set_self_trade_prevention(mode);
+        }
+    }
+}
+
+void MatchingEngine::set_risk_check(std::shared_ptr<RiskCheck> risk) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    risk_ = std::move(risk);
+    for (const auto& book : order_books_) {
+        if (book) {
+            book->set_resting_observer(risk_.get());
+        }
+    }
+}
+
+size_t MatchingEngine::subscribe_trades() {
+    // Serialised with publishing, which happens under the same lock
+    std::lock_guard<std::mutex> lock(mutex_);
+    return trades_out_.subscribe();
+}
+
+void MatchingEngine::unsubscribe_trades(size_t subscriber) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    trades_out_.unsubscribe(subscriber);
 }
 
 void MatchingEngine::print_all() const {
     std::lock_guard<std::mutex> lock(mutex_);
 
     std::cout << "=== Matching Engine State ===" << std::endl;
-    for (const auto& [symbol, book] : order_books_) {
+    for (const auto& book : order_books_) {
+        if (!book) {
+            continue;
+        }
         book->print();
         std::cout << "--------------------------" << std::endl;
     }
 }
 
-uint64_t MatchingEngine::generate_timestamp() const {
-    return std::chrono::duration_cast<std::chrono::nanoseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch()
-    ).count();
+void MatchingEngine::publish_trade(const Trade& trade) {
+    if (trades_out_.try_publish(trade)) {
+        return;
+    }
+
+    // The ring is full. The callbacks only catch up once mutex_ is released,
+    // so if they are what is behind, deliver them here rather than wait on
+    // ourselves; any other subscriber polls on its own thread.
+    {
+        std::unique_lock<std::mutex> callback_lock(callback_mutex_, std::try_to_lock);
+        if (callback_lock.owns_lock()) {
+            deliver_trade_callbacks();
+        }
+    }
+    trades_out_.publish(trade);
 }
 
-void MatchingEngine::notify_trade(const Trade& trade) {
-    for (const auto& callback : trade_callbacks_) {
-        callback(trade);
+void MatchingEngine::dispatch_trade_callbacks() {
+    if (!has_callbacks_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> callback_lock(callback_mutex_);
+    deliver_trade_callbacks();
+}
+
+void MatchingEngine::deliver_trade_callbacks() {
+    if (callback_subscriber_ == TradeRing::npos) {
+        return;
+    }
+
+    auto deliver = [this](const Trade& trade) {
+        for (const auto& callback : trade_callbacks_) {
+            callback(trade);
+        }
+    };
+    while (trades_out_.poll(callback_subscriber_, deliver, kDefaultBatchSize) > 0) {
     }
 }
 
@@ -1,67 +1,516 @@
 #pragma once
 
+#include "broadcast_ring.hpp"
+#include "book_snapshot.hpp"
+#include "clock.hpp"
+#include "command.hpp"
+#include "engine_runtime.hpp"
+#include "journal.hpp"
+#include "latency_histogram.hpp"
+#include "mpsc_queue.hpp"
 #include "order_book.hpp"
+#include "risk.hpp"
+#include <ostream>
 #include <unordered_map>
 #include <memory>
 #include <string>
 #include <vector>
 #include <functional>
 #include <mutex>
+#include <span>
+#include <atomic>
+#include <thread>
 
 namespace trading {
 
 // Callback type for trade notifications
 using TradeCallback = std::function<void(const Trade&)>;
 
-// Class that manages multiple order books and matches orders
+// Latency percentiles of the engine's entry points, in nanoseconds
+struct EngineLatencyReport {
+    LatencySummary place_limit;   // Whole place_limit_order, including matching
+    LatencySummary place_market;  // Whole place_market_order, including matching
+    LatencySummary place_stop;    // Whole stop and stop-limit placement, including any matching
+    LatencySummary cancel;
+    LatencySummary modify;        // Whole modify, including any matching
+    LatencySummary match;         // Matching alone, for both order types
+    LatencySummary queue_wait;    // submit() until the command starts executing
+    LatencySummary lock_wait;     // Waits for the engine lock while another thread held it
+
+    // Write the report as a single JSON object
+    void write_json(std::ostream& out) const;
+};
+
+// Raw latency histograms in timestamp counter ticks
+struct EngineLatencyStats {
+    LatencyHistogram place_limit;
+    LatencyHistogram place_market;
+    LatencyHistogram place_stop;
+    LatencyHistogram cancel;
+    LatencyHistogram modify;
+    LatencyHistogram match;
+    LatencyHistogram queue_wait;
+    LatencyHistogram lock_wait;     // Contended acquisitions only
+
+    void merge(const EngineLatencyStats& other);
+    EngineLatencyReport report() const;
+};
+
+// Memory held by an engine: its books, and the order index they share
+struct EngineMemoryStats {
+    size_t books;
+    size_t orders;              // Resting orders and pending stops, every book
+    size_t levels;              // Non-empty price levels, every book
+    size_t allocated_levels;
+    size_t index_entries;
+    size_t index_capacity;
+    double index_load_factor;
+    size_t book_bytes;          // Sum of the books' total_bytes
+    size_t index_bytes;
+    size_t total_bytes;
+};
+
+// Class that manages multiple order books and matches orders.
+// Symbols are interned into dense SymbolIds when their book is added; the
+// SymbolId overloads index books directly, while the string overloads are a
+// convenience that resolves the symbol first.
+//
+// Besides the synchronous calls, commands can be submit()ted into a bounded
+// lock-free inbound queue that the engine drains in batches, either on its
+// own thread (start()/stop()) or whenever process_commands() is called.
+// Producers never wait on matching.
+//
+// Trades are published as fixed-size records into an outbound ring that
+// subscribers poll in batches on their own threads. Registered callbacks are
+// an adapter over one such subscription: they run after the engine lock is
+// released, on the thread whose call produced the trades.
+//
+// Each event (a synchronous call or one queued command) reads the engine's
+// Clock once; the order, the book and every resulting trade share that time.
+//
+// With a journal open, every event and new book is appended to it ahead of
+// execution together with its event time, and committed before the call
+// returns (or, for queued commands, once per batch). replay_journal() then
+// rebuilds the books deterministically after a restart.
 class MatchingEngine {
 public:
-    MatchingEngine();
+    static constexpr size_t kDefaultQueueCapacity = 4096;
+    static constexpr size_t kDefaultBatchSize = 64;
+    static constexpr size_t kDefaultCompactionSlice = 16384;
+    static constexpr size_t kTradeRingCapacity = 1 << 14;
+
+    using TradeRing = BroadcastRing<Trade>;
+
+    // Back-pressure counters for the inbound queue
+    struct QueueStats {
+        uint64_t accepted;        // Commands queued by submit()
+        uint64_t rejected;        // Commands refused because the queue was full
+        uint64_t processed;       // Commands executed so far
+        size_t depth;             // Commands currently waiting
+        size_t high_watermark;    // Deepest the queue has been at the start of a batch
+    };
+
+    // Each order book preallocates orders_per_book orders in its pool.
+    // duplicate_ids decides whether a live order ID may be reused.
+    explicit MatchingEngine(size_t orders_per_book = OrderPool::kDefaultCapacity,
+                            DuplicateIdPolicy duplicate_ids = DuplicateIdPolicy::Allow,
+                            size_t queue_capacity = kDefaultQueueCapacity);
+    ~MatchingEngine();
 
-    // Add a new order book for a symbol
-    void add_order_book(const std::string& symbol);
+    // Add a new order book for a symbol, matching with the given algorithm,
+    // and return its interned ID (the existing ID, with its algorithm
+    // unchanged, if the book is already there). Returns kInvalidSymbolId
+    // while journaling if the name is longer than
+    // JournalRecord::kMaxSymbolLength
+    SymbolId add_order_book(const std::string& symbol, const MatchingConfig& matching = {});
+
+    // Look up the interned ID of a symbol (kInvalidSymbolId if unknown)
+    SymbolId find_symbol(const std::string& symbol) const;
+
+    // Place a limit order. An IOC or FOK order is matched and its unfilled
+    // part dropped without ever being added to the book
+    std::vector<Trade> place_limit_order(
+        SymbolId symbol,
+        OrderId order_id,
+        OrderSide side,
+        uint64_t size,
+        double price,
+        TimeInForce tif = TimeInForce::GoodTillCancel);
 
-    // Place a limit order
     std::vector<Trade> place_limit_order(
         const std::string& symbol,
-        const std::string& order_id,
+        OrderId order_id,
         OrderSide side,
         uint64_t size,
-        double price);
+        double price,
+        TimeInForce tif = TimeInForce::GoodTillCancel);
+
+    // Place a limit order that may only add liquidity. If it would cross it
+    // is rejected, or with reprice rests one tick behind the opposite best;
+    // either way it never trades on entry. Returns the order's status
+    OrderStatus place_post_only_order(
+        SymbolId symbol,
+        OrderId order_id,
+        OrderSide side,
+        uint64_t size,
+        double price,
+        bool reprice = false);
+
+    // Place a market order; FillOrKill trades only if it fills completely
+    std::vector<Trade> place_market_order(
+        SymbolId symbol,
+        OrderId order_id,
+        OrderSide side,
+        uint64_t size,
+        TimeInForce tif = TimeInForce::ImmediateOrCancel);
 
-    // Place a market order
     std::vector<Trade> place_market_order(
         const std::string& symbol,
-        const std::string& order_id,
+        OrderId order_id,
+        OrderSide side,
+        uint64_t size,
+        TimeInForce tif = TimeInForce::ImmediateOrCancel);
+
+    // Place a stop order, which becomes a market order once a trade prints
+    // at or through trigger_price (at or above it for a buy, at or below it
+    // for a sell). Returns Pending, or the status it ended with if the last
+    // trade had already reached the trigger. Stops wait inside their book and
+    // are released within the event whose trades reach them
+    OrderStatus place_stop_order(
+        SymbolId symbol,
+        OrderId order_id,
         OrderSide side,
-        uint64_t size);
+        uint64_t size,
+        double trigger_price);
+
+    // Same, becoming a limit order at price once triggered
+    OrderStatus place_stop_limit_order(
+        SymbolId symbol,
+        OrderId order_id,
+        OrderSide side,
+        uint64_t size,
+        double trigger_price,
+        double price,
+        TimeInForce tif = TimeInForce::GoodTillCancel);
+
+    // Cancel an existing order, resting or a pending stop
+    bool cancel_order(OrderId order_id);
+
+    // Change a resting order's total size and price in place (see
+    // OrderBook::modify_order). Trades from a crossing price reach the
+    // ring and the callbacks like any others
+    ModifyResult modify_order(OrderId order_id, uint64_t new_size, double new_price);
+
+    // Batch entry points for requoting: the whole batch runs under one lock
+    // acquisition and one clock read, is journaled with one commit, and its
+    // trades reach the callbacks once it is done. Entries execute in input
+    // order; response is cleared and refilled with one result per entry.
+    void place_orders(std::span<const NewOrder> orders, BatchResponse& response);
+    void cancel_orders(std::span<const OrderId> order_ids, BatchResponse& response);
+
+    // Batch of any commands, e.g. everything one read from a client
+    // delivered. New orders report as in place_orders; a cancel reports
+    // Cancelled, a modify New, PartiallyFilled (it traded), Filled or
+    // Cancelled, and either reports Rejected if it was refused or found no
+    // order. A mass cancel reports Cancelled with the count in filled_size,
+    // an auction command New (Rejected for an unknown book), an uncross
+    // Filled with the volume it traded
+    void execute_commands(std::span<const Command> commands, BatchResponse& response);
+
+    // Cancel every resting order of a book, or of one side of it, and
+    // return how many were cancelled
+    size_t mass_cancel(SymbolId symbol);
+    size_t mass_cancel(SymbolId symbol, OrderSide side);
+
+    // Open an auction on a book: from now on its orders accumulate without
+    // matching (see OrderBook::begin_auction). Returns false if the symbol
+    // is unknown
+    bool begin_auction(SymbolId symbol);
+
+    // Close a book's auction, trading everything that crosses at the
+    // equilibrium price in one batch, and resume continuous matching. Stops
+    // the auction price reaches are released in the same event
+    AuctionResult uncross(SymbolId symbol);
+
+    // Queue a command without blocking; returns false if the queue is full
+    bool submit(const Command& command);
+
+    // Execute up to max_batch queued commands under a single lock
+    // acquisition and return how many ran
+    size_t process_commands(size_t max_batch = kDefaultBatchSize);
+
+    // Run process_commands() on a dedicated engine thread
+    void start();
+
+    // Process everything already queued, then stop and join the engine thread
+    void stop();
+
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+    // Wait until every command accepted so far has been executed; without
+    // an engine thread the caller's thread executes them
+    void drain();
 
-    // Cancel an existing order
-    bool cancel_order(const std::string& order_id);
+    QueueStats queue_stats() const;
+
+    // Choose the core and idle strategy of the engine thread; call it
+    // before start(). Returns false, changing nothing, while running
+    bool set_worker_config(const WorkerConfig& config);
+    const WorkerConfig& worker_config() const { return worker_config_; }
+
+    // Busy and idle time of the engine thread, readable from any thread
+    WorkerStats worker_stats() const;
+
+    // Memory held by one book (zeroed for an unknown symbol), and by the
+    // whole engine
+    BookMemoryStats memory_stats(SymbolId symbol) const;
+    EngineMemoryStats memory_stats() const;
+
+    // One bounded slice of compaction: migrate part of an oversized order
+    // index into a smaller table, then shrink oversized book ladders, books
+    // taken round robin, spending about `budget` units of work (see
+    // OrderBook::compact). Holds the engine lock for the slice only; returns
+    // the work done, 0 once nothing is left. The engine thread runs this
+    // itself when idle if WorkerConfig::compaction_slice is set
+    size_t compact(size_t budget = kDefaultCompactionSlice);
 
     // Get all order books
     std::vector<std::shared_ptr<OrderBook>> get_all_order_books() const;
 
-    // Get a specific order book
+    // Get a specific order book. Reading it is not synchronised with
+    // matching; other threads should read book_snapshots() instead
+    std::shared_ptr<OrderBook> get_order_book(SymbolId symbol) const;
     std::shared_ptr<OrderBook> get_order_book(const std::string& symbol) const;
 
+    // Snapshots of a book's best `levels` levels per side, republished
+    // after every event that changes the book, for readers on any thread
+    // (see BookSnapshotBuffer). Books are only snapshotted once someone asks;
+    // the buffer is created on the first call, which fixes its depth, and
+    // holds the current state straight away. Returns nullptr for an unknown
+    // symbol
+    std::shared_ptr<const BookSnapshotBuffer> book_snapshots(
+        SymbolId symbol, size_t levels = BookSnapshotBuffer::kDefaultLevels);
+
     // Register a callback to be notified of trades
     void register_trade_callback(TradeCallback callback);
 
+    // Subscribe to the outbound trade ring; returns a subscriber ID, or
+    // TradeRing::npos if no slot is free. A subscriber that stops polling
+    // eventually makes matching wait, so unsubscribe when done.
+    size_t subscribe_trades();
+    void unsubscribe_trades(size_t subscriber);
+
+    // From the subscriber's thread: hand up to max_batch unread trades to f
+    // and return how many were delivered
+    template <typename F>
+    size_t poll_trades(size_t subscriber, F&& f, size_t max_batch = kDefaultBatchSize) {
+        return trades_out_.poll(subscriber, std::forward<F>(f), max_batch);
+    }
+
+    // Number of times matching had to wait for a slow trade subscriber
+    uint64_t trade_ring_stalls() const { return trades_out_.stalls(); }
+
+    // Copy of the latency histograms (all empty when TRADING_LATENCY_STATS
+    // is off) and a reset for them
+    EngineLatencyStats latency_stats() const;
+    void reset_latency_stats();
+
+    // Attach a market data publisher to every book, including books added
+    // later (nullptr detaches)
+    void set_market_data(std::shared_ptr<MarketDataPublisher> publisher);
+
+    // Emit a full snapshot of one book to the market data stream; returns
+    // false if the symbol is unknown or no publisher is attached
+    bool publish_snapshot(SymbolId symbol);
+
+    // Replace the clock that timestamps events (TscClock by default).
+    // Swap it before start(), e.g. for a ReplayClock when replaying a session
+    void set_clock(std::shared_ptr<Clock> clock);
+
+    // Apply a self-trade prevention mode to every book, including books
+    // added later. It is not journaled: set it before replaying as well
+    void set_self_trade_prevention(SelfTradePrevention mode);
+
+    // Install a pre-trade risk stage (see risk.hpp) that every new order and
+    // every modify adding exposure must pass, and that sees every trade.
+    // Set it before start() and before orders rest, and before
+    // replay_journal() to rebuild its positions and open orders; nullptr
+    // removes it and with it the checks' cost
+    void set_risk_check(std::shared_ptr<RiskCheck> risk);
+
+    // Start journaling to options.path; returns false if the file cannot
+    // be opened or is not a journal
+    bool open_journal(const JournalOptions& options);
+
+    // Write out and sync everything journaled, then stop journaling
+    void close_journal();
+
+    JournalStats journal_stats() const;
+
+    // Rebuild the books from a journal by executing its records in order at
+    // their recorded event times. Replay runs at full speed: no trades reach
+    // the ring or the callbacks, no market data is emitted and no latency is
+    // recorded. Call it on a fresh engine before start() and before reopening
+    // the journal; returns the number of records applied.
+    uint64_t replay_journal(const std::string& path);
+
     // Print the state of all order books
     void print_all() const;
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<OrderBook>> order_books_;
-    std::unordered_multimap<std::string, std::string> order_id_to_symbol_; // Allow multiple entries for same order ID
-    std::vector<TradeCallback> trade_callbacks_;
+    // Shards drive their own engine from a single thread without locking
+    friend class ShardedMatchingEngine;
+
+    std::vector<std::shared_ptr<OrderBook>> order_books_;    // Indexed by SymbolId; may have gaps
+    std::unordered_map<std::string, SymbolId> symbol_ids_;  // Interned symbols
+    std::shared_ptr<OrderIndex> order_index_; // Resting orders of every book, by ID
+    size_t compaction_cursor_ = 0;  // Book the next compaction slice starts from
+    size_t orders_per_book_;
     mutable std::mutex mutex_; // To protect concurrent access
 
-    // Helper to generate a timestamp
-    uint64_t generate_timestamp() const;
+    // Outbound trade path
+    TradeRing trades_out_; // Published under mutex_
+    std::mutex callback_mutex_; // Serialises callback delivery
+    std::vector<TradeCallback> trade_callbacks_;
+    size_t callback_subscriber_ = TradeRing::npos;
+    std::atomic<bool> has_callbacks_{false};
+
+    // Market data stream, fed by the books under mutex_
+    std::shared_ptr<MarketDataPublisher> market_data_;
+
+    // Snapshot buffers by SymbolId (null for books nobody reads), published under mutex_
+    std::vector<std::shared_ptr<BookSnapshotBuffer>> snapshots_;
+
+    // Event time source, read under mutex_
+    std::shared_ptr<Clock> clock_;
+
+    // Self-trade prevention for every book, set under mutex_
+    SelfTradePrevention self_trade_prevention_ = SelfTradePrevention::None;
+
+    // Pre-trade risk stage, called under mutex_; null when checks are off
+    std::shared_ptr<RiskCheck> risk_;
+
+    // Write-ahead journal, appended under mutex_; suspended while replaying
+    std::unique_ptr<JournalWriter> journal_;
+    bool replaying_ = false;
+
+    // Latency histograms, written under mutex_; only allocated when enabled
+    std::unique_ptr<EngineLatencyStats> latency_;
+
+    LatencyHistogram* latency_histogram(LatencyHistogram EngineLatencyStats::*member) {
+        return latency_ && !replaying_ ? &((*latency_).*member) : nullptr;
+    }
+
+    // Inbound command path
+    MpscQueue<Command> inbound_;
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> processed_{0};
+    std::atomic<size_t> high_watermark_{0};
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+
+    // Engine thread runtime; the config is fixed while running, the
+    // counters are written by the engine thread only
+    WorkerConfig worker_config_;
+    std::atomic<uint32_t> wake_epoch_{0};   // Bumped to wake a parked engine thread
+    std::atomic<bool> parked_{false};
+    std::atomic<uint64_t> busy_ticks_{0};
+    std::atomic<uint64_t> idle_ticks_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> parks_{0};
+
+    // Take mutex_ for an entry point that orders or the command loop go
+    // through; if another thread holds it, the wait is recorded in lock_wait
+    std::unique_lock<std::mutex> lock_engine();
+
+    void run_command_loop();
+    void sync_journal_while_idle();
+    void compact_while_idle();
+    void idle_wait(uint32_t empty_polls);
+    void park_worker();
+    void wake_worker();
+
+    // Helpers for the public entry points; the caller holds mutex_ or is
+    // the only thread using this engine
+    bool add_order_book_locked(const std::string& symbol, SymbolId id, const MatchingConfig& matching);
+    SymbolId find_symbol_locked(const std::string& symbol) const;
+    OrderBook* find_book_locked(SymbolId symbol) const;
+    // Place the order described by a NewLimit, NewMarket or NewStop command. Trades
+    // are published to the outbound ring and also handed to on_trade.
+    // timestamp is the event time from begin_event_locked(). The result's
+    // trade range is left for the caller to fill in
+    template <typename Sink>
+    OrderResult place_limit_order_locked(const Command& command, uint64_t timestamp, Sink&& on_trade);
+    template <typename Sink>
+    OrderResult place_market_order_locked(const Command& command, uint64_t timestamp, Sink&& on_trade);
+    template <typename Sink>
+    OrderResult place_stop_order_locked(const Command& command, uint64_t timestamp, Sink&& on_trade);
+    bool cancel_order_locked(OrderId order_id, uint64_t timestamp);
+    template <typename Sink>
+    ModifyResult modify_order_locked(OrderId order_id, uint64_t size, Price price, uint64_t timestamp, Sink&& on_trade);
+    size_t mass_cancel_locked(SymbolId symbol, OrderSide side, uint64_t timestamp);
+    bool begin_auction_locked(SymbolId symbol);
+    template <typename Sink>
+    AuctionResult uncross_locked(SymbolId symbol, uint64_t timestamp, Sink&& on_trade);
+    void execute_locked(const Command& command);
+
+    // Republish a book's snapshot if it has readers
+    void refresh_snapshot_locked(SymbolId symbol) {
+        if (symbol < snapshots_.size() && snapshots_[symbol]) {
+            snapshots_[symbol]->publish(*order_books_[symbol]);
+        }
+    }
+
+    // Time of a synchronous call, which is a batch of one event, after
+    // journaling the call as a command
+    uint64_t begin_event_locked(const Command& command) {
+        clock_->begin_batch();
+        uint64_t timestamp = clock_->now();
+        journal_locked(command, timestamp);
+        return timestamp;
+    }
+
+    void journal_locked(const Command& command, uint64_t timestamp) {
+        if (journal_ && !replaying_) {
+            journal_->append_command(command, timestamp);
+        }
+    }
+
+    void commit_journal_locked() {
+        if (journal_ && !replaying_) {
+            journal_->commit();
+        }
+    }
+
+    // Whether a new order may reach its book: its size must fit an Order and
+    // the risk stage, if any, must accept it
+    bool admit_order_locked(const Command& command, const OrderBook& book, uint64_t timestamp) {
+        if (command.size > kMaxOrderSize) {
+            return false;
+        }
+        return !risk_ || risk_->check(command, book.top_of_book(), timestamp, nullptr) == RiskReject::None;
+    }
+
+    // Account for a trade as it happens. Replayed trades still reach the
+    // risk stage, which rebuilds its positions, but not the outbound ring
+    void record_trade_locked(const Trade& trade) {
+        if (!replaying_) {
+            publish_trade(trade);
+        }
+        if (risk_) {
+            risk_->on_trade(trade);
+        }
+    }
+
+    // Append a trade to the outbound ring; the caller holds mutex_
+    void publish_trade(const Trade& trade);
+
+    // Deliver every trade not yet seen by the callbacks; the caller must
+    // not hold mutex_
+    void dispatch_trade_callbacks();
 
-    // Notify all callbacks about a new trade
-    void notify_trade(const Trade& trade);
+    // Same, for a caller that already holds callback_mutex_
+    void deliver_trade_callbacks();
 };
 
-} // namespace trading
\ No newline at end of file
+} // namespace trading
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "order.hpp"
+#include "price_level.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace trading {
+
+// How a book shares an aggressor's quantity among the orders of a level
+enum class MatchingAlgorithm : uint8_t {
+    Fifo,               // Price-time priority
+    ProRata,            // In proportion to resting size; rounding remainders in time priority
+    TopOrderProRata,    // The oldest order fills first, then pro-rata over the rest
+    FifoLmm             // A lead market maker takes its share first, then price-time
+};
+
+struct MatchingConfig {
+    MatchingAlgorithm algorithm = MatchingAlgorithm::Fifo;
+    AccountId lmm_account = kNoAccount;     // FifoLmm: the lead market maker
+    uint32_t lmm_percent = 0;               // FifoLmm: its share of each aggressor, per level
+};
+
+// Matching policies. Each is called once per price level an aggressor
+// reaches, with a fill context for that level that provides:
+//   remaining()                the aggressor's unfilled size
+//   level()                    the level being matched (its orders and total)
+//   config()                   the book's MatchingConfig
+//   fill(resting, size)        trade size against a resting order; a filled
+//                              order leaves the level at once
+//   is_self_trade(resting)     whether self-trade prevention applies to it
+//   prevent_self_trade(resting), prevent_self_trades()
+//                              resolve one, or every, self-trade at the level;
+//                              false if the aggressor has nothing left
+// match() returns false if the aggressor must stop, and otherwise returns
+// only once the aggressor is filled or the level is empty. Policies are
+// templates over the context, so each book instantiates and inlines them.
+
+struct FifoMatching {
+    template <typename Fills>
+    static bool match(Fills& fills) {
+        const PriceLevel& level = fills.level();
+        while (fills.remaining() > 0 && !level.empty()) {
+            Order* resting = level.head;
+            if (fills.is_self_trade(resting)) {
+                if (!fills.prevent_self_trade(resting)) {
+                    return false;
+                }
+                continue;
+            }
+            fills.fill(resting, std::min(fills.remaining(), resting->remaining_size()));
+        }
+        return true;
+    }
+};
+
+// Pro-rata over the level aggregate: one pass gives each order its share of
+// the aggressor, rounded down, and the lots rounding leaves over go to the
+// oldest orders. Both passes are O(orders at the level). With TopOrder the
+// head of the queue is filled first, as a reward for setting the price.
+template <bool TopOrder>
+struct BasicProRataMatching {
+    template <typename Fills>
+    static bool match(Fills& fills) {
+        // Self-trades come out first, so they cannot take part in a share
+        if (!fills.prevent_self_trades()) {
+            return false;
+        }
+
+        const PriceLevel& level = fills.level();
+        if constexpr (TopOrder) {
+            if (!level.empty() && fills.remaining() > 0) {
+                fills.fill(level.head, std::min(fills.remaining(), level.head->remaining_size()));
+            }
+        }
+
+        uint64_t wanted = fills.remaining();
+        uint64_t total = level.total_quantity;
+        if (wanted > 0 && wanted < total) {
+            // Sizes fit in 32 bits, so the products cannot overflow; a share
+            // is always less than the order, so no order leaves mid-pass
+            for (Order* resting = level.head; resting; resting = resting->next_in_level) {
+                uint64_t share = resting->remaining_size() * wanted / total;
+                if (share > 0) {
+                    fills.fill(resting, share);
+                }
+            }
+        }
+        return FifoMatching::match(fills);
+    }
+};
+
+using ProRataMatching = BasicProRataMatching<false>;
+using TopOrderProRataMatching = BasicProRataMatching<true>;
+
+// Price-time priority after the lead market maker's orders at the level,
+// oldest first, have taken lmm_percent of the aggressor's size
+struct FifoLmmMatching {
+    template <typename Fills>
+    static bool match(Fills& fills) {
+        const MatchingConfig& config = fills.config();
+        uint64_t share = fills.remaining() * config.lmm_percent / 100;
+        if (config.lmm_account != kNoAccount && share > 0) {
+            if (!fills.prevent_self_trades()) {
+                return false;
+            }
+            for (Order* resting = fills.level().head; resting && share > 0 && fills.remaining() > 0;) {
+                Order* next = resting->next_in_level;
+                if (resting->account == config.lmm_account) {
+                    uint64_t size = std::min({share, fills.remaining(), resting->remaining_size()});
+                    fills.fill(resting, size);
+                    share -= size;
+                }
+                resting = next;
+            }
+        }
+        return FifoMatching::match(fills);
+    }
+};
+
+} // namespace trading
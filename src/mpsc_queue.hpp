@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace trading {
+
+// Bounded lock-free multi-producer / single-consumer ring buffer. Every cell
+// carries a sequence number that tells producers whether it is free for the
+// current lap and tells the consumer whether it has been published, so
+// producers only contend on a single fetch of the tail and the consumer
+// never writes a shared counter that producers spin on.
+// try_push() fails immediately when the ring is full; callers decide how to
+// apply back-pressure.
+template <typename T>
+class MpscQueue {
+    static_assert(std::is_trivially_copyable_v<T>, "Queue elements are copied between threads");
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit MpscQueue(size_t capacity)
+        : capacity_(std::bit_ceil(capacity < 2 ? size_t{2} : capacity)),
+          mask_(capacity_ - 1),
+          cells_(std::make_unique<Cell[]>(capacity_)) {
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread: append an element, or return false if the ring is full
+    bool try_push(const T& value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // The consumer has not freed this cell yet
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only: remove the oldest element if one is published
+    bool try_pop(T& value) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+
+        value = cell.value;
+        cell.sequence.store(pos + capacity_, std::memory_order_release);
+        head_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer thread only: hand up to max_batch elements to f in order and
+    // return how many were consumed
+    template <typename F>
+    size_t drain(F&& f, size_t max_batch) {
+        size_t count = 0;
+        T value;
+        while (count < max_batch && try_pop(value)) {
+            f(value);
+            ++count;
+        }
+        return count;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // Number of pushes that have claimed a cell so far
+    uint64_t push_count() const { return tail_.load(std::memory_order_acquire); }
+
+    // Approximate number of queued elements (exact when producers are idle)
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static constexpr size_t kCacheLine = 64;
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    // Producers and the consumer write different cache lines
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+    alignas(kCacheLine) std::atomic<size_t> head_{0};
+};
+
+} // namespace trading
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "price.hpp"
+#include <cstdint>
+#include <type_traits>
+
+namespace trading {
+
+// Enum representing the side of an order (buy or sell)
+enum class OrderSide : uint8_t {
+    Buy,
+    Sell
+};
+
+// Enum representing the type of an order
+enum class OrderType : uint8_t {
+    Limit,          // Order with a specific price
+    Market,         // Order at best available price
+    PostOnly,       // Limit order that only adds liquidity; rejected if it would cross
+    PostOnlySlide   // Post-only, repriced one tick behind the opposite best if it would cross
+};
+
+// How long the unfilled part of an order stays in the book. Market orders
+// never rest, so for them anything but FillOrKill means ImmediateOrCancel.
+enum class TimeInForce : uint8_t {
+    GoodTillCancel,     // Rest until filled or cancelled
+    ImmediateOrCancel,  // Match what is available now and cancel the rest
+    FillOrKill          // Fill completely right away or not at all
+};
+
+// Order status
+enum class OrderStatus : uint8_t {
+    New,        // Just created
+    PartiallyFilled, // Partially executed
+    Filled,     // Fully executed
+    Cancelled,  // Cancelled by user
+    Rejected,   // Rejected by system
+    Pending     // A stop order waiting for its trigger
+};
+
+// Engine-side identifiers. Client-facing string IDs are translated at the
+// gateway (see ClientOrderIdMap) and never reach the matching path.
+using OrderId = uint64_t;
+using SymbolId = uint32_t;
+using AccountId = uint32_t;
+
+// Owner of orders that carry no account; self-trade prevention ignores them
+inline constexpr AccountId kNoAccount = 0;
+
+// Returned by symbol lookups that find nothing
+inline constexpr SymbolId kInvalidSymbolId = static_cast<SymbolId>(-1);
+
+// Orders store their quantities in 32 bits; the engine rejects larger sizes
+inline constexpr uint64_t kMaxOrderSize = UINT32_MAX;
+
+// Simple structure representing a trade
+struct Trade {
+    OrderId order_id_buy;
+    OrderId order_id_sell;
+    uint64_t size;
+    Price price;
+    uint64_t timestamp;
+    SymbolId symbol;
+    AccountId account_buy;
+    AccountId account_sell;
+};
+
+// Structure representing an order in the system. Trivially copyable and laid
+// out to fill exactly one cache line.
+struct alignas(64) Order {
+    OrderId order_id;        // Client-assigned identifier
+    Price price;             // Limit price in ticks (for limit orders)
+    uint64_t timestamp;      // When the order was placed
+
+    // Intrusive links owned by the price level the order rests in
+    Order* prev_in_level;
+    Order* next_in_level;
+
+    uint32_t size;           // Original order size (at most kMaxOrderSize)
+    uint32_t filled_size;    // Amount that has been filled
+    SymbolId symbol;         // Interned trading symbol/instrument
+    AccountId account;       // Owning account; 0 unless the caller sets one
+    OrderSide side;          // Buy or Sell
+    OrderType type;          // Limit, Market or post-only
+    OrderStatus status;      // Current status
+    TimeInForce tif;         // Good-till-cancel, IOC or FOK
+
+    Order() = default;
+
+    // Constructor for a limit order (type may also be one of the post-only types)
+    Order(OrderId id, OrderSide s, SymbolId sym,
+          uint64_t sz, Price prc, uint64_t time,
+          TimeInForce t = TimeInForce::GoodTillCancel, OrderType ty = OrderType::Limit)
+        : order_id(id), price(prc), timestamp(time),
+          prev_in_level(nullptr), next_in_level(nullptr),
+          size(static_cast<uint32_t>(sz)), filled_size(0),
+          symbol(sym), account(0), side(s), type(ty), status(OrderStatus::New), tif(t) {}
+
+    // Constructor for a market order
+    Order(OrderId id, OrderSide s, SymbolId sym,
+          uint64_t sz, uint64_t time,
+          TimeInForce t = TimeInForce::ImmediateOrCancel)
+        : order_id(id), price(s == OrderSide::Buy ? Price::max() : Price::min()),
+          timestamp(time),
+          prev_in_level(nullptr), next_in_level(nullptr),
+          size(static_cast<uint32_t>(sz)), filled_size(0),
+          symbol(sym), account(0), side(s), type(OrderType::Market), status(OrderStatus::New), tif(t) {}
+
+    // Remaining quantity
+    uint64_t remaining_size() const {
+        return static_cast<uint64_t>(size - filled_size);
+    }
+
+    // Check if order is completely filled
+    bool is_filled() const {
+        return filled_size >= size;
+    }
+
+    // Check if the unfilled part of the order may be added to a book: a
+    // good-till-cancel limit order that matching did not cancel or reject
+    bool can_rest() const {
+        return type != OrderType::Market && tif == TimeInForce::GoodTillCancel && !is_filled() &&
+               status != OrderStatus::Cancelled && status != OrderStatus::Rejected;
+    }
+
+    // Update order after a fill
+    void fill(uint64_t fill_size) {
+        filled_size += static_cast<uint32_t>(fill_size);
+        if (is_filled()) {
+            status = OrderStatus::Filled;
+        } else {
+            status = OrderStatus::PartiallyFilled;
+        }
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<Trade>, "Trade must stay a flat record");
+static_assert(std::is_trivially_copyable_v<Order>, "Order must stay a flat record");
+static_assert(sizeof(Order) == 64, "Order must fit in a single cache line");
+
+} // namespace trading
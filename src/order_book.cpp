@@ -1,236 +1,395 @@
 #include "order_book.hpp"
 #include <algorithm>
 #include <iostream>
-#include <chrono>
 
 namespace trading {
 
-OrderBook::OrderBook(std::string symbol)
+template <typename TickPolicy>
+BasicOrderBook<TickPolicy>::BasicOrderBook(std::string symbol, size_t order_capacity, SymbolId symbol_id,
+                                           std::shared_ptr<OrderIndex> index)
     : symbol_(std::move(symbol)),
+      symbol_id_(symbol_id),
+      pool_(order_capacity),
+      owns_index_(index == nullptr),
+      index_(index ? std::move(index) : std::make_shared<OrderIndex>(order_capacity)),
       last_update_time_(0) {
 }
 
-void OrderBook::add_order(std::shared_ptr<Order> order) {
-    // Store order in the map for quick access by ID
-    // Note: This allows duplicate order_ids in map
-    order_map_.insert({order->order_id, order});
+template <typename TickPolicy>
+bool BasicOrderBook<TickPolicy>::add_order(Order* order) {
+    // IOC and FOK remainders, market orders and refused post-only orders
+    // stay out of the book entirely
+    if (!order->can_rest()) {
+        return false;
+    }
 
-    // Add to appropriate vector based on side
-    if (order->side == OrderSide::Buy) {
-        buy_orders_.push_back(order);
-        sort_buy_orders();
-    } else {
-        sell_orders_.push_back(order);
-        sort_sell_orders();
+    // Index the order for lookup by ID
+    // Note: duplicate order_ids are kept unless the index policy rejects them
+    if (!index_->insert(order)) {
+        order->status = OrderStatus::Rejected;
+        return false;
+    }
+
+    // Append to the FIFO of its price level on the appropriate side
+    bool added = (order->side == OrderSide::Buy)
+                 ? bids_.push_back(order)
+                 : asks_.push_back(order);
+
+    if (!added) {
+        index_->erase(order);
+        order->status = OrderStatus::Rejected;
+        return false;
+    }
+
+    resting_changed(*order, static_cast<int64_t>(order->remaining_size()));
+    if (market_data_) {
+        market_data_->order_added(*order, level_of(*order));
     }
 
-    // Update last update time
-    last_update_time_ = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
+    last_update_time_.store(order->timestamp, std::memory_order_relaxed);
+
+    return true;
 }
 
-bool OrderBook::cancel_order(const std::string& order_id) {
-    // Find the first order with this ID
-    auto range = order_map_.equal_range(order_id);
-    if (range.first == range.second) {
+template <typename TickPolicy>
+bool BasicOrderBook<TickPolicy>::cancel_order(OrderId order_id, uint64_t timestamp) {
+    // Find the first order with this ID in this book
+    size_t slot = index_->find(order_id, symbol_id_);
+    if (slot == OrderIndex::npos) {
         return false; // Order not found
     }
 
-    // Get the first matching order and mark it as cancelled
-    auto it = range.first;
-    auto order = it->second;
+    cancel_order_at(slot, timestamp);
+    return true;
+}
+
+template <typename TickPolicy>
+void BasicOrderBook<TickPolicy>::cancel_order_at(size_t index_slot, uint64_t timestamp) {
+    // Get the indexed order and mark it as cancelled
+    Order* order = index_->at(index_slot).order;
+
+    // A pending stop has only its queue entry (its price is the trigger)
+    if (order->status == OrderStatus::Pending) {
+        StopEntry entry{};
+        bool erased = order->side == OrderSide::Buy ? buy_stops_.erase(order, order->price, &entry)
+                                                    : sell_stops_.erase(order, order->price, &entry);
+        if (erased) {
+            pending_changed(entry, -static_cast<int64_t>(order->remaining_size()));
+        }
+        order->status = OrderStatus::Cancelled;
+        index_->erase_at(index_slot);
+        pool_.release(order);
+        if (timestamp != 0) {
+            last_update_time_.store(timestamp, std::memory_order_relaxed);
+        }
+        return;
+    }
+
     order->status = OrderStatus::Cancelled;
+    resting_changed(*order, -static_cast<int64_t>(order->remaining_size()));
 
-    // Remove from vectors
+    // Unlink this specific instance from its price level
     if (order->side == OrderSide::Buy) {
-        // Find and remove this specific order instance
-        auto order_it = std::find_if(buy_orders_.begin(), buy_orders_.end(),
-            [&order](const auto& o) { return o.get() == order.get(); });
-
-        if (order_it != buy_orders_.end()) {
-            buy_orders_.erase(order_it);
-        }
+        bids_.erase(order);
     } else {
-        // Find and remove this specific order instance
-        auto order_it = std::find_if(sell_orders_.begin(), sell_orders_.end(),
-            [&order](const auto& o) { return o.get() == order.get(); });
-
-        if (order_it != sell_orders_.end()) {
-            sell_orders_.erase(order_it);
-        }
+        asks_.erase(order);
     }
 
-    // Remove from map - only remove this specific instance
-    order_map_.erase(it);
+    if (market_data_) {
+        market_data_->order_removed(*order, level_of(*order));
+    }
 
-    // Update last update time
-    last_update_time_ = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
+    // Remove from the index - only this specific instance - and recycle it
+    index_->erase_at(index_slot);
+    pool_.release(order);
 
-    return true;
+    if (timestamp != 0) {
+        last_update_time_.store(timestamp, std::memory_order_relaxed);
+    }
 }
 
-std::vector<Trade> OrderBook::match_order(std::shared_ptr<Order> order) {
-    std::vector<Trade> trades;
+template <typename TickPolicy>
+size_t BasicOrderBook<TickPolicy>::cancel_all(OrderSide side, uint64_t timestamp) {
+    size_t cancelled = (side == OrderSide::Buy) ? clear_side(bids_) + clear_stops(buy_stops_)
+                                                : clear_side(asks_) + clear_stops(sell_stops_);
 
-    // Check which side we're matching against
-    auto& opposite_side = (order->side == OrderSide::Buy) ? sell_orders_ : buy_orders_;
-
-    // Process until order is filled or no more matches
-    while (!opposite_side.empty() && !order->is_filled()) {
-        auto match_order = opposite_side.front();
-
-        // For buy orders, we match if the buy price >= sell price
-        // For sell orders, we match if the sell price <= buy price
-        bool price_matches = (order->side == OrderSide::Buy)
-                            ? order->price >= match_order->price
-                            : order->price <= match_order->price;
-
-        // If market order or price is acceptable
-        if (order->type == OrderType::Market || price_matches) {
-            // Calculate fill size
-            uint64_t fill_size = std::min(order->remaining_size(), match_order->remaining_size());
-
-            // Use the resting order's price
-            double trade_price = match_order->price;
-
-            // Update both orders
-            order->fill(fill_size);
-            match_order->fill(fill_size);
-
-            // Create trade record
-            uint64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch()).count();
-
-            // Create trade with proper buyer/seller IDs
-            if (order->side == OrderSide::Buy) {
-                trades.emplace_back(order->order_id, match_order->order_id,
-                                   fill_size, trade_price, timestamp);
-            } else {
-                trades.emplace_back(match_order->order_id, order->order_id,
-                                   fill_size, trade_price, timestamp);
-            }
-
-            // If resting order is now filled, remove it
-            if (match_order->is_filled()) {
-                opposite_side.erase(opposite_side.begin());
-                // Find all entries in the multimap with this ID and remove the one with the same pointer
-                auto range = order_map_.equal_range(match_order->order_id);
-                for (auto it = range.first; it != range.second; ++it) {
-                    if (it->second.get() == match_order.get()) {
-                        order_map_.erase(it);
-                        break;
-                    }
-                }
-            }
-        } else {
-            break; // No more price matches possible
+    if (cancelled > 0 && timestamp != 0) {
+        last_update_time_.store(timestamp, std::memory_order_relaxed);
+    }
+    return cancelled;
+}
+
+template <typename TickPolicy>
+template <typename Ladder>
+size_t BasicOrderBook<TickPolicy>::clear_side(Ladder& ladder) {
+    size_t cancelled = 0;
+    while (!ladder.empty()) {
+        // Pop from the front of the best level, as a fill would
+        PriceLevel& level = ladder.best_level();
+        Order* order = level.head;
+        order->status = OrderStatus::Cancelled;
+        resting_changed(*order, -static_cast<int64_t>(order->remaining_size()));
+        ladder.pop_best();
+
+        if (market_data_) {
+            market_data_->order_removed(*order, level);
         }
+        index_->erase(order);
+        pool_.release(order);
+        ++cancelled;
     }
+    return cancelled;
+}
 
-    // Update last update time
-    last_update_time_ = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
+template <typename TickPolicy>
+AuctionResult BasicOrderBook<TickPolicy>::indicative_uncross() const {
+    if (bids_.empty() || asks_.empty() || bids_.best_price() < asks_.best_price()) {
+        return {Price{}, 0, 0, 0};
+    }
 
-    return trades;
+    // Only the crossed range can trade: from the best ask up to the best bid
+    Price low = asks_.best_price();
+    Price high = bids_.best_price();
+    size_t count = static_cast<size_t>(high.ticks - low.ticks) + 1;
+    auction_bids_.resize(count);
+    auction_asks_.resize(count);
+    bids_.copy_quantities(low, count, auction_bids_.data());
+    asks_.copy_quantities(low, count, auction_asks_.data());
+
+    // Ties go to the price nearest the last trade, or else the middle of the range
+    Price reference = has_traded_ ? last_trade_price_ : Price(low.ticks + (high.ticks - low.ticks) / 2);
+    return find_equilibrium(low, auction_bids_, auction_asks_, reference);
 }
 
-void OrderBook::remove_filled_orders() {
-    // Remove filled orders from both sides
-    buy_orders_.erase(
-        std::remove_if(buy_orders_.begin(), buy_orders_.end(),
-            [](const auto& o) { return o->is_filled() || o->status == OrderStatus::Cancelled; }),
-        buy_orders_.end());
+template <typename TickPolicy>
+template <typename Stops>
+size_t BasicOrderBook<TickPolicy>::clear_stops(Stops& stops) {
+    size_t cancelled = stops.size();
+    stops.for_each([this](const StopEntry& entry) {
+        pending_changed(entry, -static_cast<int64_t>(entry.order->remaining_size()));
+        entry.order->status = OrderStatus::Cancelled;
+        index_->erase(entry.order);
+        pool_.release(entry.order);
+    });
+    stops.clear();
+    return cancelled;
+}
 
-    sell_orders_.erase(
-        std::remove_if(sell_orders_.begin(), sell_orders_.end(),
-            [](const auto& o) { return o->is_filled() || o->status == OrderStatus::Cancelled; }),
-        sell_orders_.end());
+template <typename TickPolicy>
+void BasicOrderBook<TickPolicy>::match_order(Order& order, std::vector<Trade>& trades) {
+    match_order(order, [&trades](const Trade& trade) { trades.push_back(trade); });
 }
 
-void OrderBook::sort_buy_orders() {
-    // Sort by price DESC, then by timestamp ASC (price-time priority)
-    std::sort(buy_orders_.begin(), buy_orders_.end(),
-              [](const auto& a, const auto& b) {
-                  if (a->price != b->price) {
-                      return a->price > b->price; // Higher buy prices first
-                  }
-                  return a->timestamp < b->timestamp; // Earlier timestamps first
-              });
+template <typename TickPolicy>
+std::vector<Trade> BasicOrderBook<TickPolicy>::match_order(Order& order) {
+    std::vector<Trade> trades;
+    match_order(order, trades);
+    return trades;
 }
 
-void OrderBook::sort_sell_orders() {
-    // Sort by price ASC, then by timestamp ASC (price-time priority)
-    std::sort(sell_orders_.begin(), sell_orders_.end(),
-              [](const auto& a, const auto& b) {
-                  if (a->price != b->price) {
-                      return a->price < b->price; // Lower sell prices first
-                  }
-                  return a->timestamp < b->timestamp; // Earlier timestamps first
-              });
+template <typename TickPolicy>
+Price BasicOrderBook<TickPolicy>::best_bid_price() const {
+    return bids_.empty() ? Price::min() : bids_.best_price();
 }
 
-double OrderBook::best_bid() const {
-    if (buy_orders_.empty()) {
+template <typename TickPolicy>
+Price BasicOrderBook<TickPolicy>::best_ask_price() const {
+    return asks_.empty() ? Price::max() : asks_.best_price();
+}
+
+template <typename TickPolicy>
+double BasicOrderBook<TickPolicy>::best_bid() const {
+    if (bids_.empty()) {
         return 0.0; // No bid
     }
-    return buy_orders_.front()->price;
+    return to_double(bids_.best_price());
 }
 
-double OrderBook::best_ask() const {
-    if (sell_orders_.empty()) {
+template <typename TickPolicy>
+double BasicOrderBook<TickPolicy>::best_ask() const {
+    if (asks_.empty()) {
         return std::numeric_limits<double>::max(); // No ask
     }
-    return sell_orders_.front()->price;
+    return to_double(asks_.best_price());
 }
 
-uint64_t OrderBook::volume_at_price(OrderSide side, double price) const {
-    uint64_t volume = 0;
+template <typename TickPolicy>
+uint64_t BasicOrderBook<TickPolicy>::volume_at_price(OrderSide side, double price) const {
+    return volume_at_price(side, to_price(price));
+}
 
-    const auto& orders = (side == OrderSide::Buy) ? buy_orders_ : sell_orders_;
+template <typename TickPolicy>
+uint64_t BasicOrderBook<TickPolicy>::volume_at_price(OrderSide side, Price price) const {
+    const PriceLevel* level = (side == OrderSide::Buy) ? bids_.find(price) : asks_.find(price);
+    return level ? level->total_quantity : 0;
+}
 
-    for (const auto& order : orders) {
-        if (order->price == price) {
-            volume += order->remaining_size();
-        }
+template <typename TickPolicy>
+uint64_t BasicOrderBook<TickPolicy>::orders_at_price(OrderSide side, Price price) const {
+    const PriceLevel* level = (side == OrderSide::Buy) ? bids_.find(price) : asks_.find(price);
+    return level ? level->order_count : 0;
+}
+
+template <typename TickPolicy>
+TopOfBook BasicOrderBook<TickPolicy>::top_of_book() const {
+    TopOfBook top{{Price::min(), 0, 0}, {Price::max(), 0, 0}};
+    if (!bids_.empty()) {
+        const PriceLevel& level = bids_.best_level();
+        top.bid = {bids_.best_price(), level.total_quantity, level.order_count};
+    }
+    if (!asks_.empty()) {
+        const PriceLevel& level = asks_.best_level();
+        top.ask = {asks_.best_price(), level.total_quantity, level.order_count};
     }
+    return top;
+}
+
+template <typename TickPolicy>
+size_t BasicOrderBook<TickPolicy>::level_count(OrderSide side) const {
+    return side == OrderSide::Buy ? bids_.level_count() : asks_.level_count();
+}
+
+template <typename TickPolicy>
+SweepEstimate BasicOrderBook<TickPolicy>::estimate_sweep(OrderSide side, uint64_t size, Price limit) const {
+    // A buyer sweeps the asks and a seller the bids
+    return side == OrderSide::Buy ? asks_.sweep(limit, size) : bids_.sweep(limit, size);
+}
+
+template <typename TickPolicy>
+SweepEstimate BasicOrderBook<TickPolicy>::estimate_sweep(OrderSide side, uint64_t size) const {
+    return estimate_sweep(side, size, side == OrderSide::Buy ? Price::max() : Price::min());
+}
 
-    return volume;
+template <typename TickPolicy>
+void BasicOrderBook<TickPolicy>::depth(size_t levels, BookDepth& out) const {
+    out.bids.clear();
+    out.asks.clear();
+
+    bids_.for_each_level(levels, [&out](Price price, const PriceLevel& level) {
+        out.bids.push_back({price, level.total_quantity, level.order_count});
+    });
+    asks_.for_each_level(levels, [&out](Price price, const PriceLevel& level) {
+        out.asks.push_back({price, level.total_quantity, level.order_count});
+    });
 }
 
-std::pair<std::vector<std::shared_ptr<Order>>, std::vector<std::shared_ptr<Order>>>
-OrderBook::get_all_orders() const {
-    return {buy_orders_, sell_orders_};
+template <typename TickPolicy>
+BookDepth BasicOrderBook<TickPolicy>::depth(size_t levels) const {
+    BookDepth out;
+    depth(levels, out);
+    return out;
 }
 
-void OrderBook::print() const {
+template <typename TickPolicy>
+template <typename Ladder>
+std::vector<const Order*> BasicOrderBook<TickPolicy>::collect_orders(const Ladder& ladder) {
+    std::vector<const Order*> orders;
+
+    ladder.for_each_level([&](Price, const PriceLevel& level) {
+        for (const Order* order = level.head; order; order = order->next_in_level) {
+            orders.push_back(order);
+        }
+    });
+
+    return orders;
+}
+
+template <typename TickPolicy>
+std::pair<std::vector<const Order*>, std::vector<const Order*>>
+BasicOrderBook<TickPolicy>::get_all_orders() const {
+    return {collect_orders(bids_), collect_orders(asks_)};
+}
+
+template <typename TickPolicy>
+void BasicOrderBook<TickPolicy>::publish_snapshot() const {
+    if (!market_data_) {
+        return;
+    }
+
+    market_data_->snapshot_start(symbol_id_);
+    bids_.for_each_level([this](Price price, const PriceLevel& level) {
+        market_data_->snapshot_level(symbol_id_, OrderSide::Buy, price, level);
+    });
+    asks_.for_each_level([this](Price price, const PriceLevel& level) {
+        market_data_->snapshot_level(symbol_id_, OrderSide::Sell, price, level);
+    });
+    market_data_->snapshot_end(symbol_id_);
+}
+
+template <typename TickPolicy>
+void BasicOrderBook<TickPolicy>::print() const {
     std::cout << "Order Book: " << symbol_ << std::endl;
 
+    auto print_level = [](Price price, const PriceLevel& level) {
+        for (const Order* order = level.head; order; order = order->next_in_level) {
+            std::cout << "  " << to_double(price) << " x " << order->remaining_size()
+                      << " (" << order->order_id << ")" << std::endl;
+        }
+    };
+
     // Print sells (highest to lowest)
     std::cout << "SELLS:" << std::endl;
-    if (sell_orders_.empty()) {
+    if (asks_.empty()) {
         std::cout << "  [Empty]" << std::endl;
     } else {
-        auto sells = sell_orders_;
-        std::sort(sells.begin(), sells.end(),
-                 [](const auto& a, const auto& b) { return a->price > b->price; });
-
-        for (const auto& order : sells) {
-            std::cout << "  " << order->price << " x " << order->remaining_size()
-                      << " (" << order->order_id << ")" << std::endl;
-        }
+        asks_.for_each_level_worst_first(print_level);
     }
 
     // Print buys (highest to lowest)
     std::cout << "BUYS:" << std::endl;
-    if (buy_orders_.empty()) {
+    if (bids_.empty()) {
         std::cout << "  [Empty]" << std::endl;
     } else {
-        for (const auto& order : buy_orders_) {
-            std::cout << "  " << order->price << " x " << order->remaining_size()
-                      << " (" << order->order_id << ")" << std::endl;
-        }
+        bids_.for_each_level(print_level);
     }
 }
 
+template <typename TickPolicy>
+BookMemoryStats BasicOrderBook<TickPolicy>::memory_stats() const {
+    BookMemoryStats stats{};
+    stats.orders = pool_.in_use();
+    stats.pool_capacity = pool_.capacity();
+    stats.pool_slabs = pool_.slab_count();
+    stats.pool_utilization = stats.pool_capacity > 0
+        ? static_cast<double>(stats.orders) / static_cast<double>(stats.pool_capacity) : 0.0;
+    stats.levels = bids_.level_count() + asks_.level_count();
+    stats.allocated_levels = bids_.allocated_levels() + asks_.allocated_levels();
+    stats.index_entries = index_->size();
+    stats.index_capacity = index_->capacity();
+    stats.index_load_factor = index_->load_factor();
+    stats.shared_index = !owns_index_;
+    stats.pool_bytes = pool_.memory_bytes();
+    stats.ladder_bytes = bids_.memory_bytes() + asks_.memory_bytes();
+    stats.index_bytes = index_->memory_bytes();
+    stats.other_bytes = buy_stops_.memory_bytes() + sell_stops_.memory_bytes() +
+                        triggered_.capacity() * sizeof(StopEntry) +
+                        (auction_bids_.capacity() + auction_asks_.capacity()) * sizeof(uint64_t);
+    stats.total_bytes = stats.pool_bytes + stats.ladder_bytes + stats.other_bytes +
+                        (owns_index_ ? stats.index_bytes : 0);
+    return stats;
+}
+
+template <typename TickPolicy>
+bool BasicOrderBook<TickPolicy>::needs_compaction() const {
+    return bids_.shrink_target() != 0 || asks_.shrink_target() != 0 || (owns_index_ && index_->needs_compaction());
+}
+
+template <typename TickPolicy>
+size_t BasicOrderBook<TickPolicy>::compact(size_t budget) {
+    size_t work = 0;
+    if (owns_index_) {
+        work += index_->compact(budget);
+    }
+    if (work < budget) {
+        work += bids_.shrink(budget - work);
+    }
+    if (work < budget) {
+        work += asks_.shrink(budget - work);
+    }
+    return work;
+}
+
+template class BasicOrderBook<CentTick>;
+template class BasicOrderBook<BasisPointTick>;
+
 } // namespace trading
@@ -1,135 +1,268 @@
 #pragma once
 
+#include "auction.hpp"
+#include "market_data.hpp"
+#include "matching_policy.hpp"
+#include "order.hpp"
+#include "order_index.hpp"
+#include "order_pool.hpp"
+#include "price.hpp"
+#include "price_ladder.hpp"
+#include "stop_queue.hpp"
 #include <cstdint>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <memory>
 #include <limits>
 #include <algorithm>
 #include <iostream>
 #include <atomic>
+#include <concepts>
 
 namespace trading {
 
-// Enum representing the side of an order (buy or sell)
-enum class OrderSide : uint8_t {
-    Buy,
-    Sell
-};
+// Receives the trades produced by matching, one call per fill
+template <typename Sink>
+concept TradeSink = std::invocable<Sink&, const Trade&>;
 
-// Enum representing the type of an order
-enum class OrderType : uint8_t {
-    Limit,  // Order with a specific price
-    Market  // Order at best available price
+// Best level of each side; an empty side reports Price::min() (bids) or
+// Price::max() (asks) with no quantity
+struct TopOfBook {
+    LevelSummary bid;
+    LevelSummary ask;
 };
 
-// Order status
-enum class OrderStatus : uint8_t {
-    New,        // Just created
-    PartiallyFilled, // Partially executed
-    Filled,     // Fully executed
-    Cancelled,  // Cancelled by user
-    Rejected    // Rejected by system
+// Outcome of modifying a resting order
+enum class ModifyResult : uint8_t {
+    NotFound,   // No live order with that ID in the book (or only a pending stop order)
+    Amended,    // Size reduced in place; the order kept its queue position
+    Requeued,   // Moved to the back of its new price level
+    Filled,     // The new price crossed and the order filled completely
+    Cancelled,  // The new size is no more than what was already filled, or self-trade prevention cancelled it
+    Rejected,   // The new size or price cannot be placed, or a post-only order would cross; the order was removed
+    Refused     // The engine's pre-trade risk stage refused the change; the order is unchanged
 };
 
-// Simple structure representing a trade
-struct Trade {
-    std::string order_id_buy;
-    std::string order_id_sell;
-    uint64_t size;
-    double price;
-    uint64_t timestamp;
-
-    // Constructor
-    Trade(const std::string& buy_id, const std::string& sell_id,
-          uint64_t qty, double prc, uint64_t time)
-        : order_id_buy(buy_id), order_id_sell(sell_id),
-          size(qty), price(prc), timestamp(time) {}
+// What a book does when an aggressor meets a resting order of the same
+// account. Orders of kNoAccount are never treated as self-trades
+enum class SelfTradePrevention : uint8_t {
+    None,               // Let them trade
+    CancelResting,      // Cancel the resting order and keep matching
+    CancelAggressing,   // Cancel what is left of the aggressor and stop matching
+    DecrementBoth       // Reduce both by the smaller remaining size, without a trade
 };
 
-// Structure representing an order in the system
-struct Order {
-    std::string order_id;    // Unique identifier
-    OrderSide side;          // Buy or Sell
-    OrderType type;          // Limit or Market
-    std::string symbol;      // Trading symbol/instrument
-    uint64_t size;           // Original order size
-    uint64_t filled_size;    // Amount that has been filled
-    double price;            // Limit price (for limit orders)
-    uint64_t timestamp;      // When the order was placed
-    OrderStatus status;      // Current status
-
-    // Constructor for a limit order
-    Order(std::string id, OrderSide s, std::string sym,
-          uint64_t sz, double prc, uint64_t time)
-        : order_id(std::move(id)), side(s), type(OrderType::Limit),
-          symbol(std::move(sym)), size(sz), filled_size(0),
-          price(prc), timestamp(time), status(OrderStatus::New) {}
-
-    // Constructor for a market order
-    Order(std::string id, OrderSide s, std::string sym,
-          uint64_t sz, uint64_t time)
-        : order_id(std::move(id)), side(s), type(OrderType::Market),
-          symbol(std::move(sym)), size(sz), filled_size(0),
-          price(s == OrderSide::Buy ? std::numeric_limits<double>::max()
-                                  : 0.0),
-          timestamp(time), status(OrderStatus::New) {}
-
-    // Remaining quantity
-    uint64_t remaining_size() const {
-        return size - filled_size;
-    }
-
-    // Check if order is completely filled
-    bool is_filled() const {
-        return filled_size >= size;
-    }
-
-    // Update order after a fill
-    void fill(uint64_t fill_size) {
-        filled_size += fill_size;
-        if (is_filled()) {
-            status = OrderStatus::Filled;
-        } else {
-            status = OrderStatus::PartiallyFilled;
-        }
-    }
+// Told of every change to the quantity resting in a book, order by order:
+// +remaining size when an order rests, -size as it fills while resting or is
+// amended down, -remaining size when it is cancelled or taken out to be
+// re-entered. Quantity an aggressor fills never rested; a stop rests only
+// once triggered.
+//
+// Pending stops are reported apart, with their queue entry: +remaining size
+// when one is queued, -remaining size when it is cancelled or triggers,
+// before it matches.
+class RestingOrderObserver {
+public:
+    virtual ~RestingOrderObserver() = default;
+    virtual void on_resting(const Order& order, int64_t quantity) = 0;
+    virtual void on_pending(const StopEntry& stop, int64_t quantity) = 0;
 };
 
-// Comparison functor for buy orders (highest price first, then earliest time)
-struct BuyOrderComparator {
-    bool operator()(const std::shared_ptr<Order>& lhs, const std::shared_ptr<Order>& rhs) const {
-        if (lhs->price == rhs->price) {
-            return lhs->timestamp > rhs->timestamp; // Earlier timestamp first
-        }
-        return lhs->price < rhs->price; // Higher price first
-    }
+// Memory held by one book. A book placed by a MatchingEngine shares the
+// engine's order index, so its index figures cover every book of the engine
+// and its index bytes are not part of total_bytes
+struct BookMemoryStats {
+    size_t orders;              // Resting orders and pending stops
+    size_t pool_capacity;       // Order slots, free or in use
+    size_t pool_slabs;
+    double pool_utilization;    // orders / pool_capacity
+    size_t levels;              // Non-empty price levels, both sides
+    size_t allocated_levels;    // Levels the two ladders have room for
+    size_t index_entries;
+    size_t index_capacity;
+    double index_load_factor;
+    bool shared_index;
+    size_t pool_bytes;
+    size_t ladder_bytes;        // Level, quantity and bitmap arrays of both sides
+    size_t index_bytes;
+    size_t other_bytes;         // Stop queues and scratch buffers
+    size_t total_bytes;
 };
 
-// Comparison functor for sell orders (lowest price first, then earliest time)
-struct SellOrderComparator {
-    bool operator()(const std::shared_ptr<Order>& lhs, const std::shared_ptr<Order>& rhs) const {
-        if (lhs->price == rhs->price) {
-            return lhs->timestamp > rhs->timestamp; // Earlier timestamp first
-        }
-        return lhs->price > rhs->price; // Lower price first
-    }
+// L2 snapshot: the best levels of each side, best price first
+struct BookDepth {
+    std::vector<LevelSummary> bids;
+    std::vector<LevelSummary> asks;
 };
 
-// Class representing an order book for a single instrument
-class OrderBook {
+// Class representing an order book for a single instrument.
+// Each side is a direct-indexed ladder of price levels; each level keeps its
+// orders in a FIFO, so inserts, cancels and top-of-book fills are O(1).
+// TickPolicy fixes the instrument's tick size at compile time: all internal
+// prices are integer ticks and doubles are converted only at the API edge.
+//
+// Matching is price-time priority unless the book is given another
+// MatchingAlgorithm; each algorithm is a policy from matching_policy.hpp,
+// compiled into its own copy of the matching loop.
+//
+// Orders are allocated from the book's own OrderPool. An order returned by
+// create_*_order belongs to the caller until add_order accepts it; from then
+// on the book recycles it as soon as it is filled or cancelled.
+//
+// Resting orders are looked up through an OrderIndex. A MatchingEngine shares
+// one index across all of its books so that a cancel costs a single probe;
+// a standalone book creates its own.
+//
+// An attached MarketDataPublisher receives an incremental update for every
+// order added, filled or cancelled, and a full snapshot on request.
+//
+// The book never reads a clock. Times come from the event being applied: an
+// order's own timestamp when it is added or matched (every fill of a sweep
+// carries the aggressor's timestamp) and the caller's time for a cancel.
+template <typename TickPolicy = DefaultTickPolicy>
+class BasicOrderBook {
 public:
-    explicit OrderBook(std::string symbol);
+    using Ticks = TickPolicy;
+
+    // order_capacity orders are preallocated; the pool only grows beyond that.
+    // symbol_id is the interned ID stamped on this book's orders and trades.
+    // index is the (possibly shared) order index; a private one is created if null.
+    explicit BasicOrderBook(std::string symbol,
+                            size_t order_capacity = OrderPool::kDefaultCapacity,
+                            SymbolId symbol_id = 0,
+                            std::shared_ptr<OrderIndex> index = nullptr);
+
+    // Levels hold raw pointers into the book, so it is neither copyable nor movable
+    BasicOrderBook(const BasicOrderBook&) = delete;
+    BasicOrderBook& operator=(const BasicOrderBook&) = delete;
+
+    // Allocate orders for this instrument from the book's pool. type may be
+    // Limit or one of the post-only types
+    Order* create_limit_order(OrderId order_id, OrderSide side, uint64_t size,
+                              Price price, uint64_t timestamp,
+                              TimeInForce tif = TimeInForce::GoodTillCancel,
+                              OrderType type = OrderType::Limit) {
+        return pool_.allocate(order_id, side, symbol_id_, size, price, timestamp, tif, type);
+    }
+    Order* create_market_order(OrderId order_id, OrderSide side, uint64_t size,
+                               uint64_t timestamp,
+                               TimeInForce tif = TimeInForce::ImmediateOrCancel) {
+        return pool_.allocate(order_id, side, symbol_id_, size, timestamp, tif);
+    }
+
+    // Return an order that the book does not own (e.g. a filled aggressor) to the pool
+    void release_order(Order* order) { pool_.release(order); }
+
+    // Convert between decimal prices and this instrument's ticks
+    static Price to_price(double price) { return TickPolicy::to_price(price); }
+    static constexpr double to_double(Price price) { return TickPolicy::to_double(price); }
+
+    // Add a pool-allocated order to the book; returns false (and marks the
+    // order Rejected, leaving it with the caller) if its price cannot be
+    // placed on the ladder or the index's duplicate policy refuses its ID.
+    // An order that may not rest (see Order::can_rest) is returned to the
+    // caller with its status untouched and the book never sees it.
+    bool add_order(Order* order);
+
+    // Take a pool-allocated stop (market type) or stop-limit (limit type)
+    // order that triggers at `trigger`. It waits, indexed but invisible to
+    // matching and market data, until a trade prints at or through the
+    // trigger; if the last trade already has, it is released at once, with
+    // its trades going to sink. The book owns the order from here on either
+    // way; returns Pending, the status it ended with, or Rejected if the
+    // index refused its ID
+    template <TradeSink Sink>
+    OrderStatus add_stop_order(Order* order, Price trigger, Sink&& sink);
 
-    // Add a new order to the book
-    void add_order(std::shared_ptr<Order> order);
+    // Release every stop the last trade price has reached, in trigger order,
+    // into matching as if each had just arrived, and repeat for the stops
+    // their own trades reach. Call it once an event has finished matching
+    // (its aggressor rested or was released); returns how many were released.
+    // Costs O(1) when nothing triggers and O(released) otherwise
+    template <TradeSink Sink>
+    size_t release_triggered_stops(Sink&& sink);
+
+    // Auction mode, for opening and closing auctions: orders accumulate
+    // without matching, even when the book crosses, until uncross(). Only
+    // orders that may rest are accepted; market, IOC and FOK orders are
+    // cancelled and post-only orders are taken as plain limits
+    void begin_auction() { auction_ = true; }
+    bool in_auction() const { return auction_; }
+
+    // Equilibrium an uncross would use now, reading only the level
+    // quantities of the crossed range; volume 0 if the book does not cross
+    AuctionResult indicative_uncross() const;
+
+    // Trade everything that crosses at the equilibrium price in one batch,
+    // bids and asks each in price-time priority, and return to continuous
+    // matching. Trades carry `timestamp` and go to sink as they print
+    template <TradeSink Sink>
+    AuctionResult uncross(uint64_t timestamp, Sink&& sink);
+
+    // Stop orders waiting on one side
+    size_t stop_count(OrderSide side) const {
+        return side == OrderSide::Buy ? buy_stops_.size() : sell_stops_.size();
+    }
 
-    // Cancel an existing order - if there are multiple orders with the same ID, only cancels one instance
-    bool cancel_order(const std::string& order_id);
+    // Price of the most recent trade, if there has been one
+    bool has_traded() const { return has_traded_; }
+    Price last_trade_price() const { return last_trade_price_; }
 
-    // Match an incoming order against the book
-    std::vector<Trade> match_order(std::shared_ptr<Order> order);
+    // Cancel an existing order - if there are multiple orders with the same ID, only cancels one instance.
+    // timestamp is the time of the cancel; 0 leaves the book's update time unchanged
+    bool cancel_order(OrderId order_id, uint64_t timestamp = 0);
+
+    // Cancel the order at an index slot already located by the caller
+    // (the slot must come from order_index().find and belong to this book)
+    void cancel_order_at(size_t index_slot, uint64_t timestamp = 0);
+
+    // Change a resting order's total size and price, reusing its record.
+    // Reducing the size at the same price keeps queue position in O(1); any
+    // other change re-enters it at the back of its new level at `timestamp`,
+    // matching first if the new price crosses the opposite side.
+    template <TradeSink Sink>
+    ModifyResult modify_order(OrderId order_id, uint64_t new_size, Price new_price,
+                              uint64_t timestamp, Sink&& sink);
+
+    // Same, for an index slot already located by the caller
+    template <TradeSink Sink>
+    ModifyResult modify_order_at(size_t index_slot, uint64_t new_size, Price new_price,
+                                 uint64_t timestamp, Sink&& sink);
+
+    // Rule for sharing an aggressor among the orders of a level (price-time
+    // by default). Change it only while no order is being matched
+    void set_matching(const MatchingConfig& matching) { matching_ = matching; }
+    const MatchingConfig& matching() const { return matching_; }
+
+    // Self-trade prevention applied by matching (None by default)
+    void set_self_trade_prevention(SelfTradePrevention mode) { self_trade_prevention_ = mode; }
+    SelfTradePrevention self_trade_prevention() const { return self_trade_prevention_; }
+
+    // Cancel every resting and pending stop order on one side and return how many there were
+    size_t cancel_all(OrderSide side, uint64_t timestamp = 0);
+
+    // Match an incoming order against the book. The aggressor is only
+    // updated, never stored, so it may live anywhere. Its timestamp is the
+    // time of every trade it produces.
+    // Order types and time in force are applied here, before any resting
+    // order is touched: a post-only order that would cross is rejected (or
+    // repriced to one tick behind the opposite best) without matching, a
+    // fill-or-kill order is cancelled unless the level aggregates show it
+    // can fill completely, and the unfilled part of an IOC, FOK or market
+    // order is marked Cancelled so that add_order refuses it.
+    // Self-trade prevention is applied as the aggressor reaches each resting
+    // order; an aggressor it cancels or decrements to nothing is left
+    // Cancelled. The fill-or-kill check counts the account's own orders.
+    // The sink overload hands each trade over as it happens and allocates
+    // nothing, however many levels the order sweeps
+    template <TradeSink Sink>
+    void match_order(Order& order, Sink&& sink);
+
+    // Append the trades to a caller-owned buffer; reusing the buffer across
+    // calls avoids allocating once it has grown
+    void match_order(Order& order, std::vector<Trade>& trades);
+
+    std::vector<Trade> match_order(Order& order);
 
     // Get the current best bid price
     double best_bid() const;
@@ -137,31 +270,660 @@ public:
     // Get the current best ask price
     double best_ask() const;
 
-    // Get the total volume at a specific price level
+    // Best prices in ticks (Price::min() / Price::max() when a side is empty)
+    Price best_bid_price() const;
+    Price best_ask_price() const;
+
+    // Best bid and ask with their aggregate size, in O(1)
+    TopOfBook top_of_book() const;
+
+    // Get the total volume at a specific price level, in O(1)
     uint64_t volume_at_price(OrderSide side, double price) const;
+    uint64_t volume_at_price(OrderSide side, Price price) const;
+
+    // Number of orders resting at a price, in O(1)
+    uint64_t orders_at_price(OrderSide side, Price price) const;
+
+    // Number of non-empty price levels on a side
+    size_t level_count(OrderSide side) const;
+
+    // How much of `size` an aggressor on `side` could fill right now at
+    // prices no worse than limit, over how many levels and down to which
+    // price. Reads only the level aggregates; nothing is matched
+    SweepEstimate estimate_sweep(OrderSide side, uint64_t size, Price limit) const;
+
+    // Same for a market order
+    SweepEstimate estimate_sweep(OrderSide side, uint64_t size) const;
+
+    // Aggregate the best `levels` price levels of each side, touching only
+    // the levels. The overload taking a BookDepth reuses its storage
+    void depth(size_t levels, BookDepth& out) const;
+    BookDepth depth(size_t levels) const;
 
     // Get the symbol this order book is for
     const std::string& get_symbol() const { return symbol_; }
+    SymbolId get_symbol_id() const { return symbol_id_; }
+
+    // Time of the last add, cancel or match applied to the book
+    uint64_t last_update_time() const { return last_update_time_.load(std::memory_order_relaxed); }
+
+    // Get all orders in the book, each side in price-time priority
+    std::pair<std::vector<const Order*>, std::vector<const Order*>> get_all_orders() const;
+
+    // Order pool backing this book
+    const OrderPool& order_pool() const { return pool_; }
+
+    // Index used to locate this book's resting orders
+    const OrderIndex& order_index() const { return *index_; }
+
+    // What the book's pool, ladders, index and buffers hold right now
+    BookMemoryStats memory_stats() const;
 
-    // Get all orders in the book
-    std::pair<std::vector<std::shared_ptr<Order>>, std::vector<std::shared_ptr<Order>>> get_all_orders() const;
+    // Whether compact() has work: a ladder at least four times the span of
+    // its resting prices (see PriceLadder::shrink), or a private index that
+    // is oversized or mid-migration
+    bool needs_compaction() const;
+
+    // One bounded slice of compaction, spending about `budget` units of
+    // work: levels copied to shrink a ladder, index slots migrated. A ladder
+    // whose shrink alone exceeds the budget is left for a larger slice. A
+    // shared index is the owner's business (MatchingEngine::compact).
+    // Returns the work done, 0 once there is nothing left that fits
+    size_t compact(size_t budget);
+
+    // Attach a market data publisher (nullptr detaches); the caller keeps
+    // it alive while attached
+    void set_market_data(MarketDataPublisher* publisher) { market_data_ = publisher; }
+    MarketDataPublisher* market_data() const { return market_data_; }
+
+    // Attach an observer of resting quantity (nullptr detaches); the caller
+    // keeps it alive while attached
+    void set_resting_observer(RestingOrderObserver* observer) { resting_observer_ = observer; }
+
+    // Emit a full snapshot of the book to the attached publisher, in
+    // sequence with the incremental updates
+    void publish_snapshot() const;
 
     // Print the current state of the order book
     void print() const;
 
 private:
     std::string symbol_;
-    std::vector<std::shared_ptr<Order>> buy_orders_;  // Sorted by price-time priority
-    std::vector<std::shared_ptr<Order>> sell_orders_; // Sorted by price-time priority
-    std::unordered_multimap<std::string, std::shared_ptr<Order>> order_map_; // For fast lookup by ID (supports duplicate IDs)
+    SymbolId symbol_id_;
+    OrderPool pool_;
+    PriceLadder<OrderSide::Buy> bids_;
+    PriceLadder<OrderSide::Sell> asks_;
+    bool owns_index_;                   // index_ was created by the book rather than passed in
+    std::shared_ptr<OrderIndex> index_; // Resting orders by ID (supports duplicate IDs)
+    MarketDataPublisher* market_data_ = nullptr;
+    RestingOrderObserver* resting_observer_ = nullptr;
+    SelfTradePrevention self_trade_prevention_ = SelfTradePrevention::None;
+    MatchingConfig matching_;
+    StopQueue<OrderSide::Buy> buy_stops_;
+    StopQueue<OrderSide::Sell> sell_stops_;
+    std::vector<StopEntry> triggered_;  // Batch being released, reused
+    Price last_trade_price_{};
+    bool has_traded_ = false;
+    bool auction_ = false;
+    mutable std::vector<uint64_t> auction_bids_;    // Scratch curves for indicative_uncross
+    mutable std::vector<uint64_t> auction_asks_;
     std::atomic<uint64_t> last_update_time_;
 
-    // Helper methods to keep the order vectors sorted
-    void sort_buy_orders();
-    void sort_sell_orders();
+    // Level currently holding a resting (or just removed) order's price
+    const PriceLevel& level_of(const Order& order) const {
+        return order.side == OrderSide::Buy ? *bids_.find(order.price) : *asks_.find(order.price);
+    }
+
+    void resting_changed(const Order& order, int64_t quantity) const {
+        if (resting_observer_ && quantity != 0) {
+            resting_observer_->on_resting(order, quantity);
+        }
+    }
+
+    void pending_changed(const StopEntry& stop, int64_t quantity) const {
+        if (resting_observer_ && quantity != 0) {
+            resting_observer_->on_pending(stop, quantity);
+        }
+    }
+
+    // Apply the order's type and time in force around match_against
+    template <typename Ladder, typename Sink>
+    void execute_against(Ladder& ladder, Order& order, Sink& sink);
+
+    // Consume resting liquidity from the best levels of one side, with the
+    // book's matching algorithm
+    template <typename Ladder, typename Sink>
+    void match_against(Ladder& ladder, Order& order, Sink& sink);
+
+    // The same for one algorithm, level by level
+    template <typename Matching, typename Ladder, typename Sink>
+    void sweep(Ladder& ladder, Order& order, Sink& sink);
+
+    // Fill context a matching policy gets for one level (see matching_policy.hpp)
+    template <typename Ladder, typename Sink>
+    class LevelFills {
+    public:
+        LevelFills(BasicOrderBook& book, Ladder& ladder, Order& order, Sink& sink, bool prevent_self_trades)
+            : book_(book), ladder_(ladder), order_(order), sink_(sink),
+              level_(ladder.best_level()), prevent_(prevent_self_trades) {
+        }
+
+        uint64_t remaining() const { return order_.remaining_size(); }
+        const PriceLevel& level() const { return level_; }
+        const MatchingConfig& config() const { return book_.matching_; }
+
+        void fill(Order* resting, uint64_t size);
+
+        bool is_self_trade(const Order* resting) const { return prevent_ && resting->account == order_.account; }
+        bool prevent_self_trade(Order* resting) { return book_.prevent_self_trade(ladder_, order_, resting); }
+        bool prevent_self_trades();
+
+    private:
+        BasicOrderBook& book_;
+        Ladder& ladder_;
+        Order& order_;
+        Sink& sink_;
+        const PriceLevel& level_;   // Stays put even once its last order leaves
+        bool prevent_;
+    };
+
+    // Whether a fill-or-kill aggressor would fill completely. Without
+    // self-trade prevention only the level aggregates are read. With it the
+    // levels are walked as the sweep would meet them: CancelResting leaves
+    // the account's own orders out of the quantity available, and under the
+    // other modes meeting one first would stop or shrink the aggressor, so
+    // the order cannot fill. FIFO meets orders one at a time; the other
+    // algorithms clear a level's own orders before allocating, so one
+    // anywhere in a level the order reaches counts
+    template <typename Ladder>
+    bool fills_completely(const Ladder& ladder, const Order& order) const;
 
-    // Remove filled orders from the book
-    void remove_filled_orders();
+    // Resolve an aggressor meeting its own account's order at the best
+    // level; returns false if the aggressor has nothing left to match
+    template <typename Ladder>
+    bool prevent_self_trade(Ladder& ladder, Order& order, Order* resting);
+
+    // Match a triggered stop order and rest or release it; returns its status
+    template <typename Sink>
+    OrderStatus activate_stop(const StopEntry& entry, uint64_t timestamp, Sink& sink);
+
+    // Drop every order of one side, best level first
+    template <typename Ladder>
+    size_t clear_side(Ladder& ladder);
+
+    // Drop every pending stop of one side
+    template <typename Stops>
+    size_t clear_stops(Stops& stops);
+
+    // Collect the orders of one side in price-time priority
+    template <typename Ladder>
+    static std::vector<const Order*> collect_orders(const Ladder& ladder);
 };
 
+// The matching loop lives in the header so that sinks inline into it
+
+template <typename TickPolicy>
+template <TradeSink Sink>
+void BasicOrderBook<TickPolicy>::match_order(Order& order, Sink&& sink) {
+    // Check which side we're matching against
+    if (order.side == OrderSide::Buy) {
+        execute_against(asks_, order, sink);
+    } else {
+        execute_against(bids_, order, sink);
+    }
+
+    last_update_time_.store(order.timestamp, std::memory_order_relaxed);
+}
+
+template <typename TickPolicy>
+template <typename Ladder, typename Sink>
+void BasicOrderBook<TickPolicy>::execute_against(Ladder& ladder, Order& order, Sink& sink) {
+    // An auction collects orders for the uncross; what cannot rest is cancelled
+    if (auction_) {
+        if (order.type == OrderType::Market || order.tif != TimeInForce::GoodTillCancel) {
+            order.status = OrderStatus::Cancelled;
+        }
+        return;
+    }
+
+    bool crosses = !ladder.empty() && !Ladder::better(order.price, ladder.best_price());
+
+    if (order.type == OrderType::PostOnly || order.type == OrderType::PostOnlySlide) {
+        if (crosses) {
+            if (order.type == OrderType::PostOnly) {
+                order.status = OrderStatus::Rejected;
+                return;
+            }
+            // Rest just behind the opposite best instead of taking it
+            int64_t behind = order.side == OrderSide::Buy ? -1 : 1;
+            order.price = Price(ladder.best_price().ticks + behind);
+        }
+    } else if (crosses) {
+        // A fill-or-kill order reads only the book until it is known to
+        // fill completely
+        if (order.tif == TimeInForce::FillOrKill && !fills_completely(ladder, order)) {
+            order.status = OrderStatus::Cancelled;
+            return;
+        }
+        match_against(ladder, order, sink);
+    }
+
+    if (!order.is_filled() && (order.type == OrderType::Market || order.tif != TimeInForce::GoodTillCancel)) {
+        order.status = OrderStatus::Cancelled;
+    }
+}
+
+template <typename TickPolicy>
+template <typename Ladder>
+bool BasicOrderBook<TickPolicy>::fills_completely(const Ladder& ladder, const Order& order) const {
+    uint64_t wanted = order.remaining_size();
+    if (self_trade_prevention_ == SelfTradePrevention::None || order.account == kNoAccount) {
+        return ladder.quantity_within(order.price, wanted) >= wanted;
+    }
+
+    bool cancel_resting = self_trade_prevention_ == SelfTradePrevention::CancelResting;
+    bool one_at_a_time = cancel_resting || matching_.algorithm == MatchingAlgorithm::Fifo;
+    uint64_t available = 0;
+    bool blocked = false;
+    ladder.visit_levels([&](Price price, const PriceLevel& level) {
+        if (Ladder::better(order.price, price)) {
+            return false; // Past the limit
+        }
+        for (const Order* resting = level.head; resting; resting = resting->next_in_level) {
+            if (resting->account == order.account) {
+                if (!cancel_resting) {
+                    blocked = true;
+                    return false;
+                }
+            } else if (one_at_a_time) {
+                available += resting->remaining_size();
+                if (available >= wanted) {
+                    return false;
+                }
+            }
+        }
+        if (!one_at_a_time) {
+            available += level.total_quantity;
+        }
+        return available < wanted;
+    });
+    return !blocked && available >= wanted;
+}
+
+template <typename TickPolicy>
+template <typename Ladder, typename Sink>
+void BasicOrderBook<TickPolicy>::match_against(Ladder& ladder, Order& order, Sink& sink) {
+    // One branch per aggressor picks the fully inlined loop of the book's algorithm
+    switch (matching_.algorithm) {
+    case MatchingAlgorithm::ProRata:
+        sweep<ProRataMatching>(ladder, order, sink);
+        break;
+    case MatchingAlgorithm::TopOrderProRata:
+        sweep<TopOrderProRataMatching>(ladder, order, sink);
+        break;
+    case MatchingAlgorithm::FifoLmm:
+        sweep<FifoLmmMatching>(ladder, order, sink);
+        break;
+    default:
+        sweep<FifoMatching>(ladder, order, sink);
+        break;
+    }
+}
+
+template <typename TickPolicy>
+template <typename Matching, typename Ladder, typename Sink>
+void BasicOrderBook<TickPolicy>::sweep(Ladder& ladder, Order& order, Sink& sink) {
+    // Decided once per aggressor, so sweeps by anonymous orders pay nothing for it
+    bool prevent_self_trades = self_trade_prevention_ != SelfTradePrevention::None && order.account != kNoAccount;
+
+    // Process until order is filled or no more matches
+    while (!ladder.empty() && !order.is_filled()) {
+        Price level_price = ladder.best_price();
+
+        // An order whose limit has strictly higher priority than the best
+        // opposite level (e.g. a buy below the best ask) cannot cross
+        bool price_matches = !Ladder::better(order.price, level_price);
+
+        // If market order or price is acceptable
+        if (order.type != OrderType::Market && !price_matches) {
+            break; // No more price matches possible
+        }
+
+        LevelFills<Ladder, Sink> fills(*this, ladder, order, sink, prevent_self_trades);
+        if (!Matching::match(fills)) {
+            break;
+        }
+    }
+}
+
+template <typename TickPolicy>
+template <typename Ladder, typename Sink>
+void BasicOrderBook<TickPolicy>::LevelFills<Ladder, Sink>::fill(Order* resting, uint64_t size) {
+    // Update both orders and the level's aggregate
+    order_.fill(size);
+    ladder_.fill(resting, size);
+    book_.resting_changed(*resting, -static_cast<int64_t>(size));
+
+    // Create trade with proper buyer/seller IDs, at the resting order's
+    // price and the aggressor's time
+    if (order_.side == OrderSide::Buy) {
+        sink_(Trade{order_.order_id, resting->order_id, size, resting->price, order_.timestamp, book_.symbol_id_,
+                    order_.account, resting->account});
+    } else {
+        sink_(Trade{resting->order_id, order_.order_id, size, resting->price, order_.timestamp, book_.symbol_id_,
+                    resting->account, order_.account});
+    }
+
+    book_.last_trade_price_ = resting->price;
+    book_.has_traded_ = true;
+
+    // If resting order is now filled, remove it and recycle its slot
+    // (the level itself stays in place, so it can still be reported)
+    if (resting->is_filled()) {
+        ladder_.erase(resting);
+        if (book_.market_data_) {
+            book_.market_data_->order_removed(*resting, level_);
+        }
+        book_.index_->erase(resting);
+        book_.pool_.release(resting);
+    } else if (book_.market_data_) {
+        book_.market_data_->order_reduced(*resting, level_);
+    }
+}
+
+template <typename TickPolicy>
+template <typename Ladder, typename Sink>
+bool BasicOrderBook<TickPolicy>::LevelFills<Ladder, Sink>::prevent_self_trades() {
+    if (!prevent_) {
+        return true;
+    }
+    for (Order* resting = level_.head; resting;) {
+        Order* next = resting->next_in_level;
+        if (resting->account == order_.account && !book_.prevent_self_trade(ladder_, order_, resting)) {
+            return false;
+        }
+        resting = next;
+    }
+    return true;
+}
+
+template <typename TickPolicy>
+template <typename Ladder>
+bool BasicOrderBook<TickPolicy>::prevent_self_trade(Ladder& ladder, Order& order, Order* resting) {
+    if (self_trade_prevention_ == SelfTradePrevention::CancelAggressing) {
+        order.status = OrderStatus::Cancelled;
+        return false;
+    }
+
+    bool aggressor_left = true;
+    if (self_trade_prevention_ == SelfTradePrevention::DecrementBoth) {
+        uint64_t decrement = std::min(order.remaining_size(), resting->remaining_size());
+        order.size = static_cast<uint32_t>(order.size - decrement);
+        if (order.remaining_size() == 0) {
+            order.status = OrderStatus::Cancelled;
+            aggressor_left = false;
+        }
+        if (resting->remaining_size() > decrement) {
+            const PriceLevel& level = ladder.resize(resting, resting->size - decrement);
+            resting_changed(*resting, -static_cast<int64_t>(decrement));
+            if (market_data_) {
+                market_data_->order_reduced(*resting, level);
+            }
+            return aggressor_left;
+        }
+    }
+
+    // Cancel the resting order (the level stays in place, so it can still be reported)
+    resting->status = OrderStatus::Cancelled;
+    resting_changed(*resting, -static_cast<int64_t>(resting->remaining_size()));
+    ladder.erase(resting);
+    if (market_data_) {
+        market_data_->order_removed(*resting, level_of(*resting));
+    }
+    index_->erase(resting);
+    pool_.release(resting);
+    return aggressor_left;
+}
+
+template <typename TickPolicy>
+template <TradeSink Sink>
+AuctionResult BasicOrderBook<TickPolicy>::uncross(uint64_t timestamp, Sink&& sink) {
+    AuctionResult result = indicative_uncross();
+    auction_ = false;
+
+    // Bids at or above the price and asks at or below it hold at least the
+    // volume, so the best levels of each side are all that is touched
+    for (uint64_t left = result.volume; left > 0;) {
+        Order* bid = bids_.best_level().head;
+        Order* ask = asks_.best_level().head;
+        uint64_t size = std::min({left, bid->remaining_size(), ask->remaining_size()});
+        bids_.fill(bid, size);
+        asks_.fill(ask, size);
+        resting_changed(*bid, -static_cast<int64_t>(size));
+        resting_changed(*ask, -static_cast<int64_t>(size));
+        sink(Trade{bid->order_id, ask->order_id, size, result.price, timestamp, symbol_id_,
+                   bid->account, ask->account});
+        ++result.trades;
+        left -= size;
+
+        for (Order* order : {bid, ask}) {
+            if (order->is_filled()) {
+                if (order->side == OrderSide::Buy) {
+                    bids_.erase(order);
+                } else {
+                    asks_.erase(order);
+                }
+                if (market_data_) {
+                    market_data_->order_removed(*order, level_of(*order));
+                }
+                index_->erase(order);
+                pool_.release(order);
+            } else if (market_data_) {
+                market_data_->order_reduced(*order, level_of(*order));
+            }
+        }
+    }
+
+    if (result.volume > 0) {
+        last_trade_price_ = result.price;
+        has_traded_ = true;
+    }
+    if (timestamp != 0) {
+        last_update_time_.store(timestamp, std::memory_order_relaxed);
+    }
+    return result;
+}
+
+template <typename TickPolicy>
+template <TradeSink Sink>
+OrderStatus BasicOrderBook<TickPolicy>::add_stop_order(Order* order, Price trigger, Sink&& sink) {
+    if (!index_->insert(order)) {
+        pool_.release(order);
+        return OrderStatus::Rejected;
+    }
+
+    StopEntry entry{trigger, order->price, order};
+    bool buy = order->side == OrderSide::Buy;
+    bool reached = has_traded_ && (buy ? StopQueue<OrderSide::Buy>::triggers(trigger, last_trade_price_)
+                                       : StopQueue<OrderSide::Sell>::triggers(trigger, last_trade_price_));
+    if (reached) {
+        OrderStatus status = activate_stop(entry, order->timestamp, sink);
+        last_update_time_.store(entry.order->timestamp, std::memory_order_relaxed);
+        return status;
+    }
+
+    order->price = trigger;
+    order->status = OrderStatus::Pending;
+    if (buy) {
+        buy_stops_.insert(entry);
+    } else {
+        sell_stops_.insert(entry);
+    }
+    pending_changed(entry, static_cast<int64_t>(order->remaining_size()));
+    return OrderStatus::Pending;
+}
+
+template <typename TickPolicy>
+template <TradeSink Sink>
+size_t BasicOrderBook<TickPolicy>::release_triggered_stops(Sink&& sink) {
+    size_t released = 0;
+    while (has_traded_ && (!buy_stops_.empty() || !sell_stops_.empty())) {
+        triggered_.clear();
+        buy_stops_.take_triggered(last_trade_price_, triggered_);
+        sell_stops_.take_triggered(last_trade_price_, triggered_);
+        if (triggered_.empty()) {
+            break;
+        }
+
+        // The batch enters at the time of the trade that triggered it
+        uint64_t timestamp = last_update_time();
+        for (const StopEntry& entry : triggered_) {
+            pending_changed(entry, -static_cast<int64_t>(entry.order->remaining_size()));
+            activate_stop(entry, timestamp, sink);
+        }
+        released += triggered_.size();
+    }
+    return released;
+}
+
+template <typename TickPolicy>
+template <typename Sink>
+OrderStatus BasicOrderBook<TickPolicy>::activate_stop(const StopEntry& entry, uint64_t timestamp, Sink& sink) {
+    Order* order = entry.order;
+    order->price = entry.limit;
+    order->status = OrderStatus::New;
+    order->timestamp = timestamp;
+
+    if (order->side == OrderSide::Buy) {
+        execute_against(asks_, *order, sink);
+    } else {
+        execute_against(bids_, *order, sink);
+    }
+
+    // Already indexed, so resting only needs the ladder
+    bool rests = order->can_rest() &&
+                 (order->side == OrderSide::Buy ? bids_.push_back(order) : asks_.push_back(order));
+    if (rests) {
+        resting_changed(*order, static_cast<int64_t>(order->remaining_size()));
+        if (market_data_) {
+            market_data_->order_added(*order, level_of(*order));
+        }
+        return order->status;
+    }
+
+    if (order->can_rest()) {
+        order->status = OrderStatus::Rejected; // Price outside the ladder
+    }
+    OrderStatus status = order->status;
+    index_->erase(order);
+    pool_.release(order);
+    return status;
+}
+
+template <typename TickPolicy>
+template <TradeSink Sink>
+ModifyResult BasicOrderBook<TickPolicy>::modify_order(OrderId order_id, uint64_t new_size, Price new_price,
+                                                      uint64_t timestamp, Sink&& sink) {
+    size_t slot = index_->find(order_id, symbol_id_);
+    if (slot == OrderIndex::npos) {
+        return ModifyResult::NotFound;
+    }
+    return modify_order_at(slot, new_size, new_price, timestamp, sink);
+}
+
+template <typename TickPolicy>
+template <TradeSink Sink>
+ModifyResult BasicOrderBook<TickPolicy>::modify_order_at(size_t index_slot, uint64_t new_size, Price new_price,
+                                                         uint64_t timestamp, Sink&& sink) {
+    Order* order = index_->at(index_slot).order;
+
+    // Pending stops are not in the book yet and cannot be amended
+    if (order->status == OrderStatus::Pending) {
+        return ModifyResult::NotFound;
+    }
+
+    // Nothing left to fill: the modify amounts to a cancel
+    if (new_size <= order->filled_size) {
+        cancel_order_at(index_slot, timestamp);
+        return ModifyResult::Cancelled;
+    }
+
+    // A size the record cannot hold removes the order like an unplaceable price
+    if (new_size > kMaxOrderSize) {
+        cancel_order_at(index_slot, timestamp);
+        return ModifyResult::Rejected;
+    }
+
+    // A size-down at the same price is amended in place
+    if (new_price == order->price && new_size <= order->size) {
+        if (new_size < order->size) {
+            resting_changed(*order, static_cast<int64_t>(new_size) - static_cast<int64_t>(order->size));
+            const PriceLevel& level = (order->side == OrderSide::Buy) ? bids_.resize(order, new_size)
+                                                                      : asks_.resize(order, new_size);
+            if (market_data_) {
+                market_data_->order_reduced(*order, level);
+            }
+        }
+        if (timestamp != 0) {
+            last_update_time_.store(timestamp, std::memory_order_relaxed);
+        }
+        return ModifyResult::Amended;
+    }
+
+    // Anything else forfeits priority: unlink the order, amend the record
+    // and re-enter it as a fresh aggressor
+    resting_changed(*order, -static_cast<int64_t>(order->remaining_size()));
+    if (order->side == OrderSide::Buy) {
+        bids_.erase(order);
+    } else {
+        asks_.erase(order);
+    }
+    if (market_data_) {
+        market_data_->order_removed(*order, level_of(*order));
+    }
+
+    order->size = static_cast<uint32_t>(new_size);
+    order->price = new_price;
+    if (timestamp != 0) {
+        order->timestamp = timestamp;
+    }
+    order->status = order->filled_size > 0 ? OrderStatus::PartiallyFilled : OrderStatus::New;
+
+    // Matching can shift index entries, so the slot is not used past here
+    match_order(*order, sink);
+    if (order->status == OrderStatus::Cancelled) {
+        // Self-trade prevention took the order out
+        index_->erase(order);
+        pool_.release(order);
+        return ModifyResult::Cancelled;
+    }
+    if (order->is_filled()) {
+        index_->erase(order);
+        pool_.release(order);
+        return ModifyResult::Filled;
+    }
+
+    // A post-only order whose new price would cross is rejected by matching
+    bool added = order->status != OrderStatus::Rejected &&
+                 ((order->side == OrderSide::Buy) ? bids_.push_back(order) : asks_.push_back(order));
+    if (!added) {
+        order->status = OrderStatus::Rejected;
+        index_->erase(order);
+        pool_.release(order);
+        return ModifyResult::Rejected;
+    }
+    resting_changed(*order, static_cast<int64_t>(order->remaining_size()));
+    if (market_data_) {
+        market_data_->order_added(*order, level_of(*order));
+    }
+    return ModifyResult::Requeued;
+}
+
+// Order book for instruments quoted in the default tick size
+using OrderBook = BasicOrderBook<DefaultTickPolicy>;
+
+// The book is instantiated once per supported tick policy in order_book.cpp
+extern template class BasicOrderBook<CentTick>;
+extern template class BasicOrderBook<BasisPointTick>;
+
 } // namespace trading
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "order.hpp"
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace trading {
+
+// Gateway-side table translating client order IDs (free-form strings) into the
+// dense 64-bit OrderIds the engine works with, and back again for reporting.
+// It is deliberately kept out of MatchingEngine so the matching path never
+// hashes or copies a string.
+class ClientOrderIdMap {
+public:
+    // Assign a fresh engine ID to a client ID. If the client reuses an ID,
+    // lookups by string resolve to the newest assignment.
+    OrderId assign(const std::string& client_id) {
+        OrderId id = next_id_++;
+        by_client_[client_id] = id;
+        by_engine_.emplace(id, client_id);
+        return id;
+    }
+
+    // Engine ID most recently assigned to a client ID
+    std::optional<OrderId> find(const std::string& client_id) const {
+        auto it = by_client_.find(client_id);
+        if (it == by_client_.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    // Client ID for an engine ID, or nullptr if unknown
+    const std::string* client_id(OrderId id) const {
+        auto it = by_engine_.find(id);
+        return it == by_engine_.end() ? nullptr : &it->second;
+    }
+
+    // Forget an engine ID once its order is done
+    void erase(OrderId id) {
+        auto it = by_engine_.find(id);
+        if (it == by_engine_.end()) {
+            return;
+        }
+        auto client_it = by_client_.find(it->second);
+        if (client_it != by_client_.end() && client_it->second == id) {
+            by_client_.erase(client_it);
+        }
+        by_engine_.erase(it);
+    }
+
+    size_t size() const { return by_engine_.size(); }
+
+private:
+    OrderId next_id_ = 1;
+    std::unordered_map<std::string, OrderId> by_client_;
+    std::unordered_map<OrderId, std::string> by_engine_;
+};
+
+} // namespace trading
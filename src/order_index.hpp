@@ -0,0 +1,321 @@
+#pragma once
+
+#include "order.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace trading {
+
+// What to do when an order arrives with the ID of an order that is still live
+enum class DuplicateIdPolicy : uint8_t {
+    Allow,  // Keep both; cancels by ID remove the oldest instance first
+    Reject  // Reject the newcomer
+};
+
+// Flat open-addressing index from OrderId to the resting Order record, using
+// linear probing over a power-of-two table of 16-byte entries. The order
+// record carries its symbol and price, so one probe locates the book, the
+// level and the node to unlink. Deletion shifts the following entries back
+// instead of leaving tombstones, so probe sequences never degrade over a
+// long session and duplicate IDs keep their insertion order.
+//
+// The table grows on insert but only shrinks through compact(), which
+// moves the entries into a smaller table a slice at a time, never below
+// the capacity asked for at construction or by reserve(). While that
+// migration is under way lookups probe the old table first, then the new
+// one, and new entries go to the new one; slots in the old table are
+// returned with kOldTableBit set.
+class OrderIndex {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr size_t kOldTableBit = size_t(1) << 62;
+
+    struct Entry {
+        OrderId id;
+        Order* order;   // nullptr marks an empty slot
+    };
+
+    explicit OrderIndex(size_t expected_orders = 0,
+                        DuplicateIdPolicy policy = DuplicateIdPolicy::Allow)
+        : policy_(policy) {
+        if (expected_orders > 0) {
+            reserved_ = capacity_for(expected_orders);
+            rehash(reserved_);
+        }
+    }
+
+    DuplicateIdPolicy duplicate_policy() const { return policy_; }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return slots_.size(); }
+    double load_factor() const {
+        return slots_.empty() ? 0.0 : static_cast<double>(size_) / static_cast<double>(slots_.size());
+    }
+
+    // Heap bytes held by the table (both tables while migrating)
+    size_t memory_bytes() const { return (slots_.capacity() + old_.capacity()) * sizeof(Entry); }
+
+    // Entry stored at a slot returned by one of the find functions
+    const Entry& at(size_t slot) const {
+        return (slot & kOldTableBit) ? old_[slot & ~kOldTableBit] : slots_[slot];
+    }
+
+    // Slot of the oldest live order with this ID, or npos
+    size_t find(OrderId id) const {
+        return probe(id, [](const Order*) { return true; });
+    }
+
+    // Slot of the oldest live order with this ID in a given book, or npos
+    size_t find(OrderId id, SymbolId symbol) const {
+        return probe(id, [symbol](const Order* order) { return order->symbol == symbol; });
+    }
+
+    // Slot holding exactly this order instance, or npos
+    size_t find(const Order* order) const {
+        return probe(order->order_id, [order](const Order* candidate) { return candidate == order; });
+    }
+
+    bool contains(OrderId id) const { return find(id) != npos; }
+
+    // Index an order under its ID. Returns false if the duplicate policy
+    // rejects it because an order with the same ID is already live.
+    bool insert(Order* order) {
+        if (policy_ == DuplicateIdPolicy::Reject && contains(order->order_id)) {
+            return false;
+        }
+
+        if ((size_ + 1) * 10 > slots_.size() * 7) {
+            finish_migration();
+            rehash(slots_.empty() ? kMinCapacity : slots_.size() * 2);
+        }
+
+        size_t slot = home(order->order_id, shift_);
+        while (slots_[slot].order) {
+            slot = (slot + 1) & mask_;
+        }
+        slots_[slot] = {order->order_id, order};
+        ++size_;
+        return true;
+    }
+
+    // Remove the entry at a slot, shifting back any entries displaced past it
+    void erase_at(size_t slot) {
+        if (slot & kOldTableBit) {
+            erase_in(old_, old_mask_, old_shift_, slot & ~kOldTableBit);
+        } else {
+            erase_in(slots_, mask_, shift_, slot);
+        }
+        --size_;
+    }
+
+    // Remove exactly this order instance; returns false if it is not indexed
+    bool erase(const Order* order) {
+        size_t slot = find(order);
+        if (slot == npos) {
+            return false;
+        }
+        erase_at(slot);
+        return true;
+    }
+
+    // Make room for at least `orders` entries without further rehashing
+    void reserve(size_t orders) {
+        size_t capacity = capacity_for(orders);
+        reserved_ = std::max(reserved_, capacity);
+        if (capacity > slots_.size()) {
+            finish_migration();
+            rehash(capacity);
+        }
+    }
+
+    // Whether the table is at least four times what its entries need (at
+    // twice their number, or the reserved capacity if larger), or a
+    // migration to a smaller one is unfinished
+    bool needs_compaction() const {
+        return migrating() || (slots_.size() > kMinCapacity && compact_target() * 4 <= slots_.size());
+    }
+
+    bool migrating() const { return !old_.empty(); }
+
+    // One bounded slice of shrinking: start a migration if the table is
+    // oversized, then move entries across, a whole probe cluster at a time,
+    // until about `budget` old slots have been visited. Returns the slots
+    // visited (0 if there was nothing to do)
+    size_t compact(size_t budget) {
+        if (!migrating()) {
+            if (!needs_compaction()) {
+                return 0;
+            }
+            begin_migration(compact_target());
+        }
+
+        size_t visited = 0;
+        while (visited < budget && migrated_ < old_.size()) {
+            size_t slot = (migrate_start_ + migrated_) & old_mask_;
+            if (!old_[slot].order) {
+                ++migrated_;
+                ++visited;
+                continue;
+            }
+            // Move the cluster newest entry first, each in front of any entry
+            // with its ID in the new table, so duplicates keep their order
+            size_t length = 0;
+            while (old_[(slot + length) & old_mask_].order) {
+                ++length;
+            }
+            for (size_t i = length; i-- > 0;) {
+                Entry& entry = old_[(slot + i) & old_mask_];
+                place_before_duplicates(entry);
+                entry = {0, nullptr};
+            }
+            migrated_ += length;
+            visited += length;
+        }
+        if (migrated_ >= old_.size()) {
+            std::vector<Entry>().swap(old_);
+        }
+        return visited;
+    }
+
+private:
+    static constexpr size_t kMinCapacity = 16;
+
+    std::vector<Entry> slots_;
+    size_t mask_ = 0;
+    unsigned shift_ = 64;
+    size_t size_ = 0;               // Entries in both tables
+    size_t reserved_ = 0;           // Capacity compact() leaves in place
+    DuplicateIdPolicy policy_;
+
+    // The table being migrated out of by compact(), empty otherwise
+    std::vector<Entry> old_;
+    size_t old_mask_ = 0;
+    unsigned old_shift_ = 64;
+    size_t migrate_start_ = 0;      // First old slot visited, just after an empty one
+    size_t migrated_ = 0;           // Old slots visited so far
+
+    // Table size compact() migrates to
+    size_t compact_target() const { return std::max(reserved_, capacity_for(size_ * 2)); }
+
+    // Smallest power-of-two table that holds `orders` under the load limit
+    static size_t capacity_for(size_t orders) {
+        return std::bit_ceil(std::max(kMinCapacity, orders * 10 / 7 + 1));
+    }
+
+    // Fibonacci hashing: sequential IDs spread evenly across the table
+    static size_t home(OrderId id, unsigned shift) {
+        return static_cast<size_t>((id * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    template <typename Match>
+    size_t probe(OrderId id, Match&& match) const {
+        if (size_ == 0) {
+            return npos;
+        }
+        // Entries still in the old table are older than any in the new one
+        if (!old_.empty()) [[unlikely]] {
+            for (size_t slot = home(id, old_shift_); old_[slot].order; slot = (slot + 1) & old_mask_) {
+                if (old_[slot].id == id && match(old_[slot].order)) {
+                    return slot | kOldTableBit;
+                }
+            }
+        }
+        for (size_t slot = home(id, shift_); slots_[slot].order; slot = (slot + 1) & mask_) {
+            if (slots_[slot].id == id && match(slots_[slot].order)) {
+                return slot;
+            }
+        }
+        return npos;
+    }
+
+    static void erase_in(std::vector<Entry>& table, size_t mask, unsigned shift, size_t slot) {
+        size_t hole = slot;
+        size_t next = slot;
+        for (;;) {
+            next = (next + 1) & mask;
+            if (!table[next].order) {
+                break;
+            }
+
+            // An entry may only move back if the hole lies between its home
+            // slot and its current slot (cyclically)
+            size_t ideal = home(table[next].id, shift);
+            bool stays = (hole <= next) ? (hole < ideal && ideal <= next)
+                                        : (hole < ideal || ideal <= next);
+            if (!stays) {
+                table[hole] = table[next];
+                hole = next;
+            }
+        }
+        table[hole] = {0, nullptr};
+    }
+
+    // Insert an entry from the old table ahead of the same-ID entries of
+    // the new one, which all arrived later
+    void place_before_duplicates(Entry entry) {
+        size_t slot = home(entry.id, shift_);
+        while (slots_[slot].order) {
+            if (slots_[slot].id == entry.id) {
+                std::swap(entry, slots_[slot]);
+            }
+            slot = (slot + 1) & mask_;
+        }
+        slots_[slot] = entry;
+    }
+
+    void begin_migration(size_t capacity) {
+        old_.swap(slots_);
+        old_mask_ = mask_;
+        old_shift_ = shift_;
+        migrate_start_ = 0;
+        while (old_[migrate_start_].order) {
+            ++migrate_start_;
+        }
+        migrate_start_ = (migrate_start_ + 1) & old_mask_;
+        migrated_ = 0;
+        slots_.assign(capacity, Entry{0, nullptr});
+        mask_ = capacity - 1;
+        shift_ = 64 - static_cast<unsigned>(std::countr_zero(capacity));
+    }
+
+    void finish_migration() {
+        if (migrating()) {
+            compact(old_.size());
+        }
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Entry> old(capacity, Entry{0, nullptr});
+        old.swap(slots_);
+        mask_ = capacity - 1;
+        shift_ = 64 - static_cast<unsigned>(std::countr_zero(capacity));
+
+        if (size_ == 0) {
+            return;
+        }
+
+        // Walk the old table starting just after an empty slot so every probe
+        // cluster is re-inserted front to back, preserving duplicate order
+        size_t start = 0;
+        while (old[start].order) {
+            ++start;
+        }
+        for (size_t i = 1; i <= old.size(); ++i) {
+            const Entry& entry = old[(start + i) % old.size()];
+            if (!entry.order) {
+                continue;
+            }
+            size_t slot = home(entry.id, shift_);
+            while (slots_[slot].order) {
+                slot = (slot + 1) & mask_;
+            }
+            slots_[slot] = entry;
+        }
+    }
+};
+
+} // namespace trading
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "order.hpp"
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace trading {
+
+// Slab allocator for Order records. Slots are carved out of large slabs that
+// are never returned to the heap, so pointers stay valid for the lifetime of
+// the pool and released slots are recycled LIFO through an intrusive free
+// list. Once the preallocated capacity covers the working set, allocating
+// and releasing orders performs no heap allocation at all.
+// Not thread-safe: each pool belongs to a single order book.
+class OrderPool {
+    static_assert(std::is_trivially_destructible_v<Order>, "Pool slots are recycled without destruction");
+
+public:
+    static constexpr size_t kDefaultCapacity = 1024;
+
+    // Preallocate room for `capacity` orders; further slabs of
+    // `growth` slots are added only if the pool runs dry
+    explicit OrderPool(size_t capacity = kDefaultCapacity, size_t growth = kDefaultCapacity)
+        : growth_(growth > 0 ? growth : kDefaultCapacity) {
+        if (capacity > 0) {
+            add_slab(capacity);
+        }
+    }
+
+    OrderPool(const OrderPool&) = delete;
+    OrderPool& operator=(const OrderPool&) = delete;
+
+    // Construct an order in a free slot (Order is trivially destructible, so
+    // releasing a slot never needs to run a destructor)
+    template <typename... Args>
+    Order* allocate(Args&&... args) {
+        if (!free_list_) {
+            add_slab(growth_);
+        }
+        Slot* slot = free_list_;
+        free_list_ = slot->next_free;
+        ++in_use_;
+        return new (slot->storage) Order(std::forward<Args>(args)...);
+    }
+
+    // Return an order's slot to the free list
+    void release(Order* order) {
+        Slot* slot = reinterpret_cast<Slot*>(order);
+        slot->next_free = free_list_;
+        free_list_ = slot;
+        --in_use_;
+    }
+
+    // Total number of slots, free or in use
+    size_t capacity() const { return capacity_; }
+
+    // Number of live orders
+    size_t in_use() const { return in_use_; }
+
+    // Number of slabs obtained from the heap (more than one means the pool grew)
+    size_t slab_count() const { return slabs_.size(); }
+
+    // Heap bytes held by the slabs and their directory
+    size_t memory_bytes() const {
+        return capacity_ * sizeof(Slot) + slabs_.capacity() * sizeof(std::unique_ptr<Slot[]>);
+    }
+
+private:
+    union Slot {
+        Slot* next_free;
+        alignas(Order) unsigned char storage[sizeof(Order)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> slabs_;
+    Slot* free_list_ = nullptr;
+    size_t growth_;
+    size_t capacity_ = 0;
+    size_t in_use_ = 0;
+
+    void add_slab(size_t slots) {
+        auto slab = std::make_unique<Slot[]>(slots);
+
+        // Thread the new slots onto the free list so they are handed out in
+        // address order, which keeps consecutive orders adjacent in memory
+        for (size_t i = slots; i-- > 0;) {
+            slab[i].next_free = free_list_;
+            free_list_ = &slab[i];
+        }
+
+        slabs_.push_back(std::move(slab));
+        capacity_ += slots;
+    }
+};
+
+} // namespace trading
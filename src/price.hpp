@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <compare>
+#include <limits>
+
+namespace trading {
+
+// Fixed-point price expressed as an integer number of ticks. Everything inside
+// the book compares and indexes on ticks; doubles only appear at the API edge.
+struct Price {
+    int64_t ticks;
+
+    // Trivial so that Price (and Order) stay POD; use Price{} for zero
+    Price() = default;
+    constexpr explicit Price(int64_t t) : ticks(t) {}
+
+    // Sentinels used as the limit of market orders
+    static constexpr Price max() { return Price(std::numeric_limits<int64_t>::max()); }
+    static constexpr Price min() { return Price(std::numeric_limits<int64_t>::min()); }
+
+    friend constexpr bool operator==(Price, Price) = default;
+    friend constexpr auto operator<=>(Price, Price) = default;
+};
+
+// Tick size policy: one tick is exactly Numerator / Denominator price units,
+// e.g. TickSize<1, 100> for cents or TickSize<1, 4> for quarter points.
+// OrderBook is specialised on this policy so conversions fold to constants.
+template <int64_t Numerator, int64_t Denominator = 1>
+struct TickSize {
+    static_assert(Numerator > 0 && Denominator > 0, "Tick size must be positive");
+
+    static constexpr int64_t numerator = Numerator;
+    static constexpr int64_t denominator = Denominator;
+
+    // Convert a decimal price to the nearest whole tick
+    static Price to_price(double price) {
+        return Price(std::llround(price * static_cast<double>(Denominator) / static_cast<double>(Numerator)));
+    }
+
+    // Convert ticks back to a decimal price
+    static constexpr double to_double(Price price) {
+        return static_cast<double>(price.ticks) * static_cast<double>(Numerator) / static_cast<double>(Denominator);
+    }
+};
+
+// Common tick policies
+using CentTick = TickSize<1, 100>;
+using BasisPointTick = TickSize<1, 10000>;
+using DefaultTickPolicy = CentTick;
+
+} // namespace trading
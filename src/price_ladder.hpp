@@ -0,0 +1,436 @@
+#pragma once
+
+#include "level_scan.hpp"
+#include "order.hpp"
+#include "price_level.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace trading {
+
+// How far an aggressor of a given size could sweep one side of a book
+struct SweepEstimate {
+    uint64_t quantity;      // Fillable quantity, capped at the size asked for
+    size_t levels;          // Price levels the sweep reaches
+    Price worst_price;      // Price of the last level reached (unset if none)
+};
+
+// One side of a book as a direct-indexed array of price levels: the level for
+// a price lives at index (price - base). A bitmap of occupied levels lets the
+// best price advance past empty levels 64 ticks at a time when a level drains.
+//
+// Alongside the levels, each level's total quantity is kept in a contiguous
+// array of its own, so that questions about resting volume across levels
+// (fill-or-kill checks, sweep estimates) read eight levels per cache line and
+// are summed with the vector kernels of level_scan.hpp. All level mutations
+// go through the ladder, which keeps the two in step.
+//
+// The arrays grow to cover every price that rests at once, and only shrink
+// back through shrink(), which re-centres them on the prices resting now.
+template <OrderSide Side>
+class PriceLadder {
+public:
+    static constexpr size_t kInitialLevels = 256;
+    static constexpr size_t kMaxLevels = size_t(1) << 20;
+
+    // True if price a has strictly higher priority than price b on this side
+    static constexpr bool better(Price a, Price b) {
+        return Side == OrderSide::Buy ? a > b : a < b;
+    }
+
+    bool empty() const { return occupied_levels_ == 0; }
+
+    // Number of non-empty price levels
+    size_t level_count() const { return occupied_levels_; }
+
+    // Levels the arrays have room for, and the heap bytes they hold
+    size_t allocated_levels() const { return levels_.size(); }
+    size_t memory_bytes() const {
+        return levels_.capacity() * sizeof(PriceLevel) + quantities_.capacity() * sizeof(uint64_t) +
+               occupied_.capacity() * sizeof(uint64_t);
+    }
+
+    // Size the arrays would shrink to: twice the span of resting prices,
+    // and never below kInitialLevels; 0 if they are not at least four times that
+    size_t shrink_target() const {
+        if (levels_.size() <= kInitialLevels) {
+            return 0;
+        }
+        size_t span = empty() ? 0 : occupied_span();
+        size_t target = std::max(kInitialLevels, (2 * span + 63) / 64 * 64);
+        return target * 4 <= levels_.size() ? target : 0;
+    }
+
+    // Re-centre the arrays on the resting prices at shrink_target() levels,
+    // if that copies no more than `budget` levels. Returns the levels
+    // copied, or 0 if the ladder is not oversized or the copy does not fit
+    size_t shrink(size_t budget) {
+        size_t target = shrink_target();
+        if (target == 0 || target > budget) {
+            return 0;
+        }
+        if (empty()) {
+            std::vector<PriceLevel>(target).swap(levels_);
+            std::vector<uint64_t>(target).swap(quantities_);
+            std::vector<uint64_t>(target / 64).swap(occupied_);
+            return target;
+        }
+        int64_t low = base_ + static_cast<int64_t>(find_next_set(0));
+        int64_t span = static_cast<int64_t>(occupied_span());
+        relocate(static_cast<int64_t>(target), low - (static_cast<int64_t>(target) - span) / 2);
+        return target;
+    }
+
+    // Best price and level; only valid when the ladder is not empty
+    Price best_price() const { return price_of(best_); }
+    PriceLevel& best_level() { return levels_[best_]; }
+    const PriceLevel& best_level() const { return levels_[best_]; }
+
+    // Level for an exact price, or nullptr if the price is outside the ladder
+    const PriceLevel* find(Price price) const {
+        if (!in_range(price)) {
+            return nullptr;
+        }
+        return &levels_[index_of(price)];
+    }
+
+    // Append an order to the FIFO at its price. Returns false if the price is
+    // too far from the resting prices to be indexed (the order is not added).
+    bool push_back(Order* order) {
+        if (!ensure_range(order->price)) {
+            return false;
+        }
+
+        size_t idx = index_of(order->price);
+        PriceLevel& level = levels_[idx];
+        if (level.empty()) {
+            mark_occupied(idx);
+        }
+        level.push_back(order);
+        quantities_[idx] = level.total_quantity;
+        return true;
+    }
+
+    // Unlink a resting order from anywhere in its level
+    void erase(Order* order) {
+        size_t idx = index_of(order->price);
+        PriceLevel& level = levels_[idx];
+        level.erase(order);
+        quantities_[idx] = level.total_quantity;
+        if (level.empty()) {
+            mark_vacated(idx);
+        }
+    }
+
+    // Change a resting order's size in place, keeping its queue position,
+    // and return its level
+    PriceLevel& resize(Order* order, uint64_t new_size) {
+        size_t idx = index_of(order->price);
+        PriceLevel& level = levels_[idx];
+        level.resize(order, new_size);
+        quantities_[idx] = level.total_quantity;
+        return level;
+    }
+
+    // Fill part or all of a resting order, leaving it in place
+    void fill(Order* order, uint64_t size) {
+        size_t idx = index_of(order->price);
+        PriceLevel& level = levels_[idx];
+        level.fill(order, size);
+        quantities_[idx] = level.total_quantity;
+    }
+
+    // Remove the oldest order at the best price
+    void pop_best() {
+        PriceLevel& level = levels_[best_];
+        level.pop_front();
+        quantities_[best_] = level.total_quantity;
+        if (level.empty()) {
+            mark_vacated(best_);
+        }
+    }
+
+    // Copy the quantities resting at each tick of [low, low + count) to out,
+    // lowest price first, with zeros where the ladder has no levels
+    void copy_quantities(Price low, size_t count, uint64_t* out) const {
+        std::fill(out, out + count, uint64_t(0));
+        int64_t first = std::max(low.ticks, base_);
+        int64_t last = std::min(low.ticks + static_cast<int64_t>(count), base_ + static_cast<int64_t>(levels_.size()));
+        if (first < last) {
+            std::copy(quantities_.begin() + (first - base_), quantities_.begin() + (last - base_),
+                      out + (first - low.ticks));
+        }
+    }
+
+    // Quantity resting at prices no worse than limit, best first; stops as
+    // soon as `wanted` is reached, so the result is only exact when it is
+    // below `wanted`
+    uint64_t quantity_within(Price limit, uint64_t wanted) const {
+        return sweep(limit, wanted).quantity;
+    }
+
+    // How much of `wanted` rests at prices no worse than limit, over how
+    // many levels, reading only the level quantities. Each 64-level block of
+    // the bitmap is summed with the vector kernel; only the block in which
+    // the running total reaches `wanted` is walked level by level.
+    SweepEstimate sweep(Price limit, uint64_t wanted) const {
+        SweepEstimate estimate{0, 0, Price{}};
+        if (empty() || wanted == 0 || better(limit, best_price())) {
+            return estimate;
+        }
+
+        // Index of the worst level within the limit, clamped to the array
+        // (compared before subtracting: market orders use the Price sentinels)
+        int64_t last_index = static_cast<int64_t>(levels_.size()) - 1;
+        size_t limit_idx = limit.ticks <= base_ ? 0
+                         : limit.ticks >= base_ + last_index ? static_cast<size_t>(last_index)
+                         : static_cast<size_t>(limit.ticks - base_);
+
+        size_t idx = best_;
+        while (true) {
+            // The block is the rest of idx's bitmap word, towards worse prices
+            size_t word = idx / 64;
+            size_t first = Side == OrderSide::Buy ? std::max(word * 64, limit_idx) : idx;
+            size_t last = Side == OrderSide::Buy ? idx : std::min(word * 64 + 63, limit_idx);
+            uint64_t bits = occupied_[word] & block_mask(first, last);
+
+            if (bits != 0) {
+                uint64_t block = level_scan::sum(&quantities_[first], last - first + 1);
+                if (estimate.quantity + block < wanted) {
+                    estimate.quantity += block;
+                    estimate.levels += static_cast<size_t>(std::popcount(bits));
+                    size_t worst = Side == OrderSide::Buy ? word * 64 + static_cast<size_t>(std::countr_zero(bits))
+                                                          : word * 64 + 63 - static_cast<size_t>(std::countl_zero(bits));
+                    estimate.worst_price = price_of(worst);
+                } else {
+                    // The sweep ends in this block: walk it best first
+                    while (estimate.quantity < wanted) {
+                        size_t level = Side == OrderSide::Buy
+                            ? word * 64 + 63 - static_cast<size_t>(std::countl_zero(bits))
+                            : word * 64 + static_cast<size_t>(std::countr_zero(bits));
+                        bits &= ~(uint64_t(1) << (level % 64));
+                        estimate.quantity += quantities_[level];
+                        ++estimate.levels;
+                        estimate.worst_price = price_of(level);
+                    }
+                    estimate.quantity = wanted;
+                    return estimate;
+                }
+            }
+
+            // Step to the next block, stopping at the limit or the array's end
+            if (Side == OrderSide::Buy) {
+                if (first == limit_idx) {
+                    return estimate;
+                }
+                idx = first - 1;
+            } else {
+                if (last == limit_idx) {
+                    return estimate;
+                }
+                idx = last + 1;
+            }
+        }
+    }
+
+    // Visit non-empty levels from best to worst price: f(Price, const PriceLevel&)
+    template <typename F>
+    void for_each_level(F&& f) const {
+        if (empty()) {
+            return;
+        }
+        for (size_t idx = best_; idx != npos; idx = next_worse(idx)) {
+            f(price_of(idx), levels_[idx]);
+        }
+    }
+
+    // Visit non-empty levels from best to worst price until
+    // f(Price, const PriceLevel&) returns false
+    template <typename F>
+    void visit_levels(F&& f) const {
+        if (empty()) {
+            return;
+        }
+        for (size_t idx = best_; idx != npos && f(price_of(idx), levels_[idx]); idx = next_worse(idx)) {
+        }
+    }
+
+    // Visit at most max_levels non-empty levels from best to worst price
+    template <typename F>
+    void for_each_level(size_t max_levels, F&& f) const {
+        if (empty()) {
+            return;
+        }
+        for (size_t idx = best_; idx != npos && max_levels > 0; idx = next_worse(idx), --max_levels) {
+            f(price_of(idx), levels_[idx]);
+        }
+    }
+
+    // Visit non-empty levels from worst to best price: f(Price, const PriceLevel&)
+    template <typename F>
+    void for_each_level_worst_first(F&& f) const {
+        if (empty()) {
+            return;
+        }
+        size_t idx = Side == OrderSide::Buy ? find_next_set(0) : find_prev_set(levels_.size() - 1);
+        for (; idx != npos; idx = next_better(idx)) {
+            f(price_of(idx), levels_[idx]);
+        }
+    }
+
+private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Prices beyond this magnitude are never indexed, which keeps every
+    // base/offset computation below clear of int64 overflow
+    static constexpr int64_t kMaxTicks = int64_t(1) << 62;
+
+    int64_t base_ = 0;                  // Price in ticks of levels_[0]
+    std::vector<PriceLevel> levels_;
+    std::vector<uint64_t> quantities_;  // levels_[i].total_quantity, contiguous
+    std::vector<uint64_t> occupied_;    // One bit per level, set when non-empty
+    size_t best_ = 0;                   // Index of the best non-empty level
+    size_t occupied_levels_ = 0;
+
+    size_t index_of(Price price) const { return static_cast<size_t>(price.ticks - base_); }
+
+    // Levels from the lowest to the highest occupied price, inclusive
+    size_t occupied_span() const {
+        return find_prev_set(levels_.size() - 1) - find_next_set(0) + 1;
+    }
+    Price price_of(size_t idx) const { return Price(base_ + static_cast<int64_t>(idx)); }
+
+    bool in_range(Price price) const {
+        return price.ticks >= base_ && price.ticks - base_ < static_cast<int64_t>(levels_.size());
+    }
+
+    // Bits first..last of the bitmap word holding them (same word)
+    static uint64_t block_mask(size_t first, size_t last) {
+        uint64_t high = (last % 64 == 63) ? ~uint64_t(0) : (uint64_t(1) << (last % 64 + 1)) - 1;
+        return high & (~uint64_t(0) << (first % 64));
+    }
+
+    void mark_occupied(size_t idx) {
+        occupied_[idx / 64] |= uint64_t(1) << (idx % 64);
+        if (occupied_levels_ == 0 || better(price_of(idx), price_of(best_))) {
+            best_ = idx;
+        }
+        ++occupied_levels_;
+    }
+
+    void mark_vacated(size_t idx) {
+        occupied_[idx / 64] &= ~(uint64_t(1) << (idx % 64));
+        --occupied_levels_;
+        if (idx == best_ && occupied_levels_ > 0) {
+            best_ = next_worse(idx);
+        }
+    }
+
+    size_t next_worse(size_t idx) const {
+        if (Side == OrderSide::Buy) {
+            return idx == 0 ? npos : find_prev_set(idx - 1);
+        }
+        return find_next_set(idx + 1);
+    }
+
+    size_t next_better(size_t idx) const {
+        if (Side == OrderSide::Buy) {
+            return find_next_set(idx + 1);
+        }
+        return idx == 0 ? npos : find_prev_set(idx - 1);
+    }
+
+    // Lowest occupied index >= from
+    size_t find_next_set(size_t from) const {
+        if (from >= levels_.size()) {
+            return npos;
+        }
+        size_t word = from / 64;
+        uint64_t bits = occupied_[word] & (~uint64_t(0) << (from % 64));
+        while (bits == 0) {
+            if (++word == occupied_.size()) {
+                return npos;
+            }
+            bits = occupied_[word];
+        }
+        return word * 64 + static_cast<size_t>(std::countr_zero(bits));
+    }
+
+    // Highest occupied index <= from
+    size_t find_prev_set(size_t from) const {
+        size_t word = from / 64;
+        uint64_t bits = occupied_[word] & (~uint64_t(0) >> (63 - from % 64));
+        while (bits == 0) {
+            if (word-- == 0) {
+                return npos;
+            }
+            bits = occupied_[word];
+        }
+        return word * 64 + 63 - static_cast<size_t>(std::countl_zero(bits));
+    }
+
+    // Make sure a price can be indexed, re-centring or growing the array
+    bool ensure_range(Price price) {
+        if (price.ticks > kMaxTicks || price.ticks < -kMaxTicks) {
+            return false;
+        }
+
+        if (levels_.empty()) {
+            levels_.resize(kInitialLevels);
+            quantities_.resize(kInitialLevels);
+            occupied_.resize(kInitialLevels / 64);
+        }
+
+        if (in_range(price)) {
+            return true;
+        }
+
+        // An empty ladder can simply be re-centred on the new price
+        if (occupied_levels_ == 0) {
+            base_ = price.ticks - static_cast<int64_t>(levels_.size() / 2);
+            return true;
+        }
+
+        // Grow at least geometrically, towards the side the price fell off
+        int64_t size = static_cast<int64_t>(levels_.size());
+        int64_t low = std::min(base_, price.ticks);
+        int64_t high = std::max(base_ + size - 1, price.ticks);
+        int64_t needed = high - low + 1;
+        if (needed > static_cast<int64_t>(kMaxLevels)) {
+            return false;
+        }
+
+        int64_t new_size = std::min(std::max(2 * size, needed), static_cast<int64_t>(kMaxLevels));
+        new_size = (new_size + 63) / 64 * 64;
+        int64_t new_base = price.ticks < base_ ? high - new_size + 1 : low;
+
+        relocate(new_size, new_base);
+        return true;
+    }
+
+    // Move every occupied level into fresh arrays of new_size levels whose
+    // first level is at new_base; the occupied range must fit inside them
+    void relocate(int64_t new_size, int64_t new_base) {
+        std::vector<PriceLevel> levels(static_cast<size_t>(new_size));
+        std::vector<uint64_t> quantities(static_cast<size_t>(new_size));
+        std::vector<uint64_t> occupied(static_cast<size_t>(new_size / 64));
+        int64_t shift = base_ - new_base;
+        for (size_t idx = find_next_set(0); idx != npos; idx = find_next_set(idx + 1)) {
+            size_t moved = static_cast<size_t>(static_cast<int64_t>(idx) + shift);
+            levels[moved] = levels_[idx];
+            quantities[moved] = quantities_[idx];
+            occupied[moved / 64] |= uint64_t(1) << (moved % 64);
+        }
+
+        levels_.swap(levels);
+        quantities_.swap(quantities);
+        occupied_.swap(occupied);
+        best_ = static_cast<size_t>(static_cast<int64_t>(best_) + shift);
+        base_ = new_base;
+    }
+};
+
+} // namespace trading
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "order.hpp"
+#include "price.hpp"
+#include <cstdint>
+
+namespace trading {
+
+// All resting orders at a single price, kept in arrival order as an intrusive
+// doubly linked list. Appending, unlinking any order and popping the front are
+// all O(1), so time priority never requires a sort. The level also keeps its
+// order count and total remaining quantity up to date, so aggregate queries
+// never walk the orders.
+struct PriceLevel {
+    Order* head = nullptr;      // Oldest order (next to be matched)
+    Order* tail = nullptr;      // Newest order
+    uint64_t order_count = 0;
+    uint64_t total_quantity = 0; // Sum of remaining_size() over the orders
+
+    bool empty() const { return head == nullptr; }
+
+    // Append an order at the back of the queue (lowest time priority)
+    void push_back(Order* order) {
+        order->prev_in_level = tail;
+        order->next_in_level = nullptr;
+        if (tail) {
+            tail->next_in_level = order;
+        } else {
+            head = order;
+        }
+        tail = order;
+        ++order_count;
+        total_quantity += order->remaining_size();
+    }
+
+    // Unlink an order from anywhere in the queue
+    void erase(Order* order) {
+        if (order->prev_in_level) {
+            order->prev_in_level->next_in_level = order->next_in_level;
+        } else {
+            head = order->next_in_level;
+        }
+        if (order->next_in_level) {
+            order->next_in_level->prev_in_level = order->prev_in_level;
+        } else {
+            tail = order->prev_in_level;
+        }
+        order->prev_in_level = nullptr;
+        order->next_in_level = nullptr;
+        --order_count;
+        total_quantity -= order->remaining_size();
+    }
+
+    // Change a resting order's total size without touching its position
+    // (the new size must exceed what is already filled)
+    void resize(Order* order, uint64_t new_size) {
+        total_quantity -= order->remaining_size();
+        order->size = static_cast<uint32_t>(new_size);
+        total_quantity += order->remaining_size();
+    }
+
+    // Fill part or all of a resting order in this level
+    void fill(Order* order, uint64_t size) {
+        order->fill(size);
+        total_quantity -= size;
+    }
+
+    // Remove the order at the front of the queue
+    void pop_front() {
+        erase(head);
+    }
+};
+
+// Aggregate view of one price level
+struct LevelSummary {
+    Price price;
+    uint64_t quantity;      // Total remaining size resting at this price
+    uint64_t order_count;
+};
+
+} // namespace trading
@@ -0,0 +1,592 @@
+#include "capture.hpp"
+#include "journal.hpp"
+#include "latency_histogram.hpp"
+#include "matching_engine.hpp"
+#include "order_book.hpp"
+#include "engine_runtime.hpp"
+#include "tool_support.hpp"
+#include "tsc.hpp"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+
+using namespace trading;
+
+namespace {
+
+// --- Recording ---
+
+// Generated flows follow the shared mixes, amending orders for their
+// replace share; aggressive orders are market orders or IOC limits a few
+// ticks through the mid
+using tools::FlowMix;
+using tools::kMixes;
+
+struct GenerateConfig {
+    FlowMix mix = kMixes[2];
+    size_t symbols = 8;
+    size_t depth = 10000;           // Resting orders per symbol before the flow starts
+    size_t messages = 1000000;      // Order messages after the book is built
+    double rate = 1e6;              // Mean message rate of the recorded timestamps, per second
+    uint64_t seed = 42;
+};
+
+constexpr int64_t kMidTicks = 10000;
+constexpr uint64_t kSessionStart = 34200ull * 1000000000ull;    // 09:30 in ns after midnight
+
+// Runs every recorded message through a reference engine and writes it,
+// followed by the trades it produced, so that a replay has something to
+// verify against
+class Recorder {
+public:
+    explicit Recorder(capture::CaptureWriter& writer) : writer_(writer) {}
+
+    bool add_book(const std::string& name, uint64_t timestamp) {
+        SymbolId symbol = engine_.add_order_book(name);
+        return symbol != kInvalidSymbolId && writer_.directory(symbol, name, timestamp);
+    }
+
+    // False if the command has no capture message (and was not executed)
+    bool record(const Command& command, uint64_t timestamp) {
+        if (!writer_.command(command, timestamp)) {
+            return false;
+        }
+        engine_.execute_commands(std::span<const Command>(&command, 1), response_);
+        for (const Trade& trade : response_.trades) {
+            writer_.execution(trade, timestamp);
+        }
+        trades_ += response_.trades.size();
+        return true;
+    }
+
+    uint64_t trades() const { return trades_; }
+
+private:
+    capture::CaptureWriter& writer_;
+    MatchingEngine engine_;
+    BatchResponse response_;
+    uint64_t trades_ = 0;
+};
+
+// A deep-book flow around a fixed mid: passive orders rest over a band of
+// levels proportional to the depth, cancels and replaces pick among the
+// orders added so far (some of which have filled, so those miss), and
+// aggressors take from the top. Timestamps have exponential gaps at the
+// configured mean rate, so recorded pacing has bursts and lulls
+bool generate_capture(const std::string& path, const GenerateConfig& config) {
+    capture::CaptureWriter writer;
+    if (!writer.open(path)) {
+        return false;
+    }
+    Recorder recorder(writer);
+    for (size_t i = 0; i < config.symbols; ++i) {
+        recorder.add_book("SYM" + std::to_string(i), kSessionStart);
+    }
+
+    std::mt19937_64 generator(config.seed);
+    std::uniform_int_distribution<unsigned> percent(0, 99);
+    std::uniform_int_distribution<size_t> symbol_dist(0, config.symbols - 1);
+    std::uniform_int_distribution<uint64_t> passive_size(1, 200);
+    std::uniform_int_distribution<uint64_t> aggress_size(1, 400);
+    std::uniform_int_distribution<int64_t> offset_dist(1, std::clamp<int64_t>(static_cast<int64_t>(config.depth / 20), 8, 4096));
+    std::exponential_distribution<double> gap(config.rate / 1e9);
+
+    struct Live {
+        SymbolId symbol;
+        OrderId order_id;
+        OrderSide side;
+    };
+    std::vector<Live> live;
+    live.reserve(config.symbols * config.depth + config.messages);
+    OrderId next_id = 1;
+    double time = static_cast<double>(kSessionStart);
+
+    auto passive_price = [](OrderSide side, int64_t offset) {
+        return Price(side == OrderSide::Buy ? kMidTicks - offset : kMidTicks + offset);
+    };
+    auto random_side = [&generator]() { return (generator() & 1) ? OrderSide::Buy : OrderSide::Sell; };
+    auto add_passive = [&](SymbolId symbol, uint64_t timestamp) {
+        OrderSide side = random_side();
+        recorder.record(Command::limit(symbol, next_id, side, passive_size(generator),
+                                       passive_price(side, offset_dist(generator))), timestamp);
+        live.push_back({symbol, next_id++, side});
+    };
+
+    for (size_t i = 0; i < config.depth; ++i) {
+        for (SymbolId symbol = 0; symbol < config.symbols; ++symbol) {
+            add_passive(symbol, static_cast<uint64_t>(time));
+        }
+    }
+
+    const FlowMix& mix = config.mix;
+    for (size_t i = 0; i < config.messages; ++i) {
+        time += gap(generator);
+        uint64_t timestamp = static_cast<uint64_t>(time);
+        unsigned roll = percent(generator);
+        unsigned adds = mix.add - mix.replace;
+        if (roll < adds || live.empty()) {
+            add_passive(static_cast<SymbolId>(symbol_dist(generator)), timestamp);
+        } else if (roll < adds + mix.cancel) {
+            size_t slot = generator() % live.size();
+            recorder.record(Command::cancel(live[slot].symbol, live[slot].order_id), timestamp);
+            live[slot] = live.back();
+            live.pop_back();
+        } else if (roll < mix.add + mix.cancel) {
+            const Live& order = live[generator() % live.size()];
+            recorder.record(Command::modify(order.symbol, order.order_id, passive_size(generator),
+                                            passive_price(order.side, offset_dist(generator))), timestamp);
+        } else {
+            SymbolId symbol = static_cast<SymbolId>(symbol_dist(generator));
+            OrderSide side = random_side();
+            if (generator() & 1) {
+                recorder.record(Command::market(symbol, next_id++, side, aggress_size(generator)), timestamp);
+            } else {
+                recorder.record(Command::limit(symbol, next_id++, side, aggress_size(generator),
+                                               passive_price(side, -3), TimeInForce::ImmediateOrCancel),
+                                timestamp);
+            }
+        }
+    }
+
+    std::cout << "Recorded " << writer.messages() << " messages (" << recorder.trades() << " executions) to "
+              << path << std::endl;
+    return writer.close();
+}
+
+// Convert an engine journal into a capture: its books, and every new
+// order, cancel and modify with the time it executed at. Stops, mass
+// cancels and auctions have no capture message and are left out, and the
+// books are re-created under price-time priority, so the executions are
+// those of the recorded messages alone
+bool convert_journal(const std::string& journal_path, const std::string& path) {
+    JournalReader reader;
+    if (!reader.open(journal_path)) {
+        return false;
+    }
+    capture::CaptureWriter writer;
+    if (!writer.open(path)) {
+        return false;
+    }
+    Recorder recorder(writer);
+    uint64_t skipped = 0;
+    for (JournalRecord record; reader.next(record);) {
+        if (record.type == JournalRecordType::AddBook) {
+            if (!recorder.add_book(reader.book_name(), record.timestamp)) {
+                return false;
+            }
+        } else if (!recorder.record(record.to_command(), record.timestamp)) {
+            ++skipped;
+        }
+    }
+    std::cout << "Converted " << reader.records() << " journal records into " << writer.messages()
+              << " messages (" << recorder.trades() << " executions, " << skipped << " commands skipped) in "
+              << path << std::endl;
+    return writer.close();
+}
+
+// --- Replay ---
+
+enum class Pacing { Full, Recorded };
+
+struct ReplayConfig {
+    std::string target = "engine";
+    Pacing pacing = Pacing::Full;
+    double speed = 1.0;         // Recorded pacing: 2 replays twice as fast as captured
+    bool verify = true;
+    bool prefault = false;
+};
+
+struct ReplayResult {
+    std::string target;
+    uint64_t messages;          // Order messages applied
+    uint64_t adds;
+    uint64_t deletes;
+    uint64_t replaces;
+    double seconds;
+    double msgs_per_sec;
+    capture::VerifyStats verify;
+    bool malformed;
+    LatencySummary all;
+    LatencySummary add;
+    LatencySummary remove;
+    LatencySummary replace;
+    LatencySummary lag;         // Recorded pacing: how late each message started against its schedule
+};
+
+// Replay targets share one interface: create a book for a capture symbol
+// and apply a message, handing its trades to sink
+
+// The full engine command path, one execute_commands call per message
+class EngineTarget {
+public:
+    static constexpr const char* kName = "engine";
+
+    bool add_book(SymbolId capture_symbol, const std::string& name) {
+        SymbolId symbol = engine_.add_order_book(name);
+        if (symbol == kInvalidSymbolId) {
+            return false;
+        }
+        if (symbols_.size() <= capture_symbol) {
+            symbols_.resize(capture_symbol + 1, kInvalidSymbolId);
+        }
+        symbols_[capture_symbol] = symbol;
+        return true;
+    }
+
+    template <typename Sink>
+    void apply(Command command, uint64_t, Sink&& sink) {
+        command.symbol = command.symbol < symbols_.size() ? symbols_[command.symbol] : kInvalidSymbolId;
+        engine_.execute_commands(std::span<const Command>(&command, 1), response_);
+        for (const Trade& trade : response_.trades) {
+            sink(trade);
+        }
+    }
+
+private:
+    MatchingEngine engine_;
+    BatchResponse response_;
+    std::vector<SymbolId> symbols_;     // Engine symbol of each capture symbol
+};
+
+// One bare OrderBook per symbol, driven the way the engine drives it, with
+// the capture timestamps as event times
+class BookTarget {
+public:
+    static constexpr const char* kName = "book";
+
+    bool add_book(SymbolId capture_symbol, const std::string& name) {
+        if (books_.size() <= capture_symbol) {
+            books_.resize(capture_symbol + 1);
+        }
+        books_[capture_symbol] = std::make_unique<OrderBook>(name, OrderPool::kDefaultCapacity, capture_symbol);
+        return true;
+    }
+
+    template <typename Sink>
+    void apply(const Command& command, uint64_t timestamp, Sink&& sink) {
+        OrderBook* book = command.symbol < books_.size() ? books_[command.symbol].get() : nullptr;
+        if (!book) {
+            return;
+        }
+        switch (command.type) {
+        case CommandType::NewLimit:
+        case CommandType::NewMarket: {
+            Order* order = command.type == CommandType::NewMarket
+                ? book->create_market_order(command.order_id, command.side, command.size, timestamp, command.tif)
+                : book->create_limit_order(command.order_id, command.side, command.size, command.price, timestamp,
+                                           command.tif, command.order_type);
+            book->match_order(*order, sink);
+            if (order->is_filled() || !book->add_order(order)) {
+                book->release_order(order);
+            }
+            break;
+        }
+        case CommandType::Cancel:
+            book->cancel_order(command.order_id, timestamp);
+            break;
+        case CommandType::Modify:
+            book->modify_order(command.order_id, command.size, command.price, timestamp, sink);
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<OrderBook>> books_;
+};
+
+template <typename Target>
+ReplayResult run_replay(const capture::CaptureFile& file, const ReplayConfig& config) {
+    Target target;
+    capture::TradeVerifier verifier;
+    LatencyHistogram histograms[3];
+    LatencyHistogram all;
+    LatencyHistogram lag;
+    uint64_t counts[3] = {0, 0, 0};
+    bool verify = config.verify;
+    auto sink = [&verifier, verify](const Trade& trade) {
+        if (verify) {
+            verifier.observe(trade);
+        }
+    };
+
+    // Directory messages are applied up front, outside the timed phase
+    bool books_ok = true;
+    capture::decode(file.messages(), [&](const capture::MessageView& message) {
+        if (message.type() == capture::MessageType::Directory) {
+            capture::DirectoryView directory(message.data());
+            books_ok = target.add_book(directory.symbol(), directory.name()) && books_ok;
+        }
+    });
+
+    double ns_per_tick = tsc_ns_per_tick();
+    bool paced = config.pacing == Pacing::Recorded && config.speed > 0;
+    bool first = true;
+    uint64_t first_timestamp = 0;
+    const std::byte* base = file.messages().data();
+
+    auto wall_start = std::chrono::steady_clock::now();
+    uint64_t tsc_start = read_tsc();
+    capture::DecodeResult decoded = capture::decode(file.messages(), [&](const capture::MessageView& message) {
+        Command command;
+        size_t kind;
+        switch (message.type()) {
+        case capture::MessageType::AddOrder:
+            if (!capture::AddOrderView(message.data()).to_command(command)) {
+                return;
+            }
+            kind = 0;
+            break;
+        case capture::MessageType::Delete:
+            command = Command::cancel(message.symbol(), capture::DeleteView(message.data()).order_id());
+            kind = 1;
+            break;
+        case capture::MessageType::Replace: {
+            capture::ReplaceView replace(message.data());
+            command = Command::modify(message.symbol(), replace.order_id(), replace.size(), replace.price());
+            kind = 2;
+            break;
+        }
+        case capture::MessageType::Execution:
+            if (verify) {
+                verifier.expect(capture::ExecutionView(message.data()));
+            }
+            return;
+        default:
+            return;
+        }
+
+        if (paced) {
+            if (first) {
+                first_timestamp = message.timestamp();
+                first = false;
+            }
+            // Wait for the message's time, relative to the first one; sleep
+            // through long gaps and spin the last stretch
+            double due_ns = static_cast<double>(message.timestamp() - first_timestamp) / config.speed;
+            double now_ns = static_cast<double>(read_tsc() - tsc_start) * ns_per_tick;
+            while (now_ns < due_ns) {
+                if (due_ns - now_ns > 200000.0) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(static_cast<int64_t>(due_ns - now_ns - 100000.0)));
+                } else {
+                    cpu_relax();
+                }
+                now_ns = static_cast<double>(read_tsc() - tsc_start) * ns_per_tick;
+            }
+            lag.record(static_cast<uint64_t>(now_ns - due_ns));
+        }
+
+        if (verify) {
+            verifier.begin(static_cast<uint64_t>(message.data() - base) + capture::kFileHeaderSize);
+        }
+        uint64_t start = read_tsc();
+        target.apply(command, message.timestamp(), sink);
+        uint64_t elapsed = read_tsc() - start;
+        histograms[kind].record(elapsed);
+        all.record(elapsed);
+        ++counts[kind];
+    });
+    auto wall_end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(wall_end - wall_start).count();
+    uint64_t messages = counts[0] + counts[1] + counts[2];
+    return {Target::kName,
+            messages,
+            counts[0],
+            counts[1],
+            counts[2],
+            seconds,
+            seconds > 0 ? static_cast<double>(messages) / seconds : 0.0,
+            verify ? verifier.finish() : capture::VerifyStats{0, 0, 0, 0},
+            decoded.malformed || !books_ok,
+            all.summary(ns_per_tick),
+            histograms[0].summary(ns_per_tick),
+            histograms[1].summary(ns_per_tick),
+            histograms[2].summary(ns_per_tick),
+            lag.summary(1.0)};
+}
+
+void print_latency(const char* name, const LatencySummary& summary) {
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(12) << summary.count
+              << std::setw(10) << summary.p50_ns
+              << std::setw(10) << summary.p99_ns
+              << std::setw(10) << summary.p999_ns
+              << std::setw(12) << summary.max_ns << std::endl;
+}
+
+void print_result(const ReplayResult& result, const ReplayConfig& config) {
+    std::cout << std::fixed << std::setprecision(0)
+              << "Replayed " << result.messages << " order messages in " << std::setprecision(3) << result.seconds
+              << " s: " << std::setprecision(0) << result.msgs_per_sec << " msgs/s" << std::endl;
+    if (config.verify) {
+        std::cout << "Executions: " << result.verify.expected << " in the capture, " << result.verify.observed
+                  << " replayed, " << result.verify.mismatches << " messages differ";
+        if (result.verify.mismatches > 0) {
+            std::cout << " (first at offset " << result.verify.first_mismatch << ")";
+        }
+        std::cout << std::endl;
+    }
+    if (result.malformed) {
+        std::cout << "The capture is malformed or names a book twice; the replay stopped early" << std::endl;
+    }
+
+    std::cout << "\n" << std::left << std::setw(10) << "Message"
+              << std::right << std::setw(12) << "count"
+              << std::setw(10) << "p50 ns"
+              << std::setw(10) << "p99 ns"
+              << std::setw(10) << "p99.9 ns"
+              << std::setw(12) << "max ns" << std::endl;
+    std::cout << std::string(64, '-') << std::endl;
+    print_latency("all", result.all);
+    print_latency("add", result.add);
+    print_latency("delete", result.remove);
+    print_latency("replace", result.replace);
+    if (config.pacing == Pacing::Recorded) {
+        print_latency("lag", result.lag);
+    }
+}
+
+void write_json(std::ostream& out, const std::string& path, const ReplayConfig& config, const ReplayResult& result) {
+    out << "{\"capture\":\"" << path << "\""
+        << ",\"target\":\"" << result.target << "\""
+        << ",\"pacing\":\"" << (config.pacing == Pacing::Recorded ? "recorded" : "full") << "\""
+        << ",\"speed\":" << config.speed
+        << ",\"messages\":" << result.messages
+        << ",\"adds\":" << result.adds
+        << ",\"deletes\":" << result.deletes
+        << ",\"replaces\":" << result.replaces
+        << ",\"seconds\":" << result.seconds
+        << ",\"msgs_per_sec\":" << result.msgs_per_sec
+        << ",\"executions_expected\":" << result.verify.expected
+        << ",\"executions_replayed\":" << result.verify.observed
+        << ",\"mismatches\":" << result.verify.mismatches
+        << ",\"malformed\":" << (result.malformed ? "true" : "false")
+        << ",";
+    tools::write_summary(out, "all", result.all, false);
+    tools::write_summary(out, "add", result.add, false);
+    tools::write_summary(out, "delete", result.remove, false);
+    tools::write_summary(out, "replace", result.replace, false);
+    tools::write_summary(out, "lag", result.lag, true);
+    out << "}" << std::endl;
+}
+
+void print_usage() {
+    std::cout << "Usage: trading_replay CAPTURE [--target engine|book] [--pace full|recorded] [--speed X]\n"
+              << "                      [--no-verify] [--prefault] [--json FILE]\n"
+              << "       trading_replay --record CAPTURE [--mix NAME] [--symbols N] [--depth N]\n"
+              << "                      [--messages N] [--rate N] [--seed N]\n"
+              << "       trading_replay --from-journal JOURNAL CAPTURE\n"
+              << "Mixes:";
+    for (const FlowMix& mix : kMixes) {
+        std::cout << " " << mix.name;
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ReplayConfig config;
+    GenerateConfig generate;
+    std::string capture_path;
+    std::string record_path;
+    std::string journal_path;
+    std::string json_path;
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--target") == 0 && has_value) {
+            config.target = argv[++i];
+        } else if (std::strcmp(argv[i], "--pace") == 0 && has_value) {
+            config.pacing = std::strcmp(argv[++i], "recorded") == 0 ? Pacing::Recorded : Pacing::Full;
+        } else if (std::strcmp(argv[i], "--speed") == 0 && has_value) {
+            config.speed = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--no-verify") == 0) {
+            config.verify = false;
+        } else if (std::strcmp(argv[i], "--prefault") == 0) {
+            config.prefault = true;
+        } else if (std::strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--record") == 0 && has_value) {
+            record_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--from-journal") == 0 && i + 2 < argc) {
+            journal_path = argv[++i];
+            record_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--mix") == 0 && has_value) {
+            const FlowMix* mix = tools::find_mix(argv[++i]);
+            if (!mix) {
+                print_usage();
+                return 1;
+            }
+            generate.mix = *mix;
+        } else if (std::strcmp(argv[i], "--symbols") == 0 && has_value) {
+            generate.symbols = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--depth") == 0 && has_value) {
+            generate.depth = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--messages") == 0 && has_value) {
+            generate.messages = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--rate") == 0 && has_value) {
+            generate.rate = std::max(std::strtod(argv[++i], nullptr), 1.0);
+        } else if (std::strcmp(argv[i], "--seed") == 0 && has_value) {
+            generate.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-' && capture_path.empty()) {
+            capture_path = argv[i];
+        } else {
+            print_usage();
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (!journal_path.empty()) {
+        if (!convert_journal(journal_path, record_path)) {
+            std::cerr << "Cannot convert " << journal_path << " into " << record_path << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (!record_path.empty()) {
+        if (!generate_capture(record_path, generate)) {
+            std::cerr << "Cannot write " << record_path << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (capture_path.empty() || (config.target != "engine" && config.target != "book")) {
+        print_usage();
+        return 1;
+    }
+
+    capture::CaptureFile file;
+    if (!file.open(capture_path, config.prefault)) {
+        std::cerr << "Cannot open " << capture_path << " as a capture" << std::endl;
+        return 1;
+    }
+
+    // Calibrate the timestamp counter before anything is timed
+    tsc_ns_per_tick();
+
+    std::cout << "=== Replay: " << capture_path << " (" << file.file_size() << " bytes, "
+              << (file.mapped() ? "mapped" : "read") << "), target " << config.target << ", pace "
+              << (config.pacing == Pacing::Recorded ? "recorded" : "full") << " ===" << std::endl;
+    ReplayResult result = config.target == "book" ? run_replay<BookTarget>(file, config)
+                                                  : run_replay<EngineTarget>(file, config);
+    print_result(result, config);
+
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        write_json(out, capture_path, config, result);
+        std::cout << "\nResults written to " << json_path << std::endl;
+    }
+    return result.malformed || result.verify.mismatches > 0 ? 2 : 0;
+}
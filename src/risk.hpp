@@ -0,0 +1,367 @@
+#pragma once
+
+#include "command.hpp"
+#include "order.hpp"
+#include "order_book.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace trading {
+
+// Why the pre-trade risk stage refused an order
+enum class RiskReject : uint8_t {
+    None,           // Accepted
+    UnknownAccount, // Account ID outside the configured range
+    UnknownSymbol,  // Symbol ID outside the range positions are kept for
+    MessageRate,    // Too many orders in the current window
+    OrderSize,
+    OrderNotional,
+    PriceBand,      // Limit price too far through the opposite best
+    Position,       // Net position would exceed the limit if the order and the account's open orders on its side filled
+    Notional        // Net notional would exceed the limit if the order and the account's open orders on its side filled
+};
+
+inline constexpr size_t kRiskRejectReasons = 9;
+
+// Limits of one account. Notionals are in price ticks times quantity
+struct RiskLimits {
+    uint64_t max_order_size = kMaxOrderSize;
+    uint64_t max_order_notional = std::numeric_limits<uint64_t>::max();
+    uint64_t max_position = std::numeric_limits<uint64_t>::max();   // |net quantity| per symbol, open orders filled
+    uint64_t max_notional = std::numeric_limits<uint64_t>::max();   // |net notional| over all symbols, open orders filled
+    uint32_t max_orders_per_window = std::numeric_limits<uint32_t>::max();
+};
+
+// Pre-trade risk stage of a MatchingEngine, called under the engine's lock
+// for every new order and every modify that can add exposure, and told of
+// every trade and, as the books' resting observer, of every change to the
+// quantity resting in them. Rejected orders never reach the book.
+class RiskCheck : public RestingOrderObserver {
+public:
+    // Check an order (for a modify: the new size and price) against its
+    // account's limits. top is the book it is for; timestamp is the event
+    // time. For a modify, replaces is the resting order being amended, whose
+    // open quantity the new one takes the place of; nullptr otherwise
+    virtual RiskReject check(const Command& order, const TopOfBook& top, uint64_t timestamp,
+                             const Order* replaces) = 0;
+
+    // Account for a trade the engine executed
+    virtual void on_trade(const Trade& trade) = 0;
+
+    // Account for resting quantity and pending stops added or taken away
+    // (see RestingOrderObserver); stages that ignore open orders need not
+    void on_resting(const Order&, int64_t) override {}
+    void on_pending(const StopEntry&, int64_t) override {}
+};
+
+// Check selection for PreTradeRisk. A policy sets to false the checks it
+// does not need and they compile away, along with the state they keep.
+struct AllRiskChecks {
+    static constexpr bool kOrderSize = true;
+    static constexpr bool kOrderNotional = true;
+    static constexpr bool kPriceBand = true;
+    static constexpr bool kPosition = true;
+    static constexpr bool kNotional = true;
+    static constexpr bool kMessageRate = true;
+};
+
+struct RiskConfig {
+    size_t accounts = 1024;                     // Account IDs 0 .. accounts-1 may trade
+    size_t symbols = 64;                        // Positions are kept for symbol IDs below this
+    uint64_t price_band_bps = 500;              // How far a limit price may reach through the opposite best
+    uint64_t rate_window_ns = 1'000'000'000;    // Message rate window, in event time
+    RiskLimits default_limits;                  // Limits every account starts with
+};
+
+// Pre-trade risk over flat per-account arrays: an order costs one array
+// lookup for its account and, with position checks, one for its
+// (account, symbol) position. Checks measure limit prices against the
+// opposite best (or the same side's best when the opposite side is empty),
+// value market orders at the opposite best and stop-market orders at their
+// trigger. Market and stop-market orders skip the price band.
+//
+// Position and notional limits hold for the worst case: the filled position
+// plus every open order and pending stop of the account on the order's side,
+// plus the order itself. Open quantity and notional are kept per side from
+// the books' resting and pending updates, so partial fills, amends, cancels
+// and triggers all release it.
+//
+// Not thread-safe: set limits before installing it in an engine, install
+// it before orders rest, and read positions while the engine is idle.
+// Limits, positions and open orders of a journaled engine are rebuilt by
+// replay if the same stage is installed first.
+template <typename Checks = AllRiskChecks>
+class PreTradeRisk final : public RiskCheck {
+public:
+    explicit PreTradeRisk(const RiskConfig& config = {})
+        : config_(config),
+          accounts_(config.accounts, AccountState{config.default_limits, 0, 0, 0}) {
+        if constexpr (Checks::kPosition) {
+            positions_.assign(config.accounts * config.symbols, PositionState{0, 0, 0});
+        }
+    }
+
+    // Replace one account's limits; returns false if the account is out of range
+    bool set_limits(AccountId account, const RiskLimits& limits) {
+        if (account >= accounts_.size()) {
+            return false;
+        }
+        accounts_[account].limits = limits;
+        return true;
+    }
+
+    // Net filled quantity of an account in a symbol (0 without position checks)
+    int64_t position(AccountId account, SymbolId symbol) const {
+        if constexpr (Checks::kPosition) {
+            if (account < accounts_.size() && symbol < config_.symbols) {
+                return positions_[position_slot(account, symbol)].net;
+            }
+        }
+        return 0;
+    }
+
+    // Quantity an account has resting on one side of a symbol (0 without
+    // position checks)
+    uint64_t open_quantity(AccountId account, SymbolId symbol, OrderSide side) const {
+        if constexpr (Checks::kPosition) {
+            if (account < accounts_.size() && symbol < config_.symbols) {
+                const PositionState& position = positions_[position_slot(account, symbol)];
+                return side == OrderSide::Buy ? position.open_buy : position.open_sell;
+            }
+        }
+        return 0;
+    }
+
+    // Net filled notional of an account, buys positive
+    int64_t notional(AccountId account) const {
+        return account < accounts_.size() ? accounts_[account].net_notional : 0;
+    }
+
+    // Notional an account has resting on one side, over all symbols (0
+    // without notional checks)
+    int64_t open_notional(AccountId account, OrderSide side) const {
+        if (account >= accounts_.size()) {
+            return 0;
+        }
+        return side == OrderSide::Buy ? accounts_[account].open_buy_notional : accounts_[account].open_sell_notional;
+    }
+
+    // Orders refused for a reason since construction
+    uint64_t rejects(RiskReject reason) const { return rejects_[static_cast<size_t>(reason)]; }
+
+    RiskReject check(const Command& order, const TopOfBook& top, uint64_t timestamp,
+                     const Order* replaces) override {
+        RiskReject result = evaluate(order, top, timestamp, replaces);
+        ++rejects_[static_cast<size_t>(result)];
+        return result;
+    }
+
+    void on_trade(const Trade& trade) override {
+        int64_t notional = saturating_notional(trade.price, trade.size);
+        auto size = static_cast<int64_t>(trade.size);
+        if (trade.account_buy < accounts_.size()) {
+            apply_fill(trade.account_buy, trade.symbol, size, notional);
+        }
+        if (trade.account_sell < accounts_.size()) {
+            apply_fill(trade.account_sell, trade.symbol, -size, -notional);
+        }
+    }
+
+    void on_resting(const Order& order, int64_t quantity) override {
+        add_open(order, order.price, quantity);
+    }
+
+    // Pending stops are valued as check() valued them: stop-market orders
+    // at their trigger, stop-limit orders at their limit
+    void on_pending(const StopEntry& stop, int64_t quantity) override {
+        add_open(*stop.order, stop.order->type == OrderType::Market ? stop.trigger : stop.limit, quantity);
+    }
+
+private:
+    struct AccountState {
+        RiskLimits limits;
+        int64_t net_notional;
+        uint64_t window_start;
+        uint32_t window_orders;
+        int64_t open_buy_notional = 0;  // Resting orders and pending stops, valued as checked
+        int64_t open_sell_notional = 0;
+    };
+
+    struct PositionState {
+        int64_t net;                    // Filled quantity, buys positive
+        uint64_t open_buy;              // Resting and pending stop quantity
+        uint64_t open_sell;
+    };
+
+    RiskConfig config_;
+    std::vector<AccountState> accounts_;
+    std::vector<PositionState> positions_;  // accounts x symbols, row per account
+    std::array<uint64_t, kRiskRejectReasons> rejects_{};
+
+    size_t position_slot(AccountId account, SymbolId symbol) const {
+        return static_cast<size_t>(account) * config_.symbols + symbol;
+    }
+
+    // Price ticks times quantity, clamped to the int64 range
+    static int64_t saturating_notional(Price price, uint64_t size) {
+        uint64_t ticks = price.ticks < 0 ? 0 - static_cast<uint64_t>(price.ticks) : static_cast<uint64_t>(price.ticks);
+        constexpr auto kMax = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+        if (ticks != 0 && size > kMax / ticks) {
+            return std::numeric_limits<int64_t>::max();
+        }
+        return static_cast<int64_t>(ticks * size);
+    }
+
+    static uint64_t magnitude(int64_t value) {
+        return value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    }
+
+    // |value + delta| <= limit, without overflowing
+    static bool within(int64_t value, int64_t delta, uint64_t limit) {
+        int64_t sum;
+        if (__builtin_add_overflow(value, delta, &sum)) {
+            return false;
+        }
+        return magnitude(sum) <= limit;
+    }
+
+    static void saturating_add(int64_t& value, int64_t delta) {
+        if (__builtin_add_overflow(value, delta, &value)) {
+            value = delta < 0 ? std::numeric_limits<int64_t>::min() : std::numeric_limits<int64_t>::max();
+        }
+    }
+
+    // Open quantity or notional of one side less what a modify replaces,
+    // plus the incoming order, clamped to the int64 range
+    static int64_t exposure(uint64_t open, uint64_t replaced, uint64_t incoming) {
+        constexpr auto kMax = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+        uint64_t rest = open - std::min(open, replaced);
+        return static_cast<int64_t>(rest >= kMax || incoming > kMax - rest ? kMax : rest + incoming);
+    }
+
+    // Move the open quantity and notional of the order's side
+    void add_open(const Order& order, Price price, int64_t quantity) {
+        if (order.account >= accounts_.size()) {
+            return;
+        }
+        bool buy = order.side == OrderSide::Buy;
+        if constexpr (Checks::kPosition) {
+            if (order.symbol < config_.symbols) {
+                PositionState& position = positions_[position_slot(order.account, order.symbol)];
+                uint64_t& open = buy ? position.open_buy : position.open_sell;
+                open += static_cast<uint64_t>(quantity);
+            }
+        }
+        if constexpr (Checks::kNotional) {
+            int64_t notional = saturating_notional(price, magnitude(quantity));
+            int64_t& open = buy ? accounts_[order.account].open_buy_notional
+                                : accounts_[order.account].open_sell_notional;
+            saturating_add(open, quantity < 0 ? -notional : notional);
+        }
+    }
+
+    void apply_fill(AccountId account, SymbolId symbol, int64_t size, int64_t notional) {
+        if constexpr (Checks::kPosition) {
+            if (symbol < config_.symbols) {
+                positions_[position_slot(account, symbol)].net += size;
+            }
+        }
+        if constexpr (Checks::kNotional) {
+            saturating_add(accounts_[account].net_notional, notional);
+        }
+    }
+
+    RiskReject evaluate(const Command& order, const TopOfBook& top, uint64_t timestamp, const Order* replaces) {
+        if (order.account >= accounts_.size()) {
+            return RiskReject::UnknownAccount;
+        }
+        AccountState& account = accounts_[order.account];
+        const RiskLimits& limits = account.limits;
+        bool buy = order.side == OrderSide::Buy;
+
+        // Every order counts towards the rate, accepted or not
+        if constexpr (Checks::kMessageRate) {
+            if (timestamp - account.window_start >= config_.rate_window_ns) {
+                account.window_start = timestamp;
+                account.window_orders = 0;
+            }
+            if (++account.window_orders > limits.max_orders_per_window) {
+                return RiskReject::MessageRate;
+            }
+        }
+
+        if constexpr (Checks::kOrderSize) {
+            if (order.size > limits.max_order_size) {
+                return RiskReject::OrderSize;
+            }
+        }
+
+        // Price the order is valued at: its limit, the trigger for a stop-market
+        // order, or the opposite best for a market order
+        const LevelSummary& opposite = buy ? top.ask : top.bid;
+        bool stop_market = order.type == CommandType::NewStop && order.order_type == OrderType::Market;
+        bool market = order.type == CommandType::NewMarket || stop_market;
+        Price price = stop_market              ? order.trigger
+                      : !market                ? order.price
+                      : opposite.quantity > 0  ? opposite.price
+                                               : Price{};
+
+        if constexpr (Checks::kPriceBand) {
+            const LevelSummary& same = buy ? top.bid : top.ask;
+            const LevelSummary& reference = opposite.quantity > 0 ? opposite : same;
+            if (!market && reference.quantity > 0) {
+                auto band = static_cast<int64_t>(magnitude(reference.price.ticks) / 10000 * config_.price_band_bps +
+                                                 magnitude(reference.price.ticks) % 10000 * config_.price_band_bps / 10000);
+                bool outside = buy ? order.price.ticks - reference.price.ticks > band
+                                   : reference.price.ticks - order.price.ticks > band;
+                if (outside) {
+                    return RiskReject::PriceBand;
+                }
+            }
+        }
+
+        int64_t notional = 0;
+        if constexpr (Checks::kOrderNotional || Checks::kNotional) {
+            notional = saturating_notional(price, order.size);
+        }
+
+        if constexpr (Checks::kOrderNotional) {
+            if (static_cast<uint64_t>(notional) > limits.max_order_notional) {
+                return RiskReject::OrderNotional;
+            }
+        }
+
+        // A modify's new size includes what the order has already filled
+        uint64_t filled = replaces ? std::min<uint64_t>(replaces->filled_size, order.size) : 0;
+        uint64_t replaced = replaces ? replaces->remaining_size() : 0;
+
+        if constexpr (Checks::kPosition) {
+            if (order.symbol >= config_.symbols) {
+                return RiskReject::UnknownSymbol;
+            }
+            const PositionState& position = positions_[position_slot(order.account, order.symbol)];
+            int64_t side = exposure(buy ? position.open_buy : position.open_sell, replaced, order.size - filled);
+            if (!within(position.net, buy ? side : -side, limits.max_position)) {
+                return RiskReject::Position;
+            }
+        }
+
+        if constexpr (Checks::kNotional) {
+            int64_t open = std::max<int64_t>(buy ? account.open_buy_notional : account.open_sell_notional, 0);
+            int64_t incoming = filled == 0 ? notional : saturating_notional(price, order.size - filled);
+            int64_t replaced_notional = replaces ? saturating_notional(replaces->price, replaced) : 0;
+            int64_t side = exposure(static_cast<uint64_t>(open), static_cast<uint64_t>(replaced_notional),
+                                    static_cast<uint64_t>(incoming));
+            if (!within(account.net_notional, buy ? side : -side, limits.max_notional)) {
+                return RiskReject::Notional;
+            }
+        }
+
+        return RiskReject::None;
+    }
+};
+
+} // namespace trading
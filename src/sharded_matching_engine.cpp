@@ -0,0 +1,220 @@
+#include "sharded_matching_engine.hpp"
+
+namespace trading {
+
+ShardedMatchingEngine::ShardedMatchingEngine(size_t shard_count, size_t orders_per_book,
+                                             size_t queue_capacity, bool pin_threads) {
+    ShardRuntimeConfig runtime;
+    unsigned cores = std::thread::hardware_concurrency();
+    if (pin_threads && cores > 0) {
+        for (size_t i = 0; i < shard_count; ++i) {
+            runtime.workers.push_back({static_cast<int>(i % cores)});
+        }
+    }
+    create_shards(shard_count, runtime, orders_per_book, queue_capacity);
+}
+
+ShardedMatchingEngine::ShardedMatchingEngine(size_t shard_count, const ShardRuntimeConfig& runtime,
+                                             size_t orders_per_book, size_t queue_capacity) {
+    create_shards(shard_count, runtime, orders_per_book, queue_capacity);
+}
+
+void ShardedMatchingEngine::create_shards(size_t shard_count, const ShardRuntimeConfig& runtime,
+                                          size_t orders_per_book, size_t queue_capacity) {
+    shard_count = shard_count > 0 ? shard_count : 1;
+    numa_local_ = runtime.numa_local;
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        WorkerConfig worker = i < runtime.workers.size() ? runtime.workers[i] : WorkerConfig{};
+        std::unique_ptr<MatchingEngine> shard;
+        run_on_cpu(numa_local_ ? worker.cpu : -1, [&]() {
+            shard = std::make_unique<MatchingEngine>(orders_per_book, DuplicateIdPolicy::Allow, queue_capacity);
+        });
+        shard->set_worker_config(worker);
+        shards_.push_back(std::move(shard));
+    }
+}
+
+ShardedMatchingEngine::~ShardedMatchingEngine() {
+    stop();
+}
+
+SymbolId ShardedMatchingEngine::add_order_book(const std::string& symbol, const MatchingConfig& matching) {
+    // Check if order book already exists
+    auto it = symbol_ids_.find(symbol);
+    if (it != symbol_ids_.end()) {
+        return it->second;
+    }
+
+    // Books can't be added under a running shard
+    if (running()) {
+        return kInvalidSymbolId;
+    }
+
+    // Intern globally, then create the book inside its shard under the same ID
+    SymbolId id = static_cast<SymbolId>(symbols_.size());
+    symbols_.push_back(symbol);
+    symbol_ids_.emplace(symbol, id);
+    size_t shard = shard_of(id);
+    bool added = false;
+    run_on_cpu(home_cpu(shard), [&]() { added = shards_[shard]->add_order_book_locked(symbol, id, matching); });
+    if (!added) {
+        // The shard's journal could not record it
+        symbols_.pop_back();
+        symbol_ids_.erase(symbol);
+        return kInvalidSymbolId;
+    }
+    return id;
+}
+
+SymbolId ShardedMatchingEngine::find_symbol(const std::string& symbol) const {
+    auto it = symbol_ids_.find(symbol);
+    return it == symbol_ids_.end() ? kInvalidSymbolId : it->second;
+}
+
+void ShardedMatchingEngine::register_trade_callback(TradeCallback callback) {
+    for (auto& shard : shards_) {
+        shard->register_trade_callback(callback);
+    }
+}
+
+void ShardedMatchingEngine::set_clock(std::shared_ptr<Clock> clock) {
+    for (auto& shard : shards_) {
+        shard->set_clock(clock);
+    }
+}
+
+void ShardedMatchingEngine::set_self_trade_prevention(SelfTradePrevention mode) {
+    for (auto& shard : shards_) {
+        shard->set_self_trade_prevention(mode);
+    }
+}
+
+void ShardedMatchingEngine::start() {
+    if (running_.exchange(true, std::memory_order_acq_rel)) {
+        return; // Already running
+    }
+
+    // Each shard thread pins itself before it polls
+    for (auto& shard : shards_) {
+        shard->start();
+    }
+}
+
+void ShardedMatchingEngine::stop() {
+    if (!running_.exchange(false, std::memory_order_acq_rel)) {
+        return; // Not running
+    }
+
+    for (auto& shard : shards_) {
+        shard->stop();
+    }
+}
+
+bool ShardedMatchingEngine::submit(const Command& command) {
+    if (command.symbol >= symbols_.size()) {
+        return false; // No such symbol
+    }
+    return shards_[shard_of(command.symbol)]->submit(command);
+}
+
+bool ShardedMatchingEngine::submit_limit_order(
+    SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, double price, TimeInForce tif) {
+    // Convert the price to ticks on the caller's thread
+    return submit(Command::limit(symbol, order_id, side, size, OrderBook::to_price(price), tif));
+}
+
+bool ShardedMatchingEngine::submit_market_order(
+    SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, TimeInForce tif) {
+    return submit(Command::market(symbol, order_id, side, size, tif));
+}
+
+bool ShardedMatchingEngine::submit_cancel(SymbolId symbol, OrderId order_id) {
+    return submit(Command::cancel(symbol, order_id));
+}
+
+bool ShardedMatchingEngine::submit_modify(SymbolId symbol, OrderId order_id, uint64_t size, double price) {
+    return submit(Command::modify(symbol, order_id, size, OrderBook::to_price(price)));
+}
+
+void ShardedMatchingEngine::drain() {
+    for (auto& shard : shards_) {
+        shard->drain();
+    }
+}
+
+MatchingEngine::QueueStats ShardedMatchingEngine::queue_stats(size_t shard) const {
+    return shards_[shard]->queue_stats();
+}
+
+EngineLatencyStats ShardedMatchingEngine::latency_stats() const {
+    EngineLatencyStats merged;
+    for (const auto& shard : shards_) {
+        merged.merge(shard->latency_stats());
+    }
+    return merged;
+}
+
+void ShardedMatchingEngine::reset_latency_stats() {
+    for (auto& shard : shards_) {
+        shard->reset_latency_stats();
+    }
+}
+
+bool ShardedMatchingEngine::open_journal(const JournalOptions& options) {
+    bool ok = true;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        JournalOptions shard_options = options;
+        shard_options.path = options.path + "." + std::to_string(i);
+        ok = shards_[i]->open_journal(shard_options) && ok;
+    }
+    return ok;
+}
+
+void ShardedMatchingEngine::close_journal() {
+    for (auto& shard : shards_) {
+        shard->close_journal();
+    }
+}
+
+uint64_t ShardedMatchingEngine::replay_journal(const std::string& path) {
+    if (running()) {
+        return 0;
+    }
+
+    uint64_t records = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        run_on_cpu(home_cpu(i), [&]() { records += shards_[i]->replay_journal(path + "." + std::to_string(i)); });
+    }
+
+    // Re-intern the symbols the shards picked up under their original IDs
+    for (const auto& shard : shards_) {
+        for (const auto& [symbol, id] : shard->symbol_ids_) {
+            if (id >= symbols_.size()) {
+                symbols_.resize(static_cast<size_t>(id) + 1);
+            }
+            symbols_[id] = symbol;
+            symbol_ids_.emplace(symbol, id);
+        }
+    }
+    return records;
+}
+
+std::shared_ptr<OrderBook> ShardedMatchingEngine::get_order_book(SymbolId symbol) const {
+    if (symbol >= symbols_.size()) {
+        return nullptr;
+    }
+    return shards_[shard_of(symbol)]->order_books_[symbol];
+}
+
+std::shared_ptr<const BookSnapshotBuffer> ShardedMatchingEngine::book_snapshots(SymbolId symbol, size_t levels) {
+    if (running() || symbol >= symbols_.size()) {
+        return nullptr;
+    }
+    size_t shard = shard_of(symbol);
+    std::shared_ptr<const BookSnapshotBuffer> snapshots;
+    run_on_cpu(home_cpu(shard), [&]() { snapshots = shards_[shard]->book_snapshots(symbol, levels); });
+    return snapshots;
+}
+
+} // namespace trading
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "command.hpp"
+#include "matching_engine.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace trading {
+
+// Thread placement of a sharded engine
+struct ShardRuntimeConfig {
+    // Shard i runs with workers[i]; shards past the end use the defaults
+    std::vector<WorkerConfig> workers;
+
+    // Build each pinned shard's engine, queue and books on a thread pinned
+    // to its core, so the kernel's first-touch policy places them on that
+    // core's NUMA node. Memory the shard allocates later is touched first by
+    // its own pinned thread and lands there anyway
+    bool numa_local = false;
+};
+
+// Matching engine that partitions symbols across N shards, each with its own
+// matching thread. A shard is a MatchingEngine that owns its order books,
+// pool and order index outright and runs its inbound command loop, so shards
+// never contend with each other; callers hand commands to a shard through
+// its lock-free inbound queue and return immediately.
+//
+// Symbols are assigned to shards round-robin by SymbolId. Order books and
+// trade callbacks must be set up before start(); callbacks then run on the
+// shard threads. Cancels are routed by symbol, and duplicate order IDs are
+// only detected within a shard.
+class ShardedMatchingEngine {
+public:
+    static constexpr size_t kDefaultQueueCapacity = MatchingEngine::kDefaultQueueCapacity;
+
+    // Create shard_count shards (at least one). With pin_threads set, shard i
+    // runs on core i modulo the number of cores where the platform allows.
+    explicit ShardedMatchingEngine(size_t shard_count,
+                                   size_t orders_per_book = OrderPool::kDefaultCapacity,
+                                   size_t queue_capacity = kDefaultQueueCapacity,
+                                   bool pin_threads = false);
+
+    // Create shard_count shards placed as runtime describes
+    ShardedMatchingEngine(size_t shard_count, const ShardRuntimeConfig& runtime,
+                          size_t orders_per_book = OrderPool::kDefaultCapacity,
+                          size_t queue_capacity = kDefaultQueueCapacity);
+    ~ShardedMatchingEngine();
+
+    ShardedMatchingEngine(const ShardedMatchingEngine&) = delete;
+    ShardedMatchingEngine& operator=(const ShardedMatchingEngine&) = delete;
+
+    // Add a new order book matching with the given algorithm and return its
+    // interned ID (the existing ID if the book is already there;
+    // kInvalidSymbolId once the shards are running)
+    SymbolId add_order_book(const std::string& symbol, const MatchingConfig& matching = {});
+
+    // Look up the interned ID of a symbol (kInvalidSymbolId if unknown)
+    SymbolId find_symbol(const std::string& symbol) const;
+
+    // Register a callback on every shard; must be called before start()
+    void register_trade_callback(TradeCallback callback);
+
+    // Use clock to timestamp events on every shard; must be called before
+    // start(). The shards read it concurrently, so it must not be a BatchClock
+    void set_clock(std::shared_ptr<Clock> clock);
+
+    // Apply a self-trade prevention mode on every shard; must be called before start()
+    void set_self_trade_prevention(SelfTradePrevention mode);
+
+    size_t shard_count() const { return shards_.size(); }
+    size_t shard_of(SymbolId symbol) const { return symbol % shards_.size(); }
+
+    // Start one matching thread per shard
+    void start();
+
+    // Process everything already queued, then stop and join the threads
+    void stop();
+
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+    // Queue a command for the symbol's shard. Returns false without blocking
+    // if the symbol is unknown or the shard's queue is full.
+    bool submit(const Command& command);
+
+    bool submit_limit_order(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size, double price,
+                            TimeInForce tif = TimeInForce::GoodTillCancel);
+    bool submit_market_order(SymbolId symbol, OrderId order_id, OrderSide side, uint64_t size,
+                             TimeInForce tif = TimeInForce::ImmediateOrCancel);
+    bool submit_cancel(SymbolId symbol, OrderId order_id);
+    bool submit_modify(SymbolId symbol, OrderId order_id, uint64_t size, double price);
+
+    // Wait until every command accepted so far has been processed
+    void drain();
+
+    // Back-pressure counters of one shard's inbound queue
+    MatchingEngine::QueueStats queue_stats(size_t shard) const;
+
+    // Core, idle strategy and utilization of one shard's thread
+    const WorkerConfig& worker_config(size_t shard) const { return shards_[shard]->worker_config(); }
+    WorkerStats worker_stats(size_t shard) const { return shards_[shard]->worker_stats(); }
+
+    // Memory footprint of one book, from the shard that owns it
+    BookMemoryStats memory_stats(SymbolId symbol) const { return shards_[shard_of(symbol)]->memory_stats(symbol); }
+
+    // Latency histograms of every shard merged together, and a reset for
+    // them; reset while the shards are idle
+    EngineLatencyStats latency_stats() const;
+    void reset_latency_stats();
+
+    // Journal each shard to options.path with the shard number appended
+    // (".0", ".1", ...); returns false unless every shard's journal opened
+    bool open_journal(const JournalOptions& options);
+    void close_journal();
+
+    // Rebuild every shard from the journals written under path, before
+    // start(), and return the number of records applied
+    uint64_t replay_journal(const std::string& path);
+
+    // Get a specific order book; only inspect it while the shards are idle
+    // (after drain() or stop())
+    std::shared_ptr<OrderBook> get_order_book(SymbolId symbol) const;
+
+    // Snapshots of a book for readers on any thread, published by its shard
+    // (see MatchingEngine::book_snapshots). Books are set up before start(),
+    // so this returns nullptr once the shards are running
+    std::shared_ptr<const BookSnapshotBuffer> book_snapshots(
+        SymbolId symbol, size_t levels = BookSnapshotBuffer::kDefaultLevels);
+
+private:
+    std::vector<std::unique_ptr<MatchingEngine>> shards_;
+    std::vector<std::string> symbols_;                      // Indexed by SymbolId
+    std::unordered_map<std::string, SymbolId> symbol_ids_;  // Interned symbols
+    std::atomic<bool> running_{false};
+    bool numa_local_ = false;
+
+    void create_shards(size_t shard_count, const ShardRuntimeConfig& runtime, size_t orders_per_book,
+                       size_t queue_capacity);
+
+    // Core to allocate a shard's memory from (-1: the calling thread)
+    int home_cpu(size_t shard) const { return numa_local_ ? shards_[shard]->worker_config().cpu : -1; }
+};
+
+} // namespace trading
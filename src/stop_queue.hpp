@@ -0,0 +1,91 @@
+#pragma once
+
+#include "order.hpp"
+#include "price.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace trading {
+
+// A stop order waiting for its trigger. While it waits, the order's own
+// price holds the trigger, so a cancel can find its entry by price
+struct StopEntry {
+    Price trigger;
+    Price limit;    // Price the order takes once triggered (unused by stop-market orders)
+    Order* order;
+};
+
+// Pending stop orders of one side, ordered by when they trigger. Buy stops
+// trigger when a trade prints at or above their trigger price, sell stops at
+// or below it; among equal triggers the oldest goes first.
+//
+// The next entry to trigger is kept at the back of a sorted vector, so
+// checking a trade price is O(1) and releasing k stops is O(k). Entering or
+// cancelling a stop shifts the entries that trigger after it, which is cheap
+// next to how rarely stops arrive compared with trades.
+template <OrderSide Side>
+class StopQueue {
+public:
+    bool empty() const { return entries_.empty(); }
+    size_t size() const { return entries_.size(); }
+    size_t memory_bytes() const { return entries_.capacity() * sizeof(StopEntry); }
+
+    // Whether a trade at `price` triggers a stop at `trigger`
+    static bool triggers(Price trigger, Price price) {
+        return Side == OrderSide::Buy ? price >= trigger : price <= trigger;
+    }
+
+    void insert(const StopEntry& entry) {
+        // Before every entry that triggers no later, so older ones go first
+        auto it = std::lower_bound(entries_.begin(), entries_.end(), entry.trigger,
+                                   [](const StopEntry& e, Price trigger) { return fires_before(trigger, e.trigger); });
+        entries_.insert(it, entry);
+    }
+
+    // Remove a pending order, copying its entry to erased if given; returns
+    // false if it is not in the queue
+    bool erase(const Order* order, Price trigger, StopEntry* erased = nullptr) {
+        auto [first, last] = std::equal_range(entries_.begin(), entries_.end(), StopEntry{trigger, Price{}, nullptr},
+                                              [](const StopEntry& a, const StopEntry& b) {
+                                                  return fires_before(b.trigger, a.trigger);
+                                              });
+        auto it = std::find_if(first, last, [order](const StopEntry& e) { return e.order == order; });
+        if (it == last) {
+            return false;
+        }
+        if (erased) {
+            *erased = *it;
+        }
+        entries_.erase(it);
+        return true;
+    }
+
+    // Move every entry a trade at `price` triggers to out, in trigger order
+    void take_triggered(Price price, std::vector<StopEntry>& out) {
+        while (!entries_.empty() && triggers(entries_.back().trigger, price)) {
+            out.push_back(entries_.back());
+            entries_.pop_back();
+        }
+    }
+
+    // Visit every pending entry, next to trigger last
+    template <typename Visit>
+    void for_each(Visit&& visit) const {
+        for (const StopEntry& entry : entries_) {
+            visit(entry);
+        }
+    }
+
+    void clear() { entries_.clear(); }
+
+private:
+    // Buy stops trigger from the lowest price up, sell stops from the highest down
+    static bool fires_before(Price a, Price b) {
+        return Side == OrderSide::Buy ? a < b : a > b;
+    }
+
+    std::vector<StopEntry> entries_;    // Sorted so that the back triggers first
+};
+
+} // namespace trading
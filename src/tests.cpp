@@ -1,5 +1,6 @@
 #include "order_book.hpp"
 #include "matching_engine.hpp"
+#include "order_id_map.hpp"
 #include <iostream>
 #include <cassert>
 #include <string>
@@ -48,6 +49,11 @@ void assert_with_message(bool condition, const std::string& message) {
     }
 }
 
+// Helper to convert a decimal price to the default book's ticks
+Price px(double price) {
+    return OrderBook::to_price(price);
+}
+
 int main() {
     TestSuite tests;
     
@@ -64,13 +70,13 @@ int main() {
         OrderBook book("TEST");
         
         // Add a buy order
-        auto buy_order = std::make_shared<Order>("BUY1", OrderSide::Buy, "TEST", 100, 10.0, 1);
+        auto buy_order = book.create_limit_order(101, OrderSide::Buy, 100, px(10.0), 1);
         book.add_order(buy_order);
         
         assert_with_message(book.best_bid() == 10.0, "Buy order not reflected in best bid");
         
         // Add a sell order
-        auto sell_order = std::make_shared<Order>("SELL1", OrderSide::Sell, "TEST", 100, 11.0, 2);
+        auto sell_order = book.create_limit_order(201, OrderSide::Sell, 100, px(11.0), 2);
         book.add_order(sell_order);
         
         assert_with_message(book.best_ask() == 11.0, "Sell order not reflected in best ask");
@@ -81,16 +87,16 @@ int main() {
         OrderBook book("TEST");
         
         // Add a sell order
-        auto sell_order = std::make_shared<Order>("SELL1", OrderSide::Sell, "TEST", 100, 10.0, 1);
+        auto sell_order = book.create_limit_order(201, OrderSide::Sell, 100, px(10.0), 1);
         book.add_order(sell_order);
         
         // Add a matching buy order
-        auto buy_order = std::make_shared<Order>("BUY1", OrderSide::Buy, "TEST", 100, 10.0, 2);
-        auto trades = book.match_order(buy_order);
+        auto buy_order = book.create_limit_order(101, OrderSide::Buy, 100, px(10.0), 2);
+        auto trades = book.match_order(*buy_order);
         
         assert_with_message(trades.size() == 1, "Expected 1 trade");
         assert_with_message(trades[0].size == 100, "Expected trade size 100");
-        assert_with_message(trades[0].price == 10.0, "Expected trade price 10.0");
+        assert_with_message(trades[0].price == px(10.0), "Expected trade price 10.0");
     });
     
     // Test order cancellation
@@ -98,15 +104,15 @@ int main() {
         OrderBook book("TEST");
         
         // Add an order
-        auto order = std::make_shared<Order>("ORDER1", OrderSide::Buy, "TEST", 100, 10.0, 1);
+        auto order = book.create_limit_order(1, OrderSide::Buy, 100, px(10.0), 1);
         book.add_order(order);
         
         // Cancel it
-        bool result = book.cancel_order("ORDER1");
+        bool result = book.cancel_order(1);
         assert_with_message(result, "Order cancellation failed");
         
         // Try to cancel non-existent order
-        result = book.cancel_order("NONEXISTENT");
+        result = book.cancel_order(999);
         assert_with_message(!result, "Cancelling non-existent order should fail");
     });
     
@@ -118,8 +124,8 @@ int main() {
         engine.add_order_book("TEST");
         
         // Place some orders
-        engine.place_limit_order("TEST", "SELL1", OrderSide::Sell, 100, 10.0);
-        auto trades = engine.place_limit_order("TEST", "BUY1", OrderSide::Buy, 100, 10.0);
+        engine.place_limit_order("TEST", 201, OrderSide::Sell, 100, 10.0);
+        auto trades = engine.place_limit_order("TEST", 101, OrderSide::Buy, 100, 10.0);
         
         assert_with_message(trades.size() == 1, "Expected 1 trade");
         assert_with_message(trades[0].size == 100, "Expected trade size 100");
@@ -130,9 +136,9 @@ int main() {
         OrderBook book("TEST");
         
         // Add sell orders
-        auto sell1 = std::make_shared<Order>("SELL1", OrderSide::Sell, "TEST", 100, 10.0, 1);
-        auto sell2 = std::make_shared<Order>("SELL2", OrderSide::Sell, "TEST", 100, 10.0, 2);
-        auto sell3 = std::make_shared<Order>("SELL3", OrderSide::Sell, "TEST", 100, 9.0, 3);
+        auto sell1 = book.create_limit_order(201, OrderSide::Sell, 100, px(10.0), 1);
+        auto sell2 = book.create_limit_order(202, OrderSide::Sell, 100, px(10.0), 2);
+        auto sell3 = book.create_limit_order(203, OrderSide::Sell, 100, px(9.0), 3);
         
         book.add_order(sell1);
         book.add_order(sell2);
@@ -142,15 +148,110 @@ int main() {
         assert_with_message(book.best_ask() == 9.0, "Expected best ask 9.0");
         
         // Match with a buy order
-        auto buy = std::make_shared<Order>("BUY1", OrderSide::Buy, "TEST", 200, 10.0, 4);
-        auto trades = book.match_order(buy);
+        auto buy = book.create_limit_order(101, OrderSide::Buy, 200, px(10.0), 4);
+        auto trades = book.match_order(*buy);
         
         // Should match with sell3 first (price priority), then sell1 (time priority over sell2)
         assert_with_message(trades.size() == 2, "Expected 2 trades");
-        assert_with_message(trades[0].order_id_sell == "SELL3", "Expected to match with SELL3 first");
-        assert_with_message(trades[1].order_id_sell == "SELL1", "Expected to match with SELL1 second");
+        assert_with_message(trades[0].order_id_sell == 203, "Expected to match with SELL3 first");
+        assert_with_message(trades[1].order_id_sell == 201, "Expected to match with SELL1 second");
     });
     
+    // Test tick size policy conversion at the API edge
+    tests.add_test("Tick Size Policy", []() {
+        BasicOrderBook<BasisPointTick> book("TEST");
+
+        auto buy = book.create_limit_order(101, OrderSide::Buy, 100,
+                                           BasicOrderBook<BasisPointTick>::to_price(10.0001), 1);
+        book.add_order(buy);
+
+        assert_with_message(buy->price == Price(100001), "Expected 100001 ticks");
+        assert_with_message(book.best_bid_price() == Price(100001), "Expected best bid in ticks");
+        assert_with_message(book.best_bid() == 10.0001, "Expected best bid 10.0001");
+        assert_with_message(book.volume_at_price(OrderSide::Buy, 10.0001) == 100, "Expected volume 100");
+        assert_with_message(px(10.004) == px(10.0), "Expected rounding to the nearest cent");
+    });
+
+    // Test symbol interning and numeric order IDs
+    tests.add_test("Symbol Interning", []() {
+        MatchingEngine engine;
+
+        SymbolId aapl = engine.add_order_book("AAPL");
+        SymbolId msft = engine.add_order_book("MSFT");
+        assert_with_message(aapl == 0 && msft == 1, "Expected dense symbol IDs");
+        assert_with_message(engine.add_order_book("AAPL") == aapl, "Expected existing ID for a known symbol");
+        assert_with_message(engine.find_symbol("MSFT") == msft, "Expected lookup by name");
+        assert_with_message(engine.find_symbol("NONE") == kInvalidSymbolId, "Expected unknown symbol");
+
+        engine.place_limit_order(msft, 1, OrderSide::Sell, 100, 10.0);
+        auto trades = engine.place_limit_order("MSFT", 2, OrderSide::Buy, 100, 10.0);
+        assert_with_message(trades.size() == 1, "Expected 1 trade");
+        assert_with_message(trades[0].symbol == msft, "Expected trade stamped with MSFT");
+        assert_with_message(trades[0].order_id_sell == 1 && trades[0].order_id_buy == 2, "Expected numeric IDs");
+        assert_with_message(engine.place_limit_order(kInvalidSymbolId, 3, OrderSide::Buy, 100, 10.0).empty(),
+                            "Expected unknown symbol to be ignored");
+    });
+
+    // Test the gateway-side client order ID table
+    tests.add_test("Client Order ID Map", []() {
+        ClientOrderIdMap ids;
+
+        OrderId first = ids.assign("CLIENT-A");
+        OrderId second = ids.assign("CLIENT-B");
+        assert_with_message(first != second, "Expected distinct engine IDs");
+        assert_with_message(*ids.client_id(second) == "CLIENT-B", "Expected reverse lookup");
+        assert_with_message(ids.find("CLIENT-A") == first, "Expected forward lookup");
+
+        ids.erase(first);
+        assert_with_message(!ids.find("CLIENT-A") && !ids.client_id(first), "Expected erased mapping");
+        assert_with_message(ids.size() == 1, "Expected one live mapping");
+    });
+
+    // Test level aggregates, top of book and L2 depth
+    tests.add_test("Level Aggregates and Depth", []() {
+        OrderBook book("TEST");
+
+        auto buy1 = book.create_limit_order(101, OrderSide::Buy, 100, px(10.0), 1);
+        auto buy2 = book.create_limit_order(102, OrderSide::Buy, 200, px(10.0), 2);
+        auto buy3 = book.create_limit_order(103, OrderSide::Buy, 300, px(9.5), 3);
+        auto sell1 = book.create_limit_order(201, OrderSide::Sell, 150, px(10.5), 4);
+        book.add_order(buy1);
+        book.add_order(buy2);
+        book.add_order(buy3);
+        book.add_order(sell1);
+
+        TopOfBook top = book.top_of_book();
+        assert_with_message(top.bid.price == px(10.0) && top.bid.quantity == 300 && top.bid.order_count == 2,
+                            "Expected best bid 300 @ 10.0 in 2 orders");
+        assert_with_message(top.ask.price == px(10.5) && top.ask.quantity == 150, "Expected best ask 150 @ 10.5");
+
+        // A partial fill reduces the level total but not its order count
+        auto sell2 = book.create_limit_order(202, OrderSide::Sell, 150, px(10.0), 5);
+        book.match_order(*sell2);
+        book.release_order(sell2);
+        assert_with_message(book.volume_at_price(OrderSide::Buy, 10.0) == 150, "Expected 150 left at 10.0");
+        assert_with_message(book.orders_at_price(OrderSide::Buy, px(10.0)) == 1, "Expected 1 order left at 10.0");
+
+        book.cancel_order(103);
+        auto buy4 = book.create_limit_order(104, OrderSide::Buy, 50, px(9.0), 6);
+        book.add_order(buy4);
+
+        BookDepth depth = book.depth(5);
+        assert_with_message(depth.bids.size() == 2 && depth.asks.size() == 1, "Expected 2 bid and 1 ask levels");
+        assert_with_message(depth.bids[0].price == px(10.0) && depth.bids[0].quantity == 150, "Expected 150 @ 10.0");
+        assert_with_message(depth.bids[1].price == px(9.0) && depth.bids[1].quantity == 50, "Expected 50 @ 9.0");
+
+        book.depth(1, depth);
+        assert_with_message(depth.bids.size() == 1 && depth.asks.size() == 1, "Expected depth capped at 1 level");
+
+        auto sweep = book.create_market_order(203, OrderSide::Sell, 1000, 7);
+        book.match_order(*sweep);
+        book.release_order(sweep);
+        top = book.top_of_book();
+        assert_with_message(top.bid.price == Price::min() && top.bid.quantity == 0, "Expected empty bid side");
+        assert_with_message(book.level_count(OrderSide::Buy) == 0, "Expected no bid levels");
+    });
+
     // Run all tests
     tests.run_all();
     
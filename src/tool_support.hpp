@@ -0,0 +1,70 @@
+#pragma once
+
+#include "latency_histogram.hpp"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+// Pieces shared by the command-line tools (benchmarks, load test, replay),
+// so that a mix of the same name is the same flow in every one of them
+namespace trading::tools {
+
+// Share of each operation in an order flow, in percent; the remainder are
+// aggressive orders taking liquidity from the top of the book. Flows that
+// amend orders spend the replace share of the adds on amends; the others
+// add for it
+struct FlowMix {
+    const char* name;
+    unsigned add;
+    unsigned cancel;
+    unsigned replace;   // Part of add
+};
+
+inline constexpr FlowMix kMixes[] = {
+    {"add-heavy", 70, 25, 5},
+    {"balanced", 50, 40, 10},
+    {"cancel-heavy", 45, 50, 10},
+    {"aggressive", 45, 25, 5},
+};
+
+// The mix called name, or nullptr
+inline const FlowMix* find_mix(const char* name) {
+    for (const FlowMix& mix : kMixes) {
+        if (std::strcmp(mix.name, name) == 0) {
+            return &mix;
+        }
+    }
+    return nullptr;
+}
+
+// Write a summary as one "name":{...} member of a JSON object
+inline void write_summary(std::ostream& out, const char* name, const LatencySummary& summary, bool last) {
+    out << "\"" << name << "\":{"
+        << "\"count\":" << summary.count
+        << ",\"min_ns\":" << summary.min_ns
+        << ",\"mean_ns\":" << summary.mean_ns
+        << ",\"p50_ns\":" << summary.p50_ns
+        << ",\"p99_ns\":" << summary.p99_ns
+        << ",\"p999_ns\":" << summary.p999_ns
+        << ",\"max_ns\":" << summary.max_ns
+        << "}" << (last ? "" : ",");
+}
+
+// Parse a comma-separated list of sizes, e.g. "1,2,4"
+inline std::vector<size_t> parse_sizes(const char* list) {
+    std::vector<size_t> sizes;
+    for (const char* p = list; *p;) {
+        char* end = nullptr;
+        unsigned long long value = std::strtoull(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        sizes.push_back(static_cast<size_t>(value));
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return sizes;
+}
+
+} // namespace trading::tools
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TRADING_HAS_RDTSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define TRADING_HAS_RDTSC 0
+#endif
+
+namespace trading {
+
+// Read the CPU timestamp counter: a few cycles, no system call. On targets
+// without one this falls back to steady_clock nanoseconds.
+inline uint64_t read_tsc() {
+#if TRADING_HAS_RDTSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Nanoseconds per timestamp counter tick, measured once against
+// steady_clock the first time it is needed (about 10 ms)
+inline double tsc_ns_per_tick() {
+#if TRADING_HAS_RDTSC
+    static const double ns_per_tick = []() {
+        auto wall_start = std::chrono::steady_clock::now();
+        uint64_t tsc_start = read_tsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        uint64_t tsc_end = read_tsc();
+        auto wall_end = std::chrono::steady_clock::now();
+
+        double ns = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(wall_end - wall_start).count());
+        uint64_t ticks = tsc_end - tsc_start;
+        return ticks > 0 ? ns / static_cast<double>(ticks) : 1.0;
+    }();
+    return ns_per_tick;
+#else
+    return 1.0;
+#endif
+}
+
+} // namespace trading
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "command.hpp"
+#include "order.hpp"
+#include "price.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace trading::wire {
+
+// Fixed-layout binary protocol of the gateway, in the style of SBE and
+// OUCH. Every message is a 4-byte header followed by a fixed body; all
+// integers are little-endian and prices are in ticks. Fields are read in
+// place from the receive buffer through the *View types below, so decoding
+// a message is a handful of loads and building its Command never touches a
+// string or the heap.
+//
+//   Header          length u16 (whole message, header included), type u8, version u8
+//
+// Client to gateway:
+//   NewOrder   48   symbol u32 @4, client_order_id u64 @8, price i64 @16, size u64 @24,
+//                   account u32 @32, side u8 @36, order_type u8 @37, tif u8 @38, trigger i64 @40
+//   Cancel     16   symbol u32 @4, client_order_id u64 @8
+//   Modify     32   symbol u32 @4, client_order_id u64 @8, price i64 @16, size u64 @24
+//
+// Gateway to client, on the order entry connection:
+//   Ack        32   request u8 @4 (type answered), status u8 @5 (OrderStatus),
+//                   client_order_id u64 @8, filled_size u64 @16, timestamp u64 @24
+//   Fill       40   symbol u32 @4, client_order_id u64 @8, price i64 @16, size u64 @24, timestamp u64 @32
+//
+// Market data, packed into datagrams behind a PacketHeader:
+//   PacketHeader 16 sequence u64 @0 (of the first message), count u16 @8
+//   TradePrint 32   symbol u32 @4, price i64 @8, size u64 @16, timestamp u64 @24
+//   Quote      40   symbol u32 @4, bid_price i64 @8, bid_size u64 @16, ask_price i64 @24, ask_size u64 @32
+//
+// Messages of an unknown type are skipped by their length.
+
+inline constexpr uint8_t kVersion = 1;
+
+enum class MessageType : uint8_t {
+    NewOrder = 'O',
+    Cancel = 'X',
+    Modify = 'U',
+    Ack = 'A',
+    Fill = 'F',
+    TradePrint = 'T',
+    Quote = 'Q'
+};
+
+// Order types on the wire
+enum class WireOrderType : uint8_t {
+    Limit,
+    Market,
+    PostOnly,
+    PostOnlySlide,
+    Stop,       // Stop-market: trigger only
+    StopLimit   // trigger and price
+};
+
+inline constexpr size_t kHeaderSize = 4;
+inline constexpr size_t kNewOrderSize = 48;
+inline constexpr size_t kCancelSize = 16;
+inline constexpr size_t kModifySize = 32;
+inline constexpr size_t kAckSize = 32;
+inline constexpr size_t kFillSize = 40;
+inline constexpr size_t kPacketHeaderSize = 16;
+inline constexpr size_t kTradePrintSize = 32;
+inline constexpr size_t kQuoteSize = 40;
+
+// Wire byte order to host byte order and back
+template <typename T>
+T little_endian(T value) {
+    static_assert(std::is_integral_v<T>);
+    if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1) {
+        using U = std::make_unsigned_t<T>;
+        auto bits = static_cast<U>(value);
+        U swapped = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            swapped = static_cast<U>((swapped << 8) | ((bits >> (8 * i)) & 0xff));
+        }
+        value = static_cast<T>(swapped);
+    }
+    return value;
+}
+
+// Unaligned loads and stores; on little-endian targets each compiles to a
+// single move
+template <typename T>
+T load(const std::byte* at) {
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    return little_endian(value);
+}
+
+template <typename T>
+void store(std::byte* at, T value) {
+    value = little_endian(value);
+    std::memcpy(at, &value, sizeof(T));
+}
+
+// Views over a complete message in a buffer; they hold a pointer only
+class MessageView {
+public:
+    explicit MessageView(const std::byte* data) : data_(data) {}
+    uint16_t length() const { return load<uint16_t>(data_); }
+    MessageType type() const { return static_cast<MessageType>(load<uint8_t>(data_ + 2)); }
+    uint8_t version() const { return load<uint8_t>(data_ + 3); }
+    const std::byte* data() const { return data_; }
+
+protected:
+    const std::byte* data_;
+};
+
+class NewOrderView : public MessageView {
+public:
+    using MessageView::MessageView;
+    SymbolId symbol() const { return load<uint32_t>(data_ + 4); }
+    uint64_t client_order_id() const { return load<uint64_t>(data_ + 8); }
+    Price price() const { return Price(load<int64_t>(data_ + 16)); }
+    uint64_t size() const { return load<uint64_t>(data_ + 24); }
+    AccountId account() const { return load<uint32_t>(data_ + 32); }
+    OrderSide side() const { return load<uint8_t>(data_ + 36) == 0 ? OrderSide::Buy : OrderSide::Sell; }
+    WireOrderType order_type() const { return static_cast<WireOrderType>(load<uint8_t>(data_ + 37)); }
+    TimeInForce tif() const { return static_cast<TimeInForce>(load<uint8_t>(data_ + 38)); }
+    Price trigger() const { return Price(load<int64_t>(data_ + 40)); }
+
+    // The engine command for this order under the given engine order ID;
+    // false if the order type or time in force is not one the engine knows
+    bool to_command(OrderId order_id, Command& out) const {
+        if (load<uint8_t>(data_ + 38) > static_cast<uint8_t>(TimeInForce::FillOrKill)) {
+            return false;
+        }
+        TimeInForce time_in_force = tif();
+        switch (order_type()) {
+        case WireOrderType::Limit:
+            out = Command::limit(symbol(), order_id, side(), size(), price(), time_in_force, account());
+            return true;
+        case WireOrderType::Market:
+            out = Command::market(symbol(), order_id, side(), size(), time_in_force, account());
+            return true;
+        case WireOrderType::PostOnly:
+        case WireOrderType::PostOnlySlide:
+            out = Command::post_only(symbol(), order_id, side(), size(), price(),
+                                     order_type() == WireOrderType::PostOnlySlide, account());
+            return true;
+        case WireOrderType::Stop:
+            out = Command::stop(symbol(), order_id, side(), size(), trigger(), account());
+            return true;
+        case WireOrderType::StopLimit:
+            out = Command::stop_limit(symbol(), order_id, side(), size(), trigger(), price(), time_in_force,
+                                      account());
+            return true;
+        }
+        return false;
+    }
+};
+
+class CancelView : public MessageView {
+public:
+    using MessageView::MessageView;
+    SymbolId symbol() const { return load<uint32_t>(data_ + 4); }
+    uint64_t client_order_id() const { return load<uint64_t>(data_ + 8); }
+};
+
+class ModifyView : public MessageView {
+public:
+    using MessageView::MessageView;
+    SymbolId symbol() const { return load<uint32_t>(data_ + 4); }
+    uint64_t client_order_id() const { return load<uint64_t>(data_ + 8); }
+    Price price() const { return Price(load<int64_t>(data_ + 16)); }
+    uint64_t size() const { return load<uint64_t>(data_ + 24); }
+};
+
+class AckView : public MessageView {
+public:
+    using MessageView::MessageView;
+    MessageType request() const { return static_cast<MessageType>(load<uint8_t>(data_ + 4)); }
+    OrderStatus status() const { return static_cast<OrderStatus>(load<uint8_t>(data_ + 5)); }
+    uint64_t client_order_id() const { return load<uint64_t>(data_ + 8); }
+    uint64_t filled_size() const { return load<uint64_t>(data_ + 16); }
+    uint64_t timestamp() const { return load<uint64_t>(data_ + 24); }
+};
+
+class FillView : public MessageView {
+public:
+    using MessageView::MessageView;
+    SymbolId symbol() const { return load<uint32_t>(data_ + 4); }
+    uint64_t client_order_id() const { return load<uint64_t>(data_ + 8); }
+    Price price() const { return Price(load<int64_t>(data_ + 16)); }
+    uint64_t size() const { return load<uint64_t>(data_ + 24); }
+    uint64_t timestamp() const { return load<uint64_t>(data_ + 32); }
+};
+
+class TradePrintView : public MessageView {
+public:
+    using MessageView::MessageView;
+    SymbolId symbol() const { return load<uint32_t>(data_ + 4); }
+    Price price() const { return Price(load<int64_t>(data_ + 8)); }
+    uint64_t size() const { return load<uint64_t>(data_ + 16); }
+    uint64_t timestamp() const { return load<uint64_t>(data_ + 24); }
+};
+
+class QuoteView : public MessageView {
+public:
+    using MessageView::MessageView;
+    SymbolId symbol() const { return load<uint32_t>(data_ + 4); }
+    Price bid_price() const { return Price(load<int64_t>(data_ + 8)); }
+    uint64_t bid_size() const { return load<uint64_t>(data_ + 16); }
+    Price ask_price() const { return Price(load<int64_t>(data_ + 24)); }
+    uint64_t ask_size() const { return load<uint64_t>(data_ + 32); }
+};
+
+// Fixed size of a known message type (0 for an unknown one)
+inline size_t message_size(MessageType type) {
+    switch (type) {
+    case MessageType::NewOrder: return kNewOrderSize;
+    case MessageType::Cancel: return kCancelSize;
+    case MessageType::Modify: return kModifySize;
+    case MessageType::Ack: return kAckSize;
+    case MessageType::Fill: return kFillSize;
+    case MessageType::TradePrint: return kTradePrintSize;
+    case MessageType::Quote: return kQuoteSize;
+    }
+    return 0;
+}
+
+struct DecodeResult {
+    size_t consumed;    // Bytes of complete messages handed out (or skipped)
+    bool malformed;     // Stopped at a header whose length cannot be right
+};
+
+// Hand every complete message at the front of buffer to visit(MessageView)
+// in order. A partial message at the end is left for the next read; a
+// length shorter than the header, or not the fixed size of a known type,
+// stops decoding, since the stream can no longer be framed
+template <typename Visit>
+DecodeResult decode(std::span<const std::byte> buffer, Visit&& visit) {
+    size_t offset = 0;
+    while (buffer.size() - offset >= kHeaderSize) {
+        MessageView message(buffer.data() + offset);
+        size_t length = message.length();
+        size_t expected = message_size(message.type());
+        if (length < kHeaderSize || (expected != 0 && length != expected)) {
+            return {offset, true};
+        }
+        if (buffer.size() - offset < length) {
+            break;
+        }
+        if (expected != 0) {
+            visit(message);
+        }
+        offset += length;
+    }
+    return {offset, false};
+}
+
+// Appends messages to a byte buffer
+class Encoder {
+public:
+    explicit Encoder(std::vector<std::byte>& out) : out_(out) {}
+
+    void new_order(SymbolId symbol, uint64_t client_order_id, OrderSide side, WireOrderType type, uint64_t size,
+                   Price price, TimeInForce tif = TimeInForce::GoodTillCancel, AccountId account = 0,
+                   Price trigger = Price{}) {
+        std::byte* at = begin(MessageType::NewOrder, kNewOrderSize);
+        store<uint32_t>(at + 4, symbol);
+        store<uint64_t>(at + 8, client_order_id);
+        store<int64_t>(at + 16, price.ticks);
+        store<uint64_t>(at + 24, size);
+        store<uint32_t>(at + 32, account);
+        store<uint8_t>(at + 36, side == OrderSide::Buy ? 0 : 1);
+        store<uint8_t>(at + 37, static_cast<uint8_t>(type));
+        store<uint8_t>(at + 38, static_cast<uint8_t>(tif));
+        store<int64_t>(at + 40, trigger.ticks);
+    }
+
+    void cancel(SymbolId symbol, uint64_t client_order_id) {
+        std::byte* at = begin(MessageType::Cancel, kCancelSize);
+        store<uint32_t>(at + 4, symbol);
+        store<uint64_t>(at + 8, client_order_id);
+    }
+
+    void modify(SymbolId symbol, uint64_t client_order_id, uint64_t size, Price price) {
+        std::byte* at = begin(MessageType::Modify, kModifySize);
+        store<uint32_t>(at + 4, symbol);
+        store<uint64_t>(at + 8, client_order_id);
+        store<int64_t>(at + 16, price.ticks);
+        store<uint64_t>(at + 24, size);
+    }
+
+    void ack(MessageType request, OrderStatus status, uint64_t client_order_id, uint64_t filled_size,
+             uint64_t timestamp) {
+        std::byte* at = begin(MessageType::Ack, kAckSize);
+        store<uint8_t>(at + 4, static_cast<uint8_t>(request));
+        store<uint8_t>(at + 5, static_cast<uint8_t>(status));
+        store<uint64_t>(at + 8, client_order_id);
+        store<uint64_t>(at + 16, filled_size);
+        store<uint64_t>(at + 24, timestamp);
+    }
+
+    void fill(SymbolId symbol, uint64_t client_order_id, Price price, uint64_t size, uint64_t timestamp) {
+        std::byte* at = begin(MessageType::Fill, kFillSize);
+        store<uint32_t>(at + 4, symbol);
+        store<uint64_t>(at + 8, client_order_id);
+        store<int64_t>(at + 16, price.ticks);
+        store<uint64_t>(at + 24, size);
+        store<uint64_t>(at + 32, timestamp);
+    }
+
+    void trade_print(SymbolId symbol, Price price, uint64_t size, uint64_t timestamp) {
+        std::byte* at = begin(MessageType::TradePrint, kTradePrintSize);
+        store<uint32_t>(at + 4, symbol);
+        store<int64_t>(at + 8, price.ticks);
+        store<uint64_t>(at + 16, size);
+        store<uint64_t>(at + 24, timestamp);
+    }
+
+    void quote(SymbolId symbol, Price bid_price, uint64_t bid_size, Price ask_price, uint64_t ask_size) {
+        std::byte* at = begin(MessageType::Quote, kQuoteSize);
+        store<uint32_t>(at + 4, symbol);
+        store<int64_t>(at + 8, bid_price.ticks);
+        store<uint64_t>(at + 16, bid_size);
+        store<int64_t>(at + 24, ask_price.ticks);
+        store<uint64_t>(at + 32, ask_size);
+    }
+
+private:
+    std::vector<std::byte>& out_;
+
+    // Grow the buffer by one zeroed message and write its header
+    std::byte* begin(MessageType type, size_t size) {
+        size_t offset = out_.size();
+        out_.resize(offset + size);
+        std::byte* at = out_.data() + offset;
+        store<uint16_t>(at, static_cast<uint16_t>(size));
+        store<uint8_t>(at + 2, static_cast<uint8_t>(type));
+        store<uint8_t>(at + 3, kVersion);
+        return at;
+    }
+};
+
+} // namespace trading::wire